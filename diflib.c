@@ -13,7 +13,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "diflib.h"
+#include "diflib_internal.h"
 
 //
 //  Our work space is a fan out of entries.  Laid out starting from left to right like the following
@@ -35,7 +37,7 @@
 //  Delete indicates of the we are going to do a delete or an insert of get over this difference
 //  Index is the location within the OldString that we are either going to delete or insert right after
 //  Back is the index into V that this location is based on.  It will be either D-1,k-1 or D-1,k+1
-//  Token is used when we are doing an insert and is the value being inserted in the string
+//  Token is used when we are doing an insert and is the index of the value being inserted in the string
 //
 
 typedef struct _WORK_SPACE_ENTRY_ {
@@ -43,7 +45,7 @@ typedef struct _WORK_SPACE_ENTRY_ {
   int SavedX,SavedY; // the indices where X and Y last matched
   char IsDelete;     // 1 for delete and 0 for Insert
   int Index, Back;   // the index within the OldString (i.e., X) where we are either going to delete or insert a character
-  char *Token;        // for an insert this is the byte value to be inserted
+  int Token;         // for an insert this is the index within the NewString of the byte to be inserted
 } WORK_SPACE_ENTRY, *PWORK_SPACE_ENTRY;
 
 //
@@ -57,14 +59,14 @@ void DebugPrintArray(PWORK_SPACE_ENTRY V, char PrintHeading, int StartIndex, int
   int i;
   if (PrintHeading) { printf("  V   D   k SavedX SavedY Del Ind Back Token\n"); }
   for (i=StartIndex; i<=StopIndex; i++) {
-    printf("%3d %3d %3d    %3d    %3d %3d %3d %4d   %3d ", i,V[i].D,V[i].k,V[i].SavedX,V[i].SavedY,V[i].IsDelete,V[i].Index,V[i].Back,*V[i].Token);
-    if (V[i].IsDelete) { printf("%3dD\n",V[i].Index); } else { printf("%3dI%c\n", V[i].Index, *V[i].Token); }
+    printf("%3d %3d %3d    %3d    %3d %3d %3d %4d   %3d ", i,V[i].D,V[i].k,V[i].SavedX,V[i].SavedY,V[i].IsDelete,V[i].Index,V[i].Back,V[i].Token);
+    if (V[i].IsDelete) { printf("%3dD\n",V[i].Index); } else { printf("%3dI%d\n", V[i].Index, V[i].Token); }
   }
 }
 
 //
 //  The edit script is a list of edit script entries.  Each entry contains a count and an opcode
-//  indicating if it is an insert, delete, or copy operation.
+//  indicating if it is an insert, delete, copy, or replace operation.
 //
 //  Count is stored as 0..63 but will be interpreted as 1 to 64
 //
@@ -76,17 +78,19 @@ void DebugPrintArray(PWORK_SPACE_ENTRY V, char PrintHeading, int StartIndex, int
 //    For a delete, count indictes the number of bytes to skip over in the Old string that is to skipped over (i.e., not
 //        added to the new string
 //    For a keep, count is the number of bytes to keep from the old string
+//    For a replace, the entry is followed by Count bytes that go into the new string in place of
+//        the next Count bytes of the old string
 //
 
 typedef struct _EDIT_SCRIPT_ENTRY_ {
   unsigned char Count:6;     // number of bytes to operation upon range is 1..64 (so we add 1 to get the real count)
-  unsigned char Opcode:2; // Type of operation 0 = unused, 1 = Insert, 2 = Delete, 3 = Keep
+  unsigned char Opcode:2; // Type of operation 0 = Replace, 1 = Insert, 2 = Delete, 3 = Keep
 } EDIT_SCRIPT_ENTRY, *PEDIT_SCRIPT_ENTRY;
 
-#define NoopOpcode   (0)
-#define InsertOpcode (1)
-#define DeleteOpcode (2)
-#define KeepOpcode   (3)
+//
+//  The opcode values ReplaceOpcode, InsertOpcode, DeleteOpcode and KeepOpcode live in diflib.h
+//  so that consumers of the edit script cursor can use them
+//
 
 //
 //  Here are support routines to help build the edit script.
@@ -101,7 +105,7 @@ typedef struct _EDIT_SCRIPT_ENTRY_ {
 //  64 which means that the routine needs to break it down into multiple operations. For example,
 //  a delete of 67 will be a delete of 64 followed by a delete of 3.
 //
-//  The Insert opcode also takes a pointer to the string that is to be Inserted into the edit script.
+//  The Insert and Replace opcodes also take a pointer to the string that is to be Inserted into the edit script.
 //
 //  Each routine returns the next free index in the edit script, or -1 if the edit script buffer
 //  overflows. or -3 for unexpected errors, such as bad opcodes.
@@ -157,7 +161,7 @@ int AddEditScript( PEDIT_SCRIPT_ENTRY P, // the start of the script buffer
     }
     return -1;
 
-  } else if (Opcode == InsertOpcode) {
+  } else if ((Opcode == InsertOpcode) || (Opcode == ReplaceOpcode)) {
 
     //
     //  This is the copy opcode which is similar to the insert and delete opcodes but has the additional
@@ -214,31 +218,258 @@ void DebugPrintEditScript(PEDIT_SCRIPT_ENTRY p, int len)
       printf(" D%d" , p[i].Count+1);
     } else if (p[i].Opcode == KeepOpcode) { // Skip
       printf(" K%d", p[i].Count+1);
+    } else if (p[i].Opcode == ReplaceOpcode) { // Replace
+      printf(" R%d\"", p[i].Count+1);
+      for (j = 0; j < p[i].Count+1; j++) {
+	printf("%c", ((char *)p)[i+j+1]);
+      }
+      printf("\"");
+      i += p[i].Count+1;
     }
   }
   printf(" <<<Edit Script\n");
 }
 
-int ConstructEditScript(PEDIT_SCRIPT_ENTRY EditScript,     //PEDIT_SCRIPT_ENTRY EditScript,  // output for the edit script
-			int EditScriptLength, // length of edit script
-			PWORK_SPACE_ENTRY V,  // the workspace array holding our solution
-			int EndIndex,            // the index in the workspace array where our solution ends
-			char *OldString, int OldStringLength,
-			char *NewString, int NewStringLength
+void InitializeEditScriptWriter(PEDIT_SCRIPT_WRITER Writer, char *EditScript, int EditScriptLength, char *NewString)
+{
+  Writer->EditScript = (PEDIT_SCRIPT_ENTRY)EditScript;
+  Writer->EditScriptLength = EditScriptLength;
+  Writer->EditScriptIndex = 0;
+  Writer->Ops = NULL;
+  Writer->OpsLength = 0;
+  Writer->NewString = NewString;
+  Writer->Substitutions = 0;
+  Writer->LastOpcode = NoPendingOpcode;
+  Writer->OpcodeCount = 0;
+  Writer->StartOldIndex = Writer->StartNewIndex = 0;
+  Writer->ChangeOldCount = Writer->ChangeNewCount = 0;
+  Writer->OldIndex = Writer->NewIndex = 0;
+}
+
+//
+//  Write out one run at Index, either through AddEditScript or as one EDIT_OP record.
+//  Returns the next free index or -1 if the output is full.
+//
+
+int WriteEditScriptRun(PEDIT_SCRIPT_WRITER Writer, int Index, unsigned int Opcode, int OldIndex, int NewIndex, int Count)
+{
+  PEDIT_OP Op;
+
+  if (Count == 0) { return Index; }
+
+  if (Writer->Ops == NULL) {
+    return AddEditScript(Writer->EditScript, Writer->EditScriptLength, Index, Opcode, Count, &Writer->NewString[NewIndex]);
+  }
+
+  if (Index >= Writer->OpsLength) { return -1; }
+  Op = &Writer->Ops[Index];
+  Op->Opcode = Opcode;
+  Op->OldOffset = OldIndex;
+  Op->NewOffset = NewIndex;
+  Op->Length = Count;
+  return Index + 1;
+}
+
+//
+//  Write out the pending opcode.  A pending change becomes a replace of the bytes it both
+//  deletes and inserts, followed by the rest of its deletes or inserts.
+//
+
+int WritePendingEditScript(PEDIT_SCRIPT_WRITER Writer)
+{
+  int Replaced, i;
+
+  if (Writer->LastOpcode != ReplaceOpcode) {
+    return WriteEditScriptRun(Writer, Writer->EditScriptIndex, Writer->LastOpcode,
+			      Writer->StartOldIndex, Writer->StartNewIndex, Writer->OpcodeCount);
+  }
+
+  Replaced = (Writer->ChangeOldCount < Writer->ChangeNewCount) ? Writer->ChangeOldCount : Writer->ChangeNewCount;
+  if ((i = WriteEditScriptRun(Writer, Writer->EditScriptIndex, ReplaceOpcode,
+			      Writer->StartOldIndex, Writer->StartNewIndex, Replaced)) < 0) return i;
+  if ((i = WriteEditScriptRun(Writer, i, DeleteOpcode, Writer->StartOldIndex + Replaced, Writer->StartNewIndex + Replaced,
+			      Writer->ChangeOldCount - Replaced)) < 0) return i;
+  return WriteEditScriptRun(Writer, i, InsertOpcode, Writer->StartOldIndex + Replaced, Writer->StartNewIndex + Replaced,
+			    Writer->ChangeNewCount - Replaced);
+}
+
+//
+//  Add Count bytes worth of Opcode to the edit script.  The routine returns the next free
+//  index in the edit script, or the error from AddEditScript when flushing the previous
+//  opcode fails.
+//
+
+int EmitEditScript(PEDIT_SCRIPT_WRITER Writer, unsigned int Opcode, int Count)
+{
+  unsigned int Pending;
+  int i;
+
+  if (Count <= 0) { return Writer->EditScriptIndex; }
+
+  //
+  //  Replaces always accumulate as a change, and with substitutions on deletes and inserts
+  //  join the same change
+  //
+
+  Pending = Opcode;
+  if (Writer->Substitutions && (Opcode != KeepOpcode)) { Pending = ReplaceOpcode; }
+
+  if (Pending != Writer->LastOpcode) {
+    if (Writer->OpcodeCount > 0) {
+      if ((i = WritePendingEditScript(Writer)) < 0) return i;
+      Writer->EditScriptIndex = i;
+    }
+    Writer->LastOpcode = Pending;
+    Writer->OpcodeCount = 0;
+    Writer->StartOldIndex = Writer->OldIndex;
+    Writer->StartNewIndex = Writer->NewIndex;
+    Writer->ChangeOldCount = Writer->ChangeNewCount = 0;
+  }
+
+  Writer->OpcodeCount += Count;
+  if (Opcode != InsertOpcode) { Writer->OldIndex += Count; }
+  if (Opcode != DeleteOpcode) { Writer->NewIndex += Count; }
+  if (Pending == ReplaceOpcode) {
+    if (Opcode != InsertOpcode) { Writer->ChangeOldCount += Count; }
+    if (Opcode != DeleteOpcode) { Writer->ChangeNewCount += Count; }
+  }
+  return Writer->EditScriptIndex;
+}
+
+//
+//  Write out the pending opcode and return the final length of the edit script.  A trailing
+//  keep is dropped from an edit script because ApplyEditScript already copies whatever is
+//  left of the OldString, but an EDIT_OP array keeps it so that it covers both strings.
+//
+
+int FlushEditScript(PEDIT_SCRIPT_WRITER Writer)
+{
+  int i;
+
+  if ((Writer->OpcodeCount > 0) && ((Writer->LastOpcode != KeepOpcode) || (Writer->Ops != NULL))) {
+    if ((i = WritePendingEditScript(Writer)) < 0) return i;
+    Writer->EditScriptIndex = i;
+  }
+  Writer->LastOpcode = NoPendingOpcode;
+  Writer->OpcodeCount = 0;
+  return Writer->EditScriptIndex;
+}
+
+//
+//  Polling the cancel routine or the clock on every diagonal would cost more than the
+//  diagonal itself, so the engines only poll once every DIFF_CANCEL_INTERVAL diagonals.
+//
+
+#define DIFF_CANCEL_INTERVAL (4096)
+
+unsigned long long DiffMilliseconds(void)
+{
+  struct timespec Now;
+
+#ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+#else
+  timespec_get(&Now, TIME_UTC);
+#endif
+  return ((unsigned long long)Now.tv_sec * 1000) + (Now.tv_nsec / 1000000);
+}
+
+void InitializeDiffContext(PDIFF_CONTEXT Context,
+			   char *OldString, int OldStringLength,
+			   char *NewString, int NewStringLength,
+			   char *EditScript, int EditScriptLength,
+			   PDIFF_OPTIONS Options)
+{
+  Context->OldString = OldString;
+  Context->OldStringLength = OldStringLength;
+  Context->NewString = NewString;
+  Context->NewStringLength = NewStringLength;
+  Context->MemoryBudget = ((Options != NULL) && (Options->MemoryBudget != 0)) ? Options->MemoryBudget : (size_t)-1;
+  Context->Options = Options;
+  Context->Deadline = ((Options != NULL) && (Options->TimeoutMilliseconds != 0)) ? DiffMilliseconds() + Options->TimeoutMilliseconds : 0;
+  Context->CancelCountdown = DIFF_CANCEL_INTERVAL;
+  Context->Cancelled = 0;
+  Context->Lce[0] = Context->Lce[1] = NULL;
+  InitializeEditScriptWriter(&Context->Writer, EditScript, EditScriptLength, NewString);
+  Context->Writer.Substitutions = (Options != NULL) && (Options->Flags & DIFF_FLAG_SUBSTITUTIONS);
+  if (Options != NULL) { Options->IsApproximate = 0; }
+}
+
+//
+//  The engines call this routine once per diagonal.  It returns nonzero once the call has
+//  been cancelled, either by the caller's cancel routine or by running past the deadline.
+//
+
+int IsDiffCancelled(PDIFF_CONTEXT Context)
+{
+  if (Context->Cancelled) { return 1; }
+  if (--Context->CancelCountdown > 0) { return 0; }
+  Context->CancelCountdown = DIFF_CANCEL_INTERVAL;
+
+  if (Context->Options == NULL) { return 0; }
+  if ((Context->Options->CancelRoutine != NULL) && Context->Options->CancelRoutine(Context->Options->CancelContext)) {
+    Context->Cancelled = 1;
+  } else if ((Context->Deadline != 0) && (DiffMilliseconds() >= Context->Deadline)) {
+    Context->Cancelled = 1;
+  }
+  return Context->Cancelled;
+}
+
+//
+//  These routines compute how much workspace each of the engines needs for a range with
+//  the given lengths.  The exact engine needs the full triangle of V entries, the linear
+//  engine only needs a forward and a reverse array of furthest reaching x values.
+//
+
+size_t ExactWorkspaceSize(int OldStringLength, int NewStringLength)
+{
+  unsigned long long MaxVSize, Size;
+
+  MaxVSize = (unsigned long long)(OldStringLength+1) + (NewStringLength+1);
+  if (MaxVSize > (1ULL << 28)) { return (size_t)-1; }
+  Size = sizeof(WORK_SPACE_ENTRY) * ((MaxVSize * (MaxVSize+1)) / 2);
+  if (Size > (size_t)-1) { return (size_t)-1; }
+  return (size_t)Size;
+}
+
+size_t LinearWorkspaceSize(int OldStringLength, int NewStringLength)
+{
+  size_t MaxD;
+
+  MaxD = ((size_t)OldStringLength + NewStringLength + 1) / 2;
+  return 2 * sizeof(int) * (2*MaxD + 2);
+}
+
+//
+//  Engines get their workspace through these two routines.  If the caller supplied a workspace
+//  that is large enough we use it, otherwise we fall back to malloc.
+//
+
+void *AllocateWorkspace(PDIFF_CONTEXT Context, size_t Size)
+{
+  if ((Context->Options != NULL) && (Context->Options->Workspace != NULL) && (Size <= Context->Options->WorkspaceLength)) {
+    return Context->Options->Workspace;
+  }
+  return malloc(Size);
+}
+
+void FreeWorkspace(PDIFF_CONTEXT Context, void *Workspace)
+{
+  if ((Context->Options != NULL) && (Workspace == Context->Options->Workspace)) { return; }
+  free(Workspace);
+}
+
+int ConstructEditScript(PDIFF_CONTEXT Context, // the context whose writer gets the edit script
+			PWORK_SPACE_ENTRY V,   // the workspace array holding our solution
+			int EndIndex           // the index in the workspace array where our solution ends
 			)
 {
-  int CurrentVIndex; // the index of the current entry in the V array that we are processing
-  int CurrentEditScriptIndex;
+  PEDIT_SCRIPT_WRITER Writer = &Context->Writer;
   int i,j,k;
-  int DeleteCount, StartDeleteIndex, InsertCount, StartInsertIndex;
-  int InsertY;
-  int CurrentOutputIndex; // the index within the string that we are constructing
-  int y;
-  int LastOpcode, OpcodeCount;
-  char *StartInsertToken;
-  
+  int X;  // the number of bytes in the old string that the edit script has covered so far
+
   //printf("ConstructEditScript(...)\n");
-  //DebugPrintArray(V,1,0,Index);
+  //DebugPrintArray(V,1,0,EndIndex);
 
   //
   //  Now we need to build the edit script.  Is is a backwards process.  First we'll
@@ -256,166 +487,87 @@ int ConstructEditScript(PEDIT_SCRIPT_ENTRY EditScript,     //PEDIT_SCRIPT_ENTRY
   //DebugPrintArray(V,1,0,EndIndex);
   //  for (i = V[0].Back; i != -1; i = V[i].Back) { DebugPrintArray(V,(i == V[0].Back),i,i); }
 
-  LastOpcode = NoopOpcode;
-  OpcodeCount = 0;
-  StartInsertToken = NULL; 
-  
-  CurrentVIndex = V[0].Back;
-  CurrentEditScriptIndex = 0;
-
   //
-  //  In this loop we essentially walk through what would be the new string. Using i as our index into the
-  //  string that we are constructing and comparing i with index of the operations that are stored in the
-  //  work array. If i is less than the index of the insert or delete then we want to keep (or retain) the
-  //  byte in the old string. so we issue a keep opcode and move one.  If i lines up with the index of the
-  //  current command then we want to process that command, and if necsssary advance i.
+  //  Now walk forward through the solution.  Entry zero is only our starting point so we
+  //  skip it.  For every other entry we keep the bytes in the old string up to the point
+  //  where the entry applies, and then issue the entry's delete or insert.  The writer
+  //  takes care of merging consecutive operations of the same kind.
   //
-  //  We actually postpone adding the command to the edit script until opcode changes so do don't do things
-  //  like issue delete 1 char, delete 1 char, delete 1 char.  But instead issue a delete 3 char.
+  //  A delete's Index is the one based location of the byte in the old string that is being
+  //  deleted, while an insert's Index is the number of old bytes that precede the insert.
   //
-  
-  for (i = 0; CurrentVIndex != -1;) {
-    if (V[CurrentVIndex].IsDelete) {
-
-      if (i < V[CurrentVIndex].Index) {
-	if (i != 0) {
-	  if (LastOpcode == KeepOpcode) {
-	    OpcodeCount++;
-	  } else {
-	    if (OpcodeCount > 0) {
-	      if ((CurrentEditScriptIndex = j = AddEditScript(EditScript, EditScriptLength, CurrentEditScriptIndex,
-							      LastOpcode, OpcodeCount, StartInsertToken)) < 0) return j;
-	    }
-	    OpcodeCount = 1;
-	  }
-	  LastOpcode = KeepOpcode;
-	  //printf("%3d Keep   %d\n", CurrentVIndex, i);
-	}
-        i++;
-
-      } else {
-	
-	if (LastOpcode == DeleteOpcode) {
-	  OpcodeCount++;
-	} else {
-	  if (OpcodeCount > 0) {
-	    if ((CurrentEditScriptIndex = j = AddEditScript(EditScript, EditScriptLength, CurrentEditScriptIndex,
-							    LastOpcode, OpcodeCount, StartInsertToken)) < 0) return j;
-	  }
-	  OpcodeCount = 1;
-	}
-
-	LastOpcode = DeleteOpcode;
-	//printf("%3d Delete %d\n", CurrentVIndex, V[CurrentVIndex].Index);
-	CurrentVIndex = V[CurrentVIndex].Back;
-	i++;
-      }
 
+  for (i = V[0].Back, X = 0; i != -1; i = V[i].Back) {
+    if (V[i].IsDelete) {
+      if ((j = EmitEditScript(Writer, KeepOpcode, V[i].Index - 1 - X)) < 0) return j;
+      if ((j = EmitEditScript(Writer, DeleteOpcode, 1)) < 0) return j;
+      //printf("%3d Delete %d\n", i, V[i].Index);
     } else {
-
-      if (i <= V[CurrentVIndex].Index) {
-	if (i != 0) {
-	  if (LastOpcode == KeepOpcode) {
-	    OpcodeCount++;
-	  } else {
-	    if (OpcodeCount > 0) {
-	      if ((CurrentEditScriptIndex = j = AddEditScript(EditScript, EditScriptLength, CurrentEditScriptIndex,
-							      LastOpcode, OpcodeCount, StartInsertToken)) < 0) return j;
-	    }
-	    OpcodeCount = 1;
-	  }
-	  LastOpcode = KeepOpcode;
-	  //printf("%3d Keep   %d\n", CurrentVIndex, i);
-	}
-        i++;
-
-      } else {
-
-	if (LastOpcode == InsertOpcode) {
-	  OpcodeCount++;
-	} else {
-	  if (OpcodeCount > 0) {
-	    if ((CurrentEditScriptIndex = j = AddEditScript(EditScript, EditScriptLength, CurrentEditScriptIndex,
-							    LastOpcode, OpcodeCount, StartInsertToken)) < 0) return j;
-	  }
-	  LastOpcode = InsertOpcode;
-	  OpcodeCount = 1;
-	  StartInsertToken = V[CurrentVIndex].Token;
-	}
-
-	LastOpcode = InsertOpcode;
-	//printf("%3d Insert %d %c\n", CurrentVIndex, V[CurrentVIndex].Index, *V[CurrentVIndex].Token);
-	CurrentVIndex = V[CurrentVIndex].Back;
-      }
+      if ((j = EmitEditScript(Writer, KeepOpcode, V[i].Index - X)) < 0) return j;
+      if ((j = EmitEditScript(Writer, InsertOpcode, 1)) < 0) return j;
+      //printf("%3d Insert %d %d\n", i, V[i].Index, V[i].Token);
     }
+    X = V[i].Index;
   }
-  
-  if (OpcodeCount > 0) {
-    if ((CurrentEditScriptIndex = j = AddEditScript(EditScript, EditScriptLength, CurrentEditScriptIndex,
-						    LastOpcode, OpcodeCount, StartInsertToken)) < 0) return j;
-  }
-  
-  return CurrentEditScriptIndex;
-}  
 
-int ComputeEditScript (char *OldString,
-		       int OldStringLength,
-		       char *NewString,
-		       int NewStringLength,
-		       char *EditScript,
-		       int EditScriptLength)
+  //
+  //  Whatever follows the last edit is the common tail the solution ended on
+  //
+
+  return EmitEditScript(Writer, KeepOpcode, V[EndIndex].SavedX - X);
+}
+
+int ComputeExactEditScript(PDIFF_CONTEXT Context,
+			   PWORK_SPACE_ENTRY V,
+			   int OldStart, int OldEnd,
+			   int NewStart, int NewEnd)
 /*++
 
   Description:
 
     This routine implements Eugene W. Myers' difference algorithm for computing the difference 
-    between two input strings.
+    between a range of the old string and a range of the new string.
 
   Input:
 
-    OldString, OldStringLength: describe the first string that we are converting from, also known
-      as X in this routine and Myers' paper.
+    Context: supplies the strings and receives the edit script through its writer.
 
-    NewString, NewStringLength: describe the second string that we are converting to, also know as 
-      Y in this rouitne and Myers' paper.
+    V: is the workspace, it must be at least ExactWorkspaceSize() bytes for the two ranges.
 
-    EditScript, EditScriptLength: is the destination for the edit script that we will generate
-      for converting the OldString into the NewString.
+    OldStart, OldEnd: describe the range of the old string that we are converting from, also
+      known as X in this routine and Myers' paper.
+
+    NewStart, NewEnd: describe the range of the new string that we are converting to, also know
+      as Y in this rouitne and Myers' paper.
 
   Output:
 
-    We return the number of bytes that we used in the EditScript.  Or -1 if the EditScriptLength is 
-    too short to contain the needed script. Or -2 if the malloc for our workspace failed, and -3 if
-    fell out of the bottom of the algorithm without successfully computed the edit script (i.e., an 
-    internal error).
+    We return the next free index in the edit script.  Or -1 if the edit script is too short
+    to contain the needed script, -3 if fell out of the bottom of the algorithm without
+    successfully computed the edit script (i.e., an internal error), and -4 if cancelled.
 
 --*/
 {
+  char *OldString = &Context->OldString[OldStart];
+  char *NewString = &Context->NewString[NewStart];
+  int OldStringLength = OldEnd - OldStart;
+  int NewStringLength = NewEnd - NewStart;
   int MaxVSize;
-  PWORK_SPACE_ENTRY V;
   int D, k;
   int X, Y;
   int i;
-
-  //printf("ComputeEditScript( %08lx, %d, %08lx, %d, %08lx, %08lx )\n", OldString, OldStringLength, NewString, NewStringLength, EditScript, EditScriptLength); 
+  int BestIndex;  // the entry that has come closest to the end of both strings so far
 
   //
-  //  Calculate how much work space is needed, then allocate and initialize it by preloading
-  //  D and k values in our work array.  Also initialize the odd first step that allows us to
-  //  start properly
+  //  Initialize the odd first step that allows us to start properly.  Each entry gets its D
+  //  and k as the search reaches it, the workspace can be far larger than the part of it we
+  //  touch and a preload would run before the first check for cancellation.
   //
 
   MaxVSize = (OldStringLength+1) + (NewStringLength+1);
-  if ((V = malloc(sizeof(WORK_SPACE_ENTRY) * MaxVSize * (MaxVSize+1))) == NULL) return -2;
-  for (D = 0; D < MaxVSize; D++){
-    for (k = -D; k <= D; k += 2){
-      i = DkIndex(D,k);
-      V[i].D = D;
-      V[i].k = k;
-    }
-  }
   V[0].D = 0; V[0].k = 0; V[0].SavedX = 0; V[0].SavedY = -1;    
   //DebugPrintArray(V,0,20);
+  BestIndex = 0;
 
   //
   //  Now do the real work of discovering the various insert and delete paths
@@ -432,6 +584,8 @@ int ComputeEditScript (char *OldString,
       Index = DkIndex(D,k);
       TopIndex = DkIndex(D-1,k+1);
       BotIndex = DkIndex(D-1,k-1);
+      V[Index].D = D;
+      V[Index].k = k;
 	
       if ((k == -D) || ((k != D) && V[BotIndex].SavedX < V[TopIndex].SavedX)) {
 
@@ -457,7 +611,7 @@ int ComputeEditScript (char *OldString,
 	  
         V[Index].IsDelete = 0;
         V[Index].Index = X;
-        V[Index].Token = &NewString[Y-1];
+        V[Index].Token = NewStart + Y - 1;
         V[Index].Back = TopIndex;
         //printf("Insert NewString[%d] at OldString[%d-1]=%c\n", x,y,NewString[y-1]);
 	  
@@ -506,122 +660,1050 @@ int ComputeEditScript (char *OldString,
       //
 	
       if ((X >= OldStringLength) && (Y >= NewStringLength)) {
-        i = ConstructEditScript((PEDIT_SCRIPT_ENTRY)EditScript, EditScriptLength, V, Index,
-				OldString, OldStringLength,
-				NewString, NewStringLength);
-        free(V);
-        return i;
+        return ConstructEditScript(Context, V, Index);
+      }
+
+      //
+      //  Otherwise remember the furthest we have gotten, and see if we have been cancelled.
+      //  If so the approximate script follows the best path we have up to where it ends and
+      //  then simply deletes the rest of the old string and inserts the rest of the new.
+      //
+
+      if (X + Y > V[BestIndex].SavedX + V[BestIndex].SavedY) {
+	BestIndex = Index;
+      }
+
+      if (IsDiffCancelled(Context)) {
+	if (!ApproximateOnCancel(Context)) { return -4; }
+	if ((i = ConstructEditScript(Context, V, BestIndex)) < 0) return i;
+	if ((i = EmitEditScript(&Context->Writer, DeleteOpcode, OldStringLength - V[BestIndex].SavedX)) < 0) return i;
+	return EmitEditScript(&Context->Writer, InsertOpcode, NewStringLength - V[BestIndex].SavedY);
       }
     }
   }
   //printf("fell through to the bottom\n");
-  free(V);
   return -3;
 }
 
-int ApplyEditScript( char *OldString,
-		     int OldStringLength,
-		     char *EditScript,
-		     int EditScriptLength,
-		     char *NewString,
-		     int NewStringLength)
-/*++
+//
+//  The linear space engine is the divide and conquer refinement from section 4b of Myers'
+//  paper.  We run the forward and reverse searches at the same time until they overlap on
+//  some diagonal, which gives us a point that lies on an optimal path.  We then split the
+//  problem at that point and solve both halves the same way.  Only the two arrays of furthest
+//  reaching x values are needed, and they are reused by every level of the recursion.
+//
+//  Vf[k] is the furthest x reached on diagonal k going forward from the start of the ranges.
+//  Vr[k] is the furthest distance reached on diagonal k going backward from the end of the
+//  ranges, measured from the end.  Both are offset by MaxD so that negative k can index them.
+//
+//  FindMiddleSnake returns 0 and the split point, or 1 if the ranges have nothing in common.
+//  When cancelled it returns -4, or pretends the ranges have nothing in common if the caller
+//  will settle for an approximate script.
+//
 
-  Description:
+int FindMiddleSnake(PDIFF_CONTEXT Context,
+		    int *Vf, int *Vr,
+		    int OldStart, int OldEnd,
+		    int NewStart, int NewEnd,
+		    int *SplitX, int *SplitY)
+{
+  char *OldString = &Context->OldString[OldStart];
+  char *NewString = &Context->NewString[NewStart];
+  int OldStringLength = OldEnd - OldStart;
+  int NewStringLength = NewEnd - NewStart;
+  int MaxD, Delta, Front;
+  int KfStart, KfEnd, KrStart, KrEnd;
+  int D, k, Kf, Kr;
+  int X, Y, Xr;
+  int i;
 
-    This routine applies the edit script to the old string and puts the results into the new string.
+  MaxD = (OldStringLength + NewStringLength + 1) / 2;
+  for (i = 0; i < 2*MaxD+2; i++) { Vf[i] = Vr[i] = -1; }
+  Vf[MaxD+1] = 0;
+  Vr[MaxD+1] = 0;
 
-    The basic algorithm is to have three active pointers to the old string, edit script and the new string.
+  //
+  //  If the difference in lengths is odd the paths first overlap during a forward step,
+  //  otherwise during a reverse step.  The start and end trims remove diagonals that have
+  //  run off the edge of either string.
+  //
 
-    If the current edit script is a delete, delete count then
-      skip over the old string by advancing its pointer by the delete count
-    If the current edit script is a keep, keep count thne
-      copy the count number of bytes from the old string to the new string advancing both pointers
-    If the current edit script is an insert, count then
-      copy the count number of bytes from the edit script to the new string advancing both pointers
+  Delta = OldStringLength - NewStringLength;
+  Front = (Delta & 1);
+  KfStart = KfEnd = KrStart = KrEnd = 0;
 
-    Lastly, if we reach the end of the edit script and there are still more bytes in the old string then
-      copy over the remainder of the old string into the new string
+  for (D = 0; D < MaxD; D++) {
+
+    for (k = -D + KfStart; k <= D - KfEnd; k += 2) {
+      if (IsDiffCancelled(Context)) { return ApproximateOnCancel(Context) ? 1 : -4; }
+      Kf = MaxD + k;
+      if ((k == -D) || ((k != D) && (Vf[Kf-1] < Vf[Kf+1]))) {
+	X = Vf[Kf+1];
+      } else {
+	X = Vf[Kf-1] + 1;
+      }
+      Y = X - k;
+      if (Context->Lce[0] != NULL) {
+	X += LceSnake(Context->Lce[0], OldStart + X, NewStart + Y,
+		      (OldStringLength - X < NewStringLength - Y) ? OldStringLength - X : NewStringLength - Y);
+	Y = X - k;
+      } else {
+	while ((X < OldStringLength) && (Y < NewStringLength) && (OldString[X] == NewString[Y])) {
+	  X++;
+	  Y++;
+	}
+      }
+      Vf[Kf] = X;
+      if (X > OldStringLength) {
+	KfEnd += 2;
+      } else if (Y > NewStringLength) {
+	KfStart += 2;
+      } else if (Front) {
+	Kr = MaxD + Delta - k;
+	if ((Kr >= 0) && (Kr < 2*MaxD+2) && (Vr[Kr] != -1)) {
+	  if (X >= OldStringLength - Vr[Kr]) {
+	    *SplitX = X;
+	    *SplitY = Y;
+	    return 0;
+	  }
+	}
+      }
+    }
+
+    for (k = -D + KrStart; k <= D - KrEnd; k += 2) {
+      Kr = MaxD + k;
+      if ((k == -D) || ((k != D) && (Vr[Kr-1] < Vr[Kr+1]))) {
+	Xr = Vr[Kr+1];
+      } else {
+	Xr = Vr[Kr-1] + 1;
+      }
+      Y = Xr - k;
+      if (Context->Lce[1] != NULL) {
+	Xr += LceSnake(Context->Lce[1], OldEnd - Xr, NewEnd - Y,
+		       (OldStringLength - Xr < NewStringLength - Y) ? OldStringLength - Xr : NewStringLength - Y);
+	Y = Xr - k;
+      } else {
+	while ((Xr < OldStringLength) && (Y < NewStringLength) &&
+	       (OldString[OldStringLength-Xr-1] == NewString[NewStringLength-Y-1])) {
+	  Xr++;
+	  Y++;
+	}
+      }
+      Vr[Kr] = Xr;
+      if (Xr > OldStringLength) {
+	KrEnd += 2;
+      } else if (Y > NewStringLength) {
+	KrStart += 2;
+      } else if (!Front) {
+	Kf = MaxD + Delta - k;
+	if ((Kf >= 0) && (Kf < 2*MaxD+2) && (Vf[Kf] != -1)) {
+	  X = Vf[Kf];
+	  if (X >= OldStringLength - Xr) {
+	    *SplitX = X;
+	    *SplitY = X - (Kf - MaxD);
+	    return 0;
+	  }
+	}
+      }
+    }
+  }
+
+  //
+  //  The two searches always meet before D reaches MaxD unless the ranges have nothing at
+  //  all in common, in which case the only solution is to delete one and insert the other
+  //
+
+  return 1;
+}
+
+int ComputeLinearEditScript(PDIFF_CONTEXT Context,
+			    int *Vf, int *Vr,
+			    int OldStart, int OldEnd,
+			    int NewStart, int NewEnd)
+/*++
+
+  Description:
+
+    This routine computes the same minimal edit script as ComputeExactEditScript but only
+    uses space linear in the length of the ranges.  It trims the common prefix and suffix,
+    then splits the remaining ranges at their middle snake and recurses on both halves.
 
   Input:
 
-    OldString, OldStringLength: describe the first string that we are converting from
+    Context: supplies the strings and receives the edit script through its writer.
 
-    EditScript, EditScriptLength: describes the edit script that is to be applied to the Old String
+    Vf, Vr: are the forward and reverse arrays, together they are LinearWorkspaceSize() bytes.
 
-    NewString, NewStringLength: gets the results of applying the edit script to the old string
+    OldStart, OldEnd, NewStart, NewEnd: describe the ranges of the old and new strings.
 
   Output:
 
-    We return the number of bytes that we used in the NewString.  Or -1 if the NewStringLength is 
-    too short to contain the needed string. Or -3 if the input is corrupt
+    We return the next free index in the edit script, or the error from the writer, -3
+    for an internal error, or -4 if cancelled.
 
 --*/
 {
-  int OldStringIndex, EditScriptIndex, NewStringIndex;
-  unsigned char Opcode, Count;
+  PEDIT_SCRIPT_WRITER Writer = &Context->Writer;
+  int Prefix, Suffix;
+  int SplitX, SplitY;
+  int i;
 
-  OldStringIndex = EditScriptIndex = NewStringIndex = 0;
+  for (Prefix = 0;
+       (OldStart + Prefix < OldEnd) && (NewStart + Prefix < NewEnd) &&
+	 (Context->OldString[OldStart + Prefix] == Context->NewString[NewStart + Prefix]);
+       Prefix++) { }
+  if ((i = EmitEditScript(Writer, KeepOpcode, Prefix)) < 0) return i;
+  OldStart += Prefix;
+  NewStart += Prefix;
 
-  while (EditScriptIndex < EditScriptLength) {
+  for (Suffix = 0;
+       (OldEnd - Suffix > OldStart) && (NewEnd - Suffix > NewStart) &&
+	 (Context->OldString[OldEnd - Suffix - 1] == Context->NewString[NewEnd - Suffix - 1]);
+       Suffix++) { }
+  OldEnd -= Suffix;
+  NewEnd -= Suffix;
 
-    Opcode = ((PEDIT_SCRIPT_ENTRY)EditScript)[EditScriptIndex].Opcode;
-    Count = ((PEDIT_SCRIPT_ENTRY)EditScript)[EditScriptIndex].Count+1; // account for the bias
+  if ((OldStart == OldEnd) || (NewStart == NewEnd)) {
 
-    if (Opcode == DeleteOpcode) {
-      OldStringIndex += Count;
-    } else if (Opcode == KeepOpcode) {
-      if (NewStringIndex + Count >= NewStringLength) return -1;
-      memcpy(&NewString[NewStringIndex], &OldString[OldStringIndex], Count);
-      OldStringIndex += Count;
-      NewStringIndex += Count;
-    } else { // Opcode == InsertOpcoode
-      if (NewStringIndex + Count >= NewStringLength) return -1;
-      memcpy(&NewString[NewStringIndex], &EditScript[EditScriptIndex+1], Count);
-      EditScriptIndex += Count;
-      NewStringIndex += Count;
+    if ((i = EmitEditScript(Writer, DeleteOpcode, OldEnd - OldStart)) < 0) return i;
+    if ((i = EmitEditScript(Writer, InsertOpcode, NewEnd - NewStart)) < 0) return i;
+
+  } else {
+
+    if ((i = FindMiddleSnake(Context, Vf, Vr, OldStart, OldEnd, NewStart, NewEnd, &SplitX, &SplitY)) < 0) return i;
+    if (i == 1) {
+      SplitX = OldEnd - OldStart;
+      SplitY = 0;
     }
-    EditScriptIndex += 1;
+    if ((i = ComputeLinearEditScript(Context, Vf, Vr, OldStart, OldStart + SplitX, NewStart, NewStart + SplitY)) < 0) return i;
+    if ((i = ComputeLinearEditScript(Context, Vf, Vr, OldStart + SplitX, OldEnd, NewStart + SplitY, NewEnd)) < 0) return i;
   }
 
-  if (OldStringIndex < OldStringLength) {
-    if (NewStringIndex + (OldStringLength - OldStringIndex) >= NewStringLength) return -1;
-    memcpy(&NewString[NewStringIndex], &OldString[OldStringIndex], OldStringLength - OldStringIndex);
-    NewStringIndex += OldStringLength - OldStringIndex;
-  }
-  return NewStringIndex;
+  return EmitEditScript(Writer, KeepOpcode, Suffix);
 }
 
-#ifdef _MAIN_
-void main (int argc, char *argv[])
+int ComputePartitionedEditScript(PDIFF_CONTEXT Context,
+				 int OldStart, int OldEnd,
+				 int NewStart, int NewEnd)
+/*++
+
+  Description:
+
+    This routine is our last resort when even the linear engine does not fit in the memory
+    budget.  We cut both ranges into the same number of proportional partitions, small enough
+    for the linear engine to fit, and diff each pair of partitions on its own.  The result is
+    a valid edit script but not necessarily a minimal one.
+
+  Output:
+
+    We return the next free index in the edit script, -2 if the budget is too small for even
+    the smallest partition, or the error from the linear engine.
+
+--*/
 {
-  //char OldString[128] = "quickfoxback!"; // "abcabba"; // "DEFJKL"; //"ABCABBA";
-  //char NewString[128] = "The quick brown fox jumped over the lazy dog's back!"; // "abcDEFghiJLK"; //JKLMNOPQRSTUVWXYZ"; //"CBABAC";
-  char EditScript[32768]; int EditScriptLength = 32768;
-  char NewString[65536]; int NewStringLength = 65536;
+  int OldStringLength = OldEnd - OldStart;
+  int NewStringLength = NewEnd - NewStart;
+  long long Capacity, Partitions, p;
+  int *Vf;
   int i;
 
-  //printf("sizeof(char) = %d\n", sizeof(char));
-  //printf("sizeof(int) = %d\n", sizeof(int));
+  //
+  //  Find the largest combined partition length whose workspace fits in the budget
+  //
+
+  Capacity = (long long)(Context->MemoryBudget / (2 * sizeof(int))) - 2;
+  if (Capacity > (long long)OldStringLength + NewStringLength) { Capacity = (long long)OldStringLength + NewStringLength; }
+  while ((Capacity > 0) && (LinearWorkspaceSize(0, (int)Capacity) > Context->MemoryBudget)) { Capacity--; }
+  if (Capacity < 4) { return -2; }
+
+  Partitions = ((long long)OldStringLength + NewStringLength + Capacity - 3) / (Capacity - 2);
+  if ((Vf = AllocateWorkspace(Context, LinearWorkspaceSize(0, (int)Capacity))) == NULL) return -2;
+
+  for (p = 0, i = 0; (p < Partitions) && (i >= 0); p++) {
+    i = ComputeLinearEditScript(Context, Vf, Vf + 2*((Capacity+1)/2) + 2,
+				OldStart + (int)((OldStringLength * p) / Partitions),
+				OldStart + (int)((OldStringLength * (p+1)) / Partitions),
+				NewStart + (int)((NewStringLength * p) / Partitions),
+				NewStart + (int)((NewStringLength * (p+1)) / Partitions));
+  }
+  FreeWorkspace(Context, Vf);
+  return i;
+}
+
+int ComputeRangeEditScript(PDIFF_CONTEXT Context,
+			   int OldStart, int OldEnd,
+			   int NewStart, int NewEnd)
+/*++
+
+  Description:
+
+    This routine appends the edit script for a range of the old string and a range of the new
+    string to the context's writer.  It trims the common prefix and suffix and then picks the
+    best engine whose workspace fits in the memory budget: the exact engine first, then the
+    linear space engine, and lastly partitioned linear diffs.  If an allocation fails we fall
+    back to the next engine rather than failing the call.  When the caller asked for them the
+    wavefront, LCE, and substitution engines go ahead of all of them, in that order.
+
+  Output:
+
+    We return the next free index in the edit script.  Or -1 if the edit script is too short,
+    -2 if no engine could get its workspace, -3 for an internal error, and -4 if cancelled.
+
+--*/
+{
+  PEDIT_SCRIPT_WRITER Writer = &Context->Writer;
+  int Prefix, Suffix;
+  size_t Size;
+  void *Workspace;
+  int i;
+
+  //
+  //  Skip over the common prefix and suffix, they cost nothing to compute and every byte we
+  //  skip shrinks the workspace the engines need
+  //
+
+  for (Prefix = 0;
+       (OldStart + Prefix < OldEnd) && (NewStart + Prefix < NewEnd) &&
+	 (Context->OldString[OldStart + Prefix] == Context->NewString[NewStart + Prefix]);
+       Prefix++) { }
+  if ((i = EmitEditScript(Writer, KeepOpcode, Prefix)) < 0) return i;
+  OldStart += Prefix;
+  NewStart += Prefix;
+
+  for (Suffix = 0;
+       (OldEnd - Suffix > OldStart) && (NewEnd - Suffix > NewStart) &&
+	 (Context->OldString[OldEnd - Suffix - 1] == Context->NewString[NewEnd - Suffix - 1]);
+       Suffix++) { }
+  OldEnd -= Suffix;
+  NewEnd -= Suffix;
+
+  if ((OldStart == OldEnd) || (NewStart == NewEnd)) {
+
+    if ((i = EmitEditScript(Writer, DeleteOpcode, OldEnd - OldStart)) < 0) return i;
+    if ((i = EmitEditScript(Writer, InsertOpcode, NewEnd - NewStart)) < 0) return i;
+
+  } else {
+
+    Workspace = NULL;
+    i = -2;
+
+    //
+    //  The wavefront, LCE, and substitution engines give up with -2 before emitting anything
+    //  when the range doesn't suit them or their workspace outgrows the budget, and then the
+    //  other engines take over
+    //
+
+    if ((Context->Options != NULL) && (Context->Options->Flags & DIFF_FLAG_WAVEFRONT)) {
+      i = ComputeWavefrontEditScript(Context, OldStart, OldEnd, NewStart, NewEnd);
+    }
+    if ((i == -2) && (Context->Options != NULL) && (Context->Options->Flags & DIFF_FLAG_LCE)) {
+      i = ComputeLceEditScript(Context, OldStart, OldEnd, NewStart, NewEnd);
+    }
+    if ((i == -2) && Context->Writer.Substitutions) {
+      i = ComputeSubstitutionEditScript(Context, OldStart, OldEnd, NewStart, NewEnd);
+    }
+
+    Size = ExactWorkspaceSize(OldEnd - OldStart, NewEnd - NewStart);
+    if (i != -2) {
+    } else if ((Size <= Context->MemoryBudget) && ((Workspace = AllocateWorkspace(Context, Size)) != NULL)) {
+      i = ComputeExactEditScript(Context, (PWORK_SPACE_ENTRY)Workspace, OldStart, OldEnd, NewStart, NewEnd);
+      FreeWorkspace(Context, Workspace);
+    } else {
+      Size = LinearWorkspaceSize(OldEnd - OldStart, NewEnd - NewStart);
+      if ((Size <= Context->MemoryBudget) && ((Workspace = AllocateWorkspace(Context, Size)) != NULL)) {
+	i = ComputeLinearEditScript(Context, (int *)Workspace, (int *)Workspace + Size / (2 * sizeof(int)),
+				    OldStart, OldEnd, NewStart, NewEnd);
+	FreeWorkspace(Context, Workspace);
+      } else if (Size > Context->MemoryBudget) {
+	i = ComputePartitionedEditScript(Context, OldStart, OldEnd, NewStart, NewEnd);
+      }
+    }
+    if (i < 0) return i;
+  }
+
+  return EmitEditScript(Writer, KeepOpcode, Suffix);
+}
+
+int ComputeContextEditScript(PDIFF_CONTEXT Context)
+/*++
+
+  Description:
+
+    This routine computes the edit script for the whole of the context's strings.  Snapshots
+    are diffed page by page, and chunked diffs chunk by chunk.  Otherwise if the caller gave
+    us a base cache and it has, or can build, a prepared base for the OldString we diff
+    against that, and failing that we diff the strings directly.
+
+--*/
+{
+  PBASE_CACHE Cache = (Context->Options != NULL) ? Context->Options->BaseCache : NULL;
+  PBASE_CACHE_ENTRY Entry;
+  int i;
+
+  if ((Context->Options != NULL) && (Context->Options->Flags & DIFF_FLAG_SNAPSHOT)) {
+    return ComputeSnapshotEditScript(Context);
+  }
+  if ((Context->Options != NULL) && (Context->Options->Flags & DIFF_FLAG_CONTENT_CHUNKS)) {
+    return ComputeChunkedEditScript(Context);
+  }
+  if ((Cache != NULL) && ((Entry = AcquireCachedBase(Cache, Context->OldString, Context->OldStringLength)) != NULL)) {
+    i = ComputeBaseEditScript(Context, CachedBase(Entry));
+    ReleaseCachedBase(Cache, Entry);
+    return i;
+  }
+  return ComputeRangeEditScript(Context, 0, Context->OldStringLength, 0, Context->NewStringLength);
+}
+
+int ComputeEditScript (char *OldString,
+		       int OldStringLength,
+		       char *NewString,
+		       int NewStringLength,
+		       char *EditScript,
+		       int EditScriptLength)
+/*++
+
+  Description:
+
+    This routine computes the edit script for converting the old string into the new string
+    using ComputeEditScriptEx without any options.
+
+--*/
+{
+  return ComputeEditScriptEx(OldString, OldStringLength, NewString, NewStringLength, EditScript, EditScriptLength, NULL);
+}
+
+int ComputeEditScriptEx (char *OldString,
+			 int OldStringLength,
+			 char *NewString,
+			 int NewStringLength,
+			 char *EditScript,
+			 int EditScriptLength,
+			 PDIFF_OPTIONS Options)
+/*++
+
+  Description:
+
+    This routine implements Eugene W. Myers' difference algorithm for computing the difference 
+    between two input strings.
+
+  Input:
+
+    OldString, OldStringLength: describe the first string that we are converting from, also known
+      as X in this routine and Myers' paper.
+
+    NewString, NewStringLength: describe the second string that we are converting to, also know as 
+      Y in this rouitne and Myers' paper.
+
+    EditScript, EditScriptLength: is the destination for the edit script that we will generate
+      for converting the OldString into the NewString.
+
+    Options: optionally tunes the computation, see DIFF_OPTIONS.  NULL means no options.
+
+  Output:
+
+    We return the number of bytes that we used in the EditScript.  Or -1 if the EditScriptLength is 
+    too short to contain the needed script. Or -2 if the malloc for our workspace failed or the
+    memory budget is too small for any engine, -3 if fell out of the bottom of the algorithm
+    without successfully computed the edit script (i.e., an internal error), and -4 if the call
+    was cancelled or ran past its deadline.
+
+    If the call was cancelled and the options ask for DIFF_FLAG_APPROXIMATE_ON_CANCEL we instead
+    return a valid but possibly far from minimal edit script and set Options->IsApproximate.
+
+--*/
+{
+  DIFF_CONTEXT Context;
+  int i;
+
+  //printf("ComputeEditScriptEx( %08lx, %d, %08lx, %d, %08lx, %08lx )\n", OldString, OldStringLength, NewString, NewStringLength, EditScript, EditScriptLength); 
+
+  InitializeDiffContext(&Context, OldString, OldStringLength, NewString, NewStringLength,
+			EditScript, EditScriptLength, Options);
+
+  if ((i = ComputeContextEditScript(&Context)) < 0) return i;
+  if (Options != NULL) { Options->IsApproximate = Context.Cancelled; }
+  return FlushEditScript(&Context.Writer);
+}
+
+int ComputeEditOps (char *OldString,
+		    int OldStringLength,
+		    char *NewString,
+		    int NewStringLength,
+		    PEDIT_OP Ops,
+		    int OpsLength,
+		    PDIFF_OPTIONS Options)
+/*++
+
+  Description:
+
+    This routine computes the same alignment as ComputeEditScriptEx but returns it as an array
+    of EDIT_OP records rather than an edit script.  Each record is one maximal run of keeps,
+    deletes or inserts, and together they cover all of both strings, including a trailing keep.
+    Inserted bytes are not copied, they are found at NewString[Op.NewOffset].
+
+  Input:
+
+    OldString, OldStringLength, NewString, NewStringLength: describe the two strings.
+
+    Ops, OpsLength: receive the records.  OldStringLength + NewStringLength records always suffice.
+
+    Options: optionally tunes the computation, see DIFF_OPTIONS.  NULL means no options.
+
+  Output:
+
+    We return the number of records we used.  Or -1 if OpsLength is too small, and otherwise
+    the same errors as ComputeEditScriptEx.
+
+--*/
+{
+  DIFF_CONTEXT Context;
+  int i;
+
+  InitializeDiffContext(&Context, OldString, OldStringLength, NewString, NewStringLength, NULL, 0, Options);
+  Context.Writer.Ops = Ops;
+  Context.Writer.OpsLength = OpsLength;
+
+  if ((i = ComputeContextEditScript(&Context)) < 0) return i;
+  if (Options != NULL) { Options->IsApproximate = Context.Cancelled; }
+  return FlushEditScript(&Context.Writer);
+}
+
+int MaxEditScriptLength (int OldStringLength,
+			 int NewStringLength)
+/*++
+
+  Description:
+
+    This routine returns an upper bound on the length of the edit script that ComputeEditScript
+    can produce for strings of the given lengths, so callers can size the buffer once.
+
+    Every keep or delete entry covers at least one byte of the old string, and every insert
+    entry covers at least one byte of the new string and carries that byte along with it.
+
+--*/
+{
+  long long Length;
+
+  Length = (long long)OldStringLength + 2 * (long long)NewStringLength;
+  return (Length > 0x7fffffff) ? 0x7fffffff : (int)Length;
+}
+
+size_t QueryWorkspaceSize (int OldStringLength,
+			   int NewStringLength,
+			   PDIFF_OPTIONS Options)
+/*++
+
+  Description:
+
+    This routine returns the most workspace that ComputeEditScriptEx will ask for when diffing
+    strings of the given lengths under the given options.  A caller that supplies a workspace
+    at least this large in Options->Workspace avoids any allocation inside the engines.
+    The wavefront engine runs before the others and is done with its workspace by the time
+    they start, so it needs the larger of the two.
+
+--*/
+{
+  size_t MemoryBudget;
+  size_t Size, Wavefront = 0;
+
+  MemoryBudget = ((Options != NULL) && (Options->MemoryBudget != 0)) ? Options->MemoryBudget : (size_t)-1;
+  if ((Options != NULL) && (Options->Flags & DIFF_FLAG_WAVEFRONT) &&
+      ((Wavefront = WavefrontWorkspaceSize(OldStringLength, NewStringLength, NULL)) > MemoryBudget)) {
+    Wavefront = 0;
+  }
+  if ((Size = ExactWorkspaceSize(OldStringLength, NewStringLength)) > MemoryBudget) {
+    if ((Size = LinearWorkspaceSize(OldStringLength, NewStringLength)) > MemoryBudget) { Size = MemoryBudget; }
+  }
+  return (Wavefront > Size) ? Wavefront : Size;
+}
+
+int ApplyEditScript( char *OldString,
+		     int OldStringLength,
+		     char *EditScript,
+		     int EditScriptLength,
+		     char *NewString,
+		     int NewStringLength)
+/*++
+
+  Description:
+
+    This routine applies the edit script to the old string and puts the results into the new string.
+
+    The basic algorithm is to have three active pointers to the old string, edit script and the new string.
+
+    If the current edit script is a delete, delete count then
+      skip over the old string by advancing its pointer by the delete count
+    If the current edit script is a keep, keep count thne
+      copy the count number of bytes from the old string to the new string advancing both pointers
+    If the current edit script is an insert, count then
+      copy the count number of bytes from the edit script to the new string advancing both pointers
+    If the current edit script is a replace, count then
+      do the same as for an insert and also skip over count bytes of the old string
+
+    Lastly, if we reach the end of the edit script and there are still more bytes in the old string then
+      copy over the remainder of the old string into the new string
+
+  Input:
+
+    OldString, OldStringLength: describe the first string that we are converting from
+
+    EditScript, EditScriptLength: describes the edit script that is to be applied to the Old String
+
+    NewString, NewStringLength: gets the results of applying the edit script to the old string
+
+  Output:
+
+    We return the number of bytes that we used in the NewString.  Or -1 if the NewStringLength is
+    too short to contain the needed string, QueryEditScriptLengths says how long it must be.  Or
+    -3 if the input is corrupt or does not fit the old string.
+
+--*/
+{
+  int OldStringIndex, EditScriptIndex, NewStringIndex;
+  unsigned char Opcode, Count;
+
+  OldStringIndex = EditScriptIndex = NewStringIndex = 0;
+
+  while (EditScriptIndex < EditScriptLength) {
+
+    Opcode = ((PEDIT_SCRIPT_ENTRY)EditScript)[EditScriptIndex].Opcode;
+    Count = ((PEDIT_SCRIPT_ENTRY)EditScript)[EditScriptIndex].Count+1; // account for the bias
+
+    if (Opcode == DeleteOpcode) {
+      if (Count > OldStringLength - OldStringIndex) return -3;
+      OldStringIndex += Count;
+    } else if (Opcode == KeepOpcode) {
+      if (Count > OldStringLength - OldStringIndex) return -3;
+      if (Count > NewStringLength - NewStringIndex) return -1;
+      memcpy(&NewString[NewStringIndex], &OldString[OldStringIndex], Count);
+      OldStringIndex += Count;
+      NewStringIndex += Count;
+    } else if ((Opcode == InsertOpcode) || (Opcode == ReplaceOpcode)) {
+      if (Count > EditScriptLength - EditScriptIndex - 1) return -3;
+      if ((Opcode == ReplaceOpcode) && (Count > OldStringLength - OldStringIndex)) return -3;
+      if (Count > NewStringLength - NewStringIndex) return -1;
+      memcpy(&NewString[NewStringIndex], &EditScript[EditScriptIndex+1], Count);
+      if (Opcode == ReplaceOpcode) { OldStringIndex += Count; }
+      EditScriptIndex += Count;
+      NewStringIndex += Count;
+    } else {
+      return -3;
+    }
+    EditScriptIndex += 1;
+  }
+
+  if (OldStringIndex < OldStringLength) {
+    if (OldStringLength - OldStringIndex > NewStringLength - NewStringIndex) return -1;
+    memcpy(&NewString[NewStringIndex], &OldString[OldStringIndex], OldStringLength - OldStringIndex);
+    NewStringIndex += OldStringLength - OldStringIndex;
+  }
+  return NewStringIndex;
+}
+
+int QueryEditScriptLengths (char *EditScript,
+			    int EditScriptLength,
+			    int OldStringLength,
+			    int *OldBytesConsumed)
+/*++
+
+  Description:
+
+    This routine returns the length of the new string that ApplyEditScript would produce,
+    so the caller can allocate exactly that much.  Only the entry headers are read, the
+    bytes carried by inserts and replaces are skipped over.
+
+  Input:
+
+    EditScript, EditScriptLength: describe the edit script.
+
+    OldStringLength: is the length of the old string the script applies to, or -1 if unknown.
+      When it is known the script is checked against it and the implicit trailing keep is
+      counted in the new length.
+
+    OldBytesConsumed: optionally receives how many bytes of the old string the script's keeps,
+      deletes, and replaces cover, not counting the implicit keep.
+
+  Output:
+
+    We return the length of the new string, or -3 if the script is corrupt, does not fit the
+    old string, or would produce a new string longer than an int can describe.
+
+--*/
+{
+  PEDIT_SCRIPT_ENTRY Entry;
+  long long OldIndex = 0, NewIndex = 0;
+  int EditScriptIndex = 0;
+
+  while (EditScriptIndex < EditScriptLength) {
+
+    Entry = &((PEDIT_SCRIPT_ENTRY)EditScript)[EditScriptIndex];
+    if ((Entry->Opcode == InsertOpcode) || (Entry->Opcode == ReplaceOpcode)) {
+      if (Entry->Count + 1 > EditScriptLength - EditScriptIndex - 1) { return -3; }
+      if (Entry->Opcode == ReplaceOpcode) { OldIndex += Entry->Count + 1; }
+      NewIndex += Entry->Count + 1;
+      EditScriptIndex += Entry->Count + 1;
+    } else if (Entry->Opcode == KeepOpcode) {
+      OldIndex += Entry->Count + 1;
+      NewIndex += Entry->Count + 1;
+    } else if (Entry->Opcode == DeleteOpcode) {
+      OldIndex += Entry->Count + 1;
+    } else {
+      return -3;
+    }
+    EditScriptIndex += 1;
+  }
+
+  if (OldStringLength >= 0) {
+    if (OldIndex > OldStringLength) { return -3; }
+    NewIndex += OldStringLength - OldIndex;
+  }
+  if ((NewIndex > 0x7fffffff) || (OldIndex > 0x7fffffff)) { return -3; }
+  if (OldBytesConsumed != NULL) { *OldBytesConsumed = (int)OldIndex; }
+  return (int)NewIndex;
+}
+
+void InitializeEditScriptCursor(PEDIT_SCRIPT_CURSOR Cursor,
+				char *EditScript,
+				int EditScriptLength,
+				int OldStringLength)
+/*++
+
+  Description:
+
+    This routine readies a cursor for walking the edit script with NextEditScriptOp.
+
+  Input:
+
+    EditScript, EditScriptLength: describe the edit script to walk.
+
+    OldStringLength: is the length of the old string the script applies to, or -1 if unknown.
+      When it is known the cursor also checks the script against it and reports the trailing
+      keep that ApplyEditScript performs implicitly.
+
+--*/
+{
+  Cursor->EditScript = EditScript;
+  Cursor->EditScriptLength = EditScriptLength;
+  Cursor->EditScriptIndex = 0;
+  Cursor->OldStringLength = OldStringLength;
+  Cursor->OldOffset = Cursor->NewOffset = 0;
+}
+
+int NextEditScriptOp(PEDIT_SCRIPT_CURSOR Cursor,
+		     PEDIT_OP Op,
+		     char **Literal)
+/*++
+
+  Description:
+
+    This routine decodes the next operation from the edit script.  Runs of keep or delete
+    entries are merged into a single operation.  Insert and replace entries are returned one
+    at a time, so that their bytes are always contiguous in the edit script.  Only the entries that are
+    returned get decoded, so a caller that stops early pays only for what it read.
+
+  Input:
+
+    Cursor: is the cursor set up by InitializeEditScriptCursor.
+
+    Op: receives the opcode, the offsets in the old and new strings where the operation
+      starts, and the number of bytes it covers.
+
+    Literal: optionally receives a pointer to the inserted bytes within the edit script, or
+      NULL if the operation is not an insert or a replace.
+
+  Output:
+
+    We return 1 if we decoded an operation, 0 at the end of the script, and -3 if the script
+    is corrupt.
+
+--*/
+{
+  PEDIT_SCRIPT_ENTRY Entry;
+  int Count;
+
+  if (Literal != NULL) { *Literal = NULL; }
+
+  if (Cursor->EditScriptIndex >= Cursor->EditScriptLength) {
+
+    //
+    //  Past the end of the script there may still be the implicit keep of the rest of the old string
+    //
+
+    if ((Cursor->OldStringLength < 0) || (Cursor->OldOffset >= Cursor->OldStringLength)) { return 0; }
+    Op->Opcode = KeepOpcode;
+    Op->OldOffset = Cursor->OldOffset;
+    Op->NewOffset = Cursor->NewOffset;
+    Op->Length = Cursor->OldStringLength - Cursor->OldOffset;
+    Cursor->NewOffset += Op->Length;
+    Cursor->OldOffset = Cursor->OldStringLength;
+    return 1;
+  }
+
+  Entry = (PEDIT_SCRIPT_ENTRY)&Cursor->EditScript[Cursor->EditScriptIndex];
+  Op->Opcode = Entry->Opcode;
+  Op->OldOffset = Cursor->OldOffset;
+  Op->NewOffset = Cursor->NewOffset;
+  Op->Length = 0;
+
+  if ((Entry->Opcode == InsertOpcode) || (Entry->Opcode == ReplaceOpcode)) {
+
+    Count = Entry->Count + 1; // account for the bias
+    if (Count > Cursor->EditScriptLength - Cursor->EditScriptIndex - 1) { return -3; }
+    if (Literal != NULL) { *Literal = &Cursor->EditScript[Cursor->EditScriptIndex + 1]; }
+    Cursor->EditScriptIndex += 1 + Count;
+    Cursor->NewOffset += Count;
+    Op->Length = Count;
+    if (Entry->Opcode == ReplaceOpcode) {
+      Cursor->OldOffset += Count;
+      if ((Cursor->OldStringLength >= 0) && (Cursor->OldOffset > Cursor->OldStringLength)) { return -3; }
+    }
+
+  } else if ((Entry->Opcode == DeleteOpcode) || (Entry->Opcode == KeepOpcode)) {
+
+    //
+    //  Soak up every following entry with the same opcode
+    //
+
+    while ((Cursor->EditScriptIndex < Cursor->EditScriptLength) && (Entry->Opcode == Op->Opcode)) {
+      Op->Length += Entry->Count + 1;
+      Cursor->EditScriptIndex += 1;
+      Entry++;
+    }
+    Cursor->OldOffset += Op->Length;
+    if (Op->Opcode == KeepOpcode) { Cursor->NewOffset += Op->Length; }
+    if ((Cursor->OldStringLength >= 0) && (Cursor->OldOffset > Cursor->OldStringLength)) { return -3; }
+
+  } else {
+    return -3;
+  }
+
+  return 1;
+}
+
+void InitializeApplyStream (PAPPLY_STREAM Stream,
+			    char *OldString,
+			    int OldStringLength,
+			    char *EditScript,
+			    int EditScriptLength)
+/*++
+
+  Description:
+
+    This routine readies a stream for producing the new string with ReadApplyStream or
+    WriteApplyStream.
+
+  Input:
+
+    OldString, OldStringLength: describe the string the edit script applies to.
+
+    EditScript, EditScriptLength: describe the edit script.
+
+--*/
+{
+  memset(Stream, 0, sizeof(APPLY_STREAM));
+  Stream->OldString = OldString;
+  InitializeEditScriptCursor(&Stream->Cursor, EditScript, EditScriptLength, OldStringLength);
+}
+
+int PeekApplyStream(PAPPLY_STREAM Stream, char **Data)
+/*++
+
+  Description:
+
+    This routine finds the next bytes of the new string that have not been produced yet.  They
+    are always contiguous, either in the old string or in the edit script.
+
+  Output:
+
+    We return how many bytes there are at *Data, 0 at the end of the new string, or -3 if the
+    edit script is corrupt.  An error sticks, so a stream that failed keeps failing.
+
+--*/
+{
+  int Status;
+
+  while ((Stream->Status == 0) && (Stream->SourceIndex >= Stream->Op.Length)) {
+
+    if ((Status = NextEditScriptOp(&Stream->Cursor, &Stream->Op, &Stream->Source)) <= 0) {
+      Stream->Status = (Status < 0) ? Status : 1;
+      break;
+    }
+    if (Stream->Op.Opcode == KeepOpcode) {
+      Stream->Source = &Stream->OldString[Stream->Op.OldOffset];
+    } else if (Stream->Op.Opcode == DeleteOpcode) {
+      Stream->Op.Length = 0;
+    }
+    Stream->SourceIndex = 0;
+  }
+
+  if (Stream->Status != 0) { return (Stream->Status < 0) ? Stream->Status : 0; }
+  *Data = &Stream->Source[Stream->SourceIndex];
+  return Stream->Op.Length - Stream->SourceIndex;
+}
+
+int ReadApplyStream (PAPPLY_STREAM Stream,
+		     char *Buffer,
+		     int BufferLength)
+/*++
+
+  Description:
+
+    This routine copies the next bytes of the new string into the buffer, filling as much of
+    it as the rest of the new string allows.
+
+  Input:
+
+    Stream: is the stream set up by InitializeApplyStream.
+
+    Buffer, BufferLength: receive the bytes.
+
+  Output:
+
+    We return how many bytes we copied, 0 once the whole new string has been produced, or -3
+    if the edit script is corrupt or does not fit the old string.  Bytes produced before the
+    corruption was found are returned first and the -3 comes on the next call.
+
+--*/
+{
+  char *Data;
+  int Length, Done = 0;
+
+  while (Done < BufferLength) {
+
+    if ((Length = PeekApplyStream(Stream, &Data)) <= 0) {
+      if ((Length < 0) && (Done == 0)) { return Length; }
+      break;
+    }
+    if (Length > BufferLength - Done) { Length = BufferLength - Done; }
+    memcpy(&Buffer[Done], Data, Length);
+    Stream->SourceIndex += Length;
+    Stream->NewOffset += Length;
+    Done += Length;
+  }
+  return Done;
+}
+
+int WriteApplyStream (PAPPLY_STREAM Stream,
+		      APPLY_SINK_ROUTINE SinkRoutine,
+		      void *SinkContext)
+/*++
+
+  Description:
+
+    This routine hands the rest of the new string to the sink routine, as many pieces as it
+    takes, until the sink stops taking bytes or the new string is done.
+
+  Input:
+
+    Stream: is the stream set up by InitializeApplyStream.
+
+    SinkRoutine, SinkContext: take the bytes, see APPLY_SINK_ROUTINE in diflib.h.
+
+  Output:
+
+    We return the length of the whole new string once all of it has been taken, -6 if the
+    sink took nothing and we should be called again once it can take more, -3 if the edit
+    script is corrupt or does not fit the old string or the sink claims to have taken more
+    than it was given, or the negative code the sink returned.
+
+--*/
+{
+  char *Data;
+  int Length, Taken;
+
+  for (;;) {
+
+    if ((Length = PeekApplyStream(Stream, &Data)) <= 0) {
+      return (Length < 0) ? Length : Stream->NewOffset;
+    }
+    if ((Taken = SinkRoutine(SinkContext, Data, Length)) < 0) { return Taken; }
+    if (Taken == 0) { return -6; }
+    if (Taken > Length) { return -3; }
+    Stream->SourceIndex += Taken;
+    Stream->NewOffset += Taken;
+  }
+}
+
+#ifdef _MAIN_
+
+//
+//  The test driver.  It diffs two strings and applies the script back, optionally with
+//  DIFF_OPTIONS flags, or applies a hand written script given in hex to check how the
+//  decoders take it.  An entry byte is the opcode times 64 plus the count less one, and
+//  EXPECTED is the new string or the error ApplyEditScript should return.  Any result that
+//  isn't what it should be is flagged with MISMATCH.
+//
+//    a.out OLD NEW
+//    a.out -f FLAGS OLD NEW
+//    a.out -a OLD SCRIPT EXPECTED
+//
+
+void main (int argc, char *argv[])
+{
+  //char OldString[128] = "quickfoxback!"; // "abcabba"; // "DEFJKL"; //"ABCABBA";
+  //char NewString[128] = "The quick brown fox jumped over the lazy dog's back!"; // "abcDEFghiJLK"; //JKLMNOPQRSTUVWXYZ"; //"CBABAC";
+  char EditScript[32768]; int EditScriptLength = 32768;
+  char *NewString; int NewStringLength;
+  DIFF_OPTIONS Options;
+  char Result[16];
+  unsigned int Byte;
+  int i;
+
+  //printf("sizeof(char) = %d\n", sizeof(char));
+  //printf("sizeof(int) = %d\n", sizeof(int));
   //printf("sizeof(short int) = %d\n", sizeof(short int));
   //printf("sizeof(double) = %d\n", sizeof(double));
   //printf("sizeof(long int) = %d\n", sizeof(long int));
   //printf("sizeof(long long int) = %d\n", sizeof(long long int));
   //printf("sizeof(EDIT_SCRIPT_TOKEN) = %d\n", sizeof(EDIT_SCRIPT_TOKEN));
 
-  printf("\n%s \"%s\" \"%s\"\n", argv[0], argv[1], argv[2]);
+  if ((argc == 5) && (strcmp(argv[1], "-a") == 0)) {
+    printf("\n%s -a \"%s\" %s \"%s\"\n", argv[0], argv[2], argv[3], argv[4]);
+    for (EditScriptLength = 0;
+	 (EditScriptLength < 128) && (sscanf(&argv[3][2*EditScriptLength], "%2x", &Byte) == 1);
+	 EditScriptLength++) {
+      EditScript[EditScriptLength] = (char)Byte;
+    }
+    NewStringLength = QueryEditScriptLengths(EditScript, EditScriptLength, strlen(argv[2]), NULL);
+    printf("QueryEditScriptLengths %d\n", NewStringLength);
+    NewString = malloc(((NewStringLength < 0) ? 128 : NewStringLength) + 1);
+    i = ApplyEditScript(argv[2], strlen(argv[2]), EditScript, EditScriptLength, NewString,
+			(NewStringLength < 0) ? 128 : NewStringLength);
+    if (i < 0) {
+      sprintf(Result, "%d", i);
+      printf("ApplyEditScript returned %d%s\n", i, (strcmp(Result, argv[4]) == 0) ? "" : " MISMATCH");
+    } else {
+      NewString[i] = 0;
+      printf("NewString Length=%d, \"%s\"%s\n", i, NewString, (strcmp(NewString, argv[4]) == 0) ? "" : " MISMATCH");
+    }
+    free(NewString);
+    return;
+  }
+
+  memset(&Options, 0, sizeof(Options));
+  printf("\n%s", argv[0]);
+  if ((argc == 5) && (strcmp(argv[1], "-f") == 0)) {
+    printf(" -f %s", argv[2]);
+    Options.Flags = (unsigned int)strtoul(argv[2], NULL, 0);
+    argv += 2;
+  }
+  printf(" \"%s\" \"%s\"\n", argv[1], argv[2]);
   EditScriptLength = 128;
-  i = ComputeEditScript(argv[1], strlen(argv[1]), argv[2], strlen(argv[2]), EditScript, EditScriptLength);
+  i = ComputeEditScriptEx(argv[1], strlen(argv[1]), argv[2], strlen(argv[2]), EditScript, EditScriptLength, &Options);
   if (i < 0) { 
     printf("ComputeEditScript Failure %d\n", i);
   } else {
     DebugPrintEditScript((PEDIT_SCRIPT_ENTRY)EditScript, i);
+    NewStringLength = QueryEditScriptLengths(EditScript, i, strlen(argv[1]), NULL);
+    NewString = malloc(NewStringLength + 1);
     i = ApplyEditScript( argv[1], strlen(argv[1]), EditScript, i, NewString, NewStringLength);
     if (i < 0 ) {
       printf("ApplyEditScriptFailure %d\n", i);
+      return;
     }
     NewString[i] = 0;
-    printf("NewString Length=%d, \"%s\"\n", i, NewString);
+    printf("NewString Length=%d, \"%s\"%s\n", i, NewString, (strcmp(NewString, argv[2]) == 0) ? "" : " MISMATCH");
+    free(NewString);
   }
 }
 #endif
@@ -1,10 +1,119 @@
 #ifndef _DIFLIB_
 #define _DIFLIB_
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+//
+//  The opcodes stored in the top two bits of each edit script entry.  A replace overwrites
+//  Count old bytes with the Count bytes that follow the entry, just like a delete followed by
+//  an insert but in half the entries.  Only DIFF_FLAG_SUBSTITUTIONS produces it.
+//
+
+#define ReplaceOpcode (0)
+#define InsertOpcode  (1)
+#define DeleteOpcode  (2)
+#define KeepOpcode    (3)
+
+//
+//  An edit operation describes one run of an edit script: its opcode, where it starts in
+//  the old and new strings, and how many bytes it covers.  The edit script cursor returns
+//  them, and ComputeEditOps produces an array of them in place of an edit script.
+//
+
+typedef struct _EDIT_OP_ {
+  int Opcode;
+  int OldOffset;
+  int NewOffset;
+  int Length;
+} EDIT_OP, *PEDIT_OP;
+
+//
+//  Options for ComputeEditScriptEx.  Callers should zero the whole structure and then fill
+//  in only the fields they care about, a zero field always means the default behavior.
+//
+//  MemoryBudget is the most workspace in bytes that one call may allocate, zero means no
+//  limit.  When the exact engine would need more than the budget we switch to a linear space
+//  engine, and when even that does not fit we diff the strings in partitions that do fit.
+//  Either way the result is a valid edit script, the fallbacks just may not be minimal.
+//
+//  CancelRoutine, if supplied, is polled every few thousand diagonals with CancelContext and
+//  returns nonzero to abandon the call.  TimeoutMilliseconds, if nonzero, abandons the call
+//  once it has run that long.  An abandoned call returns -4, unless Flags includes
+//  DIFF_FLAG_APPROXIMATE_ON_CANCEL in which case it returns a valid edit script built from
+//  the best path found so far and sets IsApproximate.
+//
+//  Workspace and WorkspaceLength optionally supply scratch memory for the engines.  When it is
+//  large enough for the engine we pick we use it instead of calling malloc, QueryWorkspaceSize
+//  tells how much is enough.  The memory budget still decides which engine we pick.
+//
+//  BaseCache, if supplied, is a cache from CreateBaseCache.  The OldString is looked up in it
+//  by content and the call is then computed like ComputeEditScriptFromBase against the cached
+//  prepared base, building and caching that base on a miss.
+//
+//  Flags may also include DIFF_FLAG_SNAPSHOT when the two strings are successive snapshots of
+//  the same memory.  Then they are compared SNAPSHOT_PAGE_SIZE bytes at a time at equal
+//  offsets, identical pages are kept without further work, and only the pages that differ
+//  are diffed, each on its own.  Unless the caller sets a memory budget each dirty page is
+//  diffed in partitions of a few hundred bytes.  The result is a valid edit script.
+//
+//  Flags may instead include DIFF_FLAG_CONTENT_CHUNKS for large inputs where content may have
+//  moved.  Both strings are split into content defined chunks, see ComputeContentChunks, the
+//  chunks are matched by hash, and only the bytes between matched chunks are diffed.  Unless
+//  the caller sets a memory budget those gaps are diffed with the linear engine or smaller.
+//
+//  Flags may also include DIFF_FLAG_SUBSTITUTIONS, alone or with one of the modes above, when
+//  the strings differ mostly in bytes that changed in place.  Then replacing a byte costs one
+//  edit instead of a delete and an insert, a change that deletes and inserts as many bytes is
+//  written as a single replace, and the script needs ReplaceOpcode aware decoders.  Ranges
+//  whose differences are small enough for the budget are solved minimally under that cost,
+//  the rest by the usual engines with their deletes and inserts paired up into replaces.
+//
+//  Flags may also include DIFF_FLAG_WAVEFRONT for DNA and other small alphabet data, where
+//  matches are everywhere but short.  Then ranges of up to 65534 bytes, old and new together,
+//  are solved minimally by filling in the whole edit table an anti-diagonal at a time, with
+//  SIMD lanes where the compiler targets them, in place of Myers' search.  That costs the
+//  same however alike the strings are, so it pays off only when they differ a lot.  Its
+//  memory grows with about (N+M)^1.5, and ranges that are longer or don't fit the budget use
+//  the usual engines.  It honors DIFF_FLAG_SUBSTITUTIONS.
+//
+//  Flags may also include DIFF_FLAG_LCE when the strings differ in many places between long
+//  runs they share.  Then each range is first indexed with a suffix array, and every snake
+//  is found with one constant time longest common extension query instead of a byte by byte
+//  compare, so the search costs O(N+M+D^2) however long the snakes are.  The index needs
+//  about 24 bytes per byte of the range and the search (D+1)^2 ints.  When the search won't
+//  fit the budget the linear engine takes over with a second, reverse index, and ranges
+//  where the indexes won't fit use the other engines.  Building the index costs more than
+//  Myers' compares save unless D is large and the snakes long, so the flag is off unless
+//  asked for.  It honors DIFF_FLAG_SUBSTITUTIONS.
+//
+
+typedef struct _BASE_CACHE_ BASE_CACHE, *PBASE_CACHE;
+
+#define DIFF_FLAG_APPROXIMATE_ON_CANCEL (0x00000001)
+#define DIFF_FLAG_SNAPSHOT              (0x00000002)
+#define DIFF_FLAG_CONTENT_CHUNKS        (0x00000004)
+#define DIFF_FLAG_SUBSTITUTIONS         (0x00000008)
+#define DIFF_FLAG_WAVEFRONT             (0x00000010)
+#define DIFF_FLAG_LCE                   (0x00000020)
+
+#define SNAPSHOT_PAGE_SIZE (4096)
+
+typedef struct _DIFF_OPTIONS_ {
+  size_t MemoryBudget;
+  int (*CancelRoutine)(void *CancelContext);
+  void *CancelContext;
+  unsigned int TimeoutMilliseconds;
+  unsigned int Flags;
+  int IsApproximate;       // output, set if the edit script is only approximate
+  void *Workspace;
+  size_t WorkspaceLength;
+  PBASE_CACHE BaseCache;
+} DIFF_OPTIONS, *PDIFF_OPTIONS;
+
 int ComputeEditScript (char *OldString,
 		       int OldStringLength,
 		       char *NewString,
@@ -12,6 +121,35 @@ int ComputeEditScript (char *OldString,
 		       char *EditScript,
 		       int EditScriptLength);
 
+int ComputeEditScriptEx (char *OldString,
+			 int OldStringLength,
+			 char *NewString,
+			 int NewStringLength,
+			 char *EditScript,
+			 int EditScriptLength,
+			 PDIFF_OPTIONS Options);
+
+int ComputeEditOps (char *OldString,
+		    int OldStringLength,
+		    char *NewString,
+		    int NewStringLength,
+		    PEDIT_OP Ops,
+		    int OpsLength,
+		    PDIFF_OPTIONS Options);
+
+int MaxEditScriptLength (int OldStringLength,
+			 int NewStringLength);
+
+size_t QueryWorkspaceSize (int OldStringLength,
+			   int NewStringLength,
+			   PDIFF_OPTIONS Options);
+
+//
+//  ApplyEditScript needs room in the NewString for exactly the length QueryEditScriptLengths
+//  returns.  That walks only the entry headers, so it costs one step per entry rather than
+//  one per byte.
+//
+
 int ApplyEditScript( char *OldString,
 		     int OldStringLength,
 		     char *EditScript,
@@ -19,6 +157,467 @@ int ApplyEditScript( char *OldString,
 		     char *NewString,
 		     int NewStringLength);
 
+int QueryEditScriptLengths (char *EditScript,
+			    int EditScriptLength,
+			    int OldStringLength,
+			    int *OldBytesConsumed);
+
+//
+//  ComputeEditScriptSegments diffs strings that are stored in pieces, such as ropes or chunk
+//  lists, each described by an array of DIFF_SEGMENTs in the manner of an iovec.  The common
+//  prefix and suffix are found across segment boundaries without joining the segments, and
+//  only the middle where the strings differ is gathered for the engines when it spans more
+//  than one segment.
+//
+
+typedef struct _DIFF_SEGMENT_ {
+  char *Data;
+  int Length;
+} DIFF_SEGMENT, *PDIFF_SEGMENT;
+
+int ComputeEditScriptSegments (PDIFF_SEGMENT OldSegments,
+			       int OldSegmentCount,
+			       PDIFF_SEGMENT NewSegments,
+			       int NewSegmentCount,
+			       char *EditScript,
+			       int EditScriptLength,
+			       PDIFF_OPTIONS Options);
+
+//
+//  The edit script cursor decodes an edit script one operation at a time without applying
+//  it.  Initialize it with InitializeEditScriptCursor and then call NextEditScriptOp until it
+//  returns 0.  The cursor fields are private to diflib.
+//
+
+typedef struct _EDIT_SCRIPT_CURSOR_ {
+  char *EditScript;
+  int EditScriptLength;
+  int EditScriptIndex;
+  int OldStringLength;
+  int OldOffset, NewOffset;
+} EDIT_SCRIPT_CURSOR, *PEDIT_SCRIPT_CURSOR;
+
+void InitializeEditScriptCursor(PEDIT_SCRIPT_CURSOR Cursor,
+				char *EditScript,
+				int EditScriptLength,
+				int OldStringLength);
+
+int NextEditScriptOp(PEDIT_SCRIPT_CURSOR Cursor,
+		     PEDIT_OP Op,
+		     char **Literal);
+
+//
+//  An apply stream produces the new string of ApplyEditScript a piece at a time, for callers
+//  that can't or don't want to hold all of it at once.  Initialize it with
+//  InitializeApplyStream and then either pull the new string with ReadApplyStream, which
+//  fills as much of the buffer it is given as it can and suits a ring buffer called once per
+//  contiguous free span, or push it with WriteApplyStream to a sink routine.  The sink is
+//  handed pointers straight into the old string and the edit script and returns how many of
+//  the bytes it took, 0 when it can take none right now, or a negative code to give up.  When
+//  the sink takes nothing WriteApplyStream returns -6, and calling it again later resumes
+//  where it stopped.  Both routines may be mixed on one stream.  The stream fields are
+//  private to diflib, and the strings must stay put until the stream is finished.
+//
+
+typedef int (*APPLY_SINK_ROUTINE)(void *SinkContext,
+				  char *Data,
+				  int Length);
+
+typedef struct _APPLY_STREAM_ {
+  char *OldString;
+  EDIT_SCRIPT_CURSOR Cursor;
+  EDIT_OP Op;
+  char *Source;
+  int SourceIndex;
+  int NewOffset;
+  int Status;
+} APPLY_STREAM, *PAPPLY_STREAM;
+
+void InitializeApplyStream (PAPPLY_STREAM Stream,
+			    char *OldString,
+			    int OldStringLength,
+			    char *EditScript,
+			    int EditScriptLength);
+
+int ReadApplyStream (PAPPLY_STREAM Stream,
+		     char *Buffer,
+		     int BufferLength);
+
+int WriteApplyStream (PAPPLY_STREAM Stream,
+		      APPLY_SINK_ROUTINE SinkRoutine,
+		      void *SinkContext);
+
+//
+//  A prepared base indexes an OldString once so that many new strings can be diffed against
+//  it cheaply.  CreatePreparedBase hashes every BlockLength bytes of the OldString, zero means
+//  the default of 32.  The base refers to the caller's OldString, which must stay unchanged
+//  until the base is destroyed.  A base is never modified after it is created, so any number
+//  of threads may call ComputeEditScriptFromBase on it at the same time.
+//
+//  ComputeEditScriptFromBase finds blocks of the OldString in the new string, keeps the
+//  longest matches that occur in order in both strings, and diffs only the gaps between them
+//  with the usual engines.  The result is a valid edit script for ApplyEditScript, but like
+//  the partitioned fallback it is not necessarily minimal.
+//
+
+typedef struct _PREPARED_BASE_ PREPARED_BASE, *PPREPARED_BASE;
+
+int CreatePreparedBase (char *OldString,
+			int OldStringLength,
+			int BlockLength,
+			PPREPARED_BASE *Base);
+
+void DestroyPreparedBase (PPREPARED_BASE Base);
+
+int ComputeEditScriptFromBase (PPREPARED_BASE Base,
+			       char *NewString,
+			       int NewStringLength,
+			       char *EditScript,
+			       int EditScriptLength,
+			       PDIFF_OPTIONS Options);
+
+//
+//  A base cache keeps prepared bases for the OldStrings it has seen, keyed by a hash of their
+//  contents, so that the callers of ComputeEditScriptEx and ComputeEditOps need not know which
+//  of their OldStrings are worth preparing.  Each cached base holds its own copy of the
+//  OldString.  Once the bases take more than ByteBudget bytes the least recently used ones
+//  are evicted.  OldStrings shorter than BASE_CACHE_MIN_LENGTH are never cached, they are
+//  cheaper to diff directly.  BlockLength is passed to CreatePreparedBase.  A cache may be
+//  shared by any number of threads.
+//
+
+#define BASE_CACHE_MIN_LENGTH (4096)
+
+int CreateBaseCache (size_t ByteBudget,
+		     int BlockLength,
+		     PBASE_CACHE *Cache);
+
+void DestroyBaseCache (PBASE_CACHE Cache);
+
+void QueryBaseCacheStatistics (PBASE_CACHE Cache,
+			       unsigned long long *Hits,
+			       unsigned long long *Misses,
+			       size_t *Size);
+
+//
+//  An edit plan is an edit script decoded once so that it can be applied to many old strings,
+//  for example several copies of a base that differ only in bytes the script keeps.  The plan
+//  is just a list of copies from the old string or from its own pool of inserted bytes, and
+//  it is checked against each old string once rather than once per operation.
+//
+//  ApplyEditPlan works like ApplyEditScript.
+//  ApplyEditPlanParallel applies the plan to every target using up to ThreadCount threads,
+//  zero meaning one per processor, and sets each target's Result to what ApplyEditPlan
+//  returned for it.  A plan is never modified once created, so it can be shared freely.
+//
+
+typedef struct _EDIT_PLAN_ EDIT_PLAN, *PEDIT_PLAN;
+
+typedef struct _EDIT_PLAN_TARGET_ {
+  char *OldString;
+  int OldStringLength;
+  char *NewString;
+  int NewStringLength;
+  int Result;              // output, the length of the new string or a negative error
+} EDIT_PLAN_TARGET, *PEDIT_PLAN_TARGET;
+
+int CreateEditPlan (char *EditScript,
+		    int EditScriptLength,
+		    PEDIT_PLAN *Plan);
+
+void DestroyEditPlan (PEDIT_PLAN Plan);
+
+int QueryEditPlanLength (PEDIT_PLAN Plan,
+			 int OldStringLength);
+
+int ApplyEditPlan (PEDIT_PLAN Plan,
+		   char *OldString,
+		   int OldStringLength,
+		   char *NewString,
+		   int NewStringLength);
+
+int ApplyEditPlanParallel (PEDIT_PLAN Plan,
+			   PEDIT_PLAN_TARGET Targets,
+			   int TargetCount,
+			   int ThreadCount);
+
+//
+//  A Merkle tree holds the hashes of a string's LeafLength byte leaves, and hashes of those
+//  hashes in pairs up to a single root.  ComputeMerkleEditScript compares the trees of two
+//  strings from the root down, keeps every subtree whose hash matches without reading its
+//  bytes, and diffs only the leaves that differ, so its cost follows the amount of change.
+//  Like DIFF_FLAG_SNAPSHOT it compares the strings at equal offsets.  The leaf hashes can be
+//  saved with QueryMerkleLeafHashes and the tree rebuilt later with
+//  CreateMerkleTreeFromLeafHashes, so an unchanged input never has to be hashed again.
+//
+
+typedef struct _MERKLE_TREE_ MERKLE_TREE, *PMERKLE_TREE;
+
+int CreateMerkleTree (char *String,
+		      int StringLength,
+		      int LeafLength,
+		      PMERKLE_TREE *Tree);
+
+int CreateMerkleTreeFromLeafHashes (unsigned long long *LeafHashes,
+				    int StringLength,
+				    int LeafLength,
+				    PMERKLE_TREE *Tree);
+
+int QueryMerkleLeafHashes (PMERKLE_TREE Tree,
+			   unsigned long long *LeafHashes,
+			   int LeafHashesLength);
+
+void DestroyMerkleTree (PMERKLE_TREE Tree);
+
+int ComputeMerkleEditScript (char *OldString,
+			     int OldStringLength,
+			     PMERKLE_TREE OldTree,
+			     char *NewString,
+			     int NewStringLength,
+			     PMERKLE_TREE NewTree,
+			     char *EditScript,
+			     int EditScriptLength,
+			     PDIFF_OPTIONS Options);
+
+//
+//  ComputeContentChunks splits a string into chunks whose boundaries depend only on the
+//  bytes around them, so that an insertion or deletion moves only the nearby boundaries.
+//  Chunks average about AverageLength bytes.
+//
+
+#define CDC_DEFAULT_AVERAGE_LENGTH (8192)
+
+int ComputeContentChunks (char *String,
+			  int StringLength,
+			  int AverageLength,
+			  int *ChunkEnds,
+			  int ChunkEndsLength);
+
+//
+//  Signatures let the old string stay where it is.  ComputeSignature reduces the old string
+//  to a weak and a strong checksum per BlockLength bytes, about 0.6% of its size with the
+//  default blocks.  ComputeSignatureDelta then needs only that signature and the new string
+//  to produce a delta of block copies and literal bytes, and ApplySignatureDelta rebuilds
+//  the new string from the old string and the delta.  The delta is a separate format from an
+//  edit script, and carries a hash of the new string that ApplySignatureDelta checks.  The
+//  Parallel variants spread the work over ThreadCount threads, zero meaning one per processor.
+//
+
+#define SIGNATURE_DEFAULT_BLOCK_LENGTH (2048)
+#define SIGNATURE_MIN_BLOCK_LENGTH (64)
+
+int MaxSignatureLength (int OldStringLength,
+			int BlockLength);
+
+int ComputeSignature (char *OldString,
+		      int OldStringLength,
+		      int BlockLength,
+		      char *Signature,
+		      int SignatureLength);
+
+int ComputeSignatureParallel (char *OldString,
+			      int OldStringLength,
+			      int BlockLength,
+			      char *Signature,
+			      int SignatureLength,
+			      int ThreadCount);
+
+int MaxSignatureDeltaLength (int NewStringLength);
+
+int ComputeSignatureDelta (char *Signature,
+			   int SignatureLength,
+			   char *NewString,
+			   int NewStringLength,
+			   char *Delta,
+			   int DeltaLength,
+			   PDIFF_OPTIONS Options);
+
+int ComputeSignatureDeltaParallel (char *Signature,
+				   int SignatureLength,
+				   char *NewString,
+				   int NewStringLength,
+				   char *Delta,
+				   int DeltaLength,
+				   PDIFF_OPTIONS Options,
+				   int ThreadCount);
+
+int ApplySignatureDelta (char *OldString,
+			 int OldStringLength,
+			 char *Delta,
+			 int DeltaLength,
+			 char *NewString,
+			 int NewStringLength);
+
+//
+//  A pack file stores many edit scripts under 64 bit ids.  CreatePackWriter starts a new
+//  pack, AppendPackScript adds scripts to the end of it one after the other, and
+//  FinishPackWriter appends an index sorted by id, with an optional bloom filter.  OpenPack
+//  maps a finished pack and LookupPackScript finds a script in it by id, reading about one
+//  index entry, and returns a pointer into the mapping that can go straight to
+//  ApplyEditScript.  These routines return -5 when the file itself can't be read or written.
+//
+
+typedef struct _PACK_WRITER_ PACK_WRITER, *PPACK_WRITER;
+typedef struct _PACK_ PACK, *PPACK;
+
+#define PACK_FLAG_BLOOM_FILTER (0x00000001)
+
+int CreatePackWriter (const char *Path,
+		      unsigned int Flags,
+		      PPACK_WRITER *Writer);
+
+int AppendPackScript (PPACK_WRITER Writer,
+		      unsigned long long Id,
+		      char *EditScript,
+		      int EditScriptLength);
+
+int FinishPackWriter (PPACK_WRITER Writer);
+
+int OpenPack (const char *Path,
+	      PPACK *Pack);
+
+void ClosePack (PPACK Pack);
+
+int LookupPackScript (PPACK Pack,
+		      unsigned long long Id,
+		      char **EditScript,
+		      int *EditScriptLength);
+
+//
+//  A version cache rebuilds versions of an object that is stored as a chain of edit scripts,
+//  each version an edit script against its parent down to a base stored whole.  The caller
+//  describes one version at a time through FetchRoutine, which fills in a VERSION_RECORD and
+//  returns 0, or a negative code that AcquireVersion passes back.  The record's Data must stay
+//  valid until the AcquireVersion call that fetched it returns, so for instance a script from
+//  LookupPackScript can be handed over as is.  FetchRoutine may be called by several threads
+//  at once.
+//
+//  AcquireVersion keeps the versions it rebuilds, up to ByteBudget bytes with the least
+//  recently used evicted first, and rebuilds a version from its nearest cached ancestor.
+//  Threads that ask for a version another thread is rebuilding wait and share its result.
+//  The data stays valid, and must not be modified, until the handle is released.
+//
+
+typedef struct _VERSION_CACHE_ VERSION_CACHE, *PVERSION_CACHE;
+typedef struct _VERSION_HANDLE_ VERSION_HANDLE, *PVERSION_HANDLE;
+
+typedef struct _VERSION_RECORD_ {
+  int IsBase;                 // set if Data is the whole version rather than an edit script
+  unsigned long long Parent;  // the version the edit script applies to
+  char *Data;
+  int DataLength;
+} VERSION_RECORD, *PVERSION_RECORD;
+
+typedef int (*VERSION_FETCH_ROUTINE)(void *FetchContext,
+				     unsigned long long Version,
+				     PVERSION_RECORD Record);
+
+int CreateVersionCache (size_t ByteBudget,
+			VERSION_FETCH_ROUTINE FetchRoutine,
+			void *FetchContext,
+			PVERSION_CACHE *Cache);
+
+void DestroyVersionCache (PVERSION_CACHE Cache);
+
+int AcquireVersion (PVERSION_CACHE Cache,
+		    unsigned long long Version,
+		    PVERSION_HANDLE *Handle,
+		    char **Data,
+		    int *DataLength);
+
+void ReleaseVersion (PVERSION_CACHE Cache,
+		     PVERSION_HANDLE Handle);
+
+void QueryVersionCacheStatistics (PVERSION_CACHE Cache,
+				  unsigned long long *Hits,
+				  unsigned long long *Misses,
+				  size_t *Size);
+
+//
+//  ComputeEditDistance returns how many bytes a minimal edit script for two strings would
+//  delete and insert, without building the script, in memory proportional to the distance.
+//  ComputeEditDistanceMatrix does the same for every pair of a set of strings, as for
+//  clustering, and stores the distance between strings i < j at EDIT_DISTANCE_INDEX.  With a
+//  MaxDistance of zero or more, distances beyond it are only reported as MaxDistance+1, which
+//  is much cheaper to find.
+//
+
+#define EDIT_DISTANCE_INDEX(Count, i, j) ((size_t)(i) * (2 * (size_t)(Count) - (i) - 1) / 2 + ((j) - (i) - 1))
+
+int ComputeEditDistance (char *OldString,
+			 int OldStringLength,
+			 char *NewString,
+			 int NewStringLength,
+			 int MaxDistance);
+
+int ComputeEditDistanceMatrix (char **Strings,
+			       int *Lengths,
+			       int Count,
+			       int MaxDistance,
+			       int *Distances);
+
+int ComputeEditDistanceMatrixParallel (char **Strings,
+				       int *Lengths,
+				       int Count,
+				       int MaxDistance,
+				       int *Distances,
+				       int ThreadCount);
+
+//
+//  Sketches find the strings in a large set that are worth diffing against each other.  A
+//  sketch is a MinHash summary of a string's 8 byte shingles, built in one pass over the
+//  string, which may arrive in pieces: InitializeSketch, UpdateSketch per piece, and then
+//  FinishSketch, or ComputeSketch for a whole string.  CompareSketches counts the bins two
+//  sketches agree on, out of SKETCH_SIZE, an estimate of the strings' similarity.  The
+//  sketch fields are private to diflib.
+//
+//  A sketch index finds candidates without comparing a sketch against every other one.
+//  InsertSketch files sketches under the caller's ids and QuerySketchCandidates returns the
+//  ids of those likely to be similar to a given sketch, best first.  Any number of threads
+//  may query an index at once, as long as none is inserting.
+//
+
+#define SKETCH_SIZE_LOG2 (7)
+#define SKETCH_SIZE (1 << SKETCH_SIZE_LOG2)
+#define SKETCH_DEFAULT_BAND_COUNT (32)
+
+typedef struct _SKETCH_ {
+  unsigned int Minima[SKETCH_SIZE];
+  unsigned long long Window;
+  long long Length;
+} SKETCH, *PSKETCH;
+
+typedef struct _SKETCH_INDEX_ SKETCH_INDEX, *PSKETCH_INDEX;
+
+void InitializeSketch (PSKETCH Sketch);
+
+void UpdateSketch (PSKETCH Sketch,
+		   char *Data,
+		   int Length);
+
+void FinishSketch (PSKETCH Sketch);
+
+void ComputeSketch (char *Data,
+		    int Length,
+		    PSKETCH Sketch);
+
+int CompareSketches (PSKETCH Sketch1,
+		     PSKETCH Sketch2);
+
+int CreateSketchIndex (int BandCount,
+		       PSKETCH_INDEX *Index);
+
+void DestroySketchIndex (PSKETCH_INDEX Index);
+
+int InsertSketch (PSKETCH_INDEX Index,
+		  unsigned long long Id,
+		  PSKETCH Sketch);
+
+int QuerySketchCandidates (PSKETCH_INDEX Index,
+			   PSKETCH Sketch,
+			   unsigned long long *Ids,
+			   int IdsLength);
+
 #ifdef __cplusplus
 }
 #endif
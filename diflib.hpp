@@ -0,0 +1,641 @@
+#ifndef _DIFLIB_HPP_
+#define _DIFLIB_HPP_
+
+//
+//  C++17 interface to diflib.  It takes string_view (or byte span under C++20) inputs, sizes the
+//  edit script buffer exactly once with MaxEditScriptLength, and hands back a move-only
+//  edit_script that owns its bytes.  Buffers come from a std::pmr::memory_resource, and the
+//  engine workspace is reused per thread, so a diff costs one allocation for the result.
+//
+//  Errors from the C routines are reported by throwing diflib::error with the C return code.
+//
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+#include "diflib.h"
+
+namespace diflib {
+
+class error : public std::runtime_error {
+public:
+  explicit error(int code) : std::runtime_error(describe(code)), code_(code) {}
+
+  int code() const noexcept { return code_; }
+
+  static const char *describe(int code) noexcept
+  {
+    switch (code) {
+    case -1: return "diflib: output buffer too small";
+    case -2: return "diflib: out of memory or memory budget too small";
+    case -3: return "diflib: internal error or corrupt edit script";
+    case -4: return "diflib: cancelled";
+    case -5: return "diflib: file could not be read or written";
+    case -6: return "diflib: would block";
+    default: return "diflib: unknown error";
+    }
+  }
+
+private:
+  int code_;
+};
+
+//
+//  An edit script owns a buffer allocated from a memory resource.  It can be moved but not
+//  copied, so handing one around never duplicates the script bytes.
+//
+
+class edit_script {
+public:
+  explicit edit_script(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) noexcept
+    : resource_(resource) {}
+
+  edit_script(edit_script &&other) noexcept
+    : resource_(other.resource_),
+      data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)),
+      capacity_(std::exchange(other.capacity_, 0)) {}
+
+  edit_script &operator=(edit_script &&other) noexcept
+  {
+    if (this != &other) {
+      release();
+      resource_ = other.resource_;
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+      capacity_ = std::exchange(other.capacity_, 0);
+    }
+    return *this;
+  }
+
+  edit_script(const edit_script &) = delete;
+  edit_script &operator=(const edit_script &) = delete;
+
+  ~edit_script() { release(); }
+
+  const char *data() const noexcept { return data_; }
+  char *data() noexcept { return data_; }
+  std::size_t size() const noexcept { return size_; }
+  bool empty() const noexcept { return size_ == 0; }
+  std::string_view view() const noexcept { return std::string_view(data_, size_); }
+  std::pmr::memory_resource *resource() const noexcept { return resource_; }
+#if __cplusplus >= 202002L
+  std::span<const char> bytes() const noexcept { return std::span<const char>(data_, size_); }
+#endif
+
+  //
+  //  Make room for at least capacity bytes, the contents are left uninitialized.  This is
+  //  only used while the script is being computed, and it throws std::bad_alloc on failure.
+  //
+
+  void reserve_uninitialized(std::size_t capacity)
+  {
+    if (capacity > capacity_) {
+      release();
+      data_ = static_cast<char *>(resource_->allocate(capacity, 1));
+      capacity_ = capacity;
+    }
+    size_ = 0;
+  }
+
+  void set_size(std::size_t size) noexcept { size_ = size; }
+
+  std::size_t capacity() const noexcept { return capacity_; }
+
+private:
+  void release() noexcept
+  {
+    if (data_ != nullptr) { resource_->deallocate(data_, capacity_, 1); }
+    data_ = nullptr;
+    size_ = capacity_ = 0;
+  }
+
+  std::pmr::memory_resource *resource_;
+  char *data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t capacity_ = 0;
+};
+
+namespace detail {
+
+//
+//  The engines' workspace is kept per thread and reused across calls.  Workspaces larger than
+//  max_thread_workspace are not kept around, the engine allocates those itself.
+//
+
+inline constexpr std::size_t max_thread_workspace = std::size_t(64) << 20;
+
+struct thread_workspace {
+  std::unique_ptr<unsigned char[]> buffer;
+  std::size_t length = 0;
+};
+
+inline void attach_thread_workspace(DIFF_OPTIONS &options, std::size_t old_length, std::size_t new_length)
+{
+  thread_local thread_workspace workspace;
+  std::size_t size;
+
+  if (options.Workspace != nullptr) { return; }
+  size = QueryWorkspaceSize(int(old_length), int(new_length), &options);
+  if (size > max_thread_workspace) { return; }
+  if (workspace.length < size) {
+    workspace.buffer.reset(new unsigned char[size]);
+    workspace.length = size;
+  }
+  options.Workspace = workspace.buffer.get();
+  options.WorkspaceLength = workspace.length;
+}
+
+inline int checked_length(std::size_t length)
+{
+  if (length > std::size_t(INT_MAX)) { throw std::length_error("diflib: input longer than INT_MAX"); }
+  return int(length);
+}
+
+inline char *mutable_chars(std::string_view s) noexcept
+{
+  //
+  //  The C routines never write to their input strings, they are just not declared const
+  //
+
+  return const_cast<char *>(s.data());
+}
+
+} // namespace detail
+
+//
+//  Compute the edit script that turns old_string into new_string.  The options are copied,
+//  so the caller's copy is only written back to for IsApproximate.
+//
+
+inline edit_script compute(std::string_view old_string,
+			   std::string_view new_string,
+			   DIFF_OPTIONS *options = nullptr,
+			   std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+{
+  DIFF_OPTIONS local = (options != nullptr) ? *options : DIFF_OPTIONS{};
+  edit_script script(resource);
+  int old_length = detail::checked_length(old_string.size());
+  int new_length = detail::checked_length(new_string.size());
+  int length;
+
+  detail::attach_thread_workspace(local, old_string.size(), new_string.size());
+  script.reserve_uninitialized(std::size_t(MaxEditScriptLength(old_length, new_length)));
+  length = ComputeEditScriptEx(detail::mutable_chars(old_string), old_length,
+			       detail::mutable_chars(new_string), new_length,
+			       script.data(), int(script.capacity()), &local);
+  if (options != nullptr) { options->IsApproximate = local.IsApproximate; }
+  if (length < 0) { throw error(length); }
+  script.set_size(std::size_t(length));
+  return script;
+}
+
+//
+//  Compute just the alignment of the two strings, as EDIT_OP records covering both of them
+//
+
+inline std::pmr::vector<EDIT_OP> compute_ops(std::string_view old_string,
+					     std::string_view new_string,
+					     DIFF_OPTIONS *options = nullptr,
+					     std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+{
+  DIFF_OPTIONS local = (options != nullptr) ? *options : DIFF_OPTIONS{};
+  int old_length = detail::checked_length(old_string.size());
+  int new_length = detail::checked_length(new_string.size());
+  std::pmr::vector<EDIT_OP> ops(std::size_t(old_length) + std::size_t(new_length), resource);
+  int count;
+
+  detail::attach_thread_workspace(local, old_string.size(), new_string.size());
+  count = ComputeEditOps(detail::mutable_chars(old_string), old_length,
+			 detail::mutable_chars(new_string), new_length,
+			 ops.data(), detail::checked_length(ops.size()), &local);
+  if (options != nullptr) { options->IsApproximate = local.IsApproximate; }
+  if (count < 0) { throw error(count); }
+  ops.resize(std::size_t(count));
+  return ops;
+}
+
+//
+//  A prepared base owns the index built by CreatePreparedBase.  The old string it indexes is
+//  not copied and must outlive the base.  compute may be called from many threads at once.
+//
+
+class prepared_base {
+public:
+  explicit prepared_base(std::string_view old_string, int block_length = 0)
+    : old_string_(old_string)
+  {
+    PPREPARED_BASE base;
+    int status = CreatePreparedBase(detail::mutable_chars(old_string), detail::checked_length(old_string.size()),
+				    block_length, &base);
+    if (status < 0) { throw error(status); }
+    base_.reset(base);
+  }
+
+  std::string_view old_string() const noexcept { return old_string_; }
+  PPREPARED_BASE get() const noexcept { return base_.get(); }
+
+  edit_script compute(std::string_view new_string,
+		      DIFF_OPTIONS *options = nullptr,
+		      std::pmr::memory_resource *resource = std::pmr::get_default_resource()) const
+  {
+    DIFF_OPTIONS local = (options != nullptr) ? *options : DIFF_OPTIONS{};
+    edit_script script(resource);
+    int new_length = detail::checked_length(new_string.size());
+    int length;
+
+    script.reserve_uninitialized(std::size_t(MaxEditScriptLength(int(old_string_.size()), new_length)));
+    length = ComputeEditScriptFromBase(base_.get(), detail::mutable_chars(new_string), new_length,
+				       script.data(), int(script.capacity()), &local);
+    if (options != nullptr) { options->IsApproximate = local.IsApproximate; }
+    if (length < 0) { throw error(length); }
+    script.set_size(std::size_t(length));
+    return script;
+  }
+
+private:
+  struct destroy {
+    void operator()(PPREPARED_BASE base) const noexcept { DestroyPreparedBase(base); }
+  };
+
+  std::string_view old_string_;
+  std::unique_ptr<PREPARED_BASE, destroy> base_;
+};
+
+//
+//  A base cache owns a BASE_CACHE.  Point DIFF_OPTIONS::BaseCache at get() to have compute and
+//  compute_ops look their old strings up in it.
+//
+
+class base_cache {
+public:
+  explicit base_cache(std::size_t byte_budget, int block_length = 0)
+  {
+    PBASE_CACHE cache;
+    int status = CreateBaseCache(byte_budget, block_length, &cache);
+    if (status < 0) { throw error(status); }
+    cache_.reset(cache);
+  }
+
+  PBASE_CACHE get() const noexcept { return cache_.get(); }
+
+private:
+  struct destroy {
+    void operator()(PBASE_CACHE cache) const noexcept { DestroyBaseCache(cache); }
+  };
+
+  std::unique_ptr<BASE_CACHE, destroy> cache_;
+};
+
+//
+//  Apply an edit script to old_string.  The first form writes into a caller supplied buffer
+//  and returns the number of bytes used, the second returns a string from the resource.
+//
+
+inline std::size_t apply(std::string_view old_string,
+			 std::string_view script,
+			 char *output,
+			 std::size_t output_length)
+{
+  int length = ApplyEditScript(detail::mutable_chars(old_string), detail::checked_length(old_string.size()),
+			       detail::mutable_chars(script), detail::checked_length(script.size()),
+			       output, int(output_length > std::size_t(INT_MAX) ? INT_MAX : output_length));
+  if (length < 0) { throw error(length); }
+  return std::size_t(length);
+}
+
+inline std::pmr::string apply(std::string_view old_string,
+			      std::string_view script,
+			      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+{
+  int length = QueryEditScriptLengths(detail::mutable_chars(script), detail::checked_length(script.size()),
+				      detail::checked_length(old_string.size()), nullptr);
+  if (length < 0) { throw error(length); }
+
+  std::pmr::string result(std::size_t(length), '\0', resource);
+  apply(old_string, script, result.data(), result.size());
+  return result;
+}
+
+inline std::pmr::string apply(std::string_view old_string,
+			      const edit_script &script,
+			      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+{
+  return apply(old_string, script.view(), resource);
+}
+
+//
+//  Template engine.  differ runs the same Myers forward search as the C engines over any
+//  element type, with the equality predicate and the index type fixed at compile time so
+//  comparisons inline and the snake loop can be specialized per element type.  Instead of
+//  the full V entries of the C exact engine it only records the furthest x reached on each
+//  diagonal, as an Index, so a uint16_t instantiation needs 2 bytes per (D,k) pair.
+//
+//  The result is reported to a sink as calls of sink(op, old_offset, new_offset, length),
+//  in order and with runs of the same op merged.  The op values match the C opcodes.
+//
+
+enum op_code : int { replace = ReplaceOpcode, insert = InsertOpcode, erase = DeleteOpcode, keep = KeepOpcode };
+
+template <class T, class Equal = std::equal_to<T>, class Index = std::uint32_t>
+class differ {
+  static_assert(std::is_unsigned_v<Index>, "diflib::differ needs an unsigned index type");
+
+public:
+  explicit differ(Equal equal = Equal(),
+		  std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+    : equal_(std::move(equal)), trace_(resource), path_(resource) {}
+
+  //
+  //  Diff old_data[0,old_length) against new_data[0,new_length) and report the edits to
+  //  sink.  If max_distance is given and the inputs need more edits than that we stop and
+  //  return false without calling the sink at all.  The workspace is kept between calls.
+  //
+
+  template <class Sink>
+  bool operator()(const T *old_data, std::size_t old_length,
+		  const T *new_data, std::size_t new_length,
+		  Sink &&sink,
+		  std::size_t max_distance = std::size_t(-1))
+  {
+    const std::ptrdiff_t n = std::ptrdiff_t(old_length);
+    const std::ptrdiff_t m = std::ptrdiff_t(new_length);
+    std::ptrdiff_t d, k, x, y;
+
+    if ((old_length >= std::numeric_limits<Index>::max()) || (new_length >= std::numeric_limits<Index>::max())) {
+      throw std::length_error("diflib: input too long for the differ's index type");
+    }
+
+    trace_.clear();
+    for (d = 0; std::size_t(d) <= max_distance; d++) {
+      std::size_t row = trace_.size();
+      std::size_t previous = row - std::size_t(d);   // start of row d-1, which holds d entries
+      trace_.resize(row + std::size_t(d) + 1);
+
+      for (k = -d; k <= d; k += 2) {
+	if (d == 0) {
+	  x = 0;
+	} else if ((k == -d) || ((k != d) && (trace_[previous + (k-1+d-1)/2] < trace_[previous + (k+1+d-1)/2]))) {
+	  x = trace_[previous + (k+1+d-1)/2];
+	} else {
+	  x = std::ptrdiff_t(trace_[previous + (k-1+d-1)/2]) + 1;
+	}
+	y = x - k;
+	if ((x <= n) && (y >= 0) && (y <= m)) {
+	  x += snake(old_data + x, new_data + y, std::size_t(std::min(n - x, m - y)));
+	}
+
+	//
+	//  Diagonals that have run off the right edge are dead ends, all that matters is that
+	//  they compare greater than any live x, so they are clamped to n+1 to fit the Index
+	//
+
+	trace_[row + std::size_t((k+d)/2)] = Index(std::min(x, n + 1));
+
+	if ((x >= n) && (x - k >= m)) {
+	  backtrack(d, k, n);
+	  for (auto it = path_.rbegin(); it != path_.rend(); ++it) {
+	    sink(op_code(it->op), it->old_offset, it->new_offset, it->length);
+	  }
+	  return true;
+	}
+      }
+    }
+    return false;
+  }
+
+private:
+  struct step {
+    int op;
+    std::size_t old_offset, new_offset, length;
+  };
+
+  //
+  //  Count the common elements at the start of a and b.  Integral elements compared with
+  //  plain equality are compared a block at a time, which compiles to a few wide loads.
+  //
+
+  std::size_t snake(const T *a, const T *b, std::size_t length) const
+  {
+    std::size_t i = 0;
+
+    if constexpr (std::is_integral_v<T> &&
+		  (std::is_same_v<Equal, std::equal_to<T>> || std::is_same_v<Equal, std::equal_to<>>)) {
+      constexpr std::size_t block = 32 / sizeof(T);
+      while ((i + block <= length) && (std::memcmp(a + i, b + i, block * sizeof(T)) == 0)) { i += block; }
+    }
+    while ((i < length) && equal_(a[i], b[i])) { i++; }
+    return i;
+  }
+
+  //
+  //  Walk back from diagonal k of row d to the origin, recording the steps in reverse
+  //
+
+  void backtrack(std::ptrdiff_t d, std::ptrdiff_t k, std::ptrdiff_t x)
+  {
+    std::size_t row = trace_.size() - std::size_t(d) - 1;
+    std::ptrdiff_t start_x, start_y, previous_k;
+
+    path_.clear();
+    for (; d > 0; d--) {
+      std::size_t previous = row - std::size_t(d);
+      if ((k == -d) || ((k != d) && (trace_[previous + (k-1+d-1)/2] < trace_[previous + (k+1+d-1)/2]))) {
+	previous_k = k + 1;
+	start_x = trace_[previous + (previous_k+d-1)/2];
+	start_y = start_x - previous_k;
+	add(keep, start_x, start_y + 1, x - start_x);
+	add(insert, start_x, start_y, 1);
+      } else {
+	previous_k = k - 1;
+	start_x = trace_[previous + (previous_k+d-1)/2];
+	start_y = start_x - previous_k;
+	add(keep, start_x + 1, start_y, x - start_x - 1);
+	add(erase, start_x, start_y, 1);
+      }
+      x = start_x;
+      k = previous_k;
+      row = previous;
+    }
+    add(keep, 0, 0, x);
+  }
+
+  //
+  //  Record a step, merging it with the step recorded before it when the ops match.  As we
+  //  record backwards the merged step starts at the new step's offsets.
+  //
+
+  void add(int op, std::ptrdiff_t old_offset, std::ptrdiff_t new_offset, std::ptrdiff_t length)
+  {
+    if (length <= 0) { return; }
+    if (!path_.empty() && (path_.back().op == op)) {
+      path_.back().old_offset = std::size_t(old_offset);
+      path_.back().new_offset = std::size_t(new_offset);
+      path_.back().length += std::size_t(length);
+    } else {
+      path_.push_back(step{op, std::size_t(old_offset), std::size_t(new_offset), std::size_t(length)});
+    }
+  }
+
+  Equal equal_;
+  std::pmr::vector<Index> trace_;
+  std::pmr::vector<step> path_;
+};
+
+//
+//  Diff two ranges with the narrowest index type that can hold their offsets.  Small inputs
+//  get a uint16_t workspace, which halves the memory of the default uint32_t one.
+//
+
+template <class T, class Equal = std::equal_to<T>, class Sink>
+bool diff(const T *old_data, std::size_t old_length,
+	  const T *new_data, std::size_t new_length,
+	  Sink &&sink,
+	  Equal equal = Equal(),
+	  std::size_t max_distance = std::size_t(-1))
+{
+  std::size_t longest = std::max(old_length, new_length);
+
+  if (longest < std::numeric_limits<std::uint16_t>::max()) {
+    return differ<T, Equal, std::uint16_t>(std::move(equal))(old_data, old_length, new_data, new_length, sink, max_distance);
+  } else if (longest < std::numeric_limits<std::uint32_t>::max()) {
+    return differ<T, Equal, std::uint32_t>(std::move(equal))(old_data, old_length, new_data, new_length, sink, max_distance);
+  }
+  return differ<T, Equal, std::uint64_t>(std::move(equal))(old_data, old_length, new_data, new_length, sink, max_distance);
+}
+
+//
+//  Lazy walk over an encoded edit script.  ops(script) is a range of edit_op records decoded
+//  on demand by the C cursor, so a loop that breaks early only decodes what it looked at.
+//  Pass the old string's length to also see the implicit trailing keep.  A corrupt script
+//  throws diflib::error(-3) from the iterator.
+//
+
+struct edit_op {
+  op_code op;
+  std::size_t old_offset;
+  std::size_t new_offset;
+  std::size_t length;
+  const char *literal;   // the new bytes for an insert or a replace, otherwise nullptr
+};
+
+class edit_op_range {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = edit_op;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const edit_op *;
+    using reference = const edit_op &;
+
+    iterator() = default;
+
+    explicit iterator(const EDIT_SCRIPT_CURSOR &cursor) : cursor_(cursor), done_(false) { advance(); }
+
+    reference operator*() const noexcept { return op_; }
+    pointer operator->() const noexcept { return &op_; }
+    iterator &operator++() { advance(); return *this; }
+    void operator++(int) { advance(); }
+
+    friend bool operator==(const iterator &a, const iterator &b) noexcept
+    {
+      return (a.done_ == b.done_) &&
+	     (a.done_ || ((a.cursor_.EditScriptIndex == b.cursor_.EditScriptIndex) && (a.cursor_.OldOffset == b.cursor_.OldOffset)));
+    }
+    friend bool operator!=(const iterator &a, const iterator &b) noexcept { return !(a == b); }
+
+  private:
+    void advance()
+    {
+      EDIT_OP op;
+      char *literal;
+      int status = NextEditScriptOp(&cursor_, &op, &literal);
+
+      if (status < 0) { throw error(status); }
+      if (status == 0) {
+	done_ = true;
+	return;
+      }
+      op_ = edit_op{op_code(op.Opcode), std::size_t(op.OldOffset), std::size_t(op.NewOffset), std::size_t(op.Length), literal};
+    }
+
+    EDIT_SCRIPT_CURSOR cursor_{};
+    edit_op op_{};
+    bool done_ = true;
+  };
+
+  explicit edit_op_range(std::string_view script, int old_length = -1)
+    : script_(script), old_length_(old_length) {}
+
+  iterator begin() const
+  {
+    EDIT_SCRIPT_CURSOR cursor;
+
+    InitializeEditScriptCursor(&cursor, detail::mutable_chars(script_), detail::checked_length(script_.size()), old_length_);
+    return iterator(cursor);
+  }
+
+  iterator end() const noexcept { return iterator(); }
+
+private:
+  std::string_view script_;
+  int old_length_;
+};
+
+inline edit_op_range ops(std::string_view script, int old_length = -1)
+{
+  return edit_op_range(script, old_length);
+}
+
+inline edit_op_range ops(const edit_script &script, int old_length = -1)
+{
+  return edit_op_range(script.view(), old_length);
+}
+
+#if __cplusplus >= 202002L
+
+//
+//  Binary inputs can be passed as spans of bytes
+//
+
+inline edit_script compute(std::span<const std::byte> old_string,
+			   std::span<const std::byte> new_string,
+			   DIFF_OPTIONS *options = nullptr,
+			   std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+{
+  return compute(std::string_view(reinterpret_cast<const char *>(old_string.data()), old_string.size()),
+		 std::string_view(reinterpret_cast<const char *>(new_string.data()), new_string.size()),
+		 options, resource);
+}
+
+inline std::size_t apply(std::span<const std::byte> old_string,
+			 const edit_script &script,
+			 std::span<std::byte> output)
+{
+  return apply(std::string_view(reinterpret_cast<const char *>(old_string.data()), old_string.size()),
+	       script.view(), reinterpret_cast<char *>(output.data()), output.size());
+}
+
+#endif
+
+} // namespace diflib
+
+#endif // _DIFLIB_HPP_
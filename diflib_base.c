@@ -0,0 +1,345 @@
+/*
+
+  This file implements prepared bases, see CreatePreparedBase in diflib.h.
+
+  A prepared base is a hash index of the blocks of one OldString.  Diffing a new string
+  against it rolls a hash over the new string, and wherever the hash hits an indexed block
+  that really matches we extend the match in both directions and keep the best match in
+  the neighborhood.  Matches are only taken in order, so each one splits the problem into
+  an already solved gap before it and the rest of the strings after it, and the gaps are
+  handed to ComputeRangeEditScript.  The engines then only ever see the small regions that
+  actually changed.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+#define DEFAULT_BLOCK_LENGTH (32)
+
+//
+//  The multiplier for our polynomial rolling hash, the arithmetic is all modulo 2^32
+//
+
+#define ROLLING_HASH_BASE (0x01000193)
+
+//
+//  Following every candidate on a long hash chain would make repetitive inputs quadratic,
+//  so we only look at the first few candidates at each position
+//
+
+#define MAX_CHAIN_CANDIDATES (16)
+
+struct _PREPARED_BASE_ {
+  char *OldString;
+  int OldStringLength;
+  int BlockLength;
+  unsigned int OutFactor;   // ROLLING_HASH_BASE^BlockLength, to roll a byte out of the hash
+  unsigned int BucketMask;  // the bucket count minus one, the count is a power of two
+  int *Buckets;             // the first block in each bucket, or -1
+  int *Chain;               // the next block in the same bucket, or -1, in increasing order
+};
+
+unsigned int BlockHash(const char *Block, int BlockLength)
+{
+  unsigned int Hash = 0;
+  int i;
+
+  for (i = 0; i < BlockLength; i++) { Hash = (Hash * ROLLING_HASH_BASE) + (unsigned char)Block[i]; }
+  return Hash;
+}
+
+//
+//  Move the hash of the block at some index to the block one byte further along
+//
+
+#define RollHash(B,H,Out,In) (((H) * ROLLING_HASH_BASE) + (unsigned char)(In) - ((B)->OutFactor * (unsigned char)(Out)))
+
+//
+//  Spread the bits of the rolling hash before we take the bucket index from the low bits
+//
+
+#define HashBucket(B,H) (((H) * 0x9e3779b1u >> 7) & (B)->BucketMask)
+
+int CreatePreparedBase (char *OldString,
+			int OldStringLength,
+			int BlockLength,
+			PPREPARED_BASE *Base)
+/*++
+
+  Description:
+
+    This routine builds the block index of an OldString so that many new strings can later be
+    diffed against it with ComputeEditScriptFromBase.
+
+  Input:
+
+    OldString, OldStringLength: the string to index.  It is not copied and must outlive the base.
+
+    BlockLength: how many bytes each indexed block covers, zero for the default.  Shorter
+      blocks find smaller matches but cost a larger index.
+
+    Base: receives the new base.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory, and -3 for a bad argument.
+
+--*/
+{
+  PPREPARED_BASE b;
+  unsigned int Buckets, Factor;
+  int Blocks, i;
+
+  *Base = NULL;
+  if (BlockLength == 0) { BlockLength = DEFAULT_BLOCK_LENGTH; }
+  if ((OldStringLength < 0) || (BlockLength < 4) || (BlockLength > 4096)) { return -3; }
+
+  Blocks = OldStringLength / BlockLength;
+  for (Buckets = 16; (Buckets < (unsigned int)Blocks * 2) && (Buckets < (1u << 30)); Buckets *= 2) { }
+
+  if ((b = calloc(1, sizeof(PREPARED_BASE))) == NULL) { return -2; }
+  b->Buckets = malloc(sizeof(int) * Buckets);
+  b->Chain = malloc(sizeof(int) * ((size_t)Blocks + 1));
+  if ((b->Buckets == NULL) || (b->Chain == NULL)) {
+    DestroyPreparedBase(b);
+    return -2;
+  }
+
+  b->OldString = OldString;
+  b->OldStringLength = OldStringLength;
+  b->BlockLength = BlockLength;
+  b->BucketMask = Buckets - 1;
+  for (Factor = 1, i = 0; i < BlockLength; i++) { Factor *= ROLLING_HASH_BASE; }
+  b->OutFactor = Factor;
+
+  //
+  //  Insert the blocks last to first so that every chain comes out in increasing order
+  //
+
+  memset(b->Buckets, 0xff, sizeof(int) * Buckets);
+  for (i = Blocks - 1; i >= 0; i--) {
+    unsigned int Bucket = HashBucket(b, BlockHash(&OldString[(size_t)i * BlockLength], BlockLength));
+    b->Chain[i] = b->Buckets[Bucket];
+    b->Buckets[Bucket] = i;
+  }
+
+  *Base = b;
+  return 0;
+}
+
+//
+//  How much memory a base holds, not counting the OldString it refers to
+//
+
+size_t PreparedBaseSize(PPREPARED_BASE Base)
+{
+  return sizeof(PREPARED_BASE) + sizeof(int) * ((size_t)Base->BucketMask + 1) +
+    sizeof(int) * ((size_t)(Base->OldStringLength / Base->BlockLength) + 1);
+}
+
+void DestroyPreparedBase (PPREPARED_BASE Base)
+{
+  if (Base == NULL) { return; }
+  free(Base->Buckets);
+  free(Base->Chain);
+  free(Base);
+}
+
+int FindBaseMatch(PPREPARED_BASE Base,
+		  char *NewString, int NewStringLength,
+		  int NewIndex, unsigned int Hash,
+		  int OldDone, int NewDone,
+		  int *MatchLength,
+		  long long *MatchScore)
+/*++
+
+  Description:
+
+    This routine looks for the best match between the new string at NewIndex and an indexed
+    block of the OldString that starts at or after OldDone.
+
+    A match is scored by its length less how far it strays from the diagonal of the last
+    match, which is about what the engines would pay to bridge the gap before it.  Without
+    this a repetitive string would happily match a copy of the block far ahead of where it
+    belongs and delete everything in between.
+
+  Output:
+
+    We return the offset of the match in the OldString, with its length and score in
+    MatchLength and MatchScore, or -1 if there is none.
+
+--*/
+{
+  char *OldString = Base->OldString;
+  int Block, Candidates, Old, Length;
+  int BestOld = -1, BestLength = 0;
+  long long Score, BestScore = 0;
+
+  for (Block = Base->Buckets[HashBucket(Base, Hash)], Candidates = 0;
+       (Block >= 0) && (Candidates < MAX_CHAIN_CANDIDATES);
+       Block = Base->Chain[Block]) {
+
+    Old = Block * Base->BlockLength;
+    if (Old < OldDone) { continue; }
+    Candidates++;
+
+    if (memcmp(&OldString[Old], &NewString[NewIndex], Base->BlockLength) != 0) { continue; }
+    for (Length = Base->BlockLength;
+	 (Old + Length < Base->OldStringLength) && (NewIndex + Length < NewStringLength) &&
+	   (OldString[Old + Length] == NewString[NewIndex + Length]);
+	 Length++) { }
+
+    Score = (long long)Length - llabs((long long)(Old - OldDone) - (NewIndex - NewDone));
+    if ((BestOld < 0) || (Score > BestScore)) {
+      BestOld = Old;
+      BestLength = Length;
+      BestScore = Score;
+    }
+  }
+
+  *MatchLength = BestLength;
+  *MatchScore = BestScore;
+  return BestOld;
+}
+
+int ComputeBaseEditScript(PDIFF_CONTEXT Context,
+			  PPREPARED_BASE Base)
+/*++
+
+  Description:
+
+    This routine appends the edit script from the base's OldString to the context's
+    NewString to the context's writer, using the base's block index to find the unchanged
+    regions.  The context's OldString must have the same contents as the base's.
+
+  Output:
+
+    We return the next free index in the edit script, or the same errors as
+    ComputeRangeEditScript.
+
+--*/
+{
+  PEDIT_SCRIPT_WRITER Writer = &Context->Writer;
+  char *OldString = Base->OldString;
+  char *NewString = Context->NewString;
+  int NewStringLength = Context->NewStringLength;
+  int BlockLength = Base->BlockLength;
+  int OldDone = 0, NewDone = 0;   // everything before these has been written to the script
+  int NewIndex, Match, Old, Length, Back;
+  int j, LookOld, LookLength;
+  long long Score, LookScore;
+  unsigned int Hash = 0, LookHash;
+  int i;
+
+  if (NewStringLength >= BlockLength) { Hash = BlockHash(NewString, BlockLength); }
+
+  for (NewIndex = 0; NewIndex + BlockLength <= NewStringLength; ) {
+
+    if (IsDiffCancelled(Context)) { break; }
+
+    Match = NewIndex;
+    if ((Old = FindBaseMatch(Base, NewString, NewStringLength, NewIndex, Hash, OldDone, NewDone, &Length, &Score)) >= 0) {
+
+      //
+      //  The right alignment for this region, if there is one, has to hit an indexed block
+      //  within the next BlockLength positions, so look that far ahead for a better match
+      //
+
+      for (j = NewIndex + 1, LookHash = Hash;
+	   (j < NewIndex + BlockLength) && (j + BlockLength <= NewStringLength);
+	   j++) {
+	LookHash = RollHash(Base, LookHash, NewString[j - 1], NewString[j + BlockLength - 1]);
+	if (((LookOld = FindBaseMatch(Base, NewString, NewStringLength, j, LookHash, OldDone, NewDone, &LookLength, &LookScore)) >= 0) &&
+	    (LookScore > Score)) {
+	  Old = LookOld;
+	  Length = LookLength;
+	  Score = LookScore;
+	  Match = j;
+	}
+      }
+      if (Score <= 0) { Old = -1; }
+    }
+
+    if (Old >= 0) {
+
+      //
+      //  The block may really start a little earlier, extend it back to the last match
+      //
+
+      for (Back = 0;
+	   (Old - Back > OldDone) && (Match - Back > NewDone) &&
+	     (OldString[Old - Back - 1] == NewString[Match - Back - 1]);
+	   Back++) { }
+
+      if ((i = ComputeRangeEditScript(Context, OldDone, Old - Back, NewDone, Match - Back)) < 0) return i;
+      if ((i = EmitEditScript(Writer, KeepOpcode, Back + Length)) < 0) return i;
+      OldDone = Old + Length;
+      NewDone = Match + Length;
+
+      NewIndex = NewDone;
+      if (NewIndex + BlockLength <= NewStringLength) { Hash = BlockHash(&NewString[NewIndex], BlockLength); }
+      continue;
+    }
+
+    //
+    //  No match here, roll the hash forward one byte
+    //
+
+    if (NewIndex + BlockLength == NewStringLength) { break; }
+    Hash = RollHash(Base, Hash, NewString[NewIndex], NewString[NewIndex + BlockLength]);
+    NewIndex++;
+  }
+
+  //
+  //  Whatever follows the last match is one more gap.  If we were cancelled the engine
+  //  approximates it.
+  //
+
+  if (Context->Cancelled && !ApproximateOnCancel(Context)) { return -4; }
+  return ComputeRangeEditScript(Context, OldDone, Base->OldStringLength, NewDone, NewStringLength);
+}
+
+int ComputeEditScriptFromBase (PPREPARED_BASE Base,
+			       char *NewString,
+			       int NewStringLength,
+			       char *EditScript,
+			       int EditScriptLength,
+			       PDIFF_OPTIONS Options)
+/*++
+
+  Description:
+
+    This routine computes an edit script that converts the base's OldString into the new
+    string, using the base's block index to find the unchanged regions.
+
+  Input:
+
+    Base: a base from CreatePreparedBase.
+
+    NewString, NewStringLength: describe the string that we are converting to.
+
+    EditScript, EditScriptLength: is the destination for the edit script.
+
+    Options: optionally tunes the computation, see DIFF_OPTIONS.  The memory budget applies to
+      each gap between matches.
+
+  Output:
+
+    We return the number of bytes that we used in the EditScript, or the same errors as
+    ComputeEditScriptEx.
+
+--*/
+{
+  DIFF_CONTEXT Context;
+  int i;
+
+  InitializeDiffContext(&Context, Base->OldString, Base->OldStringLength, NewString, NewStringLength,
+			EditScript, EditScriptLength, Options);
+
+  if ((i = ComputeBaseEditScript(&Context, Base)) < 0) return i;
+  if (Options != NULL) { Options->IsApproximate = Context.Cancelled; }
+  return FlushEditScript(&Context.Writer);
+}
@@ -0,0 +1,302 @@
+/*
+
+  This file implements the base cache, see CreateBaseCache in diflib.h.
+
+  Entries live in a hash table keyed by DiffHash64 of the OldString and on a doubly linked
+  LRU list, most recently used first.  Both are protected by the cache lock.  Callers hold a
+  reference on an entry while they diff against it, so an entry that is evicted while in use
+  is only unlinked, and the last caller to release it frees it.
+
+  Building a base happens outside the lock.  If two threads miss on the same OldString at
+  the same time they both build it, and whichever inserts second uses the first one's entry
+  and throws its own away.
+
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+struct _BASE_CACHE_ENTRY_ {
+  PBASE_CACHE_ENTRY HashNext;          // the next entry in the same bucket
+  PBASE_CACHE_ENTRY LruPrev, LruNext;  // neighbors on the LRU list
+  unsigned long long Hash;             // DiffHash64 of the OldString
+  char *OldString;                     // our own copy, the base refers to it
+  int OldStringLength;
+  PPREPARED_BASE Base;
+  size_t Size;                         // the bytes charged against the budget
+  int References;                      // callers using the entry, plus one while it is cached
+};
+
+struct _BASE_CACHE_ {
+  pthread_mutex_t Lock;
+  size_t ByteBudget, Size;
+  int BlockLength;
+  PBASE_CACHE_ENTRY *Buckets;
+  unsigned int BucketMask;             // the bucket count minus one, the count is a power of two
+  int EntryCount;
+  BASE_CACHE_ENTRY Lru;                // sentinel of the LRU list, Lru.LruNext is the most recent
+  unsigned long long Hits, Misses;
+};
+
+#define INITIAL_BUCKET_COUNT (64)
+
+int CreateBaseCache (size_t ByteBudget,
+		     int BlockLength,
+		     PBASE_CACHE *Cache)
+/*++
+
+  Description:
+
+    This routine creates an empty base cache.
+
+  Input:
+
+    ByteBudget: the most memory the cached bases may hold, counting their copies of the
+      OldStrings.  Bases larger than the budget are built for the call but never cached.
+
+    BlockLength: passed to CreatePreparedBase, zero for the default.
+
+    Cache: receives the new cache.
+
+  Output:
+
+    We return 0 on success and -2 if we ran out of memory.
+
+--*/
+{
+  PBASE_CACHE c;
+
+  *Cache = NULL;
+  if ((c = calloc(1, sizeof(BASE_CACHE))) == NULL) { return -2; }
+  if ((c->Buckets = calloc(INITIAL_BUCKET_COUNT, sizeof(PBASE_CACHE_ENTRY))) == NULL) {
+    free(c);
+    return -2;
+  }
+  pthread_mutex_init(&c->Lock, NULL);
+  c->ByteBudget = ByteBudget;
+  c->BlockLength = BlockLength;
+  c->BucketMask = INITIAL_BUCKET_COUNT - 1;
+  c->Lru.LruNext = c->Lru.LruPrev = &c->Lru;
+  *Cache = c;
+  return 0;
+}
+
+void FreeCachedBase(PBASE_CACHE_ENTRY Entry)
+{
+  DestroyPreparedBase(Entry->Base);
+  free(Entry->OldString);
+  free(Entry);
+}
+
+//
+//  Drop one reference to an entry, the caller holds the lock
+//
+
+void DereferenceCachedBase(PBASE_CACHE_ENTRY Entry)
+{
+  if (--Entry->References == 0) { FreeCachedBase(Entry); }
+}
+
+void DestroyBaseCache (PBASE_CACHE Cache)
+/*++
+
+  Description:
+
+    This routine frees a cache and all of its entries.  No call may be using the cache.
+
+--*/
+{
+  PBASE_CACHE_ENTRY Entry, Next;
+
+  if (Cache == NULL) { return; }
+  for (Entry = Cache->Lru.LruNext; Entry != &Cache->Lru; Entry = Next) {
+    Next = Entry->LruNext;
+    DereferenceCachedBase(Entry);
+  }
+  pthread_mutex_destroy(&Cache->Lock);
+  free(Cache->Buckets);
+  free(Cache);
+}
+
+void QueryBaseCacheStatistics (PBASE_CACHE Cache,
+			       unsigned long long *Hits,
+			       unsigned long long *Misses,
+			       size_t *Size)
+{
+  pthread_mutex_lock(&Cache->Lock);
+  if (Hits != NULL) { *Hits = Cache->Hits; }
+  if (Misses != NULL) { *Misses = Cache->Misses; }
+  if (Size != NULL) { *Size = Cache->Size; }
+  pthread_mutex_unlock(&Cache->Lock);
+}
+
+//
+//  These routines manage the table and the LRU list, the caller holds the lock
+//
+
+PBASE_CACHE_ENTRY FindCachedBase(PBASE_CACHE Cache, unsigned long long Hash, int OldStringLength)
+{
+  PBASE_CACHE_ENTRY Entry;
+
+  for (Entry = Cache->Buckets[Hash & Cache->BucketMask]; Entry != NULL; Entry = Entry->HashNext) {
+    if ((Entry->Hash == Hash) && (Entry->OldStringLength == OldStringLength)) { return Entry; }
+  }
+  return NULL;
+}
+
+void LinkMostRecent(PBASE_CACHE Cache, PBASE_CACHE_ENTRY Entry)
+{
+  Entry->LruNext = Cache->Lru.LruNext;
+  Entry->LruPrev = &Cache->Lru;
+  Entry->LruNext->LruPrev = Entry;
+  Cache->Lru.LruNext = Entry;
+}
+
+void UnlinkLru(PBASE_CACHE_ENTRY Entry)
+{
+  Entry->LruPrev->LruNext = Entry->LruNext;
+  Entry->LruNext->LruPrev = Entry->LruPrev;
+}
+
+void GrowCacheBuckets(PBASE_CACHE Cache)
+{
+  PBASE_CACHE_ENTRY *Buckets, Entry, Next;
+  unsigned int Count = (Cache->BucketMask + 1) * 2;
+  unsigned int i;
+
+  //
+  //  Failing to grow only makes the chains longer, so we just keep the old table
+  //
+
+  if ((Buckets = calloc(Count, sizeof(PBASE_CACHE_ENTRY))) == NULL) { return; }
+  for (i = 0; i <= Cache->BucketMask; i++) {
+    for (Entry = Cache->Buckets[i]; Entry != NULL; Entry = Next) {
+      Next = Entry->HashNext;
+      Entry->HashNext = Buckets[Entry->Hash & (Count - 1)];
+      Buckets[Entry->Hash & (Count - 1)] = Entry;
+    }
+  }
+  free(Cache->Buckets);
+  Cache->Buckets = Buckets;
+  Cache->BucketMask = Count - 1;
+}
+
+void EvictCachedBase(PBASE_CACHE Cache, PBASE_CACHE_ENTRY Entry)
+{
+  PBASE_CACHE_ENTRY *Link;
+
+  for (Link = &Cache->Buckets[Entry->Hash & Cache->BucketMask]; *Link != Entry; Link = &(*Link)->HashNext) { }
+  *Link = Entry->HashNext;
+  UnlinkLru(Entry);
+  Cache->Size -= Entry->Size;
+  Cache->EntryCount--;
+  DereferenceCachedBase(Entry);
+}
+
+//
+//  Lookups only match the hash and length, which is all we can afford under the lock.  Once
+//  we hold a reference we compare the contents, and in the unlikely event that two strings
+//  collide we give up on the cache for this call.
+//
+
+PBASE_CACHE_ENTRY VerifyCachedBase(PBASE_CACHE Cache, PBASE_CACHE_ENTRY Entry, char *OldString)
+{
+  if (memcmp(Entry->OldString, OldString, (size_t)Entry->OldStringLength) == 0) { return Entry; }
+  ReleaseCachedBase(Cache, Entry);
+  return NULL;
+}
+
+PBASE_CACHE_ENTRY AcquireCachedBase(PBASE_CACHE Cache, char *OldString, int OldStringLength)
+/*++
+
+  Description:
+
+    This routine finds the cached base for an OldString, building and caching it if needed,
+    and takes a reference on it that the caller drops with ReleaseCachedBase.
+
+  Output:
+
+    We return the entry, or NULL if the OldString is too short to be worth caching or we ran
+    out of memory.  Either way the caller should then diff without a base.
+
+--*/
+{
+  PBASE_CACHE_ENTRY Entry, Found;
+  unsigned long long Hash;
+
+  if (OldStringLength < BASE_CACHE_MIN_LENGTH) { return NULL; }
+  Hash = DiffHash64(OldString, (size_t)OldStringLength, 0);
+
+  pthread_mutex_lock(&Cache->Lock);
+  if ((Found = FindCachedBase(Cache, Hash, OldStringLength)) != NULL) {
+    UnlinkLru(Found);
+    LinkMostRecent(Cache, Found);
+    Found->References++;
+    Cache->Hits++;
+  } else {
+    Cache->Misses++;
+  }
+  pthread_mutex_unlock(&Cache->Lock);
+  if (Found != NULL) { return VerifyCachedBase(Cache, Found, OldString); }
+
+  //
+  //  Build the entry without holding the lock
+  //
+
+  if ((Entry = calloc(1, sizeof(BASE_CACHE_ENTRY))) == NULL) { return NULL; }
+  if ((Entry->OldString = malloc((size_t)OldStringLength)) == NULL) {
+    free(Entry);
+    return NULL;
+  }
+  memcpy(Entry->OldString, OldString, (size_t)OldStringLength);
+  if (CreatePreparedBase(Entry->OldString, OldStringLength, Cache->BlockLength, &Entry->Base) != 0) {
+    free(Entry->OldString);
+    free(Entry);
+    return NULL;
+  }
+  Entry->Hash = Hash;
+  Entry->OldStringLength = OldStringLength;
+  Entry->Size = sizeof(BASE_CACHE_ENTRY) + (size_t)OldStringLength + PreparedBaseSize(Entry->Base);
+  Entry->References = 1;
+
+  pthread_mutex_lock(&Cache->Lock);
+  if ((Found = FindCachedBase(Cache, Hash, OldStringLength)) != NULL) {
+
+    //
+    //  Someone else cached it while we were building ours
+    //
+
+    Found->References++;
+    pthread_mutex_unlock(&Cache->Lock);
+    FreeCachedBase(Entry);
+    return VerifyCachedBase(Cache, Found, OldString);
+  }
+
+  if (Entry->Size <= Cache->ByteBudget) {
+    while (Cache->Size + Entry->Size > Cache->ByteBudget) { EvictCachedBase(Cache, Cache->Lru.LruPrev); }
+    if (Cache->EntryCount >= (int)Cache->BucketMask + 1) { GrowCacheBuckets(Cache); }
+    Entry->HashNext = Cache->Buckets[Hash & Cache->BucketMask];
+    Cache->Buckets[Hash & Cache->BucketMask] = Entry;
+    LinkMostRecent(Cache, Entry);
+    Cache->Size += Entry->Size;
+    Cache->EntryCount++;
+    Entry->References++;
+  }
+  pthread_mutex_unlock(&Cache->Lock);
+  return Entry;
+}
+
+PPREPARED_BASE CachedBase(PBASE_CACHE_ENTRY Entry)
+{
+  return Entry->Base;
+}
+
+void ReleaseCachedBase(PBASE_CACHE Cache, PBASE_CACHE_ENTRY Entry)
+{
+  pthread_mutex_lock(&Cache->Lock);
+  DereferenceCachedBase(Entry);
+  pthread_mutex_unlock(&Cache->Lock);
+}
@@ -0,0 +1,371 @@
+/*
+
+  This file implements content defined chunking and the chunked mode of ComputeEditScriptEx,
+  see DIFF_FLAG_CONTENT_CHUNKS in diflib.h.
+
+  The chunker is FastCDC.  A gear hash, h = (h << 1) + Gear[byte], rolls over the string and
+  a chunk ends wherever the top bits of the hash are all zero.  Each hash only depends on the
+  last 64 bytes, so the cut points depend only on the nearby content and an insertion moves
+  just the cut points next to it.  Chunks shorter than a quarter of the average length are
+  never cut, a stricter mask is used before the average length and a looser one after it to
+  pull chunk lengths toward the average, and no chunk is longer than eight times the average.
+
+  The hash is a strictly serial chain, one shift and add per byte, so there is nothing for
+  vector instructions to do.  Instead the loop takes two bytes per step, testing the first
+  byte's hash in its shifted form, which halves the loop overhead.
+
+  To diff, both strings are chunked and each new chunk is looked up among the old chunks by
+  hash.  Of all the matching pairs we keep the chain that is in order in both strings and
+  covers the most bytes, and only the gaps between the chunks of that chain are diffed.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+//
+//  Without a budget from the caller each gap between matched chunks is diffed with at most
+//  this much workspace, enough for the linear engine on gaps of over a hundred kilobytes
+//
+
+#define CHUNK_GAP_BUDGET (1024 * 1024)
+
+//
+//  How many equal old chunks we consider for each new chunk, repeated content such as runs
+//  of zeros would otherwise make matching quadratic
+//
+
+#define MAX_CHUNK_CANDIDATES (8)
+
+typedef struct _CHUNKER_ {
+  unsigned long long Gear[256];
+  unsigned long long GearShifted[256];  // Gear << 1, for the first byte of each step
+  unsigned long long MaskSmall, MaskSmallShifted;
+  unsigned long long MaskLarge, MaskLargeShifted;
+  int MinimumLength, AverageLength, MaximumLength;
+} CHUNKER, *PCHUNKER;
+
+int InitializeChunker(PCHUNKER Chunker, int AverageLength)
+{
+  unsigned long long Seed = 0x9e3779b97f4a7c15ULL, z;
+  int Bits, i;
+
+  if (AverageLength == 0) { AverageLength = CDC_DEFAULT_AVERAGE_LENGTH; }
+  if ((AverageLength < 64) || (AverageLength > (1 << 26))) { return -3; }
+
+  //
+  //  The gear table only has to look random, and it has to be the same every time
+  //
+
+  for (i = 0; i < 256; i++) {
+    z = (Seed += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    Chunker->Gear[i] = z ^ (z >> 31);
+    Chunker->GearShifted[i] = Chunker->Gear[i] << 1;
+  }
+
+  //
+  //  A mask of b bits cuts on average every 2^b bytes.  Normalized chunking uses two more
+  //  bits before the average length and two fewer after it.  The masks stop short of the
+  //  top bit so that their shifted forms lose nothing.
+  //
+
+  for (Bits = 0; (1 << (Bits + 1)) <= AverageLength; Bits++) { }
+  Chunker->MaskSmall = ((1ULL << (Bits + 2)) - 1) << (63 - (Bits + 2));
+  Chunker->MaskLarge = ((1ULL << (Bits - 2)) - 1) << (63 - (Bits - 2));
+  Chunker->MaskSmallShifted = Chunker->MaskSmall << 1;
+  Chunker->MaskLargeShifted = Chunker->MaskLarge << 1;
+
+  Chunker->AverageLength = AverageLength;
+  Chunker->MinimumLength = AverageLength / 4;
+  Chunker->MaximumLength = AverageLength * 8;
+  return 0;
+}
+
+int NextChunkLength(PCHUNKER Chunker, const unsigned char *String, int Length)
+/*++
+
+  Description:
+
+    This routine returns the length of the chunk that starts at String, which has Length
+    bytes left.
+
+--*/
+{
+  unsigned long long Hash = 0;
+  int Normal, End, i;
+
+  if (Length <= Chunker->MinimumLength) { return Length; }
+  Normal = (Length < Chunker->AverageLength) ? Length : Chunker->AverageLength;
+  End = (Length < Chunker->MaximumLength) ? Length : Chunker->MaximumLength;
+
+  //
+  //  After each pair of bytes Hash is the gear hash through the second byte.  In between,
+  //  the hash through the first byte is only ever seen shifted left by one.
+  //
+
+  for (i = Chunker->MinimumLength; i + 1 < Normal; i += 2) {
+    Hash = (Hash << 2) + Chunker->GearShifted[String[i]];
+    if ((Hash & Chunker->MaskSmallShifted) == 0) { return i + 1; }
+    Hash += Chunker->Gear[String[i + 1]];
+    if ((Hash & Chunker->MaskSmall) == 0) { return i + 2; }
+  }
+  for (; i + 1 < End; i += 2) {
+    Hash = (Hash << 2) + Chunker->GearShifted[String[i]];
+    if ((Hash & Chunker->MaskLargeShifted) == 0) { return i + 1; }
+    Hash += Chunker->Gear[String[i + 1]];
+    if ((Hash & Chunker->MaskLarge) == 0) { return i + 2; }
+  }
+  if (i < End) {
+    Hash = (Hash << 1) + Chunker->Gear[String[i]];
+    if ((Hash & Chunker->MaskLarge) == 0) { return i + 1; }
+  }
+  return End;
+}
+
+int ComputeContentChunks (char *String,
+			  int StringLength,
+			  int AverageLength,
+			  int *ChunkEnds,
+			  int ChunkEndsLength)
+/*++
+
+  Description:
+
+    This routine splits a string into content defined chunks.
+
+  Input:
+
+    String, StringLength: the string to split.
+
+    AverageLength: the chunk length to aim for, zero for CDC_DEFAULT_AVERAGE_LENGTH.  Chunks
+      are between a quarter of it and eight times it long, except that the last may be shorter.
+
+    ChunkEnds, ChunkEndsLength: receive the offset just past the end of each chunk.  Callers
+      can size it by StringLength / (AverageLength / 4) + 1, or pass NULL to only count.
+
+  Output:
+
+    We return the number of chunks, -1 if ChunkEndsLength is too small, or -3 for a bad
+    AverageLength.
+
+--*/
+{
+  CHUNKER Chunker;
+  int Offset, Count;
+  int i;
+
+  if ((i = InitializeChunker(&Chunker, AverageLength)) < 0) { return i; }
+
+  for (Offset = 0, Count = 0; Offset < StringLength; Count++) {
+    Offset += NextChunkLength(&Chunker, (const unsigned char *)&String[Offset], StringLength - Offset);
+    if (ChunkEnds != NULL) {
+      if (Count >= ChunkEndsLength) { return -1; }
+      ChunkEnds[Count] = Offset;
+    }
+  }
+  return Count;
+}
+
+//
+//  The chunks of one string, as end offsets and hashes
+//
+
+typedef struct _CHUNK_LIST_ {
+  int Count;
+  int *Ends;
+  unsigned long long *Hashes;
+} CHUNK_LIST, *PCHUNK_LIST;
+
+#define ChunkStart(L,i) (((i) == 0) ? 0 : (L)->Ends[(i) - 1])
+#define ChunkLength(L,i) ((L)->Ends[i] - ChunkStart(L,i))
+
+int BuildChunkList(PCHUNKER Chunker, char *String, int StringLength, PCHUNK_LIST List)
+{
+  int Offset, i;
+
+  List->Count = 0;
+  List->Ends = malloc(sizeof(int) * ((size_t)StringLength / Chunker->MinimumLength + 2));
+  List->Hashes = malloc(sizeof(unsigned long long) * ((size_t)StringLength / Chunker->MinimumLength + 2));
+  if ((List->Ends == NULL) || (List->Hashes == NULL)) { return -2; }
+
+  for (Offset = 0; Offset < StringLength; List->Count++) {
+    Offset += NextChunkLength(Chunker, (const unsigned char *)&String[Offset], StringLength - Offset);
+    List->Ends[List->Count] = Offset;
+  }
+  for (i = 0; i < List->Count; i++) {
+    List->Hashes[i] = DiffHash64(&String[ChunkStart(List, i)], (size_t)ChunkLength(List, i), 0);
+  }
+  return 0;
+}
+
+void FreeChunkList(PCHUNK_LIST List)
+{
+  free(List->Ends);
+  free(List->Hashes);
+}
+
+//
+//  A pair of equal chunks, and its place in the best chain ending with it
+//
+
+typedef struct _CHUNK_PAIR_ {
+  int NewChunk, OldChunk;
+  long long Weight;        // bytes covered by the best chain that ends with this pair
+  int Previous;            // the pair before this one in that chain, or -1
+} CHUNK_PAIR, *PCHUNK_PAIR;
+
+int FindChunkChain(PCHUNK_LIST OldList, PCHUNK_LIST NewList, char *OldString, char *NewString,
+		   PCHUNK_PAIR *Pairs, int *Last)
+/*++
+
+  Description:
+
+    This routine finds every pair of equal old and new chunks and then the chain of pairs
+    that is increasing in both strings and covers the most bytes.  The chain is found as a
+    heaviest increasing subsequence: pairs are taken in new chunk order, and a Fenwick tree
+    indexed by old chunk gives the heaviest chain ending before any old chunk.  Pairs that
+    share a new chunk are taken in decreasing old chunk order so no chain holds two of them.
+
+  Output:
+
+    We return 0 and set Pairs and Last, the index of the final pair of the chain or -1 if
+    there are no pairs at all.  Or -2 if we ran out of memory.
+
+--*/
+{
+  PCHUNK_PAIR p;
+  int *Buckets, *Chain, *Tree;
+  int PairCount = 0, BucketMask, Candidates[MAX_CHUNK_CANDIDATES];
+  int i, j, k, c, n, Best;
+  long long Weight;
+
+  for (BucketMask = 15; BucketMask < 2 * OldList->Count; BucketMask = 2 * BucketMask + 1) { }
+  Buckets = malloc(sizeof(int) * ((size_t)BucketMask + 1));
+  Chain = malloc(sizeof(int) * ((size_t)OldList->Count + 1));
+  Tree = malloc(sizeof(int) * ((size_t)OldList->Count + 1));
+  p = malloc(sizeof(CHUNK_PAIR) * ((size_t)NewList->Count * MAX_CHUNK_CANDIDATES + 1));
+  if ((Buckets == NULL) || (Chain == NULL) || (Tree == NULL) || (p == NULL)) {
+    free(Buckets); free(Chain); free(Tree); free(p);
+    return -2;
+  }
+
+  //
+  //  Index the old chunks by hash, each chain in increasing order
+  //
+
+  memset(Buckets, 0xff, sizeof(int) * ((size_t)BucketMask + 1));
+  for (k = OldList->Count - 1; k >= 0; k--) {
+    Chain[k] = Buckets[OldList->Hashes[k] & BucketMask];
+    Buckets[OldList->Hashes[k] & BucketMask] = k;
+  }
+
+  //
+  //  The Fenwick tree holds, for each prefix of old chunks, the pair ending the heaviest chain
+  //
+
+  memset(Tree, 0xff, sizeof(int) * ((size_t)OldList->Count + 1));
+  *Last = -1;
+
+  for (j = 0; j < NewList->Count; j++) {
+
+    for (k = Buckets[NewList->Hashes[j] & BucketMask], n = 0; (k >= 0) && (n < MAX_CHUNK_CANDIDATES); k = Chain[k]) {
+      if ((OldList->Hashes[k] == NewList->Hashes[j]) && (ChunkLength(OldList, k) == ChunkLength(NewList, j)) &&
+	  (memcmp(&OldString[ChunkStart(OldList, k)], &NewString[ChunkStart(NewList, j)], ChunkLength(NewList, j)) == 0)) {
+	Candidates[n++] = k;
+      }
+    }
+
+    for (c = n - 1; c >= 0; c--) {
+      k = Candidates[c];
+
+      for (Best = -1, i = k; i > 0; i -= i & -i) {
+	if ((Tree[i] >= 0) && ((Best < 0) || (p[Tree[i]].Weight > p[Best].Weight))) { Best = Tree[i]; }
+      }
+      Weight = ((Best >= 0) ? p[Best].Weight : 0) + ChunkLength(NewList, j);
+      p[PairCount].NewChunk = j;
+      p[PairCount].OldChunk = k;
+      p[PairCount].Weight = Weight;
+      p[PairCount].Previous = Best;
+
+      for (i = k + 1; i <= OldList->Count; i += i & -i) {
+	if ((Tree[i] < 0) || (p[Tree[i]].Weight < Weight)) { Tree[i] = PairCount; }
+      }
+      if ((*Last < 0) || (p[*Last].Weight < Weight)) { *Last = PairCount; }
+      PairCount++;
+    }
+  }
+
+  free(Buckets);
+  free(Chain);
+  free(Tree);
+  *Pairs = p;
+  return 0;
+}
+
+int ComputeChunkedEditScript(PDIFF_CONTEXT Context)
+/*++
+
+  Description:
+
+    This routine appends the edit script for the whole of the context's strings to its
+    writer, aligning them by content defined chunks and diffing only what lies between the
+    matched chunks.
+
+  Output:
+
+    We return the next free index in the edit script, or the same errors as
+    ComputeRangeEditScript.
+
+--*/
+{
+  CHUNKER Chunker;
+  CHUNK_LIST OldList, NewList;
+  PCHUNK_PAIR Pairs = NULL;
+  int Last, Next, OldDone = 0, NewDone = 0;
+  int OldStart, NewStart, Length;
+  int i;
+
+  if (Context->MemoryBudget == (size_t)-1) { Context->MemoryBudget = CHUNK_GAP_BUDGET; }
+  InitializeChunker(&Chunker, 0);
+  memset(&OldList, 0, sizeof(OldList));
+  memset(&NewList, 0, sizeof(NewList));
+
+  i = BuildChunkList(&Chunker, Context->OldString, Context->OldStringLength, &OldList);
+  if (i == 0) { i = BuildChunkList(&Chunker, Context->NewString, Context->NewStringLength, &NewList); }
+  if (i == 0) { i = FindChunkChain(&OldList, &NewList, Context->OldString, Context->NewString, &Pairs, &Last); }
+
+  if (i == 0) {
+
+    //
+    //  The chain is linked from its end, turn it around so we can walk it forwards
+    //
+
+    for (Next = -1; Last >= 0; ) {
+      i = Pairs[Last].Previous;
+      Pairs[Last].Previous = Next;
+      Next = Last;
+      Last = i;
+    }
+
+    for (i = 0; Next >= 0; Next = Pairs[Next].Previous) {
+      OldStart = ChunkStart(&OldList, Pairs[Next].OldChunk);
+      NewStart = ChunkStart(&NewList, Pairs[Next].NewChunk);
+      Length = ChunkLength(&NewList, Pairs[Next].NewChunk);
+
+      if ((i = ComputeRangeEditScript(Context, OldDone, OldStart, NewDone, NewStart)) < 0) break;
+      if ((i = EmitEditScript(&Context->Writer, KeepOpcode, Length)) < 0) break;
+      OldDone = OldStart + Length;
+      NewDone = NewStart + Length;
+    }
+    if (i >= 0) { i = ComputeRangeEditScript(Context, OldDone, Context->OldStringLength, NewDone, Context->NewStringLength); }
+  }
+
+  FreeChunkList(&OldList);
+  FreeChunkList(&NewList);
+  free(Pairs);
+  return i;
+}
@@ -0,0 +1,287 @@
+/*
+
+  This file implements edit distances without edit scripts, see ComputeEditDistance in
+  diflib.h.
+
+  The distance is the D of Myers' algorithm, the number of bytes an edit script deletes and
+  inserts.  Finding it needs only the forward half of the algorithm and a single array of
+  furthest reaching x values, one per diagonal, and since nothing gets traced back nothing
+  else has to be kept.  With a cutoff the array shrinks to the diagonals a path of that
+  length can reach, and pairs whose lengths alone differ by more than the cutoff are
+  answered without looking at their bytes at all.
+
+  The all pairs matrix is cut into square tiles of pairs that the threads take in turn.  A
+  tile covers DISTANCE_TILE strings from each side, so each thread works on a small set of
+  strings at a time, and every thread reuses one array for all of its pairs.
+
+ */
+
+#include <stdlib.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+#define DISTANCE_TILE (32)
+
+int ForwardEditDistance(char *OldString, int OldStringLength,
+			char *NewString, int NewStringLength,
+			int MaxD, int *V)
+/*++
+
+  Description:
+
+    This routine runs the forward search of Myers' algorithm for at most MaxD differences.
+    As in FindMiddleSnake, diagonals that run off the edge of either string are trimmed from
+    the search.
+
+  Input:
+
+    V: is room for 2*MaxD+3 ints.
+
+  Output:
+
+    We return the distance, or MaxD+1 if it is larger than MaxD.
+
+--*/
+{
+  int *Vf = &V[MaxD + 1];
+  int KStart = 0, KEnd = 0;
+  int D, k, X, Y;
+
+  for (k = -MaxD - 1; k <= MaxD + 1; k++) { Vf[k] = -1; }
+  Vf[1] = 0;
+
+  for (D = 0; D <= MaxD; D++) {
+    for (k = -D + KStart; k <= D - KEnd; k += 2) {
+      if ((k == -D) || ((k != D) && (Vf[k-1] < Vf[k+1]))) {
+	X = Vf[k+1];
+      } else {
+	X = Vf[k-1] + 1;
+      }
+      Y = X - k;
+      while ((X < OldStringLength) && (Y < NewStringLength) && (OldString[X] == NewString[Y])) {
+	X++;
+	Y++;
+      }
+      Vf[k] = X;
+      if (X > OldStringLength) {
+	KEnd += 2;
+      } else if (Y > NewStringLength) {
+	KStart += 2;
+      } else if ((X == OldStringLength) && (Y == NewStringLength)) {
+	return D;
+      }
+    }
+  }
+  return MaxD + 1;
+}
+
+int BoundedEditDistance(char *OldString, int OldStringLength,
+			char *NewString, int NewStringLength,
+			int MaxD, int *V)
+/*++
+
+  Description:
+
+    This routine returns the distance between two strings, or MaxD+1 if it is larger than
+    MaxD.  The common prefix and suffix are trimmed first, they cost nothing.
+
+  Input:
+
+    V: is room for 2*MaxD+3 ints.
+
+--*/
+{
+  int Prefix, Suffix;
+
+  for (Prefix = 0;
+       (Prefix < OldStringLength) && (Prefix < NewStringLength) && (OldString[Prefix] == NewString[Prefix]);
+       Prefix++) { }
+  OldString += Prefix;
+  NewString += Prefix;
+  OldStringLength -= Prefix;
+  NewStringLength -= Prefix;
+
+  for (Suffix = 0;
+       (Suffix < OldStringLength) && (Suffix < NewStringLength) &&
+	 (OldString[OldStringLength - Suffix - 1] == NewString[NewStringLength - Suffix - 1]);
+       Suffix++) { }
+  OldStringLength -= Suffix;
+  NewStringLength -= Suffix;
+
+  //
+  //  Every byte of the difference in lengths needs an insert or a delete of its own, and no
+  //  distance exceeds deleting one string and inserting the other
+  //
+
+  if ((OldStringLength - NewStringLength > MaxD) || (NewStringLength - OldStringLength > MaxD)) { return MaxD + 1; }
+  if ((OldStringLength == 0) || (NewStringLength == 0)) { return OldStringLength + NewStringLength; }
+  if ((long long)OldStringLength + NewStringLength < MaxD) { MaxD = OldStringLength + NewStringLength; }
+
+  return ForwardEditDistance(OldString, OldStringLength, NewString, NewStringLength, MaxD, V);
+}
+
+int ComputeEditDistance (char *OldString,
+			 int OldStringLength,
+			 char *NewString,
+			 int NewStringLength,
+			 int MaxDistance)
+/*++
+
+  Description:
+
+    This routine computes the edit distance between two strings, the number of bytes that a
+    minimal edit script deletes plus the number it inserts, without building the script.
+
+  Input:
+
+    OldString, OldStringLength, NewString, NewStringLength: describe the two strings.
+
+    MaxDistance: is the largest distance the caller cares about, or -1 for no limit.  The
+      smaller it is the less work and memory we need.
+
+  Output:
+
+    We return the distance, MaxDistance+1 if the distance is larger than MaxDistance, or -2 if
+    we ran out of memory.
+
+--*/
+{
+  long long Limit = (long long)OldStringLength + NewStringLength;
+  int *V;
+  int i;
+
+  if ((MaxDistance >= 0) && (MaxDistance < Limit)) { Limit = MaxDistance; }
+  if ((Limit > 0x3fffffff) || ((V = malloc(sizeof(int) * (size_t)(2 * Limit + 3))) == NULL)) { return -2; }
+  i = BoundedEditDistance(OldString, OldStringLength, NewString, NewStringLength, (int)Limit, V);
+  free(V);
+  return ((MaxDistance >= 0) && (i > MaxDistance)) ? MaxDistance + 1 : i;
+}
+
+typedef struct _DISTANCE_MATRIX_ {
+  char **Strings;
+  int *Lengths;
+  int Count;
+  int MaxDistance;             // the caller's cutoff, or -1
+  int *Distances;
+  int TileCount;               // tiles along each side of the matrix
+  int *Buffers;                // one V array per thread
+  size_t BufferLength;         // the ints in each of them
+} DISTANCE_MATRIX, *PDISTANCE_MATRIX;
+
+void ComputeDistanceTile(void *Context, int ThreadIndex, int TaskIndex)
+/*++
+
+  Description:
+
+    This routine is the DiffParallelFor routine that fills in one tile of the matrix.  Tasks
+    number the tiles on or above the diagonal row by row.
+
+--*/
+{
+  PDISTANCE_MATRIX Matrix = (PDISTANCE_MATRIX)Context;
+  int *V = &Matrix->Buffers[(size_t)ThreadIndex * Matrix->BufferLength];
+  int Row, Column, RowEnd, ColumnEnd, i, j;
+  long long MaxD;
+
+  for (Row = 0; TaskIndex >= Matrix->TileCount - Row; Row++) { TaskIndex -= Matrix->TileCount - Row; }
+  Column = Row + TaskIndex;
+
+  RowEnd = (Row + 1) * DISTANCE_TILE;
+  if (RowEnd > Matrix->Count) { RowEnd = Matrix->Count; }
+  ColumnEnd = (Column + 1) * DISTANCE_TILE;
+  if (ColumnEnd > Matrix->Count) { ColumnEnd = Matrix->Count; }
+
+  for (i = Row * DISTANCE_TILE; i < RowEnd; i++) {
+    for (j = (Row == Column) ? i + 1 : Column * DISTANCE_TILE; j < ColumnEnd; j++) {
+      MaxD = (long long)Matrix->Lengths[i] + Matrix->Lengths[j];
+      if ((Matrix->MaxDistance >= 0) && (Matrix->MaxDistance < MaxD)) { MaxD = Matrix->MaxDistance; }
+      Matrix->Distances[EDIT_DISTANCE_INDEX(Matrix->Count, i, j)] =
+	BoundedEditDistance(Matrix->Strings[i], Matrix->Lengths[i], Matrix->Strings[j], Matrix->Lengths[j], (int)MaxD, V);
+    }
+  }
+}
+
+int ComputeEditDistanceMatrix (char **Strings,
+			       int *Lengths,
+			       int Count,
+			       int MaxDistance,
+			       int *Distances)
+/*++
+
+  Description:
+
+    This routine computes the edit distance between every pair of strings, see
+    ComputeEditDistanceMatrixParallel.
+
+--*/
+{
+  return ComputeEditDistanceMatrixParallel(Strings, Lengths, Count, MaxDistance, Distances, 1);
+}
+
+int ComputeEditDistanceMatrixParallel (char **Strings,
+				       int *Lengths,
+				       int Count,
+				       int MaxDistance,
+				       int *Distances,
+				       int ThreadCount)
+/*++
+
+  Description:
+
+    This routine computes the edit distance between every pair of strings using up to
+    ThreadCount threads, zero or less meaning one per processor.
+
+  Input:
+
+    Strings, Lengths, Count: describe the strings.
+
+    MaxDistance: is the largest distance the caller cares about, or -1 for no limit.
+
+    Distances: receives Count*(Count-1)/2 distances, the one between strings i < j at
+      EDIT_DISTANCE_INDEX(Count, i, j).  Distances larger than MaxDistance are stored as
+      MaxDistance+1.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory, and -3 if a length is negative or the
+    strings are too long to diff.
+
+--*/
+{
+  DISTANCE_MATRIX Matrix;
+  long long Longest = 0, Limit;
+  int TaskCount, i;
+
+  if (Count < 0) { return -3; }
+  for (i = 0; i < Count; i++) {
+    if (Lengths[i] < 0) { return -3; }
+    if (Lengths[i] > Longest) { Longest = Lengths[i]; }
+  }
+  if (Count < 2) { return 0; }
+
+  //
+  //  Each thread gets one array big enough for the longest pair it could meet
+  //
+
+  Limit = 2 * Longest;
+  if ((MaxDistance >= 0) && (MaxDistance < Limit)) { Limit = MaxDistance; }
+  if (Limit > 0x3fffffff) { return -3; }
+
+  Matrix.Strings = Strings;
+  Matrix.Lengths = Lengths;
+  Matrix.Count = Count;
+  Matrix.MaxDistance = MaxDistance;
+  Matrix.Distances = Distances;
+  Matrix.TileCount = (Count + DISTANCE_TILE - 1) / DISTANCE_TILE;
+  Matrix.BufferLength = (size_t)(2 * Limit + 3);
+
+  if ((long long)Matrix.TileCount * (Matrix.TileCount + 1) / 2 > 0x7fffffff) { return -3; }
+  TaskCount = Matrix.TileCount * (Matrix.TileCount + 1) / 2;
+  ThreadCount = DiffParallelThreadCount(ThreadCount, TaskCount);
+  if ((Matrix.Buffers = malloc(sizeof(int) * Matrix.BufferLength * ThreadCount)) == NULL) { return -2; }
+
+  DiffParallelFor(ThreadCount, TaskCount, ComputeDistanceTile, &Matrix);
+
+  free(Matrix.Buffers);
+  return 0;
+}
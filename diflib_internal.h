@@ -0,0 +1,214 @@
+#ifndef _DIFLIB_INTERNAL_
+#define _DIFLIB_INTERNAL_
+
+//
+//  Declarations shared by the diflib source files and the tools.  Nothing in here is part of
+//  the public interface, that is all in diflib.h.
+//
+
+#include <stddef.h>
+#include "diflib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+//  The edit script writer sits between the engines and AddEditScript.  Engines report their
+//  solution one operation at a time, in order, and the writer coalesces runs of the same
+//  opcode so that we emit a delete 3 instead of delete 1, delete 1, delete 1.
+//
+//  The writer also tracks how far into the old and new strings the script has progressed,
+//  which means an insert never needs to be told where its bytes come from; they are always
+//  the next bytes of the NewString.  This lets several engines, each solving a different
+//  range of the strings, append to the same edit script.
+//
+//  Instead of an edit script the writer can produce an array of EDIT_OP records, one per
+//  coalesced run.  Then nothing is split into 64 byte entries and no bytes get copied.
+//
+//  With substitutions on, every delete and insert between two keeps is gathered into one
+//  pending change, and the change is written as a replace of as many bytes as it both deletes
+//  and inserts followed by whatever deletes or inserts are left over.  Engines may also emit
+//  replaces of their own, they join the change the same way.
+//
+
+#define NoPendingOpcode (4)
+
+typedef struct _EDIT_SCRIPT_WRITER_ {
+  struct _EDIT_SCRIPT_ENTRY_ *EditScript; // the start of the script buffer
+  int EditScriptLength;          // the total length of the script buffer
+  int EditScriptIndex;           // next free index in the script buffer, or in the Ops array
+  PEDIT_OP Ops;                  // if not NULL we produce EDIT_OP records instead of a script
+  int OpsLength;                 // the number of records that fit in Ops
+  char *NewString;               // where inserted bytes come from
+  int Substitutions;             // nonzero to pair deletes with inserts into replaces
+  unsigned int LastOpcode;       // the opcode we are currently accumulating, or NoPendingOpcode
+  int OpcodeCount;               // how many bytes the pending opcode covers
+  int StartOldIndex;             // where the pending opcode starts in the OldString
+  int StartNewIndex;             // and in the NewString, for an insert that is its first byte
+  int ChangeOldCount;            // for a pending change, the old bytes it deletes
+  int ChangeNewCount;            // and the new bytes it inserts
+  int OldIndex, NewIndex;        // how much of the old and new strings the script has covered
+} EDIT_SCRIPT_WRITER, *PEDIT_SCRIPT_WRITER;
+
+//
+//  The diff context carries everything that the engines share while computing one edit
+//  script: the two strings, the memory budget, the cancellation state, and the writer that
+//  collects the result.  Engines always work on a range [OldStart,OldEnd) x [NewStart,NewEnd)
+//  of the strings.
+//
+//  While the LCE engine runs, the context also carries its indexes of the range, and the
+//  engines it calls slide their snakes with LceSnake instead of byte by byte.
+//
+
+typedef struct _LCE_INDEX_ LCE_INDEX, *PLCE_INDEX;
+
+typedef struct _DIFF_CONTEXT_ {
+  char *OldString; int OldStringLength;
+  char *NewString; int NewStringLength;
+  size_t MemoryBudget;         // the most workspace we may allocate, (size_t)-1 if unlimited
+  PDIFF_OPTIONS Options;       // the caller's options, or NULL
+  unsigned long long Deadline; // DiffMilliseconds() value at which we give up, 0 if none
+  int CancelCountdown;         // diagonals left until we next poll for cancellation
+  int Cancelled;               // set once the call has been cancelled, it never gets cleared
+  PLCE_INDEX Lce[2];           // the forward and reverse snake indexes, or NULL
+  EDIT_SCRIPT_WRITER Writer;
+} DIFF_CONTEXT, *PDIFF_CONTEXT;
+
+//
+//  After a cancellation the engines either fail with -4 or, if the caller asked for it,
+//  settle for an approximate script
+//
+
+#define ApproximateOnCancel(C) (((C)->Options != NULL) && ((C)->Options->Flags & DIFF_FLAG_APPROXIMATE_ON_CANCEL))
+
+void InitializeDiffContext(PDIFF_CONTEXT Context,
+			   char *OldString, int OldStringLength,
+			   char *NewString, int NewStringLength,
+			   char *EditScript, int EditScriptLength,
+			   PDIFF_OPTIONS Options);
+
+int IsDiffCancelled(PDIFF_CONTEXT Context);
+
+int AddEditScript(struct _EDIT_SCRIPT_ENTRY_ *P, int Length, int Index, unsigned int Opcode, int Count, char *NewString);
+
+int EmitEditScript(PEDIT_SCRIPT_WRITER Writer, unsigned int Opcode, int Count);
+
+int FlushEditScript(PEDIT_SCRIPT_WRITER Writer);
+
+int ComputeRangeEditScript(PDIFF_CONTEXT Context,
+			   int OldStart, int OldEnd,
+			   int NewStart, int NewEnd);
+
+int ComputeContextEditScript(PDIFF_CONTEXT Context);
+
+//
+//  Prepared bases and the base cache, see diflib_base.c and diflib_cache.c
+//
+
+int ComputeBaseEditScript(PDIFF_CONTEXT Context, PPREPARED_BASE Base);
+
+size_t PreparedBaseSize(PPREPARED_BASE Base);
+
+typedef struct _BASE_CACHE_ENTRY_ BASE_CACHE_ENTRY, *PBASE_CACHE_ENTRY;
+
+PBASE_CACHE_ENTRY AcquireCachedBase(PBASE_CACHE Cache, char *OldString, int OldStringLength);
+
+PPREPARED_BASE CachedBase(PBASE_CACHE_ENTRY Entry);
+
+void ReleaseCachedBase(PBASE_CACHE Cache, PBASE_CACHE_ENTRY Entry);
+
+//
+//  The linear engine, for engines that hand it their ranges
+//
+
+size_t LinearWorkspaceSize(int OldStringLength, int NewStringLength);
+
+void *AllocateWorkspace(PDIFF_CONTEXT Context, size_t Size);
+
+void FreeWorkspace(PDIFF_CONTEXT Context, void *Workspace);
+
+int ComputeLinearEditScript(PDIFF_CONTEXT Context,
+			    int *Vf, int *Vr,
+			    int OldStart, int OldEnd,
+			    int NewStart, int NewEnd);
+
+//
+//  The substitution engine, see diflib_substitution.c, and the LCE engine and its indexes
+//  of longest common extensions, see diflib_lce.c.  LceSnake returns how many bytes, up to
+//  Limit, the strings have in common from OldOffset and NewOffset on, or for a reverse index
+//  just before them.
+//
+
+int LceSnake(PLCE_INDEX Index, int OldOffset, int NewOffset, int Limit);
+
+int ComputeFurthestEditScript(PDIFF_CONTEXT Context,
+			      int OldStart, int OldEnd,
+			      int NewStart, int NewEnd,
+			      size_t MemoryBudget);
+
+int ComputeSubstitutionEditScript(PDIFF_CONTEXT Context,
+				  int OldStart, int OldEnd,
+				  int NewStart, int NewEnd);
+
+int ComputeLceEditScript(PDIFF_CONTEXT Context,
+			 int OldStart, int OldEnd,
+			 int NewStart, int NewEnd);
+
+//
+//  The wavefront engine, see diflib_wavefront.c
+//
+
+size_t WavefrontWorkspaceSize(int OldLength, int NewLength, int *BlockLength);
+
+int ComputeWavefrontEditScript(PDIFF_CONTEXT Context,
+			       int OldStart, int OldEnd,
+			       int NewStart, int NewEnd);
+
+//
+//  Snapshot mode, see diflib_snapshot.c
+//
+
+int ComputeSnapshotEditScript(PDIFF_CONTEXT Context);
+
+//
+//  Content defined chunking mode, see diflib_chunk.c
+//
+
+int ComputeChunkedEditScript(PDIFF_CONTEXT Context);
+
+//
+//  DiffParallelFor calls Routine once for every TaskIndex in [0,TaskCount) using up to
+//  ThreadCount threads, zero or less meaning one per processor.  Tasks are handed out in
+//  order as threads become free.  ThreadIndex tells the routine which of the threads it is
+//  running on, [0,ThreadCount), so that it can keep per thread buffers.  The calling thread
+//  is always thread zero, and we return once every task has completed.
+//
+
+typedef void (*PARALLEL_ROUTINE)(void *Context, int ThreadIndex, int TaskIndex);
+
+int DiffProcessorCount(void);
+
+int DiffParallelThreadCount(int ThreadCount, int TaskCount);
+
+void DiffParallelFor(int ThreadCount, int TaskCount, PARALLEL_ROUTINE Routine, void *Context);
+
+//
+//  A fast 64 bit non cryptographic hash of a buffer, used for matching content
+//
+
+unsigned long long DiffHash64(const void *Data, size_t Length, unsigned long long Seed);
+
+//
+//  Little endian integers of Size bytes, for the file formats
+//
+
+void DiffPutInteger(char *Buffer, unsigned long long Value, int Size);
+
+unsigned long long DiffGetInteger(const char *Buffer, int Size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _DIFLIB_INTERNAL_
@@ -0,0 +1,530 @@
+/*
+
+  This file implements the LCE engine, which ComputeRangeEditScript runs ahead of the usual
+  engines when DIFF_FLAG_LCE is set.
+
+  Once D is large the snakes of Myers' algorithm keep sliding over the same bytes, every
+  diagonal that crosses a long common run walks it again.  Here the snake from (x,y) is the
+  longest common extension of the old string at x and the new string at y, and we answer it
+  in constant time from an index of the range built once up front.  The search itself is the
+  furthest reaching one of the substitution engine, so the forward pass costs O(N+M+D^2) no
+  matter how long the snakes are, and honors DIFF_FLAG_SUBSTITUTIONS.
+
+  The index is the suffix array of Old#New, where # is a symbol that appears nowhere else,
+  built in linear time by induced sorting, SA-IS.  Kasai's algorithm gives the longest common
+  prefix of every pair of neighbouring suffixes, and the extension of any two suffixes is
+  the minimum of those between their ranks.  That minimum comes from a sparse table over
+  blocks of LCE_BLOCK entries plus a scan of the two partial blocks at the ends, which keeps
+  the table to a fraction of the array it covers.
+
+  The index costs about 24 bytes per byte of the range while it is built, and the rows
+  of the search cost (D+1)^2 ints.  When the rows would outgrow the memory budget we build
+  a second index over both ranges reversed and hand the range to the linear engine, whose
+  middle snake search slides both ways with them, so a large D costs time but no memory.
+  If the indexes won't fit either we give up before emitting anything and the range goes
+  to the next engine.
+
+  Short snakes are compared byte by byte, as a query costs a few cache misses, so the index
+  only pays for itself on inputs where many diagonals slide along the same long runs.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+#define LCE_BLOCK (32)
+
+//
+//  Most snakes are short, and comparing a few bytes costs less than the cache misses of a
+//  query, so the index only takes over once a snake has run this far
+//
+
+#define LCE_DIRECT_SLIDE (16)
+
+struct _LCE_INDEX_ {
+  char *OldString;       // the context's strings, for comparing short snakes directly
+  char *NewString;
+  int OldStart, OldEnd;  // the ranges indexed
+  int NewStart, NewEnd;
+  int Reversed;          // if the ranges were indexed last byte first
+  int OldLength, NewLength;
+  int Length;            // OldLength + 1 + NewLength
+  int *Rank;             // the position of each suffix in the suffix array
+  int *Lcp;              // Lcp[r] is the common prefix of suffixes ranked r-1 and r
+  int *Table;            // Table[l*BlockCount+b] is the minimum of Lcp blocks [b,b+2^l)
+  int BlockCount;
+};
+
+int LceIndexSize(int OldLength, int NewLength, size_t *Size)
+/*++
+
+  Description:
+
+    This routine works out the most memory building an index of the two ranges needs.
+
+  Output:
+
+    We return 0 with *Size set, or -2 if the ranges are too long to index.
+
+--*/
+{
+  long long Length = (long long)OldLength + NewLength + 1;
+  long long Blocks = (Length + LCE_BLOCK - 1) / LCE_BLOCK;
+  int Levels;
+
+  if (Length > 0x3fffffff) { return -2; }
+  for (Levels = 1; (1LL << Levels) <= Blocks; Levels++) { }
+
+  //
+  //  Rank, Lcp and the table stay, the string and the suffix array are only needed while
+  //  building, and SA-IS needs its types and buckets, which shrink by half at each level
+  //
+
+  *Size = sizeof(LCE_INDEX) + sizeof(int) * (size_t)(5 * Length + 2 * 258 + Levels * Blocks) + 2 * (size_t)Length;
+  return 0;
+}
+
+void DestroyLceIndex(PLCE_INDEX Index)
+{
+  if (Index == NULL) { return; }
+  free(Index->Rank);
+  free(Index->Lcp);
+  free(Index->Table);
+  free(Index);
+}
+
+//
+//  Suffix types for SA-IS.  A suffix is S type if it is smaller than the one after it and L
+//  type if larger, and an LMS suffix is an S type suffix right after an L type one.
+//
+
+#define IsLms(Types,i) (((i) > 0) && (Types)[i] && !(Types)[(i) - 1])
+
+void GetSuffixBuckets(int *String, int Length, int Alphabet, int *Buckets, int Ends)
+/*++
+
+  Description:
+
+    This routine sets each symbol's bucket to the start, or with Ends the end, of the
+    suffixes that begin with it in the suffix array.
+
+--*/
+{
+  int i, Sum;
+
+  memset(Buckets, 0, sizeof(int) * (size_t)Alphabet);
+  for (i = 0; i < Length; i++) { Buckets[String[i]]++; }
+  for (i = 0, Sum = 0; i < Alphabet; i++) {
+    Sum += Buckets[i];
+    Buckets[i] = Ends ? Sum : Sum - Buckets[i];
+  }
+}
+
+void InduceSuffixes(int *String, int *SuffixArray, unsigned char *Types, int *Buckets, int Length, int Alphabet)
+/*++
+
+  Description:
+
+    This routine induces the order of the L type suffixes from the suffixes already placed,
+    scanning forward, and then that of the S type suffixes, scanning back.
+
+--*/
+{
+  int i, j;
+
+  GetSuffixBuckets(String, Length, Alphabet, Buckets, 0);
+  for (i = 0; i < Length; i++) {
+    j = SuffixArray[i] - 1;
+    if ((j >= 0) && !Types[j]) { SuffixArray[Buckets[String[j]]++] = j; }
+  }
+  GetSuffixBuckets(String, Length, Alphabet, Buckets, 1);
+  for (i = Length - 1; i >= 0; i--) {
+    j = SuffixArray[i] - 1;
+    if ((j >= 0) && Types[j]) { SuffixArray[--Buckets[String[j]]] = j; }
+  }
+}
+
+int SortSuffixes(int *String, int *SuffixArray, int Length, int Alphabet)
+/*++
+
+  Description:
+
+    This routine builds the suffix array of String by induced sorting, SA-IS, in time linear
+    in its length.  The symbols must be in [0,Alphabet) and the last one must be a unique 0.
+    The LMS substrings are sorted by inducing from their unsorted positions, named, and if
+    any names repeat the string of names is sorted recursively in the top of SuffixArray.
+    The sorted LMS suffixes then induce the whole array.
+
+  Output:
+
+    We return 0, or -2 if we ran out of memory.
+
+--*/
+{
+  unsigned char *Types;
+  int *Buckets, *Reduced;
+  int LmsCount, Names, Previous, Position, Different;
+  int i, j, d;
+
+  Types = malloc((size_t)Length);
+  Buckets = malloc(sizeof(int) * (size_t)Alphabet);
+  if ((Types == NULL) || (Buckets == NULL)) {
+    free(Types);
+    free(Buckets);
+    return -2;
+  }
+
+  Types[Length - 1] = 1;
+  if (Length > 1) { Types[Length - 2] = 0; }
+  for (i = Length - 3; i >= 0; i--) {
+    Types[i] = (String[i] < String[i + 1]) || ((String[i] == String[i + 1]) && Types[i + 1]);
+  }
+
+  //
+  //  Sort the LMS substrings
+  //
+
+  GetSuffixBuckets(String, Length, Alphabet, Buckets, 1);
+  for (i = 0; i < Length; i++) { SuffixArray[i] = -1; }
+  for (i = 1; i < Length; i++) {
+    if (IsLms(Types, i)) { SuffixArray[--Buckets[String[i]]] = i; }
+  }
+  InduceSuffixes(String, SuffixArray, Types, Buckets, Length, Alphabet);
+
+  //
+  //  Gather them at the front in order and name them, equal substrings getting equal names.
+  //  An LMS position is at least two more than the previous one, so position/2 is a free
+  //  slot of its own in the back of the array.
+  //
+
+  for (i = 0, LmsCount = 0; i < Length; i++) {
+    if (IsLms(Types, SuffixArray[i])) { SuffixArray[LmsCount++] = SuffixArray[i]; }
+  }
+  for (i = LmsCount; i < Length; i++) { SuffixArray[i] = -1; }
+
+  for (i = 0, Names = 0, Previous = -1; i < LmsCount; i++) {
+    Position = SuffixArray[i];
+    Different = 0;
+    for (d = 0; d < Length; d++) {
+      if ((Previous == -1) || (String[Position + d] != String[Previous + d]) || (Types[Position + d] != Types[Previous + d])) {
+	Different = 1;
+	break;
+      } else if ((d > 0) && (IsLms(Types, Position + d) || IsLms(Types, Previous + d))) {
+	break;
+      }
+    }
+    if (Different) {
+      Names++;
+      Previous = Position;
+    }
+    SuffixArray[LmsCount + Position / 2] = Names - 1;
+  }
+  for (i = Length - 1, j = Length - 1; i >= LmsCount; i--) {
+    if (SuffixArray[i] >= 0) { SuffixArray[j--] = SuffixArray[i]; }
+  }
+
+  //
+  //  Sort the LMS suffixes by the string of their names, recursing only if names repeat
+  //
+
+  Reduced = &SuffixArray[Length - LmsCount];
+  if (Names < LmsCount) {
+    if (SortSuffixes(Reduced, SuffixArray, LmsCount, Names) < 0) {
+      free(Types);
+      free(Buckets);
+      return -2;
+    }
+  } else {
+    for (i = 0; i < LmsCount; i++) { SuffixArray[Reduced[i]] = i; }
+  }
+
+  //
+  //  Put the sorted LMS suffixes at the ends of their buckets and induce the rest
+  //
+
+  for (i = 1, j = 0; i < Length; i++) {
+    if (IsLms(Types, i)) { Reduced[j++] = i; }
+  }
+  for (i = 0; i < LmsCount; i++) { SuffixArray[i] = Reduced[SuffixArray[i]]; }
+  for (i = LmsCount; i < Length; i++) { SuffixArray[i] = -1; }
+  GetSuffixBuckets(String, Length, Alphabet, Buckets, 1);
+  for (i = LmsCount - 1; i >= 0; i--) {
+    j = SuffixArray[i];
+    SuffixArray[i] = -1;
+    SuffixArray[--Buckets[String[j]]] = j;
+  }
+  InduceSuffixes(String, SuffixArray, Types, Buckets, Length, Alphabet);
+
+  free(Types);
+  free(Buckets);
+  return 0;
+}
+
+int BuildLceIndex(PDIFF_CONTEXT Context,
+		  int OldStart, int OldEnd,
+		  int NewStart, int NewEnd,
+		  int Reversed, size_t MemoryBudget,
+		  PLCE_INDEX *Result)
+/*++
+
+  Description:
+
+    This routine builds the longest common extension index of an old and a new range.  A
+    reversed index is built over both ranges last byte first, so its extensions run back
+    from a point instead of forward.
+
+  Output:
+
+    We return 0 with *Result set, or -2 if the index won't fit in the budget or we ran out of
+    memory.
+
+--*/
+{
+  PLCE_INDEX Index;
+  int *Symbols = NULL, *SuffixArray = NULL, *Sorted;
+  int OldLength = OldEnd - OldStart;
+  int NewLength = NewEnd - NewStart;
+  int Length, Levels, Low, High;
+  int i, j, h;
+  size_t Size;
+
+  *Result = NULL;
+  if ((LceIndexSize(OldLength, NewLength, &Size) < 0) || (Size > MemoryBudget)) { return -2; }
+  if ((Index = calloc(1, sizeof(LCE_INDEX))) == NULL) { return -2; }
+
+  Length = OldLength + 1 + NewLength;
+  Index->OldString = Context->OldString;
+  Index->NewString = Context->NewString;
+  Index->OldStart = OldStart;
+  Index->OldEnd = OldEnd;
+  Index->NewStart = NewStart;
+  Index->NewEnd = NewEnd;
+  Index->Reversed = Reversed;
+  Index->OldLength = OldLength;
+  Index->NewLength = NewLength;
+  Index->Length = Length;
+  Index->BlockCount = (Length + LCE_BLOCK - 1) / LCE_BLOCK;
+  for (Levels = 1; (1 << Levels) <= Index->BlockCount; Levels++) { }
+
+  Index->Rank = malloc(sizeof(int) * (size_t)Length);
+  Index->Lcp = malloc(sizeof(int) * (size_t)Length);
+  Index->Table = malloc(sizeof(int) * (size_t)Levels * Index->BlockCount);
+  Symbols = malloc(sizeof(int) * ((size_t)Length + 1));
+  SuffixArray = malloc(sizeof(int) * ((size_t)Length + 1));
+  if ((Index->Rank == NULL) || (Index->Lcp == NULL) || (Index->Table == NULL) ||
+      (Symbols == NULL) || (SuffixArray == NULL)) {
+    DestroyLceIndex(Index);
+    Index = NULL;
+    goto Done;
+  }
+
+  //
+  //  Bytes become the symbols 2..257, the separator is 1, and SortSuffixes wants a 0 at the
+  //  end.  Its suffix sorts first, so the suffixes we index start at SuffixArray[1].
+  //
+
+  for (i = 0; i < OldLength; i++) {
+    Symbols[i] = (unsigned char)Context->OldString[Reversed ? OldEnd - 1 - i : OldStart + i] + 2;
+  }
+  Symbols[OldLength] = 1;
+  for (i = 0; i < NewLength; i++) {
+    Symbols[OldLength + 1 + i] = (unsigned char)Context->NewString[Reversed ? NewEnd - 1 - i : NewStart + i] + 2;
+  }
+  Symbols[Length] = 0;
+
+  if (SortSuffixes(Symbols, SuffixArray, Length + 1, 258) < 0) {
+    DestroyLceIndex(Index);
+    Index = NULL;
+    goto Done;
+  }
+  Sorted = &SuffixArray[1];
+  for (i = 0; i < Length; i++) { Index->Rank[Sorted[i]] = i; }
+
+  //
+  //  Now Rank is the inverse of the suffix array, and Kasai's algorithm fills in Lcp.  The
+  //  separator is unique so no common prefix runs across it.
+  //
+
+  for (i = 0, h = 0; i < Length; i++) {
+    if (Index->Rank[i] == 0) {
+      Index->Lcp[0] = 0;
+      h = 0;
+      continue;
+    }
+    j = Sorted[Index->Rank[i] - 1];
+    while ((i + h < Length) && (j + h < Length) && (Symbols[i + h] == Symbols[j + h])) { h++; }
+    Index->Lcp[Index->Rank[i]] = h;
+    if (h > 0) { h--; }
+  }
+
+  //
+  //  Level zero of the table is the minimum of each block, and level l combines two entries
+  //  of level l-1
+  //
+
+  for (i = 0; i < Index->BlockCount; i++) {
+    Low = i * LCE_BLOCK;
+    High = (Low + LCE_BLOCK < Length) ? Low + LCE_BLOCK : Length;
+    for (h = Index->Lcp[Low], j = Low + 1; j < High; j++) {
+      if (Index->Lcp[j] < h) { h = Index->Lcp[j]; }
+    }
+    Index->Table[i] = h;
+  }
+  for (h = 1; h < Levels; h++) {
+    for (i = 0; i + (1 << h) <= Index->BlockCount; i++) {
+      Low = Index->Table[(size_t)(h - 1) * Index->BlockCount + i];
+      High = Index->Table[(size_t)(h - 1) * Index->BlockCount + i + (1 << (h - 1))];
+      Index->Table[(size_t)h * Index->BlockCount + i] = (Low < High) ? Low : High;
+    }
+  }
+
+ Done:
+  free(Symbols);
+  free(SuffixArray);
+  *Result = Index;
+  return (Index == NULL) ? -2 : 0;
+}
+
+int LongestCommonExtension(PLCE_INDEX Index, int OldOffset, int NewOffset)
+/*++
+
+  Description:
+
+    This routine returns how many symbols the indexed old range starting at OldOffset and
+    the indexed new range starting at NewOffset have in common.  The offsets count from the
+    start of the ranges, or for a reversed index from their ends.
+
+--*/
+{
+  int Low, High, LowBlock, HighBlock, Level, Minimum, i;
+
+  if ((OldOffset >= Index->OldLength) || (NewOffset >= Index->NewLength)) { return 0; }
+
+  Low = Index->Rank[OldOffset];
+  High = Index->Rank[Index->OldLength + 1 + NewOffset];
+  if (Low > High) { i = Low; Low = High; High = i; }
+
+  //
+  //  The answer is the minimum of Lcp over (Low,High]
+  //
+
+  Low += 1;
+  LowBlock = Low / LCE_BLOCK;
+  HighBlock = High / LCE_BLOCK;
+  Minimum = Index->Lcp[Low];
+
+  if (HighBlock - LowBlock <= 1) {
+    for (i = Low + 1; i <= High; i++) {
+      if (Index->Lcp[i] < Minimum) { Minimum = Index->Lcp[i]; }
+    }
+    return Minimum;
+  }
+
+  for (i = Low + 1; i < (LowBlock + 1) * LCE_BLOCK; i++) {
+    if (Index->Lcp[i] < Minimum) { Minimum = Index->Lcp[i]; }
+  }
+  for (i = HighBlock * LCE_BLOCK; i <= High; i++) {
+    if (Index->Lcp[i] < Minimum) { Minimum = Index->Lcp[i]; }
+  }
+
+  LowBlock += 1;
+  HighBlock -= 1;
+  for (Level = 0; (2 << Level) <= HighBlock - LowBlock + 1; Level++) { }
+  i = Index->Table[(size_t)Level * Index->BlockCount + LowBlock];
+  if (i < Minimum) { Minimum = i; }
+  i = Index->Table[(size_t)Level * Index->BlockCount + HighBlock - (1 << Level) + 1];
+  if (i < Minimum) { Minimum = i; }
+  return Minimum;
+}
+
+int LceSnake(PLCE_INDEX Index, int OldOffset, int NewOffset, int Limit)
+/*++
+
+  Description:
+
+    This routine returns the length of the snake from OldOffset and NewOffset in the
+    context's strings, or for a reversed index the snake that ends just before them.  It
+    never slides further than Limit, and both offsets must be within the indexed ranges.
+
+--*/
+{
+  char *Old, *New;
+  int Step, i;
+
+  if (Index->Reversed) {
+    Old = &Index->OldString[OldOffset - 1];
+    New = &Index->NewString[NewOffset - 1];
+    Step = -1;
+  } else {
+    Old = &Index->OldString[OldOffset];
+    New = &Index->NewString[NewOffset];
+    Step = 1;
+  }
+
+  for (i = 0; (i < Limit) && (i < LCE_DIRECT_SLIDE) && (Old[i * Step] == New[i * Step]); i++) { }
+  if ((i < LCE_DIRECT_SLIDE) || (i == Limit)) { return i; }
+
+  if (Index->Reversed) {
+    i = LongestCommonExtension(Index, Index->OldEnd - OldOffset, Index->NewEnd - NewOffset);
+  } else {
+    i = LongestCommonExtension(Index, OldOffset - Index->OldStart, NewOffset - Index->NewStart);
+  }
+  return (i < Limit) ? i : Limit;
+}
+
+int ComputeLceEditScript(PDIFF_CONTEXT Context,
+			 int OldStart, int OldEnd,
+			 int NewStart, int NewEnd)
+/*++
+
+  Description:
+
+    This routine appends a minimal edit script for a range of the old string and a range of
+    the new string to the context's writer, sliding snakes with indexes of the range.  The
+    furthest reaching search goes first, and if its rows outgrow the budget the linear
+    engine takes over with a reverse index as well, so large D only costs time.
+
+  Output:
+
+    We return the next free index in the edit script.  Or -1 if the edit script is too short,
+    -2 with nothing emitted if the indexes and workspace won't fit in the budget, or if
+    cancelled and the caller wants an approximate script, and -4 if cancelled.
+
+--*/
+{
+  PLCE_INDEX Forward = NULL, Reverse = NULL;
+  size_t Size, Linear;
+  void *Workspace;
+  int i;
+
+  //
+  //  The index stays around while the search runs, so the rows only get what the budget has
+  //  left after it.  Likewise both indexes stay around while the linear engine runs, so the
+  //  budget has to cover them and its workspace together.
+  //
+
+  if ((i = BuildLceIndex(Context, OldStart, OldEnd, NewStart, NewEnd, 0, Context->MemoryBudget, &Forward)) < 0) {
+    return i;
+  }
+  LceIndexSize(OldEnd - OldStart, NewEnd - NewStart, &Size);
+  Context->Lce[0] = Forward;
+  i = ComputeFurthestEditScript(Context, OldStart, OldEnd, NewStart, NewEnd, Context->MemoryBudget - Size);
+
+  Linear = LinearWorkspaceSize(OldEnd - OldStart, NewEnd - NewStart);
+  if ((i == -2) && !Context->Cancelled && (Linear + 2 * Size <= Context->MemoryBudget) &&
+      (BuildLceIndex(Context, OldStart, OldEnd, NewStart, NewEnd, 1, Size, &Reverse) == 0)) {
+    Context->Lce[1] = Reverse;
+    if ((Workspace = AllocateWorkspace(Context, Linear)) != NULL) {
+      i = ComputeLinearEditScript(Context, (int *)Workspace, (int *)Workspace + Linear / (2 * sizeof(int)),
+				  OldStart, OldEnd, NewStart, NewEnd);
+      FreeWorkspace(Context, Workspace);
+    }
+  }
+
+  Context->Lce[0] = Context->Lce[1] = NULL;
+  DestroyLceIndex(Forward);
+  DestroyLceIndex(Reverse);
+  return i;
+}
@@ -0,0 +1,328 @@
+/*
+
+  This file implements Merkle tree comparison, see ComputeMerkleEditScript in diflib.h.
+
+  A Merkle tree hashes a string in leaves of LeafLength bytes, and then hashes the leaf
+  hashes in pairs, and those in pairs, up to a single root.  Two trees whose nodes at the
+  same position have the same hash cover the same bytes, so comparing the trees from the
+  root down visits only the subtrees that differ.  Matching subtrees become keeps without
+  the strings being read at all, and only the differing leaves are handed to the engines.
+
+  Like snapshot mode this compares the strings at equal offsets.  An insertion shifts every
+  leaf after it, and then everything after it is a differing leaf.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+#define DEFAULT_LEAF_LENGTH (4096)
+
+//
+//  Without a budget from the caller each differing leaf is diffed with this much workspace,
+//  see SNAPSHOT_PAGE_BUDGET
+//
+
+#define MERKLE_LEAF_BUDGET (4 * 1024)
+
+#define MAX_MERKLE_LEVELS (40)
+
+struct _MERKLE_TREE_ {
+  int StringLength;
+  int LeafLength;
+  int Levels;                            // level 0 is the leaves, Levels-1 is the root
+  int LevelCount[MAX_MERKLE_LEVELS];     // nodes on each level
+  unsigned long long *Level[MAX_MERKLE_LEVELS];
+  unsigned long long *Hashes;            // every level, one after the other
+};
+
+//
+//  Allocate a tree and lay out its levels, the leaf hashes are left for the caller
+//
+
+int AllocateMerkleTree(int StringLength, int LeafLength, PMERKLE_TREE *Tree)
+{
+  PMERKLE_TREE t;
+  size_t Total;
+  int Count, i;
+
+  *Tree = NULL;
+  if (LeafLength == 0) { LeafLength = DEFAULT_LEAF_LENGTH; }
+  if ((StringLength < 0) || (LeafLength < 1)) { return -3; }
+  if ((t = calloc(1, sizeof(MERKLE_TREE))) == NULL) { return -2; }
+
+  t->StringLength = StringLength;
+  t->LeafLength = LeafLength;
+  Count = (int)(((long long)StringLength + LeafLength - 1) / LeafLength);
+  for (Total = 0; ; Count = (Count + 1) / 2) {
+    t->LevelCount[t->Levels++] = Count;
+    Total += Count;
+    if (Count <= 1) { break; }
+  }
+
+  if ((t->Hashes = malloc(sizeof(unsigned long long) * (Total + 1))) == NULL) {
+    free(t);
+    return -2;
+  }
+  for (i = 0, Total = 0; i < t->Levels; i++) {
+    t->Level[i] = &t->Hashes[Total];
+    Total += t->LevelCount[i];
+  }
+  *Tree = t;
+  return 0;
+}
+
+//
+//  Hash every level above the leaves.  Each level is hashed with its own seed so that a node
+//  never collides with the same bytes hashed at another level.
+//
+
+void BuildMerkleLevels(PMERKLE_TREE Tree)
+{
+  int Level, i;
+
+  for (Level = 1; Level < Tree->Levels; Level++) {
+    for (i = 0; i < Tree->LevelCount[Level]; i++) {
+      Tree->Level[Level][i] = DiffHash64(&Tree->Level[Level-1][2*i],
+					 sizeof(unsigned long long) * ((2*i + 1 < Tree->LevelCount[Level-1]) ? 2 : 1),
+					 (unsigned long long)Level);
+    }
+  }
+}
+
+int CreateMerkleTree (char *String,
+		      int StringLength,
+		      int LeafLength,
+		      PMERKLE_TREE *Tree)
+/*++
+
+  Description:
+
+    This routine builds the Merkle tree of a string.
+
+  Input:
+
+    String, StringLength: the string to hash.  It is not referenced once we return.
+
+    LeafLength: how many bytes each leaf covers, zero for the default of 4096.
+
+    Tree: receives the new tree.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory, and -3 for a bad argument.
+
+--*/
+{
+  PMERKLE_TREE t;
+  long long Offset;
+  int i;
+
+  if ((i = AllocateMerkleTree(StringLength, LeafLength, &t)) < 0) { return i; }
+  for (i = 0; i < t->LevelCount[0]; i++) {
+    Offset = (long long)i * t->LeafLength;
+    t->Level[0][i] = DiffHash64(&String[Offset],
+				(size_t)(((StringLength - Offset) < t->LeafLength) ? (StringLength - Offset) : t->LeafLength), 0);
+  }
+  BuildMerkleLevels(t);
+  *Tree = t;
+  return 0;
+}
+
+int CreateMerkleTreeFromLeafHashes (unsigned long long *LeafHashes,
+				    int StringLength,
+				    int LeafLength,
+				    PMERKLE_TREE *Tree)
+/*++
+
+  Description:
+
+    This routine rebuilds a Merkle tree from the leaf hashes of an earlier one, as returned
+    by QueryMerkleLeafHashes, without needing the string itself.
+
+  Input:
+
+    LeafHashes: one hash per leaf, (StringLength + LeafLength - 1) / LeafLength of them.
+
+    StringLength, LeafLength: what the earlier tree was built with.
+
+    Tree: receives the new tree.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory, and -3 for a bad argument.
+
+--*/
+{
+  PMERKLE_TREE t;
+  int i;
+
+  if ((i = AllocateMerkleTree(StringLength, LeafLength, &t)) < 0) { return i; }
+  memcpy(t->Level[0], LeafHashes, sizeof(unsigned long long) * t->LevelCount[0]);
+  BuildMerkleLevels(t);
+  *Tree = t;
+  return 0;
+}
+
+int QueryMerkleLeafHashes (PMERKLE_TREE Tree,
+			   unsigned long long *LeafHashes,
+			   int LeafHashesLength)
+/*++
+
+  Description:
+
+    This routine copies out the leaf hashes of a tree so the caller can keep them for next
+    time.  With LeafHashes NULL it just returns how many there are.
+
+  Output:
+
+    We return the number of leaf hashes, or -1 if LeafHashesLength is too small.
+
+--*/
+{
+  if (LeafHashes == NULL) { return Tree->LevelCount[0]; }
+  if (LeafHashesLength < Tree->LevelCount[0]) { return -1; }
+  memcpy(LeafHashes, Tree->Level[0], sizeof(unsigned long long) * Tree->LevelCount[0]);
+  return Tree->LevelCount[0];
+}
+
+void DestroyMerkleTree (PMERKLE_TREE Tree)
+{
+  if (Tree == NULL) { return; }
+  free(Tree->Hashes);
+  free(Tree);
+}
+
+//
+//  The bytes a node covers, clipped to the end of its string
+//
+
+int MerkleNodeEnd(PMERKLE_TREE Tree, int Level, int Index)
+{
+  long long End = ((long long)(Index + 1) << Level) * Tree->LeafLength;
+  return (End < Tree->StringLength) ? (int)End : Tree->StringLength;
+}
+
+int CompareMerkleNodes(PDIFF_CONTEXT Context,
+		       PMERKLE_TREE OldTree,
+		       PMERKLE_TREE NewTree,
+		       int Level,
+		       int Index)
+/*++
+
+  Description:
+
+    This routine appends the edit script for the bytes under one node position to the
+    context's writer.  If both trees have a node there with the same hash and the same span
+    we keep the span, at a leaf we diff the two leaves, and otherwise we try both children.
+
+  Output:
+
+    We return the next free index in the edit script, or the same errors as
+    ComputeRangeEditScript.
+
+--*/
+{
+  long long Start = ((long long)Index << Level) * OldTree->LeafLength;
+  int OldStart, OldEnd, NewStart, NewEnd;
+  int i;
+
+  //
+  //  Nodes past the end of both strings have nothing under them
+  //
+
+  if ((Start >= OldTree->StringLength) && (Start >= NewTree->StringLength)) { return Context->Writer.EditScriptIndex; }
+  OldStart = (Start < OldTree->StringLength) ? (int)Start : OldTree->StringLength;
+  NewStart = (Start < NewTree->StringLength) ? (int)Start : NewTree->StringLength;
+  OldEnd = MerkleNodeEnd(OldTree, Level, Index);
+  NewEnd = MerkleNodeEnd(NewTree, Level, Index);
+
+  if ((Level < OldTree->Levels) && (Level < NewTree->Levels) &&
+      (Index < OldTree->LevelCount[Level]) && (Index < NewTree->LevelCount[Level]) &&
+      (OldEnd - OldStart == NewEnd - NewStart) &&
+      (OldTree->Level[Level][Index] == NewTree->Level[Level][Index])) {
+    return EmitEditScript(&Context->Writer, KeepOpcode, OldEnd - OldStart);
+  }
+
+  if (Level == 0) {
+    if (IsDiffCancelled(Context) && !ApproximateOnCancel(Context)) { return -4; }
+    return ComputeRangeEditScript(Context, OldStart, OldEnd, NewStart, NewEnd);
+  }
+
+  if ((i = CompareMerkleNodes(Context, OldTree, NewTree, Level - 1, 2*Index)) < 0) return i;
+  return CompareMerkleNodes(Context, OldTree, NewTree, Level - 1, 2*Index + 1);
+}
+
+int ComputeMerkleEditScript (char *OldString,
+			     int OldStringLength,
+			     PMERKLE_TREE OldTree,
+			     char *NewString,
+			     int NewStringLength,
+			     PMERKLE_TREE NewTree,
+			     char *EditScript,
+			     int EditScriptLength,
+			     PDIFF_OPTIONS Options)
+/*++
+
+  Description:
+
+    This routine computes an edit script that converts the old string into the new string by
+    comparing their Merkle trees, and diffing only the leaves that differ.
+
+  Input:
+
+    OldString, OldStringLength, NewString, NewStringLength: describe the two strings.
+
+    OldTree, NewTree: the trees of the two strings, or NULL to have us build them.  Both
+      trees must have the same leaf length.  Their hashes are trusted: a matching subtree is
+      kept without its bytes being compared.
+
+    EditScript, EditScriptLength: is the destination for the edit script.
+
+    Options: optionally tunes the computation, see DIFF_OPTIONS.  The memory budget applies to
+      each differing leaf.
+
+  Output:
+
+    We return the number of bytes that we used in the EditScript.  Or -3 if a tree does not
+    match its string or the leaf lengths differ, and otherwise the same errors as
+    ComputeEditScriptEx.
+
+--*/
+{
+  DIFF_CONTEXT Context;
+  PMERKLE_TREE OldBuilt = NULL, NewBuilt = NULL;
+  int LeafLength;
+  int i;
+
+  LeafLength = (OldTree != NULL) ? OldTree->LeafLength : ((NewTree != NULL) ? NewTree->LeafLength : 0);
+  if ((OldTree == NULL) && ((i = CreateMerkleTree(OldString, OldStringLength, LeafLength, &OldBuilt)) < 0)) { return i; }
+  if ((NewTree == NULL) && ((i = CreateMerkleTree(NewString, NewStringLength, LeafLength, &NewBuilt)) < 0)) {
+    DestroyMerkleTree(OldBuilt);
+    return i;
+  }
+  if (OldTree == NULL) { OldTree = OldBuilt; }
+  if (NewTree == NULL) { NewTree = NewBuilt; }
+
+  if ((OldTree->StringLength != OldStringLength) || (NewTree->StringLength != NewStringLength) ||
+      (OldTree->LeafLength != NewTree->LeafLength)) {
+    i = -3;
+  } else {
+    InitializeDiffContext(&Context, OldString, OldStringLength, NewString, NewStringLength,
+			  EditScript, EditScriptLength, Options);
+    if (Context.MemoryBudget == (size_t)-1) { Context.MemoryBudget = MERKLE_LEAF_BUDGET; }
+
+    i = CompareMerkleNodes(&Context, OldTree, NewTree,
+			   (OldTree->Levels > NewTree->Levels) ? OldTree->Levels - 1 : NewTree->Levels - 1, 0);
+    if (i >= 0) {
+      if (Options != NULL) { Options->IsApproximate = Context.Cancelled; }
+      i = FlushEditScript(&Context.Writer);
+    }
+  }
+
+  DestroyMerkleTree(OldBuilt);
+  DestroyMerkleTree(NewBuilt);
+  return i;
+}
@@ -0,0 +1,463 @@
+/*
+
+  This file implements pack files, see CreatePackWriter and OpenPack in diflib.h.
+
+  A pack holds many edit scripts in one file.  The writer appends each script to the end of
+  the file as it arrives, so building a pack is one sequential write, and when the writer is
+  finished it appends an index of where each script is.  A reader maps the whole file and
+  finds a script through the index without copying it anywhere.
+
+  Layout, all integers little endian:
+
+    8 bytes   PACK_MAGIC
+    the edit scripts, back to back
+    the index, at IndexOffset:
+      fanout    2^FanoutBits u32 counts, entry i counting the keys whose top FanoutBits
+                bits are at most i
+      entries   EntryCount times: u64 Key  u64 Offset  u32 Length, sorted by Key
+      bloom     2^BloomBitsLog2 bits, only if BloomBitsLog2 is not zero
+    the trailer, the last 32 bytes:
+      u64 IndexOffset  u64 EntryCount  u32 FanoutBits  u32 BloomBitsLog2  PACK_TRAILER_MAGIC
+
+  Entries are sorted by a key mixed from the caller's id rather than by the id itself, so
+  that the fanout splits the entries evenly however the ids were chosen.  The mixing is a
+  bijection, so the key identifies the id exactly.  With about one entry per fanout slot a
+  lookup reads one fanout slot and one or two entries.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+#define PACK_MAGIC "DIFPACK1"
+#define PACK_TRAILER_MAGIC "DIFPACKE"
+
+#define PACK_HEADER_LENGTH (8)
+#define PACK_ENTRY_LENGTH (20)
+#define PACK_TRAILER_LENGTH (32)
+
+#define PACK_MIN_FANOUT_BITS (8)
+#define PACK_MAX_FANOUT_BITS (24)
+
+//
+//  The bloom filter has at least PACK_BLOOM_BITS_PER_ENTRY bits per entry and sets
+//  PACK_BLOOM_HASHES of them for each, which lets through well under one absent id in a
+//  thousand
+//
+
+#define PACK_BLOOM_BITS_PER_ENTRY (16)
+#define PACK_BLOOM_HASHES (8)
+
+//
+//  The writer's file buffer, large enough that appending small scripts turns into large
+//  sequential writes
+//
+
+#define PACK_WRITE_BUFFER_LENGTH (1024 * 1024)
+
+//
+//  The splitmix64 finalizer.  Every step is invertible, so distinct ids get distinct keys.
+//
+
+unsigned long long PackKey(unsigned long long Id)
+{
+  Id = (Id ^ (Id >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  Id = (Id ^ (Id >> 27)) * 0x94d049bb133111ebULL;
+  return Id ^ (Id >> 31);
+}
+
+#define PackBloomBit(Key, i, Mask) \
+  (((unsigned int)(Key) + (unsigned int)(i) * ((unsigned int)((Key) >> 32) | 1)) & (Mask))
+
+typedef struct _PACK_ENTRY_ {
+  unsigned long long Key;
+  unsigned long long Offset;
+  int Length;
+} PACK_ENTRY, *PPACK_ENTRY;
+
+struct _PACK_WRITER_ {
+  FILE *File;
+  char *Buffer;                // the file's stdio buffer
+  unsigned int Flags;
+  unsigned long long Offset;   // where the next script goes
+  PPACK_ENTRY Entries;
+  long long EntryCount, EntryCapacity;
+  int Failed;                  // set once a write has failed, the pack is then useless
+};
+
+struct _PACK_ {
+  char *Map;
+  size_t MapLength;
+  unsigned long long IndexOffset;
+  unsigned long long EntryCount;
+  int FanoutBits;
+  const char *Fanout;
+  const char *Entries;
+  const unsigned char *Bloom;  // NULL if the pack has no bloom filter
+  unsigned int BloomMask;
+};
+
+int CreatePackWriter (const char *Path,
+		      unsigned int Flags,
+		      PPACK_WRITER *Writer)
+/*++
+
+  Description:
+
+    This routine creates a pack file, replacing any file already at Path, and returns a
+    writer for adding edit scripts to it.
+
+  Input:
+
+    Path: the pack file to create.
+
+    Flags: PACK_FLAG_BLOOM_FILTER to give the pack a bloom filter, which lets OpenPack's
+      lookups reject most absent ids without reading the index.
+
+    Writer: receives the writer.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory and -5 if the file could not be
+    created.
+
+--*/
+{
+  PPACK_WRITER w;
+
+  *Writer = NULL;
+  if ((w = calloc(1, sizeof(PACK_WRITER))) == NULL) { return -2; }
+  if ((w->Buffer = malloc(PACK_WRITE_BUFFER_LENGTH)) == NULL) {
+    free(w);
+    return -2;
+  }
+  if ((w->File = fopen(Path, "wb")) == NULL) {
+    free(w->Buffer);
+    free(w);
+    return -5;
+  }
+  setvbuf(w->File, w->Buffer, _IOFBF, PACK_WRITE_BUFFER_LENGTH);
+
+  w->Flags = Flags;
+  w->Offset = PACK_HEADER_LENGTH;
+  if (fwrite(PACK_MAGIC, 1, PACK_HEADER_LENGTH, w->File) != PACK_HEADER_LENGTH) { w->Failed = 1; }
+  *Writer = w;
+  return 0;
+}
+
+int AppendPackScript (PPACK_WRITER Writer,
+		      unsigned long long Id,
+		      char *EditScript,
+		      int EditScriptLength)
+/*++
+
+  Description:
+
+    This routine appends an edit script to the pack under the given id.  If the id is added
+    more than once the last script added wins.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory, -3 for a bad argument, and -5 if the
+    write failed.
+
+--*/
+{
+  PPACK_ENTRY Grown;
+
+  if (EditScriptLength < 0) { return -3; }
+  if (Writer->Failed) { return -5; }
+
+  if (Writer->EntryCount == Writer->EntryCapacity) {
+    Writer->EntryCapacity = (Writer->EntryCapacity == 0) ? 1024 : 2 * Writer->EntryCapacity;
+    if ((Grown = realloc(Writer->Entries, sizeof(PACK_ENTRY) * (size_t)Writer->EntryCapacity)) == NULL) {
+      Writer->EntryCapacity = Writer->EntryCount;
+      return -2;
+    }
+    Writer->Entries = Grown;
+  }
+
+  if (fwrite(EditScript, 1, (size_t)EditScriptLength, Writer->File) != (size_t)EditScriptLength) {
+    Writer->Failed = 1;
+    return -5;
+  }
+
+  Writer->Entries[Writer->EntryCount].Key = PackKey(Id);
+  Writer->Entries[Writer->EntryCount].Offset = Writer->Offset;
+  Writer->Entries[Writer->EntryCount].Length = EditScriptLength;
+  Writer->EntryCount++;
+  Writer->Offset += (unsigned long long)EditScriptLength;
+  return 0;
+}
+
+//
+//  Entries are sorted by key, and among entries with the same key by when they were added,
+//  which their offsets give us
+//
+
+int ComparePackEntries(const void *a, const void *b)
+{
+  const PACK_ENTRY *x = (const PACK_ENTRY *)a, *y = (const PACK_ENTRY *)b;
+
+  if (x->Key != y->Key) { return (x->Key < y->Key) ? -1 : 1; }
+  return (x->Offset < y->Offset) ? -1 : ((x->Offset > y->Offset) ? 1 : 0);
+}
+
+int WritePackIndex(PPACK_WRITER Writer)
+{
+  char Record[PACK_TRAILER_LENGTH];
+  unsigned int *Fanout = NULL;
+  unsigned char *Bloom = NULL;
+  unsigned long long BloomBits = 0, Slot;
+  long long Count, i;
+  int FanoutBits, BloomBitsLog2 = 0, Result = -2;
+  int j;
+
+  //
+  //  Drop every entry that a later one with the same id replaced
+  //
+
+  if (Writer->EntryCount > 0) { qsort(Writer->Entries, (size_t)Writer->EntryCount, sizeof(PACK_ENTRY), ComparePackEntries); }
+  for (i = 0, Count = 0; i < Writer->EntryCount; i++) {
+    if ((i + 1 < Writer->EntryCount) && (Writer->Entries[i+1].Key == Writer->Entries[i].Key)) { continue; }
+    Writer->Entries[Count++] = Writer->Entries[i];
+  }
+  if (Count > 0xffffffffLL) { return -3; }
+
+  for (FanoutBits = PACK_MIN_FANOUT_BITS; (FanoutBits < PACK_MAX_FANOUT_BITS) && ((1LL << FanoutBits) < Count); FanoutBits++) { }
+  if (Writer->Flags & PACK_FLAG_BLOOM_FILTER) {
+    for (BloomBitsLog2 = 6, BloomBits = 64; (BloomBitsLog2 < 32) && (BloomBits < PACK_BLOOM_BITS_PER_ENTRY * (unsigned long long)Count); BloomBitsLog2++, BloomBits <<= 1) { }
+  }
+
+  if (((Fanout = calloc((size_t)1 << FanoutBits, sizeof(unsigned int))) == NULL) ||
+      ((BloomBits != 0) && ((Bloom = calloc((size_t)(BloomBits / 8), 1)) == NULL))) {
+    goto Done;
+  }
+
+  for (i = 0; i < Count; i++) {
+    Fanout[Writer->Entries[i].Key >> (64 - FanoutBits)]++;
+    for (j = 0; (Bloom != NULL) && (j < PACK_BLOOM_HASHES); j++) {
+      Slot = PackBloomBit(Writer->Entries[i].Key, j, BloomBits - 1);
+      Bloom[Slot / 8] |= (unsigned char)(1 << (Slot % 8));
+    }
+  }
+
+  //
+  //  Write the fanout as running totals, then the entries, the filter and the trailer
+  //
+
+  Result = -5;
+  for (i = 0, Slot = 0; i < (1LL << FanoutBits); i++) {
+    Slot += Fanout[i];
+    DiffPutInteger(Record, Slot, 4);
+    if (fwrite(Record, 1, 4, Writer->File) != 4) { goto Done; }
+  }
+  for (i = 0; i < Count; i++) {
+    DiffPutInteger(&Record[0], Writer->Entries[i].Key, 8);
+    DiffPutInteger(&Record[8], Writer->Entries[i].Offset, 8);
+    DiffPutInteger(&Record[16], (unsigned long long)Writer->Entries[i].Length, 4);
+    if (fwrite(Record, 1, PACK_ENTRY_LENGTH, Writer->File) != PACK_ENTRY_LENGTH) { goto Done; }
+  }
+  if ((Bloom != NULL) && (fwrite(Bloom, 1, (size_t)(BloomBits / 8), Writer->File) != (size_t)(BloomBits / 8))) { goto Done; }
+
+  DiffPutInteger(&Record[0], Writer->Offset, 8);
+  DiffPutInteger(&Record[8], (unsigned long long)Count, 8);
+  DiffPutInteger(&Record[16], (unsigned long long)FanoutBits, 4);
+  DiffPutInteger(&Record[20], (unsigned long long)BloomBitsLog2, 4);
+  memcpy(&Record[24], PACK_TRAILER_MAGIC, 8);
+  if (fwrite(Record, 1, PACK_TRAILER_LENGTH, Writer->File) != PACK_TRAILER_LENGTH) { goto Done; }
+  Result = 0;
+
+ Done:
+  free(Fanout);
+  free(Bloom);
+  return Result;
+}
+
+int FinishPackWriter (PPACK_WRITER Writer)
+/*++
+
+  Description:
+
+    This routine writes the pack's index, closes the file and frees the writer.  The pack
+    can't be opened until this has succeeded, and the writer is gone either way.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory, -3 if the pack holds more than 2^32
+    scripts, and -5 if a write failed at any point since the writer was created.
+
+--*/
+{
+  int Result;
+
+  Result = Writer->Failed ? -5 : WritePackIndex(Writer);
+  if ((fclose(Writer->File) != 0) && (Result == 0)) { Result = -5; }
+  free(Writer->Buffer);
+  free(Writer->Entries);
+  free(Writer);
+  return Result;
+}
+
+int OpenPack (const char *Path,
+	      PPACK *Pack)
+/*++
+
+  Description:
+
+    This routine maps a pack file for lookups.  Only the trailer and the fanout are checked
+    here, every entry is checked as it is looked up.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory, -3 if the file is not a pack, and -5
+    if it could not be opened or mapped.
+
+--*/
+{
+  struct stat Status;
+  PPACK p;
+  const char *Trailer;
+  unsigned long long IndexLength, Previous, Count, i;
+  int Fd, BloomBitsLog2;
+
+  *Pack = NULL;
+  if ((p = calloc(1, sizeof(PACK))) == NULL) { return -2; }
+  if ((Fd = open(Path, O_RDONLY)) < 0) {
+    free(p);
+    return -5;
+  }
+  if ((fstat(Fd, &Status) != 0) || ((unsigned long long)Status.st_size > (size_t)-1)) {
+    close(Fd);
+    free(p);
+    return -5;
+  }
+  if (Status.st_size < PACK_HEADER_LENGTH + PACK_TRAILER_LENGTH) {
+    close(Fd);
+    free(p);
+    return -3;
+  }
+  p->MapLength = (size_t)Status.st_size;
+  p->Map = mmap(NULL, p->MapLength, PROT_READ, MAP_SHARED, Fd, 0);
+  close(Fd);
+  if (p->Map == MAP_FAILED) {
+    free(p);
+    return -5;
+  }
+
+  //
+  //  The trailer must describe an index that exactly fills the space between the scripts
+  //  and itself
+  //
+
+  Trailer = &p->Map[p->MapLength - PACK_TRAILER_LENGTH];
+  p->IndexOffset = DiffGetInteger(&Trailer[0], 8);
+  p->EntryCount = DiffGetInteger(&Trailer[8], 8);
+  p->FanoutBits = (int)DiffGetInteger(&Trailer[16], 4);
+  BloomBitsLog2 = (int)DiffGetInteger(&Trailer[20], 4);
+  IndexLength = p->MapLength - PACK_TRAILER_LENGTH - p->IndexOffset;
+
+  if ((memcmp(p->Map, PACK_MAGIC, PACK_HEADER_LENGTH) != 0) || (memcmp(&Trailer[24], PACK_TRAILER_MAGIC, 8) != 0) ||
+      (p->FanoutBits < PACK_MIN_FANOUT_BITS) || (p->FanoutBits > PACK_MAX_FANOUT_BITS) ||
+      ((BloomBitsLog2 != 0) && ((BloomBitsLog2 < 6) || (BloomBitsLog2 > 32))) ||
+      (p->EntryCount > 0xffffffffULL) ||
+      (p->IndexOffset < PACK_HEADER_LENGTH) || (p->IndexOffset > p->MapLength - PACK_TRAILER_LENGTH) ||
+      (IndexLength != (4ULL << p->FanoutBits) + PACK_ENTRY_LENGTH * p->EntryCount + ((BloomBitsLog2 == 0) ? 0 : (1ULL << BloomBitsLog2) / 8))) {
+    ClosePack(p);
+    return -3;
+  }
+
+  p->Fanout = &p->Map[p->IndexOffset];
+  p->Entries = p->Fanout + (4ULL << p->FanoutBits);
+  if (BloomBitsLog2 != 0) {
+    p->Bloom = (const unsigned char *)(p->Entries + PACK_ENTRY_LENGTH * p->EntryCount);
+    p->BloomMask = (unsigned int)((1ULL << BloomBitsLog2) - 1);
+  }
+
+  //
+  //  A lookup trusts the fanout to bound its search, so it has to be nondecreasing and end
+  //  at the entry count
+  //
+
+  for (i = 0, Previous = 0; i < (1ULL << p->FanoutBits); i++, Previous = Count) {
+    Count = DiffGetInteger(&p->Fanout[4 * i], 4);
+    if (Count < Previous) { break; }
+  }
+  if ((i < (1ULL << p->FanoutBits)) || (Previous != p->EntryCount)) {
+    ClosePack(p);
+    return -3;
+  }
+
+  *Pack = p;
+  return 0;
+}
+
+void ClosePack (PPACK Pack)
+{
+  if (Pack == NULL) { return; }
+  if (Pack->Map != NULL) { munmap(Pack->Map, Pack->MapLength); }
+  free(Pack);
+}
+
+int LookupPackScript (PPACK Pack,
+		      unsigned long long Id,
+		      char **EditScript,
+		      int *EditScriptLength)
+/*++
+
+  Description:
+
+    This routine finds the edit script stored under an id.  The script is not copied, we
+    return a pointer into the mapped pack that stays valid until the pack is closed, and can
+    be handed straight to ApplyEditScript.  Any number of threads may look up at once.
+
+  Output:
+
+    We return 1 if we found the id, 0 if the pack doesn't hold it, and -3 if its entry is
+    corrupt.
+
+--*/
+{
+  unsigned long long Key = PackKey(Id), EntryKey, Offset, Length;
+  unsigned long long Low, High, Middle, Slot;
+  int i;
+
+  if (Pack->Bloom != NULL) {
+    for (i = 0; i < PACK_BLOOM_HASHES; i++) {
+      Slot = PackBloomBit(Key, i, Pack->BloomMask);
+      if ((Pack->Bloom[Slot / 8] & (1 << (Slot % 8))) == 0) { return 0; }
+    }
+  }
+
+  Slot = Key >> (64 - Pack->FanoutBits);
+  Low = (Slot == 0) ? 0 : DiffGetInteger(&Pack->Fanout[4 * (Slot - 1)], 4);
+  High = DiffGetInteger(&Pack->Fanout[4 * Slot], 4);
+
+  while (Low < High) {
+    Middle = Low + (High - Low) / 2;
+    EntryKey = DiffGetInteger(&Pack->Entries[PACK_ENTRY_LENGTH * Middle], 8);
+    if (EntryKey < Key) {
+      Low = Middle + 1;
+    } else if (EntryKey > Key) {
+      High = Middle;
+    } else {
+      Offset = DiffGetInteger(&Pack->Entries[PACK_ENTRY_LENGTH * Middle + 8], 8);
+      Length = DiffGetInteger(&Pack->Entries[PACK_ENTRY_LENGTH * Middle + 16], 4);
+      if ((Offset < PACK_HEADER_LENGTH) || (Offset > Pack->IndexOffset) ||
+	  (Length > Pack->IndexOffset - Offset) || (Length > 0x7fffffff)) {
+	return -3;
+      }
+      *EditScript = &Pack->Map[Offset];
+      *EditScriptLength = (int)Length;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,217 @@
+/*
+
+  This file implements edit plans, see CreateEditPlan in diflib.h.
+
+  Decoding an edit script means walking it one byte entry at a time, and every keep, delete
+  or insert of more than 64 bytes is split over several entries.  A plan does that walk once.
+  Deletes disappear entirely, since the offsets of the other operations already account for
+  them, adjacent inserts and replaces are joined by copying their bytes into one pool, and what
+  is left is a short list of memcpy calls.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+typedef struct _PLAN_OP_ {
+  int IsInsert;     // 1 to copy from the literal pool, 0 to copy from the old string
+  int Offset;       // where the bytes come from in the old string or the pool
+  int NewOffset;    // where they go in the new string
+  int Length;
+} PLAN_OP, *PPLAN_OP;
+
+struct _EDIT_PLAN_ {
+  PPLAN_OP Ops;
+  int OpCount;
+  char *Pool;       // the inserted and replacing bytes, in order
+  int OldLength;    // how much of the old string the script covers explicitly
+  int NewLength;    // how much of the new string it produces before the implicit keep
+};
+
+int CreateEditPlan (char *EditScript,
+		    int EditScriptLength,
+		    PEDIT_PLAN *Plan)
+/*++
+
+  Description:
+
+    This routine decodes an edit script into a plan.
+
+  Input:
+
+    EditScript, EditScriptLength: the edit script.  It is not referenced once we return.
+
+    Plan: receives the new plan.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory and -3 if the edit script is corrupt.
+
+--*/
+{
+  EDIT_SCRIPT_CURSOR Cursor;
+  EDIT_OP Op;
+  PEDIT_PLAN p;
+  PPLAN_OP Last;
+  char *Literal;
+  int PoolLength = 0;
+  int IsLiteral, i;
+
+  *Plan = NULL;
+  if ((p = calloc(1, sizeof(EDIT_PLAN))) == NULL) { return -2; }
+
+  //
+  //  Every op takes at least one entry and the pool can't be larger than the script, so
+  //  sizing both by the script length means we never have to grow them
+  //
+
+  p->Ops = malloc(sizeof(PLAN_OP) * ((size_t)EditScriptLength + 1));
+  p->Pool = malloc((size_t)EditScriptLength + 1);
+  if ((p->Ops == NULL) || (p->Pool == NULL)) {
+    DestroyEditPlan(p);
+    return -2;
+  }
+
+  InitializeEditScriptCursor(&Cursor, EditScript, EditScriptLength, -1);
+  while ((i = NextEditScriptOp(&Cursor, &Op, &Literal)) > 0) {
+
+    if (Op.Opcode == DeleteOpcode) { continue; }
+
+    //
+    //  A replace is copied like an insert, its offsets already skip the old bytes it replaces
+    //
+
+    IsLiteral = (Op.Opcode == InsertOpcode) || (Op.Opcode == ReplaceOpcode);
+    Last = (p->OpCount > 0) ? &p->Ops[p->OpCount - 1] : NULL;
+    if (IsLiteral && (Last != NULL) && Last->IsInsert && (Last->NewOffset + Last->Length == Op.NewOffset)) {
+      Last->Length += Op.Length;
+    } else {
+      Last = &p->Ops[p->OpCount++];
+      Last->IsInsert = IsLiteral;
+      Last->Offset = Last->IsInsert ? PoolLength : Op.OldOffset;
+      Last->NewOffset = Op.NewOffset;
+      Last->Length = Op.Length;
+    }
+    if (IsLiteral) {
+      memcpy(&p->Pool[PoolLength], Literal, Op.Length);
+      PoolLength += Op.Length;
+    }
+  }
+  if (i < 0) {
+    DestroyEditPlan(p);
+    return i;
+  }
+
+  p->OldLength = Cursor.OldOffset;
+  p->NewLength = Cursor.NewOffset;
+  *Plan = p;
+  return 0;
+}
+
+void DestroyEditPlan (PEDIT_PLAN Plan)
+{
+  if (Plan == NULL) { return; }
+  free(Plan->Ops);
+  free(Plan->Pool);
+  free(Plan);
+}
+
+int QueryEditPlanLength (PEDIT_PLAN Plan,
+			 int OldStringLength)
+/*++
+
+  Description:
+
+    This routine returns the length of the new string the plan produces from an old string
+    of the given length, or -3 if the plan does not fit that old string.
+
+--*/
+{
+  long long Length;
+
+  if (OldStringLength < Plan->OldLength) { return -3; }
+  Length = (long long)Plan->NewLength + (OldStringLength - Plan->OldLength);
+  return (Length > 0x7fffffff) ? -3 : (int)Length;
+}
+
+int ApplyEditPlan (PEDIT_PLAN Plan,
+		   char *OldString,
+		   int OldStringLength,
+		   char *NewString,
+		   int NewStringLength)
+/*++
+
+  Description:
+
+    This routine applies a plan to one old string.
+
+  Output:
+
+    We return the number of bytes that we used in the NewString.  Or -1 if the NewStringLength is
+    too short to contain the needed string, or -3 if the plan does not fit the old string.
+
+--*/
+{
+  PPLAN_OP Op, End;
+  int Length;
+
+  //
+  //  These two checks cover every copy below
+  //
+
+  if ((Length = QueryEditPlanLength(Plan, OldStringLength)) < 0) { return Length; }
+  if (Length > NewStringLength) { return -1; }
+
+  for (Op = Plan->Ops, End = Op + Plan->OpCount; Op < End; Op++) {
+    memcpy(&NewString[Op->NewOffset], Op->IsInsert ? &Plan->Pool[Op->Offset] : &OldString[Op->Offset], Op->Length);
+  }
+  memcpy(&NewString[Plan->NewLength], &OldString[Plan->OldLength], OldStringLength - Plan->OldLength);
+  return Length;
+}
+
+typedef struct _PLAN_FAN_OUT_ {
+  PEDIT_PLAN Plan;
+  PEDIT_PLAN_TARGET Targets;
+} PLAN_FAN_OUT, *PPLAN_FAN_OUT;
+
+void ApplyEditPlanTarget(void *Context, int ThreadIndex, int TaskIndex)
+{
+  PPLAN_FAN_OUT FanOut = (PPLAN_FAN_OUT)Context;
+  PEDIT_PLAN_TARGET Target = &FanOut->Targets[TaskIndex];
+
+  (void)ThreadIndex;
+  Target->Result = ApplyEditPlan(FanOut->Plan, Target->OldString, Target->OldStringLength,
+				 Target->NewString, Target->NewStringLength);
+}
+
+int ApplyEditPlanParallel (PEDIT_PLAN Plan,
+			   PEDIT_PLAN_TARGET Targets,
+			   int TargetCount,
+			   int ThreadCount)
+/*++
+
+  Description:
+
+    This routine applies a plan to every target, in parallel.
+
+  Output:
+
+    We return 0 if every target succeeded, otherwise the first target's error.  Each target's
+    Result holds its own outcome either way.
+
+--*/
+{
+  PLAN_FAN_OUT FanOut;
+  int i;
+
+  FanOut.Plan = Plan;
+  FanOut.Targets = Targets;
+  DiffParallelFor(ThreadCount, TargetCount, ApplyEditPlanTarget, &FanOut);
+
+  for (i = 0; i < TargetCount; i++) {
+    if (Targets[i].Result < 0) { return Targets[i].Result; }
+  }
+  return 0;
+}
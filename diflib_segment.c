@@ -0,0 +1,235 @@
+/*
+
+  This file implements ComputeEditScriptSegments, which diffs strings that are stored as
+  lists of segments, such as the pieces of a rope, without first joining them together.
+
+  The engines index both strings directly in all of their inner loops, so they still need
+  contiguous memory.  But most edits touch a small part of a large string.  So we find the
+  common prefix and suffix by walking the segments of both strings side by side, comparing a
+  span at a time across segment boundaries, and only the middle that is left over goes to the
+  engines.  When that middle lies inside a single segment we hand the engines the segment
+  itself, and only when it spans segments do we gather it, and then just the middle.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+int SegmentListLength(PDIFF_SEGMENT Segments, int SegmentCount)
+/*++
+
+  Description:
+
+    This routine adds up the lengths of a segment list.
+
+  Output:
+
+    We return the total length, or -3 if a segment is malformed or the total does not fit in
+    an int.
+
+--*/
+{
+  long long Length = 0;
+  int i;
+
+  if ((SegmentCount < 0) || ((Segments == NULL) && (SegmentCount != 0))) { return -3; }
+  for (i = 0; i < SegmentCount; i++) {
+    if ((Segments[i].Length < 0) || ((Segments[i].Data == NULL) && (Segments[i].Length != 0))) { return -3; }
+    Length += Segments[i].Length;
+  }
+  return (Length > 0x7fffffff) ? -3 : (int)Length;
+}
+
+int CommonSegmentPrefix(PDIFF_SEGMENT Old, PDIFF_SEGMENT New, int Limit)
+/*++
+
+  Description:
+
+    This routine returns how many leading bytes, up to Limit, the two segment lists have in
+    common.  Both lists must hold at least Limit bytes.
+
+--*/
+{
+  int OldOffset = 0, NewOffset = 0;
+  int Common = 0, Span, i;
+
+  while (Common < Limit) {
+
+    while (OldOffset == Old->Length) { Old++; OldOffset = 0; }
+    while (NewOffset == New->Length) { New++; NewOffset = 0; }
+
+    Span = Limit - Common;
+    if (Span > Old->Length - OldOffset) { Span = Old->Length - OldOffset; }
+    if (Span > New->Length - NewOffset) { Span = New->Length - NewOffset; }
+
+    if (memcmp(&Old->Data[OldOffset], &New->Data[NewOffset], Span) != 0) {
+      for (i = 0; Old->Data[OldOffset + i] == New->Data[NewOffset + i]; i++) { }
+      return Common + i;
+    }
+    Common += Span;
+    OldOffset += Span;
+    NewOffset += Span;
+  }
+  return Common;
+}
+
+int CommonSegmentSuffix(PDIFF_SEGMENT Old, int OldCount, PDIFF_SEGMENT New, int NewCount, int Limit)
+/*++
+
+  Description:
+
+    This routine returns how many trailing bytes, up to Limit, the two segment lists have in
+    common.  Both lists must hold at least Limit bytes.
+
+--*/
+{
+  PDIFF_SEGMENT o, n;
+  int OldLeft, NewLeft;
+  int Common = 0, Span, i;
+
+  if (Limit == 0) { return 0; }
+  o = &Old[OldCount - 1];
+  n = &New[NewCount - 1];
+  OldLeft = o->Length;
+  NewLeft = n->Length;
+
+  //
+  //  OldLeft and NewLeft count the bytes of the current segments that are still unchecked,
+  //  they are the ones in front of the suffix we have matched so far
+  //
+
+  while (Common < Limit) {
+
+    while (OldLeft == 0) { o--; OldLeft = o->Length; }
+    while (NewLeft == 0) { n--; NewLeft = n->Length; }
+
+    Span = Limit - Common;
+    if (Span > OldLeft) { Span = OldLeft; }
+    if (Span > NewLeft) { Span = NewLeft; }
+
+    if (memcmp(&o->Data[OldLeft - Span], &n->Data[NewLeft - Span], Span) != 0) {
+      for (i = 1; o->Data[OldLeft - i] == n->Data[NewLeft - i]; i++) { }
+      return Common + i - 1;
+    }
+    Common += Span;
+    OldLeft -= Span;
+    NewLeft -= Span;
+  }
+  return Common;
+}
+
+int GetSegmentRange(PDIFF_SEGMENT Segments, int Start, int Length, char **Data, char **Copy)
+/*++
+
+  Description:
+
+    This routine makes the bytes [Start,Start+Length) of a segment list available as one
+    contiguous string.  If they lie in one segment we point into it, otherwise we gather them
+    into a buffer that the caller must free.
+
+  Output:
+
+    We return 0 with *Data set, and *Copy set to the buffer to free or NULL, or -2 if we
+    could not allocate the buffer.
+
+--*/
+{
+  int Offset, Span;
+
+  *Data = *Copy = NULL;
+  if (Length == 0) { return 0; }
+
+  while (Start >= Segments->Length) {
+    Start -= Segments->Length;
+    Segments++;
+  }
+  if (Length <= Segments->Length - Start) {
+    *Data = &Segments->Data[Start];
+    return 0;
+  }
+
+  if ((*Copy = malloc(Length)) == NULL) { return -2; }
+  for (Offset = 0; Offset < Length; Offset += Span, Segments++, Start = 0) {
+    Span = Segments->Length - Start;
+    if (Span > Length - Offset) { Span = Length - Offset; }
+    if (Span > 0) { memcpy(&(*Copy)[Offset], &Segments->Data[Start], Span); }
+  }
+  *Data = *Copy;
+  return 0;
+}
+
+int ComputeEditScriptSegments (PDIFF_SEGMENT OldSegments,
+			       int OldSegmentCount,
+			       PDIFF_SEGMENT NewSegments,
+			       int NewSegmentCount,
+			       char *EditScript,
+			       int EditScriptLength,
+			       PDIFF_OPTIONS Options)
+/*++
+
+  Description:
+
+    This routine computes the edit script that converts the concatenation of the old segments
+    into the concatenation of the new segments.  Without mode flags in the options the script
+    is the same one ComputeEditScriptEx computes for the joined strings.
+
+  Input:
+
+    OldSegments, OldSegmentCount: describe the old string, segment by segment.  Empty segments
+      are allowed.
+
+    NewSegments, NewSegmentCount: describe the new string the same way.
+
+    EditScript, EditScriptLength: receive the edit script.
+
+    Options: optionally tunes the computation, see DIFF_OPTIONS.  NULL means no options.
+
+  Output:
+
+    We return the length of the edit script, or the errors of ComputeEditScriptEx.  A
+    malformed segment list is -3.
+
+--*/
+{
+  DIFF_CONTEXT Context;
+  char *OldMiddle, *NewMiddle, *OldCopy = NULL, *NewCopy = NULL;
+  int OldLength, NewLength, Prefix, Suffix;
+  int i, Index;
+
+  if ((OldLength = SegmentListLength(OldSegments, OldSegmentCount)) < 0) { return OldLength; }
+  if ((NewLength = SegmentListLength(NewSegments, NewSegmentCount)) < 0) { return NewLength; }
+  if (Options != NULL) { Options->IsApproximate = 0; }
+
+  Prefix = CommonSegmentPrefix(OldSegments, NewSegments, (OldLength < NewLength) ? OldLength : NewLength);
+  if ((Prefix == OldLength) && (Prefix == NewLength)) { return 0; }
+  Suffix = CommonSegmentSuffix(OldSegments, OldSegmentCount, NewSegments, NewSegmentCount,
+			       ((OldLength < NewLength) ? OldLength : NewLength) - Prefix);
+
+  //
+  //  The prefix becomes explicit keeps at the front of the script, and the engines append the
+  //  script for the middle after them.  The suffix is left to the implicit trailing keep.
+  //
+
+  if ((Index = AddEditScript((struct _EDIT_SCRIPT_ENTRY_ *)EditScript, EditScriptLength, 0, KeepOpcode, Prefix, NULL)) < 0) {
+    return Index;
+  }
+
+  if (((i = GetSegmentRange(OldSegments, Prefix, OldLength - Prefix - Suffix, &OldMiddle, &OldCopy)) < 0) ||
+      ((i = GetSegmentRange(NewSegments, Prefix, NewLength - Prefix - Suffix, &NewMiddle, &NewCopy)) < 0)) {
+    free(OldCopy);
+    return i;
+  }
+
+  InitializeDiffContext(&Context, OldMiddle, OldLength - Prefix - Suffix, NewMiddle, NewLength - Prefix - Suffix,
+			EditScript + Index, EditScriptLength - Index, Options);
+  if ((i = ComputeContextEditScript(&Context)) >= 0) {
+    if (Options != NULL) { Options->IsApproximate = Context.Cancelled; }
+    i = FlushEditScript(&Context.Writer);
+  }
+
+  free(OldCopy);
+  free(NewCopy);
+  return (i < 0) ? i : Index + i;
+}
@@ -0,0 +1,764 @@
+/*
+
+  This file implements signatures and signature deltas, see ComputeSignature in diflib.h.
+
+  This is the rsync algorithm.  The side that holds the old string cuts it into BlockLength
+  byte blocks and sends a signature holding a weak and a strong checksum of each block.  The
+  side that holds the new string slides a BlockLength window over it one byte at a time.  At
+  each position it looks the window's weak checksum up among the blocks, and only on a hit
+  does it compute the strong checksum to confirm the match.  The weak checksum rolls: moving
+  the window one byte costs a few additions however long the blocks are.  Matched windows
+  become copies of old blocks and everything else is sent literally.
+
+  Signature format, all integers little endian:
+
+    4 bytes   SIGNATURE_MAGIC
+    4 bytes   BlockLength
+    4 bytes   OldStringLength
+    then for every block, the last of which may be short:
+    4 bytes   weak checksum
+    8 bytes   strong checksum
+
+  Delta format:
+
+    4 bytes   SIGNATURE_DELTA_MAGIC
+    4 bytes   BlockLength
+    4 bytes   OldStringLength
+    4 bytes   NewStringLength
+    8 bytes   hash of the new string, see HashSignatureContent
+    then records until the end of the delta, each starting with a varint V:
+      V even  copy V/2 consecutive blocks, starting with the block given by a second varint
+      V odd   insert the next V/2 bytes of the delta
+
+  Varints are little endian base 128, seven bits per byte with the top bit set on every byte
+  but the last.  Strong checksums are trusted the way a Merkle hash is, and the hash of the
+  whole new string catches the rare false match when the delta is applied.
+
+  Both halves run in parallel.  Every block of the signature is independent, and the new
+  string is scanned in regions, each on its own thread, with the matches merged in order
+  afterwards.  A region's scan starts afresh at its first byte, so where a match from one
+  region runs into the next we drop the next region's matches until they fall back into
+  step, at a cost of at most a block or so per region.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+#define SIGNATURE_MAGIC (0x67697364)        // "dsig"
+#define SIGNATURE_DELTA_MAGIC (0x746c6464)  // "ddlt"
+
+#define SIGNATURE_HEADER_LENGTH (12)
+#define SIGNATURE_ENTRY_LENGTH (12)
+#define SIGNATURE_DELTA_HEADER_LENGTH (24)
+
+//
+//  Work is handed to the threads in pieces of about this many bytes, a signature task covers
+//  this much of the old string and the hash of the new string is made of hashes of pieces
+//  this long.  The new string's regions are whole numbers of them.
+//
+
+#define SIGNATURE_CHUNK_LENGTH (1024 * 1024)
+
+//
+//  Longest a varint holding an int can be
+//
+
+#define MAX_VARINT_LENGTH (5)
+
+//
+//  The weak checksum of a window is two 16 bit sums: A is the sum of its bytes and B the sum
+//  of each byte weighted by how far it is from the end of the window.  Sliding the window
+//  one byte subtracts the byte leaving from A and its weight, BlockLength times it, from B.
+//
+
+#define WeakChecksum(A, B) (((unsigned int)(A) & 0xffff) | (((unsigned int)(B) & 0xffff) << 16))
+
+unsigned int ComputeWeakChecksum(const unsigned char *Data, int Length, unsigned int *A, unsigned int *B)
+{
+  unsigned int a = 0, b = 0;
+  int i;
+
+  for (i = 0; i < Length; i++) {
+    a += Data[i];
+    b += a;
+  }
+  *A = a;
+  *B = b;
+  return WeakChecksum(a, b);
+}
+
+int MaxSignatureLength (int OldStringLength,
+			int BlockLength)
+/*++
+
+  Description:
+
+    This routine returns the length of the signature that ComputeSignature produces for an
+    old string of the given length, or -3 for a bad argument.
+
+--*/
+{
+  long long Length;
+
+  if (BlockLength == 0) { BlockLength = SIGNATURE_DEFAULT_BLOCK_LENGTH; }
+  if ((OldStringLength < 0) || (BlockLength < SIGNATURE_MIN_BLOCK_LENGTH)) { return -3; }
+  Length = SIGNATURE_HEADER_LENGTH + SIGNATURE_ENTRY_LENGTH * (((long long)OldStringLength + BlockLength - 1) / BlockLength);
+  return (Length > 0x7fffffff) ? -3 : (int)Length;
+}
+
+typedef struct _SIGNATURE_BUILD_ {
+  char *OldString;
+  int OldStringLength;
+  int BlockLength;
+  int BlocksPerTask;
+  char *Entries;
+} SIGNATURE_BUILD, *PSIGNATURE_BUILD;
+
+void ComputeSignatureBlocks(void *Context, int ThreadIndex, int TaskIndex)
+{
+  PSIGNATURE_BUILD Build = (PSIGNATURE_BUILD)Context;
+  unsigned int A, B;
+  long long Offset, End;
+  char *Entry;
+  int Size;
+
+  (void)ThreadIndex;
+  Offset = (long long)TaskIndex * Build->BlocksPerTask * Build->BlockLength;
+  End = Offset + (long long)Build->BlocksPerTask * Build->BlockLength;
+  if (End > Build->OldStringLength) { End = Build->OldStringLength; }
+  Entry = &Build->Entries[(size_t)TaskIndex * Build->BlocksPerTask * SIGNATURE_ENTRY_LENGTH];
+
+  for ( ; Offset < End; Offset += Build->BlockLength, Entry += SIGNATURE_ENTRY_LENGTH) {
+    Size = (End - Offset < Build->BlockLength) ? (int)(End - Offset) : Build->BlockLength;
+    DiffPutInteger(&Entry[0], ComputeWeakChecksum((unsigned char *)&Build->OldString[Offset], Size, &A, &B), 4);
+    DiffPutInteger(&Entry[4], DiffHash64(&Build->OldString[Offset], (size_t)Size, 0), 8);
+  }
+}
+
+int ComputeSignature (char *OldString,
+		      int OldStringLength,
+		      int BlockLength,
+		      char *Signature,
+		      int SignatureLength)
+/*++
+
+  Description:
+
+    This routine computes the signature of an old string, which is all that
+    ComputeSignatureDelta needs to know about it.
+
+  Input:
+
+    OldString, OldStringLength: the old string.
+
+    BlockLength: how many bytes of the old string each signature entry covers, zero for
+      SIGNATURE_DEFAULT_BLOCK_LENGTH.  Smaller blocks find more matches around small changes
+      at the cost of a larger signature.  At least SIGNATURE_MIN_BLOCK_LENGTH.
+
+    Signature, SignatureLength: receive the signature, MaxSignatureLength bytes of it.
+
+  Output:
+
+    We return the number of bytes that we used in the Signature.  Or -1 if SignatureLength is
+    too small, and -3 for a bad argument.
+
+--*/
+{
+  return ComputeSignatureParallel(OldString, OldStringLength, BlockLength, Signature, SignatureLength, 1);
+}
+
+int ComputeSignatureParallel (char *OldString,
+			      int OldStringLength,
+			      int BlockLength,
+			      char *Signature,
+			      int SignatureLength,
+			      int ThreadCount)
+/*++
+
+  Description:
+
+    This routine computes the same signature as ComputeSignature using up to ThreadCount
+    threads, zero or less meaning one per processor.
+
+--*/
+{
+  SIGNATURE_BUILD Build;
+  int Length;
+
+  if (BlockLength == 0) { BlockLength = SIGNATURE_DEFAULT_BLOCK_LENGTH; }
+  if ((Length = MaxSignatureLength(OldStringLength, BlockLength)) < 0) { return Length; }
+  if (Length > SignatureLength) { return -1; }
+
+  DiffPutInteger(&Signature[0], SIGNATURE_MAGIC, 4);
+  DiffPutInteger(&Signature[4], (unsigned int)BlockLength, 4);
+  DiffPutInteger(&Signature[8], (unsigned int)OldStringLength, 4);
+
+  Build.OldString = OldString;
+  Build.OldStringLength = OldStringLength;
+  Build.BlockLength = BlockLength;
+  Build.BlocksPerTask = (BlockLength < SIGNATURE_CHUNK_LENGTH) ? SIGNATURE_CHUNK_LENGTH / BlockLength : 1;
+  Build.Entries = &Signature[SIGNATURE_HEADER_LENGTH];
+  DiffParallelFor(ThreadCount, (int)(((long long)OldStringLength + (long long)Build.BlocksPerTask * BlockLength - 1) /
+				     ((long long)Build.BlocksPerTask * BlockLength)),
+		  ComputeSignatureBlocks, &Build);
+  return Length;
+}
+
+//
+//  The signature as ComputeSignatureDelta sees it: the blocks hashed by weak checksum, with
+//  the chains of blocks that share a bucket threaded through Next
+//
+
+typedef struct _SIGNATURE_INDEX_ {
+  int BlockLength;
+  int OldStringLength;
+  int BlockCount;
+  int TailLength;              // length of the last block if it is short, otherwise 0
+  const char *Entries;         // the signature's entries, in block order
+  int *Buckets;                // first block in each bucket, or -1
+  int *Next;                   // next block in the same bucket, or -1
+  unsigned int *Weak;          // the weak checksum of each full length block
+  int BucketShift;             // 32 less the log of the bucket count
+  unsigned int *Filter;        // a bit per weak checksum hash, set if some block has it
+  int FilterShift;             // 32 less the log of the number of bits
+} SIGNATURE_INDEX, *PSIGNATURE_INDEX;
+
+#define SignatureStrong(Index, Block) (DiffGetInteger(&(Index)->Entries[(size_t)(Block) * SIGNATURE_ENTRY_LENGTH + 4], 8))
+#define SignatureBucket(Index, Weak) ((unsigned int)((Weak) * 0x9e3779b1u) >> (Index)->BucketShift)
+
+//
+//  Most windows match nothing.  The filter has 16 bits per block, few enough to stay in the
+//  cache, so it turns most of them away before we touch the buckets.
+//
+
+#define SignatureFilterBit(Index, Weak) ((unsigned int)((Weak) * 0x9e3779b1u) >> (Index)->FilterShift)
+#define SignatureMayMatch(Index, Weak) \
+  (((Index)->Filter[SignatureFilterBit(Index, Weak) >> 5] >> (SignatureFilterBit(Index, Weak) & 31)) & 1)
+
+void DestroySignatureIndex(PSIGNATURE_INDEX Index)
+{
+  free(Index->Buckets);
+  free(Index->Next);
+  free(Index->Weak);
+  free(Index->Filter);
+}
+
+int CreateSignatureIndex(char *Signature, int SignatureLength, PSIGNATURE_INDEX Index)
+/*++
+
+  Description:
+
+    This routine checks a signature and hashes its full length blocks.  The short last block,
+    if there is one, is only ever matched against the end of the new string, so it is left
+    out of the buckets.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory, and -3 if the signature is corrupt.
+
+--*/
+{
+  unsigned long long Bits;
+  int FullBlocks, Block;
+  unsigned int Bucket, Count;
+
+  memset(Index, 0, sizeof(SIGNATURE_INDEX));
+  if ((SignatureLength < SIGNATURE_HEADER_LENGTH) || (DiffGetInteger(&Signature[0], 4) != SIGNATURE_MAGIC)) { return -3; }
+
+  Index->BlockLength = (int)DiffGetInteger(&Signature[4], 4);
+  Index->OldStringLength = (int)DiffGetInteger(&Signature[8], 4);
+  if ((Index->BlockLength < SIGNATURE_MIN_BLOCK_LENGTH) ||
+      (MaxSignatureLength(Index->OldStringLength, Index->BlockLength) != SignatureLength)) {
+    return -3;
+  }
+
+  Index->BlockCount = (SignatureLength - SIGNATURE_HEADER_LENGTH) / SIGNATURE_ENTRY_LENGTH;
+  Index->TailLength = Index->OldStringLength % Index->BlockLength;
+  Index->Entries = &Signature[SIGNATURE_HEADER_LENGTH];
+  FullBlocks = Index->OldStringLength / Index->BlockLength;
+
+  for (Count = 2, Index->BucketShift = 31; Count < 2 * (unsigned int)FullBlocks; Count <<= 1, Index->BucketShift--) { }
+  Index->Buckets = malloc(sizeof(int) * Count);
+  Index->Next = malloc(sizeof(int) * ((size_t)FullBlocks + 1));
+  Index->Weak = malloc(sizeof(unsigned int) * ((size_t)FullBlocks + 1));
+  for (Bits = 64, Index->FilterShift = 26; (Bits < 16 * (unsigned long long)FullBlocks) && (Index->FilterShift > 0); Bits <<= 1, Index->FilterShift--) { }
+  Index->Filter = calloc((size_t)(Bits / 32), sizeof(unsigned int));
+  if ((Index->Buckets == NULL) || (Index->Next == NULL) || (Index->Weak == NULL) || (Index->Filter == NULL)) {
+    DestroySignatureIndex(Index);
+    return -2;
+  }
+  memset(Index->Buckets, 0xff, sizeof(int) * Count);
+
+  //
+  //  Inserting in reverse leaves every chain in block order, so of several identical blocks
+  //  we find the first
+  //
+
+  for (Block = FullBlocks - 1; Block >= 0; Block--) {
+    Index->Weak[Block] = (unsigned int)DiffGetInteger(&Index->Entries[(size_t)Block * SIGNATURE_ENTRY_LENGTH], 4);
+    Bucket = SignatureBucket(Index, Index->Weak[Block]);
+    Index->Filter[SignatureFilterBit(Index, Index->Weak[Block]) >> 5] |= 1u << (SignatureFilterBit(Index, Index->Weak[Block]) & 31);
+    Index->Next[Block] = Index->Buckets[Bucket];
+    Index->Buckets[Bucket] = Block;
+  }
+  return 0;
+}
+
+//
+//  The delta writer appends records to the caller's buffer.  Copies of consecutive blocks
+//  are joined into one record, and literal bytes accumulate until the next copy.
+//
+
+typedef struct _DELTA_WRITER_ {
+  char *Delta;
+  int DeltaLength;
+  int DeltaIndex;              // next free byte in the delta
+  int CopyBlock, CopyCount;    // the pending copy, CopyCount 0 if there is none
+} DELTA_WRITER, *PDELTA_WRITER;
+
+int PutDeltaVarint(PDELTA_WRITER Writer, unsigned long long Value)
+{
+  do {
+    if (Writer->DeltaIndex >= Writer->DeltaLength) { return -1; }
+    Writer->Delta[Writer->DeltaIndex++] = (char)((Value & 0x7f) | ((Value > 0x7f) ? 0x80 : 0));
+    Value >>= 7;
+  } while (Value != 0);
+  return 0;
+}
+
+int FlushDeltaCopy(PDELTA_WRITER Writer)
+{
+  if (Writer->CopyCount == 0) { return 0; }
+  if (PutDeltaVarint(Writer, 2ULL * Writer->CopyCount) < 0) { return -1; }
+  if (PutDeltaVarint(Writer, (unsigned long long)Writer->CopyBlock) < 0) { return -1; }
+  Writer->CopyCount = 0;
+  return 0;
+}
+
+int PutDeltaCopy(PDELTA_WRITER Writer, int Block)
+{
+  if ((Writer->CopyCount != 0) && (Writer->CopyBlock + Writer->CopyCount == Block)) {
+    Writer->CopyCount++;
+    return 0;
+  }
+  if (FlushDeltaCopy(Writer) < 0) { return -1; }
+  Writer->CopyBlock = Block;
+  Writer->CopyCount = 1;
+  return 0;
+}
+
+int PutDeltaLiteral(PDELTA_WRITER Writer, const char *Bytes, int Length)
+{
+  if (Length == 0) { return 0; }
+  if (FlushDeltaCopy(Writer) < 0) { return -1; }
+  if (PutDeltaVarint(Writer, 2ULL * Length + 1) < 0) { return -1; }
+  if (Length > Writer->DeltaLength - Writer->DeltaIndex) { return -1; }
+  memcpy(&Writer->Delta[Writer->DeltaIndex], Bytes, Length);
+  Writer->DeltaIndex += Length;
+  return 0;
+}
+
+int FindSignatureBlock(PSIGNATURE_INDEX Index,
+		       const char *Window,
+		       unsigned int Weak,
+		       int PreferredBlock)
+/*++
+
+  Description:
+
+    This routine looks for an old block with the same contents as a window of the new string.
+    The block after the last one we matched is tried first, so that a run of unchanged blocks
+    stays a single copy record even when the old string repeats itself.
+
+  Output:
+
+    We return the matching block, or -1 if there is none.
+
+--*/
+{
+  unsigned long long Strong = 0;
+  int HaveStrong = 0;
+  int Block;
+
+  if ((PreferredBlock >= 0) && (PreferredBlock < Index->OldStringLength / Index->BlockLength) &&
+      (Index->Weak[PreferredBlock] == Weak)) {
+    Strong = DiffHash64(Window, (size_t)Index->BlockLength, 0);
+    HaveStrong = 1;
+    if (SignatureStrong(Index, PreferredBlock) == Strong) { return PreferredBlock; }
+  }
+
+  if (!SignatureMayMatch(Index, Weak)) { return -1; }
+  for (Block = Index->Buckets[SignatureBucket(Index, Weak)]; Block >= 0; Block = Index->Next[Block]) {
+    if (Index->Weak[Block] != Weak) { continue; }
+    if (!HaveStrong) {
+      Strong = DiffHash64(Window, (size_t)Index->BlockLength, 0);
+      HaveStrong = 1;
+    }
+    if (SignatureStrong(Index, Block) == Strong) { return Block; }
+  }
+  return -1;
+}
+
+int MaxSignatureDeltaLength (int NewStringLength)
+/*++
+
+  Description:
+
+    This routine returns an upper bound on the length of the delta that ComputeSignatureDelta
+    can produce for a new string of the given length.
+
+    Every copy record covers a whole block, at least SIGNATURE_MIN_BLOCK_LENGTH bytes, except
+    perhaps the last one, and no two literal records are adjacent.  So the records cost the
+    literal bytes plus at most 3 * MAX_VARINT_LENGTH bytes per copy, plus a little.
+
+--*/
+{
+  long long Length;
+
+  Length = SIGNATURE_DELTA_HEADER_LENGTH + (long long)NewStringLength +
+           3 * MAX_VARINT_LENGTH * ((long long)NewStringLength / SIGNATURE_MIN_BLOCK_LENGTH + 2);
+  return (Length > 0x7fffffff) ? 0x7fffffff : (int)Length;
+}
+
+//
+//  The hash of a new string is a hash of the hashes of its SIGNATURE_CHUNK_LENGTH pieces, so
+//  that the regions of a parallel scan can each hash their own part
+//
+
+void HashSignatureChunks(char *String, int StringLength, int FirstChunk, int EndChunk, unsigned long long *ChunkHashes)
+{
+  long long Offset;
+  int Chunk;
+
+  for (Chunk = FirstChunk; Chunk < EndChunk; Chunk++) {
+    Offset = (long long)Chunk * SIGNATURE_CHUNK_LENGTH;
+    ChunkHashes[Chunk] = DiffHash64(&String[Offset],
+				    (size_t)((StringLength - Offset < SIGNATURE_CHUNK_LENGTH) ? StringLength - Offset : SIGNATURE_CHUNK_LENGTH), 0);
+  }
+}
+
+#define SignatureChunkCount(Length) ((int)(((long long)(Length) + SIGNATURE_CHUNK_LENGTH - 1) / SIGNATURE_CHUNK_LENGTH))
+
+#define HashSignatureContent(ChunkHashes, StringLength) \
+  DiffHash64((ChunkHashes), sizeof(unsigned long long) * SignatureChunkCount(StringLength), (unsigned long long)(StringLength))
+
+//
+//  A scan finds the blocks of the old string in one region of the new string.  Each match
+//  is the position in the new string of a window that matched, and the block it matched.
+//
+
+typedef struct _SIGNATURE_MATCH_ {
+  int Position;
+  int Block;
+} SIGNATURE_MATCH, *PSIGNATURE_MATCH;
+
+typedef struct _SIGNATURE_SCAN_ {
+  PSIGNATURE_INDEX Index;
+  char *NewString;
+  int NewStringLength;
+  int RegionLength;            // a whole number of SIGNATURE_CHUNK_LENGTH pieces
+  PDIFF_CONTEXT Contexts;      // one per region, for polling for cancellation
+  PSIGNATURE_MATCH Matches;    // MatchesPerRegion for each region
+  int MatchesPerRegion;
+  int *MatchCounts;            // how many matches each region found
+  unsigned long long *ChunkHashes;
+} SIGNATURE_SCAN, *PSIGNATURE_SCAN;
+
+void ScanSignatureRegion(void *Context, int ThreadIndex, int TaskIndex)
+/*++
+
+  Description:
+
+    This routine slides the window over one region of the new string.  Every window starting
+    in the region is looked up, whether or not the window ends in the region, and after a
+    match we continue with the window just past it.  A cancelled scan just stops, and the
+    rest of its region is sent literally.
+
+--*/
+{
+  PSIGNATURE_SCAN Scan = (PSIGNATURE_SCAN)Context;
+  PSIGNATURE_INDEX Index = Scan->Index;
+  PDIFF_CONTEXT DiffContext = &Scan->Contexts[TaskIndex];
+  PSIGNATURE_MATCH Matches = &Scan->Matches[(size_t)TaskIndex * Scan->MatchesPerRegion];
+  const unsigned char *New = (const unsigned char *)Scan->NewString;
+  unsigned int A = 0, B = 0;
+  int BlockLength = Index->BlockLength;
+  int Position, End, Block, Preferred, Rolled, Count;
+
+  (void)ThreadIndex;
+  Position = TaskIndex * Scan->RegionLength;
+  End = (Scan->NewStringLength - Position < Scan->RegionLength) ? Scan->NewStringLength : Position + Scan->RegionLength;
+  HashSignatureChunks(Scan->NewString, Scan->NewStringLength,
+		      Position / SIGNATURE_CHUNK_LENGTH, SignatureChunkCount(End), Scan->ChunkHashes);
+
+  //
+  //  Rolled is zero whenever the checksum has to be computed afresh, at the start and after
+  //  every match
+  //
+
+  for (Count = 0, Rolled = 0; (Position < End) && (Position <= Scan->NewStringLength - BlockLength); ) {
+
+    if (IsDiffCancelled(DiffContext)) { break; }
+
+    if (!Rolled) {
+      ComputeWeakChecksum(&New[Position], BlockLength, &A, &B);
+      Rolled = 1;
+    }
+
+    Preferred = ((Count != 0) && (Matches[Count-1].Position + BlockLength == Position)) ? Matches[Count-1].Block + 1 : -1;
+    if (((Preferred >= 0) || SignatureMayMatch(Index, WeakChecksum(A, B))) &&
+	((Block = FindSignatureBlock(Index, (char *)&New[Position], WeakChecksum(A, B), Preferred)) >= 0)) {
+      Matches[Count].Position = Position;
+      Matches[Count++].Block = Block;
+      Position += BlockLength;
+      Rolled = 0;
+      continue;
+    }
+
+    if (Position + BlockLength < Scan->NewStringLength) {
+      A += New[Position + BlockLength] - New[Position];
+      B += A - (unsigned int)BlockLength * New[Position];
+    }
+    Position++;
+  }
+  Scan->MatchCounts[TaskIndex] = Count;
+}
+
+int ComputeSignatureDelta (char *Signature,
+			   int SignatureLength,
+			   char *NewString,
+			   int NewStringLength,
+			   char *Delta,
+			   int DeltaLength,
+			   PDIFF_OPTIONS Options)
+/*++
+
+  Description:
+
+    This routine computes a delta that converts the old string described by a signature into
+    the new string, without needing the old string itself.
+
+  Input:
+
+    Signature, SignatureLength: the old string's signature, from ComputeSignature.
+
+    NewString, NewStringLength: the new string.
+
+    Delta, DeltaLength: receive the delta, at most MaxSignatureDeltaLength bytes of it.
+
+    Options: optionally allows the computation to be cancelled, see DIFF_OPTIONS.  With
+      DIFF_FLAG_APPROXIMATE_ON_CANCEL the rest of the new string is sent literally.  The
+      memory budget does not apply, we need about four ints per block of the signature.
+
+  Output:
+
+    We return the number of bytes that we used in the Delta.  Or -1 if DeltaLength is too
+    small, -2 if we ran out of memory, -3 if the signature is corrupt, and -4 if we were
+    cancelled.
+
+--*/
+{
+  return ComputeSignatureDeltaParallel(Signature, SignatureLength, NewString, NewStringLength,
+				       Delta, DeltaLength, Options, 1);
+}
+
+int ComputeSignatureDeltaParallel (char *Signature,
+				   int SignatureLength,
+				   char *NewString,
+				   int NewStringLength,
+				   char *Delta,
+				   int DeltaLength,
+				   PDIFF_OPTIONS Options,
+				   int ThreadCount)
+/*++
+
+  Description:
+
+    This routine computes a delta like ComputeSignatureDelta using up to ThreadCount threads,
+    zero or less meaning one per processor.  The new string is split into a few regions per
+    thread, so the delta can differ slightly from ComputeSignatureDelta's around the region
+    boundaries.  Options->CancelRoutine, if any, may be called from several threads at once.
+
+--*/
+{
+  SIGNATURE_INDEX Index;
+  SIGNATURE_SCAN Scan;
+  DELTA_WRITER Writer;
+  PSIGNATURE_MATCH Match, End;
+  unsigned int A, B;
+  int RegionCount, Region, LiteralStart, Cancelled = 0;
+  int i;
+
+  if (DeltaLength < SIGNATURE_DELTA_HEADER_LENGTH) { return -1; }
+  if ((i = CreateSignatureIndex(Signature, SignatureLength, &Index)) < 0) { return i; }
+
+  //
+  //  A single thread scans the whole string as one region, otherwise we aim for four
+  //  regions per thread so that an unlucky slow region doesn't hold everyone up
+  //
+
+  ThreadCount = DiffParallelThreadCount(ThreadCount, SignatureChunkCount(NewStringLength));
+  RegionCount = (ThreadCount == 1) ? 1 : 4 * ThreadCount;
+  Scan.RegionLength = SIGNATURE_CHUNK_LENGTH * ((SignatureChunkCount(NewStringLength) + RegionCount - 1) / RegionCount);
+  if (Scan.RegionLength == 0) { Scan.RegionLength = SIGNATURE_CHUNK_LENGTH; }
+  RegionCount = (int)(((long long)NewStringLength + Scan.RegionLength - 1) / Scan.RegionLength);
+  if (RegionCount == 0) { RegionCount = 1; }
+
+  Scan.Index = &Index;
+  Scan.NewString = NewString;
+  Scan.NewStringLength = NewStringLength;
+  Scan.MatchesPerRegion = Scan.RegionLength / Index.BlockLength + 1;
+  Scan.Contexts = malloc(sizeof(DIFF_CONTEXT) * RegionCount);
+  Scan.Matches = malloc(sizeof(SIGNATURE_MATCH) * (size_t)Scan.MatchesPerRegion * RegionCount);
+  Scan.MatchCounts = malloc(sizeof(int) * RegionCount);
+  Scan.ChunkHashes = malloc(sizeof(unsigned long long) * ((size_t)SignatureChunkCount(NewStringLength) + 1));
+
+  if ((Scan.Contexts == NULL) || (Scan.Matches == NULL) || (Scan.MatchCounts == NULL) || (Scan.ChunkHashes == NULL)) {
+    i = -2;
+  } else {
+    for (Region = 0; Region < RegionCount; Region++) {
+      InitializeDiffContext(&Scan.Contexts[Region], NULL, Index.OldStringLength, NewString, NewStringLength, NULL, 0, Options);
+    }
+    DiffParallelFor(ThreadCount, RegionCount, ScanSignatureRegion, &Scan);
+
+    for (Region = 0, Cancelled = 0; Region < RegionCount; Region++) { Cancelled |= Scan.Contexts[Region].Cancelled; }
+    i = (Cancelled && !ApproximateOnCancel(&Scan.Contexts[0])) ? -4 : 0;
+  }
+
+  if (i == 0) {
+    DiffPutInteger(&Delta[0], SIGNATURE_DELTA_MAGIC, 4);
+    DiffPutInteger(&Delta[4], (unsigned int)Index.BlockLength, 4);
+    DiffPutInteger(&Delta[8], (unsigned int)Index.OldStringLength, 4);
+    DiffPutInteger(&Delta[12], (unsigned int)NewStringLength, 4);
+    DiffPutInteger(&Delta[16], HashSignatureContent(Scan.ChunkHashes, NewStringLength), 8);
+    Writer.Delta = Delta;
+    Writer.DeltaLength = DeltaLength;
+    Writer.DeltaIndex = SIGNATURE_DELTA_HEADER_LENGTH;
+    Writer.CopyCount = 0;
+
+    //
+    //  Merge the regions' matches in order, dropping any that overlap the one before
+    //
+
+    for (Region = 0, LiteralStart = 0; (i == 0) && (Region < RegionCount); Region++) {
+      Match = &Scan.Matches[(size_t)Region * Scan.MatchesPerRegion];
+      for (End = Match + Scan.MatchCounts[Region]; (i == 0) && (Match < End); Match++) {
+	if (Match->Position < LiteralStart) { continue; }
+	if (((i = PutDeltaLiteral(&Writer, &NewString[LiteralStart], Match->Position - LiteralStart)) == 0) &&
+	    ((i = PutDeltaCopy(&Writer, Match->Block)) == 0)) {
+	  LiteralStart = Match->Position + Index.BlockLength;
+	}
+      }
+    }
+
+    //
+    //  The short last block can only have come from the end of the old string, so we only
+    //  look for it at the end of the new string
+    //
+
+    if ((i == 0) && !Cancelled && (Index.TailLength != 0) &&
+	(NewStringLength - Index.TailLength >= LiteralStart) &&
+	((unsigned int)DiffGetInteger(&Index.Entries[(size_t)(Index.BlockCount - 1) * SIGNATURE_ENTRY_LENGTH], 4) ==
+	 ComputeWeakChecksum((unsigned char *)&NewString[NewStringLength - Index.TailLength], Index.TailLength, &A, &B)) &&
+	(SignatureStrong(&Index, Index.BlockCount - 1) ==
+	 DiffHash64(&NewString[NewStringLength - Index.TailLength], (size_t)Index.TailLength, 0))) {
+
+      if (((i = PutDeltaLiteral(&Writer, &NewString[LiteralStart], NewStringLength - Index.TailLength - LiteralStart)) == 0) &&
+	  ((i = PutDeltaCopy(&Writer, Index.BlockCount - 1)) == 0)) {
+	LiteralStart = NewStringLength;
+      }
+    }
+
+    if (i == 0) { i = PutDeltaLiteral(&Writer, &NewString[LiteralStart], NewStringLength - LiteralStart); }
+    if (i == 0) { i = FlushDeltaCopy(&Writer); }
+    if (i == 0) { i = Writer.DeltaIndex; }
+  }
+
+  if ((i >= 0) && (Options != NULL)) { Options->IsApproximate = Cancelled; }
+  free(Scan.Contexts);
+  free(Scan.Matches);
+  free(Scan.MatchCounts);
+  free(Scan.ChunkHashes);
+  DestroySignatureIndex(&Index);
+  return i;
+}
+
+int GetDeltaVarint(const char *Delta, int DeltaLength, int *Index, unsigned long long *Value)
+{
+  int Shift;
+
+  for (*Value = 0, Shift = 0; (*Index < DeltaLength) && (Shift < 7 * MAX_VARINT_LENGTH); Shift += 7) {
+    *Value |= (unsigned long long)(Delta[*Index] & 0x7f) << Shift;
+    if ((Delta[(*Index)++] & 0x80) == 0) { return 0; }
+  }
+  return -3;
+}
+
+int ApplySignatureDelta (char *OldString,
+			 int OldStringLength,
+			 char *Delta,
+			 int DeltaLength,
+			 char *NewString,
+			 int NewStringLength)
+/*++
+
+  Description:
+
+    This routine applies a delta from ComputeSignatureDelta to the old string whose signature
+    it was computed against.  With NewString NULL it just returns the length of the new string.
+
+  Output:
+
+    We return the number of bytes that we used in the NewString.  Or -1 if NewStringLength is
+    too small, -2 if we ran out of memory, and -3 if the delta is corrupt, was computed
+    against an old string of another length, or produced a new string whose hash does not
+    match.  The last can mean the old string is not the one the signature was computed from.
+
+--*/
+{
+  unsigned long long Value, Block, *ChunkHashes;
+  long long Start, Length;
+  int BlockLength, BlockCount, Index, Offset, Result;
+
+  if ((DeltaLength < SIGNATURE_DELTA_HEADER_LENGTH) || (DiffGetInteger(&Delta[0], 4) != SIGNATURE_DELTA_MAGIC)) { return -3; }
+  BlockLength = (int)DiffGetInteger(&Delta[4], 4);
+  Result = (int)DiffGetInteger(&Delta[12], 4);
+  if ((BlockLength < SIGNATURE_MIN_BLOCK_LENGTH) || (Result < 0) ||
+      ((int)DiffGetInteger(&Delta[8], 4) != OldStringLength)) {
+    return -3;
+  }
+  if (NewString == NULL) { return Result; }
+  if (Result > NewStringLength) { return -1; }
+  BlockCount = (int)(((long long)OldStringLength + BlockLength - 1) / BlockLength);
+
+  for (Index = SIGNATURE_DELTA_HEADER_LENGTH, Offset = 0; Index < DeltaLength; Offset += (int)Length) {
+
+    if (GetDeltaVarint(Delta, DeltaLength, &Index, &Value) < 0) { return -3; }
+
+    if (Value & 1) {
+      Length = (long long)(Value >> 1);
+      if ((Length > DeltaLength - Index) || (Length > Result - Offset)) { return -3; }
+      memcpy(&NewString[Offset], &Delta[Index], (size_t)Length);
+      Index += (int)Length;
+    } else {
+      if (GetDeltaVarint(Delta, DeltaLength, &Index, &Block) < 0) { return -3; }
+      if ((Value == 0) || (Block + (Value >> 1) > (unsigned long long)BlockCount)) { return -3; }
+      Start = (long long)Block * BlockLength;
+      Length = (long long)(Value >> 1) * BlockLength;
+      if (Start + Length > OldStringLength) { Length = OldStringLength - Start; }
+      if (Length > Result - Offset) { return -3; }
+      memcpy(&NewString[Offset], &OldString[Start], (size_t)Length);
+    }
+  }
+
+  if (Offset != Result) { return -3; }
+
+  if ((ChunkHashes = malloc(sizeof(unsigned long long) * ((size_t)SignatureChunkCount(Result) + 1))) == NULL) { return -2; }
+  HashSignatureChunks(NewString, Result, 0, SignatureChunkCount(Result), ChunkHashes);
+  if (HashSignatureContent(ChunkHashes, Result) != DiffGetInteger(&Delta[16], 8)) { Result = -3; }
+  free(ChunkHashes);
+  return Result;
+}
@@ -0,0 +1,384 @@
+/*
+
+  This file implements sketches and the sketch index, see SKETCH in diflib.h.
+
+  A sketch is a MinHash signature of the set of 8 byte shingles of a string.  Rather than
+  hash every shingle SKETCH_SIZE times we hash it once, use the top bits of the hash to pick
+  one of SKETCH_SIZE bins, and keep the smallest low half seen in each bin.  Two strings
+  then agree on a bin with about the probability that they share a shingle, their Jaccard
+  similarity.  Short strings leave some bins empty, and those borrow the value of the next
+  bin that is not, rotated by how far away it is, so that empty bins still agree for
+  similar strings rather than always or never.
+
+  The index is locality sensitive hashing over the sketches.  Each sketch is cut into bands
+  of consecutive bins and filed under the hash of every band.  Two sketches that agree on
+  any whole band meet in the index, which is likely for similar strings and unlikely for
+  dissimilar ones, and candidates are ranked by how many bands they share.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+#define SKETCH_SHINGLE_LENGTH (8)
+#define SKETCH_EMPTY_BIN (0xffffffffU)
+#define SKETCH_ROTATION (0x9e3779b9U)
+
+#define INITIAL_SKETCH_BUCKET_COUNT (1024)
+
+//
+//  The splitmix64 finalizer, a cheap and well mixed hash of a shingle
+//
+
+#define SketchMix(x) ((x) ^= (x) >> 30, (x) *= 0xbf58476d1ce4e5b9ULL, (x) ^= (x) >> 27, (x) *= 0x94d049bb133111ebULL, (x) ^= (x) >> 31)
+
+void InitializeSketch (PSKETCH Sketch)
+/*++
+
+  Description:
+
+    This routine readies a sketch for UpdateSketch.
+
+--*/
+{
+  int i;
+
+  for (i = 0; i < SKETCH_SIZE; i++) { Sketch->Minima[i] = SKETCH_EMPTY_BIN; }
+  Sketch->Window = 0;
+  Sketch->Length = 0;
+}
+
+void AddSketchShingle(PSKETCH Sketch, unsigned long long Shingle)
+{
+  unsigned int Bin, Value;
+
+  SketchMix(Shingle);
+  Bin = (unsigned int)(Shingle >> (64 - SKETCH_SIZE_LOG2));
+  Value = (unsigned int)Shingle;
+  if (Value < Sketch->Minima[Bin]) { Sketch->Minima[Bin] = Value; }
+}
+
+void UpdateSketch (PSKETCH Sketch,
+		   char *Data,
+		   int Length)
+/*++
+
+  Description:
+
+    This routine adds the next bytes of a string to its sketch.  A string may be fed in any
+    number of pieces, the shingles that span pieces are counted as if it were in one.
+
+--*/
+{
+  unsigned long long Window = Sketch->Window;
+  int i = 0;
+
+  //
+  //  Until the first shingle is complete there is nothing to add
+  //
+
+  for (; (i < Length) && (Sketch->Length + i < SKETCH_SHINGLE_LENGTH - 1); i++) {
+    Window = (Window << 8) | (unsigned char)Data[i];
+  }
+  for (; i < Length; i++) {
+    Window = (Window << 8) | (unsigned char)Data[i];
+    AddSketchShingle(Sketch, Window);
+  }
+  Sketch->Window = Window;
+  Sketch->Length += Length;
+}
+
+void FinishSketch (PSKETCH Sketch)
+/*++
+
+  Description:
+
+    This routine completes a sketch once all of its string has been added.  A string shorter
+    than a shingle counts as one shingle, and empty bins are filled in from the bins that
+    follow them.
+
+--*/
+{
+  unsigned int Minima[SKETCH_SIZE];
+  int i, Distance;
+
+  if ((Sketch->Length > 0) && (Sketch->Length < SKETCH_SHINGLE_LENGTH)) {
+    AddSketchShingle(Sketch, Sketch->Window | ((unsigned long long)Sketch->Length << 56));
+  }
+
+  memcpy(Minima, Sketch->Minima, sizeof(Minima));
+  for (i = 0; i < SKETCH_SIZE; i++) {
+    if (Minima[i] != SKETCH_EMPTY_BIN) { continue; }
+    for (Distance = 1; Distance < SKETCH_SIZE; Distance++) {
+      if (Minima[(i + Distance) % SKETCH_SIZE] != SKETCH_EMPTY_BIN) {
+	Sketch->Minima[i] = Minima[(i + Distance) % SKETCH_SIZE] + (unsigned int)Distance * SKETCH_ROTATION;
+	break;
+      }
+    }
+  }
+}
+
+void ComputeSketch (char *Data,
+		    int Length,
+		    PSKETCH Sketch)
+/*++
+
+  Description:
+
+    This routine computes the sketch of a whole string at once.
+
+--*/
+{
+  InitializeSketch(Sketch);
+  UpdateSketch(Sketch, Data, Length);
+  FinishSketch(Sketch);
+}
+
+int CompareSketches (PSKETCH Sketch1,
+		     PSKETCH Sketch2)
+/*++
+
+  Description:
+
+    This routine estimates how similar the strings behind two finished sketches are.
+
+  Output:
+
+    We return how many of the SKETCH_SIZE bins agree.  Divided by SKETCH_SIZE that estimates
+    the Jaccard similarity of the strings' shingles.
+
+--*/
+{
+  int i, Count = 0;
+
+  for (i = 0; i < SKETCH_SIZE; i++) { Count += (Sketch1->Minima[i] == Sketch2->Minima[i]); }
+  return Count;
+}
+
+typedef struct _SKETCH_INDEX_ENTRY_ {
+  unsigned long long Key;      // the hash of one band, seeded with the band number
+  unsigned long long Id;
+  int Next;                    // the next entry in the same bucket, or -1
+} SKETCH_INDEX_ENTRY, *PSKETCH_INDEX_ENTRY;
+
+struct _SKETCH_INDEX_ {
+  int BandCount;
+  int BandLength;              // bins per band
+  int *Buckets;                // the first entry of each bucket, or -1
+  unsigned int BucketMask;     // the bucket count minus one, the count is a power of two
+  PSKETCH_INDEX_ENTRY Entries;
+  int EntryCount, EntryCapacity;
+};
+
+#define SketchBandKey(Index, Sketch, Band) \
+  DiffHash64(&(Sketch)->Minima[(Band) * (Index)->BandLength], sizeof(unsigned int) * (Index)->BandLength, (Band))
+
+int CreateSketchIndex (int BandCount,
+		       PSKETCH_INDEX *Index)
+/*++
+
+  Description:
+
+    This routine creates an empty sketch index.
+
+  Input:
+
+    BandCount: is how many bands each sketch is cut into, a power of two no larger than
+      SKETCH_SIZE, or zero for SKETCH_DEFAULT_BAND_COUNT.  More and so shorter bands find
+      less similar candidates.
+
+    Index: receives the index.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory, and -3 for a bad BandCount.
+
+--*/
+{
+  PSKETCH_INDEX x;
+  int i;
+
+  *Index = NULL;
+  if (BandCount == 0) { BandCount = SKETCH_DEFAULT_BAND_COUNT; }
+  if ((BandCount < 0) || (BandCount > SKETCH_SIZE) || ((BandCount & (BandCount - 1)) != 0)) { return -3; }
+
+  if ((x = calloc(1, sizeof(SKETCH_INDEX))) == NULL) { return -2; }
+  if ((x->Buckets = malloc(sizeof(int) * INITIAL_SKETCH_BUCKET_COUNT)) == NULL) {
+    free(x);
+    return -2;
+  }
+  for (i = 0; i < INITIAL_SKETCH_BUCKET_COUNT; i++) { x->Buckets[i] = -1; }
+  x->BucketMask = INITIAL_SKETCH_BUCKET_COUNT - 1;
+  x->BandCount = BandCount;
+  x->BandLength = SKETCH_SIZE / BandCount;
+  *Index = x;
+  return 0;
+}
+
+void DestroySketchIndex (PSKETCH_INDEX Index)
+{
+  if (Index == NULL) { return; }
+  free(Index->Buckets);
+  free(Index->Entries);
+  free(Index);
+}
+
+int GrowSketchIndex(PSKETCH_INDEX Index)
+/*++
+
+  Description:
+
+    This routine makes room for another sketch's worth of entries, doubling the entries and,
+    to keep the chains short, the buckets.
+
+--*/
+{
+  PSKETCH_INDEX_ENTRY Entries;
+  int *Buckets;
+  unsigned int Mask;
+  int i, Capacity;
+
+  if (Index->EntryCount + Index->BandCount > Index->EntryCapacity) {
+    if (Index->EntryCapacity > 0x3fffffff - Index->BandCount) { return -2; }
+    Capacity = (Index->EntryCapacity == 0) ? 16 * Index->BandCount : 2 * Index->EntryCapacity;
+    if ((Entries = realloc(Index->Entries, sizeof(SKETCH_INDEX_ENTRY) * Capacity)) == NULL) { return -2; }
+    Index->Entries = Entries;
+    Index->EntryCapacity = Capacity;
+  }
+
+  if ((unsigned int)Index->EntryCount + Index->BandCount > Index->BucketMask + 1) {
+    Mask = 2 * Index->BucketMask + 1;
+    if ((Buckets = malloc(sizeof(int) * ((size_t)Mask + 1))) != NULL) {
+      for (i = 0; i <= (int)Mask; i++) { Buckets[i] = -1; }
+      for (i = 0; i < Index->EntryCount; i++) {
+	Index->Entries[i].Next = Buckets[Index->Entries[i].Key & Mask];
+	Buckets[Index->Entries[i].Key & Mask] = i;
+      }
+      free(Index->Buckets);
+      Index->Buckets = Buckets;
+      Index->BucketMask = Mask;
+    }
+  }
+  return 0;
+}
+
+int InsertSketch (PSKETCH_INDEX Index,
+		  unsigned long long Id,
+		  PSKETCH Sketch)
+/*++
+
+  Description:
+
+    This routine files a finished sketch in the index under the caller's id.
+
+  Output:
+
+    We return 0 on success or -2 if we ran out of memory.
+
+--*/
+{
+  PSKETCH_INDEX_ENTRY Entry;
+  int Band, i;
+
+  if ((i = GrowSketchIndex(Index)) < 0) { return i; }
+  for (Band = 0; Band < Index->BandCount; Band++) {
+    Entry = &Index->Entries[Index->EntryCount];
+    Entry->Key = SketchBandKey(Index, Sketch, Band);
+    Entry->Id = Id;
+    Entry->Next = Index->Buckets[Entry->Key & Index->BucketMask];
+    Index->Buckets[Entry->Key & Index->BucketMask] = Index->EntryCount++;
+  }
+  return 0;
+}
+
+int CompareUnsigned64(const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+  return (x < y) ? -1 : (x > y);
+}
+
+int CompareSketchCandidates(const void *a, const void *b)
+{
+  const unsigned long long *x = (const unsigned long long *)a, *y = (const unsigned long long *)b;
+
+  //
+  //  Each candidate is an id followed by the number of bands it shares, most shared first
+  //
+
+  if (x[1] != y[1]) { return (x[1] > y[1]) ? -1 : 1; }
+  return (x[0] < y[0]) ? -1 : (x[0] > y[0]);
+}
+
+int QuerySketchCandidates (PSKETCH_INDEX Index,
+			   PSKETCH Sketch,
+			   unsigned long long *Ids,
+			   int IdsLength)
+/*++
+
+  Description:
+
+    This routine finds the sketches in the index that share at least one band with the given
+    sketch.  They are likely, but not certain, to be similar to it, CompareSketches gives a
+    better estimate and only a diff tells for sure.
+
+  Input:
+
+    Index: the index.
+
+    Sketch: a finished sketch.
+
+    Ids, IdsLength: receive the ids of the candidates, those that share the most bands first.
+
+  Output:
+
+    We return how many candidates there are, which may be more than fit in Ids, or -2 if we
+    ran out of memory.
+
+--*/
+{
+  PSKETCH_INDEX_ENTRY Entry;
+  unsigned long long Key, *Found = NULL, *Pairs, *Grown;
+  int Band, i, j, Count = 0, Capacity = 0;
+
+  for (Band = 0; Band < Index->BandCount; Band++) {
+    Key = SketchBandKey(Index, Sketch, Band);
+    for (i = Index->Buckets[Key & Index->BucketMask]; i >= 0; i = Entry->Next) {
+      Entry = &Index->Entries[i];
+      if (Entry->Key != Key) { continue; }
+      if (Count == Capacity) {
+	Capacity = (Capacity == 0) ? 64 : 2 * Capacity;
+	if ((Grown = realloc(Found, sizeof(unsigned long long) * Capacity)) == NULL) {
+	  free(Found);
+	  return -2;
+	}
+	Found = Grown;
+      }
+      Found[Count++] = Entry->Id;
+    }
+  }
+
+  //
+  //  Collapse the hits into an id and a count of shared bands per candidate and rank them
+  //
+
+  if (Count > 1) { qsort(Found, Count, sizeof(unsigned long long), CompareUnsigned64); }
+  for (i = j = 0; i < Count; i++) { j += (i == 0) || (Found[i] != Found[i - 1]); }
+  if ((Pairs = malloc(2 * sizeof(unsigned long long) * ((size_t)j + 1))) == NULL) {
+    free(Found);
+    return -2;
+  }
+  for (i = j = 0; i < Count; j++) {
+    Key = Found[i];
+    for (Band = 0; (i < Count) && (Found[i] == Key); i++, Band++) { }
+    Pairs[2 * j] = Key;
+    Pairs[2 * j + 1] = (unsigned long long)Band;
+  }
+  if (j > 1) { qsort(Pairs, j, 2 * sizeof(unsigned long long), CompareSketchCandidates); }
+
+  for (i = 0; (i < j) && (i < IdsLength); i++) { Ids[i] = Pairs[2 * i]; }
+  free(Pairs);
+  free(Found);
+  return j;
+}
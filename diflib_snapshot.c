@@ -0,0 +1,117 @@
+/*
+
+  This file implements the snapshot mode of ComputeEditScriptEx, see DIFF_FLAG_SNAPSHOT in
+  diflib.h.
+
+  Two snapshots of the same memory differ in place: a page that changed is still at the same
+  offset, it just has different bytes in it.  So rather than aligning the whole of both
+  strings we compare them a page at a time at equal offsets, emit a single keep for each run
+  of identical pages, and run the byte engines only on the pages that differ.  Finding the
+  identical pages is a straight pass over memory, and the engines only ever see one page.
+
+ */
+
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "diflib.h"
+#include "diflib_internal.h"
+
+//
+//  With no budget from the caller each dirty page gets at most this much workspace.  That
+//  holds the linear engine for about 500 bytes, so a page that changed from end to end is
+//  diffed in partitions of that size, and the work per page stays bounded however much of
+//  it changed.
+//
+
+#define SNAPSHOT_PAGE_BUDGET (4 * 1024)
+
+int SnapshotPagesEqual(const char *Old, const char *New)
+/*++
+
+  Description:
+
+    This routine compares one SNAPSHOT_PAGE_SIZE page of each snapshot, 64 bytes at a time.
+
+--*/
+{
+#if defined(__SSE2__)
+  const __m128i *o = (const __m128i *)Old;
+  const __m128i *n = (const __m128i *)New;
+  __m128i Equal;
+  int i;
+
+  for (i = 0; i < SNAPSHOT_PAGE_SIZE / 16; i += 4) {
+    Equal = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(o + i), _mm_loadu_si128(n + i)),
+					_mm_cmpeq_epi8(_mm_loadu_si128(o + i + 1), _mm_loadu_si128(n + i + 1))),
+			  _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(o + i + 2), _mm_loadu_si128(n + i + 2)),
+					_mm_cmpeq_epi8(_mm_loadu_si128(o + i + 3), _mm_loadu_si128(n + i + 3))));
+    if (_mm_movemask_epi8(Equal) != 0xffff) { return 0; }
+  }
+  return 1;
+#else
+  return memcmp(Old, New, SNAPSHOT_PAGE_SIZE) == 0;
+#endif
+}
+
+int ComputeSnapshotEditScript(PDIFF_CONTEXT Context)
+/*++
+
+  Description:
+
+    This routine appends the edit script for the whole of the context's strings to its
+    writer, treating them as two snapshots of the same memory.  Identical pages are kept
+    in bulk and every other page is diffed on its own.  Whatever follows the last whole page
+    of the shorter snapshot is diffed as one range.
+
+  Output:
+
+    We return the next free index in the edit script, or the same errors as
+    ComputeRangeEditScript.
+
+--*/
+{
+  char *OldString = Context->OldString;
+  char *NewString = Context->NewString;
+  int Pages, Page, End, Offset;
+  int i;
+
+  if (Context->MemoryBudget == (size_t)-1) { Context->MemoryBudget = SNAPSHOT_PAGE_BUDGET; }
+
+  Pages = ((Context->OldStringLength < Context->NewStringLength) ? Context->OldStringLength : Context->NewStringLength) / SNAPSHOT_PAGE_SIZE;
+
+  for (Page = 0; Page < Pages; Page = End) {
+
+    Offset = Page * SNAPSHOT_PAGE_SIZE;
+
+    if (IsDiffCancelled(Context)) {
+      if (!ApproximateOnCancel(Context)) { return -4; }
+      break;
+    }
+
+    if (SnapshotPagesEqual(&OldString[Offset], &NewString[Offset])) {
+
+      for (End = Page + 1;
+	   (End < Pages) && SnapshotPagesEqual(&OldString[End * SNAPSHOT_PAGE_SIZE], &NewString[End * SNAPSHOT_PAGE_SIZE]);
+	   End++) { }
+      if ((i = EmitEditScript(&Context->Writer, KeepOpcode, (End - Page) * SNAPSHOT_PAGE_SIZE)) < 0) return i;
+
+    } else {
+
+      End = Page + 1;
+      if ((i = ComputeRangeEditScript(Context, Offset, Offset + SNAPSHOT_PAGE_SIZE, Offset, Offset + SNAPSHOT_PAGE_SIZE)) < 0) return i;
+    }
+  }
+
+  //
+  //  Once cancelled we don't look at the remaining pages at all, they are simply replaced
+  //
+
+  Offset = Page * SNAPSHOT_PAGE_SIZE;
+  if (Context->Cancelled) {
+    if ((i = EmitEditScript(&Context->Writer, DeleteOpcode, Context->OldStringLength - Offset)) < 0) return i;
+    return EmitEditScript(&Context->Writer, InsertOpcode, Context->NewStringLength - Offset);
+  }
+  return ComputeRangeEditScript(Context, Offset, Context->OldStringLength, Offset, Context->NewStringLength);
+}
@@ -0,0 +1,207 @@
+/*
+
+  This file implements the substitution engine, which ComputeRangeEditScript runs ahead of
+  the others when DIFF_FLAG_SUBSTITUTIONS is set.
+
+  Myers' algorithm charges two edits for a byte that changed in place, a delete and an
+  insert, so a record with a few hundred scattered byte changes sends it a few hundred
+  diagonals deeper than the changes warrant.  Here a replace costs one edit, and the search
+  is the Landau-Vishkin form of Ukkonen's algorithm for that cost.  For each D and each
+  diagonal k we keep the furthest x that a path of cost D reaches on k.  It is one step past
+  the furthest x on k for D-1 by a replace, one step past the one on k-1 by a delete, or the
+  one on k+1 by an insert, whichever reaches furthest, and then slid down the snake.  Every
+  diagonal is within reach at every D, so unlike Myers we visit all 2D+1 of them.
+
+  Row D of the furthest x values holds 2D+1 ints and starts at D*D, so keeping every row for
+  the trace back costs (D+1)^2 ints.  That grows with the differences and not with the
+  strings, which suits inputs that are long but mostly unchanged, and we grow the rows as the
+  search deepens.  When they would outgrow the memory budget, or SUBSTITUTION_MAX_WORKSPACE,
+  we give up before emitting anything and the range goes to the usual engines instead.
+
+  Without the replace step the same search is the greedy forward pass of Myers' algorithm,
+  with every other diagonal out of reach.  The LCE engine, see diflib_lce.c, runs it either
+  way, with its snakes slid by a longest common extension query instead of byte by byte.
+
+ */
+
+#include <stdlib.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+#define SUBSTITUTION_MAX_WORKSPACE (256 * 1024 * 1024)
+
+//
+//  The furthest x of cost D on diagonal k, -1 when the diagonal is out of reach
+//
+
+#define Furthest(L,D,K) ((L)[(size_t)(D)*(D) + (D) + (K)])
+
+int FurthestPredecessor(int *L, int D, int k, int OldLength, int NewLength, int Replace, unsigned int *Opcode)
+/*++
+
+  Description:
+
+    This routine works out how a path of cost D first reaches diagonal k from the paths of
+    cost D-1, before it slides down the snake.  The search and the trace back both use it,
+    so they always agree on the step that was taken.  Replace says if a replace is a step.
+
+  Output:
+
+    We return the x the step reaches, or -1 if no path of cost D reaches k.  *Opcode
+    receives the step.
+
+--*/
+{
+  int X = -1, Candidate;
+
+  if (Replace && (k >= -(D-1)) && (k <= D-1) && ((Candidate = Furthest(L, D-1, k)) >= 0) &&
+      (Candidate < OldLength) && (Candidate - k < NewLength)) {
+    X = Candidate + 1;
+    *Opcode = ReplaceOpcode;
+  }
+  if ((k-1 >= -(D-1)) && ((Candidate = Furthest(L, D-1, k-1)) >= 0) &&
+      (Candidate < OldLength) && (Candidate + 1 > X)) {
+    X = Candidate + 1;
+    *Opcode = DeleteOpcode;
+  }
+  if ((k+1 <= D-1) && ((Candidate = Furthest(L, D-1, k+1)) >= 0) &&
+      (Candidate - (k+1) < NewLength) && (Candidate > X)) {
+    X = Candidate;
+    *Opcode = InsertOpcode;
+  }
+  return X;
+}
+
+int EmitFurthestPath(PEDIT_SCRIPT_WRITER Writer, int *L, int D, int k, int OldLength, int NewLength, int Replace)
+/*++
+
+  Description:
+
+    This routine traces the path that ended on diagonal k at cost D back to the start and
+    hands it to the writer.  Once the trace back has left row D it no longer needs it, so the
+    step taken into each row, and the length of the snake after it, are stored in its first
+    two slots.
+
+--*/
+{
+  unsigned int Opcode;
+  int X, i, j;
+
+  for (i = D; i > 0; i--) {
+    X = FurthestPredecessor(L, i, k, OldLength, NewLength, Replace, &Opcode);
+    j = Furthest(L, i, k) - X;
+    L[(size_t)i*i] = (int)Opcode;
+    L[(size_t)i*i + 1] = j;
+    if (Opcode == DeleteOpcode) { k--; } else if (Opcode == InsertOpcode) { k++; }
+  }
+
+  if ((j = EmitEditScript(Writer, KeepOpcode, L[0])) < 0) return j;
+  for (i = 1; i <= D; i++) {
+    if ((j = EmitEditScript(Writer, (unsigned int)L[(size_t)i*i], 1)) < 0) return j;
+    if ((j = EmitEditScript(Writer, KeepOpcode, L[(size_t)i*i + 1])) < 0) return j;
+  }
+  return j;
+}
+
+int ComputeFurthestEditScript(PDIFF_CONTEXT Context,
+			      int OldStart, int OldEnd,
+			      int NewStart, int NewEnd,
+			      size_t MemoryBudget)
+/*++
+
+  Description:
+
+    This routine appends the edit script with the fewest edits for a range of the old string
+    and a range of the new string to the context's writer.  With substitutions on a replace
+    is an edit, otherwise only deletes and inserts are.  Snakes are slid with the context's
+    forward index when it has one.
+
+  Input:
+
+    MemoryBudget: is the most the rows may grow to, the context's budget less whatever the
+        caller already holds.
+
+  Output:
+
+    We return the next free index in the edit script.  Or -1 if the edit script is too short,
+    -2 if the search outgrew the budget, or was cancelled and the caller wants an approximate
+    script, and -4 if cancelled.  With -2 nothing has been emitted.
+
+--*/
+{
+  char *OldString = &Context->OldString[OldStart];
+  char *NewString = &Context->NewString[NewStart];
+  int OldLength = OldEnd - OldStart;
+  int NewLength = NewEnd - NewStart;
+  size_t Limit, Capacity = 0, Needed;
+  unsigned int Opcode;
+  int Replace = Context->Writer.Substitutions;
+  int *L = NULL, *Grown;
+  int D, k, X, Y, i;
+
+  Limit = (MemoryBudget < SUBSTITUTION_MAX_WORKSPACE) ? MemoryBudget : SUBSTITUTION_MAX_WORKSPACE;
+  Limit /= sizeof(int);
+
+  for (D = 0; ; D++) {
+
+    Needed = (size_t)(D+1) * (D+1);
+    if (Needed > Capacity) {
+      Capacity = (Capacity == 0) ? 1024 : 2 * Capacity;
+      if (Capacity < Needed) { Capacity = Needed; }
+      if (Capacity > Limit) { Capacity = Limit; }
+      if ((Needed > Capacity) || ((Grown = realloc(L, sizeof(int) * Capacity)) == NULL)) {
+	free(L);
+	return -2;
+      }
+      L = Grown;
+    }
+
+    for (k = -D; k <= D; k++) {
+
+      if (IsDiffCancelled(Context)) {
+	free(L);
+	return ApproximateOnCancel(Context) ? -2 : -4;
+      }
+
+      X = -1;
+      if ((k >= -NewLength) && (k <= OldLength)) {
+	X = (D == 0) ? 0 : FurthestPredecessor(L, D, k, OldLength, NewLength, Replace, &Opcode);
+      }
+      if (X >= 0) {
+	Y = X - k;
+	if (Context->Lce[0] != NULL) {
+	  X += LceSnake(Context->Lce[0], OldStart + X, NewStart + Y,
+			(OldLength - X < NewLength - Y) ? OldLength - X : NewLength - Y);
+	} else {
+	  while ((X < OldLength) && (Y < NewLength) && (OldString[X] == NewString[Y])) {
+	    X++;
+	    Y++;
+	  }
+	}
+      }
+      Furthest(L, D, k) = X;
+
+      if ((X == OldLength) && (X - k == NewLength)) {
+	i = EmitFurthestPath(&Context->Writer, L, D, k, OldLength, NewLength, Replace);
+	free(L);
+	return i;
+      }
+    }
+  }
+}
+
+int ComputeSubstitutionEditScript(PDIFF_CONTEXT Context,
+				  int OldStart, int OldEnd,
+				  int NewStart, int NewEnd)
+/*++
+
+  Description:
+
+    This routine appends the edit script with the fewest deletes, inserts, and replaces for
+    a range of the old string and a range of the new string to the context's writer.  It
+    returns what ComputeFurthestEditScript does.
+
+--*/
+{
+  return ComputeFurthestEditScript(Context, OldStart, OldEnd, NewStart, NewEnd, Context->MemoryBudget);
+}
@@ -0,0 +1,164 @@
+/*
+
+  Support routines shared by the rest of diflib: a simple parallel for loop on top of
+  pthreads and a fast content hash.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "diflib_internal.h"
+
+int DiffProcessorCount(void)
+{
+  long Count;
+
+  Count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (Count < 1) ? 1 : (int)Count;
+}
+
+//
+//  Returns how many threads DiffParallelFor will actually use for the given request, so
+//  that callers can size their per thread buffers
+//
+
+int DiffParallelThreadCount(int ThreadCount, int TaskCount)
+{
+  if (ThreadCount <= 0) { ThreadCount = DiffProcessorCount(); }
+  if (ThreadCount > TaskCount) { ThreadCount = TaskCount; }
+  return (ThreadCount < 1) ? 1 : ThreadCount;
+}
+
+typedef struct _PARALLEL_FOR_ {
+  pthread_mutex_t Lock;
+  int NextTask;
+  int TaskCount;
+  PARALLEL_ROUTINE Routine;
+  void *Context;
+} PARALLEL_FOR, *PPARALLEL_FOR;
+
+typedef struct _PARALLEL_WORKER_ {
+  PPARALLEL_FOR Loop;
+  int ThreadIndex;
+  pthread_t Thread;
+} PARALLEL_WORKER, *PPARALLEL_WORKER;
+
+void *ParallelForWorker(void *Parameter)
+{
+  PPARALLEL_WORKER Worker = (PPARALLEL_WORKER)Parameter;
+  PPARALLEL_FOR Loop = Worker->Loop;
+  int Task;
+
+  for (;;) {
+    pthread_mutex_lock(&Loop->Lock);
+    Task = Loop->NextTask++;
+    pthread_mutex_unlock(&Loop->Lock);
+    if (Task >= Loop->TaskCount) { break; }
+    Loop->Routine(Loop->Context, Worker->ThreadIndex, Task);
+  }
+  return NULL;
+}
+
+void DiffParallelFor(int ThreadCount, int TaskCount, PARALLEL_ROUTINE Routine, void *Context)
+{
+  PARALLEL_FOR Loop;
+  PPARALLEL_WORKER Workers;
+  int Started;
+  int i;
+
+  ThreadCount = DiffParallelThreadCount(ThreadCount, TaskCount);
+
+  //
+  //  With one thread, or if we cannot get memory for the workers, just run the loop here
+  //
+
+  if ((ThreadCount == 1) || ((Workers = malloc(sizeof(PARALLEL_WORKER) * ThreadCount)) == NULL)) {
+    for (i = 0; i < TaskCount; i++) { Routine(Context, 0, i); }
+    return;
+  }
+
+  pthread_mutex_init(&Loop.Lock, NULL);
+  Loop.NextTask = 0;
+  Loop.TaskCount = TaskCount;
+  Loop.Routine = Routine;
+  Loop.Context = Context;
+
+  //
+  //  Threads that fail to start are not a problem, the ones that did start and this thread
+  //  will pick up their share of the tasks
+  //
+
+  for (i = 1, Started = 1; i < ThreadCount; i++) {
+    Workers[Started].Loop = &Loop;
+    Workers[Started].ThreadIndex = Started;
+    if (pthread_create(&Workers[Started].Thread, NULL, ParallelForWorker, &Workers[Started]) == 0) { Started++; }
+  }
+  Workers[0].Loop = &Loop;
+  Workers[0].ThreadIndex = 0;
+  ParallelForWorker(&Workers[0]);
+
+  for (i = 1; i < Started; i++) { pthread_join(Workers[i].Thread, NULL); }
+  pthread_mutex_destroy(&Loop.Lock);
+  free(Workers);
+}
+
+//
+//  This is MurmurHash64A, it consumes eight bytes at a time and mixes the tail in at the end
+//
+
+unsigned long long DiffHash64(const void *Data, size_t Length, unsigned long long Seed)
+{
+  const unsigned long long m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  const unsigned char *p = (const unsigned char *)Data;
+  const unsigned char *End = p + (Length & ~(size_t)7);
+  unsigned long long h = Seed ^ (Length * m);
+  unsigned long long k;
+
+  for (; p != End; p += 8) {
+    memcpy(&k, p, 8);
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+
+  switch (Length & 7) {
+  case 7: h ^= (unsigned long long)p[6] << 48; /* fall through */
+  case 6: h ^= (unsigned long long)p[5] << 40; /* fall through */
+  case 5: h ^= (unsigned long long)p[4] << 32; /* fall through */
+  case 4: h ^= (unsigned long long)p[3] << 24; /* fall through */
+  case 3: h ^= (unsigned long long)p[2] << 16; /* fall through */
+  case 2: h ^= (unsigned long long)p[1] << 8;  /* fall through */
+  case 1: h ^= (unsigned long long)p[0];
+          h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+//
+//  Little endian integers of Size bytes, for the file formats
+//
+
+void DiffPutInteger(char *Buffer, unsigned long long Value, int Size)
+{
+  int i;
+
+  for (i = 0; i < Size; i++, Value >>= 8) { Buffer[i] = (char)(Value & 0xff); }
+}
+
+unsigned long long DiffGetInteger(const char *Buffer, int Size)
+{
+  unsigned long long Value = 0;
+  int i;
+
+  for (i = Size - 1; i >= 0; i--) { Value = (Value << 8) | (unsigned char)Buffer[i]; }
+  return Value;
+}
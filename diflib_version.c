@@ -0,0 +1,452 @@
+/*
+
+  This file implements the version cache, see CreateVersionCache in diflib.h.
+
+  A version is either a base, stored whole, or an edit script against its parent version.
+  Rebuilding a version means walking up its chain of parents to a base and applying the
+  scripts back down.  The cache keeps whole versions that have been rebuilt, so the walk can
+  stop at the nearest cached ancestor instead, and a reader of a cached version pays nothing.
+
+  Entries live in a hash table keyed by version and, once built, on a doubly linked LRU list,
+  most recently used first.  Both are protected by the cache lock.  Callers hold a reference
+  on an entry while they use its data, so an entry that is evicted while in use is only
+  unlinked, and the last caller to release it frees it.
+
+  A version that is missing is entered in the table as building before the lock is dropped,
+  so that a second reader of the same version finds it and waits on the cache's condition
+  variable for the first reader's result rather than building it again.  A build never
+  waits for anything itself.  It only stops at ancestors that are already built, so however
+  builds overlap none of them can end up waiting on another.
+
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "diflib.h"
+#include "diflib_internal.h"
+
+//
+//  A chain this long is taken to be a loop in the caller's versions
+//
+
+#define VERSION_MAX_CHAIN_LENGTH (1 << 20)
+
+#define INITIAL_VERSION_BUCKET_COUNT (64)
+
+struct _VERSION_HANDLE_ {
+  PVERSION_HANDLE HashNext;            // the next entry in the same bucket
+  PVERSION_HANDLE LruPrev, LruNext;    // neighbors on the LRU list, once built
+  unsigned long long Version;
+  char *Data;                          // the whole version, our own copy
+  int DataLength;
+  int Building;                        // set until Result is known
+  int Result;                          // 0 once built, or why the build failed
+  size_t Size;                         // the bytes charged against the budget
+  int References;                      // callers using the entry, plus one while it is cached
+};
+
+struct _VERSION_CACHE_ {
+  pthread_mutex_t Lock;
+  pthread_cond_t Built;                // signalled whenever a build finishes
+  size_t ByteBudget, Size;
+  VERSION_FETCH_ROUTINE FetchRoutine;
+  void *FetchContext;
+  PVERSION_HANDLE *Buckets;
+  unsigned int BucketMask;             // the bucket count minus one, the count is a power of two
+  int EntryCount;
+  VERSION_HANDLE Lru;                  // sentinel of the LRU list, Lru.LruNext is the most recent
+  unsigned long long Hits, Misses;
+};
+
+#define VersionBucket(Cache, Version) ((unsigned int)(((Version) * 0x9e3779b97f4a7c15ULL) >> 32) & (Cache)->BucketMask)
+
+int CreateVersionCache (size_t ByteBudget,
+			VERSION_FETCH_ROUTINE FetchRoutine,
+			void *FetchContext,
+			PVERSION_CACHE *Cache)
+/*++
+
+  Description:
+
+    This routine creates an empty version cache.
+
+  Input:
+
+    ByteBudget: the most memory the cached versions may hold.  Versions larger than the
+      budget are rebuilt for the caller but never cached.
+
+    FetchRoutine, FetchContext: describe a version to the cache, see VERSION_FETCH_ROUTINE.
+
+    Cache: receives the new cache.
+
+  Output:
+
+    We return 0 on success and -2 if we ran out of memory.
+
+--*/
+{
+  PVERSION_CACHE c;
+
+  *Cache = NULL;
+  if ((c = calloc(1, sizeof(VERSION_CACHE))) == NULL) { return -2; }
+  if ((c->Buckets = calloc(INITIAL_VERSION_BUCKET_COUNT, sizeof(PVERSION_HANDLE))) == NULL) {
+    free(c);
+    return -2;
+  }
+  pthread_mutex_init(&c->Lock, NULL);
+  pthread_cond_init(&c->Built, NULL);
+  c->ByteBudget = ByteBudget;
+  c->FetchRoutine = FetchRoutine;
+  c->FetchContext = FetchContext;
+  c->BucketMask = INITIAL_VERSION_BUCKET_COUNT - 1;
+  c->Lru.LruNext = c->Lru.LruPrev = &c->Lru;
+  *Cache = c;
+  return 0;
+}
+
+//
+//  Drop one reference to an entry, the caller holds the lock
+//
+
+void DereferenceCachedVersion(PVERSION_HANDLE Entry)
+{
+  if (--Entry->References == 0) {
+    free(Entry->Data);
+    free(Entry);
+  }
+}
+
+void DestroyVersionCache (PVERSION_CACHE Cache)
+/*++
+
+  Description:
+
+    This routine frees a cache and all of its entries.  No call may be using the cache and
+    every handle must have been released.
+
+--*/
+{
+  PVERSION_HANDLE Entry, Next;
+
+  if (Cache == NULL) { return; }
+  for (Entry = Cache->Lru.LruNext; Entry != &Cache->Lru; Entry = Next) {
+    Next = Entry->LruNext;
+    DereferenceCachedVersion(Entry);
+  }
+  pthread_cond_destroy(&Cache->Built);
+  pthread_mutex_destroy(&Cache->Lock);
+  free(Cache->Buckets);
+  free(Cache);
+}
+
+void QueryVersionCacheStatistics (PVERSION_CACHE Cache,
+				  unsigned long long *Hits,
+				  unsigned long long *Misses,
+				  size_t *Size)
+{
+  pthread_mutex_lock(&Cache->Lock);
+  if (Hits != NULL) { *Hits = Cache->Hits; }
+  if (Misses != NULL) { *Misses = Cache->Misses; }
+  if (Size != NULL) { *Size = Cache->Size; }
+  pthread_mutex_unlock(&Cache->Lock);
+}
+
+//
+//  These routines manage the table and the LRU list, the caller holds the lock
+//
+
+PVERSION_HANDLE FindCachedVersion(PVERSION_CACHE Cache, unsigned long long Version)
+{
+  PVERSION_HANDLE Entry;
+
+  for (Entry = Cache->Buckets[VersionBucket(Cache, Version)]; Entry != NULL; Entry = Entry->HashNext) {
+    if (Entry->Version == Version) { return Entry; }
+  }
+  return NULL;
+}
+
+void GrowVersionBuckets(PVERSION_CACHE Cache)
+{
+  PVERSION_HANDLE *Buckets, *Old, Entry, Next;
+  unsigned int OldMask = Cache->BucketMask;
+  unsigned int i;
+
+  //
+  //  Failing to grow only makes the chains longer, so we just keep the old table
+  //
+
+  if ((Buckets = calloc((size_t)(OldMask + 1) * 2, sizeof(PVERSION_HANDLE))) == NULL) { return; }
+  Old = Cache->Buckets;
+  Cache->Buckets = Buckets;
+  Cache->BucketMask = 2 * OldMask + 1;
+  for (i = 0; i <= OldMask; i++) {
+    for (Entry = Old[i]; Entry != NULL; Entry = Next) {
+      Next = Entry->HashNext;
+      Entry->HashNext = Buckets[VersionBucket(Cache, Entry->Version)];
+      Buckets[VersionBucket(Cache, Entry->Version)] = Entry;
+    }
+  }
+  free(Old);
+}
+
+void InsertCachedVersion(PVERSION_CACHE Cache, PVERSION_HANDLE Entry)
+{
+  if (Cache->EntryCount >= (int)Cache->BucketMask + 1) { GrowVersionBuckets(Cache); }
+  Entry->HashNext = Cache->Buckets[VersionBucket(Cache, Entry->Version)];
+  Cache->Buckets[VersionBucket(Cache, Entry->Version)] = Entry;
+  Cache->EntryCount++;
+  Entry->References++;
+}
+
+void RemoveCachedVersion(PVERSION_CACHE Cache, PVERSION_HANDLE Entry)
+{
+  PVERSION_HANDLE *Link;
+
+  for (Link = &Cache->Buckets[VersionBucket(Cache, Entry->Version)]; *Link != Entry; Link = &(*Link)->HashNext) { }
+  *Link = Entry->HashNext;
+  if (!Entry->Building) {
+    Entry->LruPrev->LruNext = Entry->LruNext;
+    Entry->LruNext->LruPrev = Entry->LruPrev;
+    Cache->Size -= Entry->Size;
+  }
+  Cache->EntryCount--;
+  DereferenceCachedVersion(Entry);
+}
+
+void LinkMostRecentVersion(PVERSION_CACHE Cache, PVERSION_HANDLE Entry)
+{
+  Entry->LruNext = Cache->Lru.LruNext;
+  Entry->LruPrev = &Cache->Lru;
+  Entry->LruNext->LruPrev = Entry;
+  Cache->Lru.LruNext = Entry;
+}
+
+int BuildCachedVersion(PVERSION_CACHE Cache, PVERSION_HANDLE Entry)
+/*++
+
+  Description:
+
+    This routine rebuilds the version for an entry that the caller has marked as building.
+    We fetch records up the chain until we reach a base or an ancestor that is already in
+    the cache, and then apply the scripts we collected from there back down to the version.
+
+  Output:
+
+    We return 0 with Entry->Data holding the version, -2 if we ran out of memory, -3 if the
+    chain loops or a script does not fit its parent, or whatever the fetch routine returned.
+
+--*/
+{
+  PVERSION_RECORD Records = NULL, Grown;
+  PVERSION_HANDLE Ancestor = NULL;
+  VERSION_RECORD Record;
+  unsigned long long Version = Entry->Version;
+  char *Current = NULL, *Next;
+  int CurrentLength = 0, CurrentOwned = 0, Length;
+  int Count = 0, Capacity = 0;
+  int i, Result = 0;
+
+  for (;;) {
+
+    memset(&Record, 0, sizeof(VERSION_RECORD));
+    if ((Result = Cache->FetchRoutine(Cache->FetchContext, Version, &Record)) < 0) { goto Done; }
+    if ((Record.Data == NULL) && (Record.DataLength != 0)) {
+      Result = -3;
+      goto Done;
+    }
+    if (Record.IsBase) {
+      Current = Record.Data;
+      CurrentLength = Record.DataLength;
+      break;
+    }
+
+    if (Count >= VERSION_MAX_CHAIN_LENGTH) {
+      Result = -3;
+      goto Done;
+    }
+    if (Count == Capacity) {
+      Capacity = (Capacity == 0) ? 16 : 2 * Capacity;
+      if ((Grown = realloc(Records, sizeof(VERSION_RECORD) * Capacity)) == NULL) {
+	Result = -2;
+	goto Done;
+      }
+      Records = Grown;
+    }
+    Records[Count++] = Record;
+    Version = Record.Parent;
+    if (Version == Entry->Version) {
+      Result = -3;
+      goto Done;
+    }
+
+    //
+    //  Stop at the first ancestor that is already built.  One still being built by someone
+    //  else is treated as missing, we never wait inside a build.
+    //
+
+    pthread_mutex_lock(&Cache->Lock);
+    if (((Ancestor = FindCachedVersion(Cache, Version)) != NULL) && !Ancestor->Building) {
+      Ancestor->References++;
+    } else {
+      Ancestor = NULL;
+    }
+    pthread_mutex_unlock(&Cache->Lock);
+    if (Ancestor != NULL) {
+      Current = Ancestor->Data;
+      CurrentLength = Ancestor->DataLength;
+      break;
+    }
+  }
+
+  //
+  //  Apply the scripts from the oldest down.  A version that is itself a base still gets
+  //  copied, the fetch routine's data is only ours until we return.
+  //
+
+  for (i = Count - 1; i >= -1; i--) {
+    if ((i < 0) && CurrentOwned) { break; }
+    Length = (i < 0) ? CurrentLength : QueryEditScriptLengths(Records[i].Data, Records[i].DataLength, CurrentLength, NULL);
+    if (Length < 0) {
+      Result = Length;
+      goto Done;
+    }
+    if ((Next = malloc((size_t)Length + 1)) == NULL) {
+      Result = -2;
+      goto Done;
+    }
+    if (i < 0) {
+      memcpy(Next, Current, (size_t)Length);
+    } else if (ApplyEditScript(Current, CurrentLength, Records[i].Data, Records[i].DataLength, Next, Length) != Length) {
+      free(Next);
+      Result = -3;
+      goto Done;
+    }
+    if (CurrentOwned) { free(Current); }
+    Current = Next;
+    CurrentLength = Length;
+    CurrentOwned = 1;
+  }
+
+  Entry->Data = Current;
+  Entry->DataLength = CurrentLength;
+  CurrentOwned = 0;
+
+ Done:
+  if (CurrentOwned) { free(Current); }
+  if (Ancestor != NULL) { ReleaseVersion(Cache, Ancestor); }
+  free(Records);
+  return Result;
+}
+
+int AcquireVersion (PVERSION_CACHE Cache,
+		    unsigned long long Version,
+		    PVERSION_HANDLE *Handle,
+		    char **Data,
+		    int *DataLength)
+/*++
+
+  Description:
+
+    This routine returns the whole of a version, rebuilding it from the nearest cached
+    ancestor if it is not cached itself.  If another thread is already rebuilding it we wait
+    for that thread's result instead.  The data is shared, the caller must not modify it, and
+    stays valid until the caller releases the handle with ReleaseVersion.
+
+  Input:
+
+    Cache: the cache.
+
+    Version: the version to return.
+
+    Handle: receives the handle to release once the caller is done with the data.
+
+    Data, DataLength: receive the version.
+
+  Output:
+
+    We return 0 on success, -2 if we ran out of memory, -3 if the version's chain loops or
+    one of its scripts does not fit, or whatever the fetch routine returned.
+
+--*/
+{
+  PVERSION_HANDLE Entry;
+  int Result;
+
+  *Handle = NULL;
+  pthread_mutex_lock(&Cache->Lock);
+
+  if ((Entry = FindCachedVersion(Cache, Version)) != NULL) {
+
+    Entry->References++;
+    Cache->Hits++;
+    if (!Entry->Building) {
+      Entry->LruPrev->LruNext = Entry->LruNext;
+      Entry->LruNext->LruPrev = Entry->LruPrev;
+      LinkMostRecentVersion(Cache, Entry);
+    }
+    while (Entry->Building) { pthread_cond_wait(&Cache->Built, &Cache->Lock); }
+
+  } else {
+
+    //
+    //  Enter the version as building so that other readers wait for us, then build it
+    //  without holding the lock
+    //
+
+    Cache->Misses++;
+    if ((Entry = calloc(1, sizeof(VERSION_HANDLE))) == NULL) {
+      pthread_mutex_unlock(&Cache->Lock);
+      return -2;
+    }
+    Entry->Version = Version;
+    Entry->Building = 1;
+    Entry->References = 1;
+    InsertCachedVersion(Cache, Entry);
+    pthread_mutex_unlock(&Cache->Lock);
+
+    Result = BuildCachedVersion(Cache, Entry);
+
+    pthread_mutex_lock(&Cache->Lock);
+    Entry->Result = Result;
+    Entry->Size = sizeof(VERSION_HANDLE) + (size_t)Entry->DataLength;
+    if ((Result < 0) || (Entry->Size > Cache->ByteBudget)) {
+
+      //
+      //  Failed and oversized versions leave the table, the next reader tries again
+      //
+
+      RemoveCachedVersion(Cache, Entry);
+      Entry->Building = 0;
+
+    } else {
+
+      Entry->Building = 0;
+      while (Cache->Size + Entry->Size > Cache->ByteBudget) { RemoveCachedVersion(Cache, Cache->Lru.LruPrev); }
+      LinkMostRecentVersion(Cache, Entry);
+      Cache->Size += Entry->Size;
+    }
+    pthread_cond_broadcast(&Cache->Built);
+  }
+
+  Result = Entry->Result;
+  if (Result < 0) {
+    DereferenceCachedVersion(Entry);
+    pthread_mutex_unlock(&Cache->Lock);
+    return Result;
+  }
+  pthread_mutex_unlock(&Cache->Lock);
+
+  *Handle = Entry;
+  *Data = Entry->Data;
+  *DataLength = Entry->DataLength;
+  return 0;
+}
+
+void ReleaseVersion (PVERSION_CACHE Cache,
+		     PVERSION_HANDLE Handle)
+{
+  pthread_mutex_lock(&Cache->Lock);
+  DereferenceCachedVersion(Handle);
+  pthread_mutex_unlock(&Cache->Lock);
+}
@@ -0,0 +1,275 @@
+/*
+
+  This file implements the wavefront engine, which ComputeRangeEditScript runs ahead of the
+  others when DIFF_FLAG_WAVEFRONT is set.
+
+  On DNA and other small alphabet data nearly every pair of bytes could match, so Myers'
+  snakes are a byte or two long and each diagonal costs a branch that can't be predicted.
+  Here we fill in the whole dynamic programming table instead, H(i,j) being the cost of
+  turning the first i old bytes into the first j new bytes.  A cell depends on its left,
+  upper, and upper left neighbours, so all the cells of one anti-diagonal, where i+j is
+  constant, are independent of each other, and we compute them eight at a time in 16 bit
+  SSE2 lanes with no branches at all.  Walking i up an anti-diagonal walks j down, so the
+  new string is kept reversed to make both byte loads ascending.
+
+  An anti-diagonal t holds the cells with max(0,t-M) <= i <= min(N,t), at most min(N,M)+1 of
+  them, and we store each one packed from its lowest i.  Keeping all of them for the trace
+  back would cost N*M cells, so the forward pass keeps only a pair of adjacent anti-diagonals
+  out of every block of them.  The trace back then recomputes one block at a time from its
+  pair, so the table is filled in twice but the memory is closer to (N+M)^1.5 than N*M.
+
+  The 16 bit cells limit a range to WAVEFRONT_MAX_LENGTH bytes of both strings together, and
+  longer ranges, like those whose checkpoints would not fit in the memory budget, go to the
+  usual engines.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "diflib.h"
+#include "diflib_internal.h"
+
+typedef unsigned short WAVE_CELL;
+
+#define WAVEFRONT_MAX_LENGTH (0xfffe)
+
+typedef struct _WAVEFRONT_ {
+  char *OldString;        // the old range
+  char *ReversedNew;      // the new range, last byte first
+  int OldLength, NewLength;
+  int Width;              // cells in a stored anti-diagonal, min(N,M)+1
+  WAVE_CELL ReplaceCost;  // 1 with substitutions, otherwise 2 for a delete and an insert
+} WAVEFRONT, *PWAVEFRONT;
+
+//
+//  The lowest i on anti-diagonal t, stored cells are indexed by i minus this
+//
+
+#define WaveLow(W,T) (((T) > (W)->NewLength) ? (T) - (W)->NewLength : 0)
+
+void ComputeAntiDiagonal(PWAVEFRONT Wave, int t, WAVE_CELL *Previous2, WAVE_CELL *Previous1, WAVE_CELL *Row)
+/*++
+
+  Description:
+
+    This routine computes anti-diagonal t from the two before it.  A cell is the cheapest
+    of a delete from the cell above it, an insert from the cell to its left, both on t-1,
+    and a keep or a replace from the cell up and to the left on t-2.
+
+--*/
+{
+  char *Old = Wave->OldString;
+  char *New = &Wave->ReversedNew[Wave->NewLength - t];
+  int Low = WaveLow(Wave, t);
+  int Low1 = WaveLow(Wave, t - 1);
+  int Low2 = WaveLow(Wave, t - 2);
+  int Start, End, i;
+  WAVE_CELL Delete, Insert, Replace;
+
+  //
+  //  The cells on the edges of the table cost the bytes deleted or inserted to reach them
+  //
+
+  if (Low == 0) { Row[0] = (WAVE_CELL)t; }
+  if (t <= Wave->OldLength) { Row[t - Low] = (WAVE_CELL)t; }
+
+  //
+  //  The interior cells run from i = max(1,t-M) to min(N,t-1).  The new byte for cell i is
+  //  New[t-i-1], which is ReversedNew[M-t+i], so New[i] here.
+  //
+
+  Start = (Low > 1) ? Low : 1;
+  End = (t - 1 < Wave->OldLength) ? t - 1 : Wave->OldLength;
+  i = Start;
+
+#if defined(__SSE2__)
+  {
+    __m128i One = _mm_set1_epi16(1);
+    __m128i Cost = _mm_set1_epi16(Wave->ReplaceCost);
+    __m128i Up, Left, Diagonal, Equal, Best;
+
+    for (; i + 7 <= End; i += 8) {
+      Up = _mm_adds_epu16(_mm_loadu_si128((__m128i *)&Previous1[i - 1 - Low1]), One);
+      Left = _mm_adds_epu16(_mm_loadu_si128((__m128i *)&Previous1[i - Low1]), One);
+      Equal = _mm_cmpeq_epi8(_mm_loadl_epi64((__m128i *)&Old[i - 1]), _mm_loadl_epi64((__m128i *)&New[i]));
+      Equal = _mm_unpacklo_epi8(Equal, Equal);
+      Diagonal = _mm_adds_epu16(_mm_loadu_si128((__m128i *)&Previous2[i - 1 - Low2]), _mm_andnot_si128(Equal, Cost));
+
+      //
+      //  SSE2 has no unsigned 16 bit min, but a - max(a-b,0) is min(a,b)
+      //
+
+      Best = _mm_sub_epi16(Up, _mm_subs_epu16(Up, Left));
+      Best = _mm_sub_epi16(Best, _mm_subs_epu16(Best, Diagonal));
+      _mm_storeu_si128((__m128i *)&Row[i - Low], Best);
+    }
+  }
+#endif
+
+  for (; i <= End; i++) {
+    Delete = Previous1[i - 1 - Low1] + 1;
+    Insert = Previous1[i - Low1] + 1;
+    Replace = Previous2[i - 1 - Low2] + ((Old[i - 1] == New[i]) ? 0 : Wave->ReplaceCost);
+    if (Insert < Delete) { Delete = Insert; }
+    if (Replace < Delete) { Delete = Replace; }
+    Row[i - Low] = Delete;
+  }
+}
+
+size_t WavefrontWorkspaceSize(int OldLength, int NewLength, int *BlockLength)
+/*++
+
+  Description:
+
+    This routine works out the workspace the wavefront engine needs for ranges of the given
+    lengths, and the number of anti-diagonals in each of its blocks.
+
+  Output:
+
+    We return the size in bytes, or 0 if the ranges are too long for the engine.
+
+--*/
+{
+  int Total = OldLength + NewLength;
+  int Width = ((OldLength < NewLength) ? OldLength : NewLength) + 1 + 8;
+  int Length, CheckpointCount;
+
+  if (Total > WAVEFRONT_MAX_LENGTH) { return 0; }
+
+  //
+  //  A block of B anti-diagonals costs B rows while it is recomputed, and the checkpoints
+  //  cost two rows per block, so blocks of about sqrt(2(N+M)) keep the sum smallest
+  //
+
+  for (Length = 1; Length * Length < 2 * Total; Length++) { }
+  CheckpointCount = (Total - 2) / Length + 1;
+  if (BlockLength != NULL) { *BlockLength = Length; }
+  return sizeof(WAVE_CELL) * (size_t)Width * (3 + 2 * (size_t)CheckpointCount + Length + 2) + NewLength + Total;
+}
+
+int ComputeWavefrontEditScript(PDIFF_CONTEXT Context,
+			       int OldStart, int OldEnd,
+			       int NewStart, int NewEnd)
+/*++
+
+  Description:
+
+    This routine appends a minimal edit script for a range of the old string and a range of
+    the new string to the context's writer.  With substitutions on a replace costs one edit,
+    otherwise deletes and inserts cost one each.
+
+  Output:
+
+    We return the next free index in the edit script.  Or -1 if the edit script is too short,
+    -2 if the range is too long or the workspace won't fit in the budget, or if cancelled and
+    the caller wants an approximate script, and -4 if cancelled.  With -2 nothing has been
+    emitted.
+
+--*/
+{
+  WAVEFRONT Wave;
+  WAVE_CELL *Rows, *Checkpoints, *Block, *Previous2, *Previous1, *Row;
+  unsigned char *Path;
+  int Total, BlockLength, CheckpointCount, BlockStart;
+  int t, i, j, k, Step;
+  size_t Width, Size;
+  unsigned char Opcode;
+  void *Workspace;
+
+  Wave.OldString = &Context->OldString[OldStart];
+  Wave.OldLength = OldEnd - OldStart;
+  Wave.NewLength = NewEnd - NewStart;
+  Wave.Width = ((Wave.OldLength < Wave.NewLength) ? Wave.OldLength : Wave.NewLength) + 1;
+  Wave.ReplaceCost = Context->Writer.Substitutions ? 1 : 2;
+  Total = Wave.OldLength + Wave.NewLength;
+  if ((Size = WavefrontWorkspaceSize(Wave.OldLength, Wave.NewLength, &BlockLength)) == 0) { return -2; }
+  CheckpointCount = (Total - 2) / BlockLength + 1;
+  Width = (size_t)Wave.Width + 8;
+  if ((Size > Context->MemoryBudget) || ((Workspace = AllocateWorkspace(Context, Size)) == NULL)) { return -2; }
+
+  Rows = (WAVE_CELL *)Workspace;
+  Checkpoints = Rows + 3 * Width;
+  Block = Checkpoints + 2 * (size_t)CheckpointCount * Width;
+  Wave.ReversedNew = (char *)(Block + (size_t)(BlockLength + 2) * Width);
+  Path = (unsigned char *)Wave.ReversedNew + Wave.NewLength;
+  for (j = 0; j < Wave.NewLength; j++) { Wave.ReversedNew[j] = Context->NewString[NewEnd - 1 - j]; }
+
+  //
+  //  The forward pass, keeping anti-diagonals cB and cB+1 for every block c
+  //
+
+  for (t = 0; t <= Total; t++) {
+
+    if (IsDiffCancelled(Context)) {
+      FreeWorkspace(Context, Workspace);
+      return ApproximateOnCancel(Context) ? -2 : -4;
+    }
+
+    Previous2 = &Rows[((t + 1) % 3) * Width];
+    Previous1 = &Rows[((t + 2) % 3) * Width];
+    Row = &Rows[(t % 3) * Width];
+    ComputeAntiDiagonal(&Wave, t, Previous2, Previous1, Row);
+
+    k = t % BlockLength;
+    if ((k < 2) && (t / BlockLength < CheckpointCount)) {
+      memcpy(&Checkpoints[(2 * (size_t)(t / BlockLength) + k) * Width], Row, sizeof(WAVE_CELL) * Width);
+    }
+  }
+
+  //
+  //  The trace back, from (N,M) to an edge of the table.  Cell i of anti-diagonal t is at
+  //  Block[(t - BlockStart) * Width + i - WaveLow(t)] once its block has been recomputed.
+  //
+
+#define WaveCell(T,I) (Block[(size_t)((T) - BlockStart) * Width + (I) - WaveLow(&Wave, (T))])
+
+  i = Wave.OldLength;
+  j = Wave.NewLength;
+  k = Total;
+  BlockStart = Total + 1;
+
+  while ((i > 0) && (j > 0)) {
+
+    t = i + j;
+    if (t - 2 < BlockStart) {
+      BlockStart = ((t - 2) / BlockLength) * BlockLength;
+      memcpy(Block, &Checkpoints[2 * (size_t)(BlockStart / BlockLength) * Width], 2 * sizeof(WAVE_CELL) * Width);
+      for (Step = BlockStart + 2; (Step <= BlockStart + BlockLength + 1) && (Step <= Total); Step++) {
+	ComputeAntiDiagonal(&Wave, Step,
+			    &Block[(size_t)(Step - 2 - BlockStart) * Width],
+			    &Block[(size_t)(Step - 1 - BlockStart) * Width],
+			    &Block[(size_t)(Step - BlockStart) * Width]);
+      }
+    }
+
+    if (Wave.OldString[i - 1] == Wave.ReversedNew[Wave.NewLength - j]) {
+      Opcode = (WaveCell(t, i) == WaveCell(t - 2, i - 1)) ? KeepOpcode : DeleteOpcode;
+    } else {
+      Opcode = ((Wave.ReplaceCost == 1) && (WaveCell(t, i) == WaveCell(t - 2, i - 1) + 1)) ? ReplaceOpcode : DeleteOpcode;
+    }
+    if ((Opcode == DeleteOpcode) && (WaveCell(t, i) != WaveCell(t - 1, i - 1) + 1)) { Opcode = InsertOpcode; }
+
+    Path[--k] = Opcode;
+    if (Opcode != InsertOpcode) { i--; }
+    if (Opcode != DeleteOpcode) { j--; }
+  }
+  while (i-- > 0) { Path[--k] = DeleteOpcode; }
+  while (j-- > 0) { Path[--k] = InsertOpcode; }
+
+#undef WaveCell
+
+  //
+  //  And now the path forward, a run at a time
+  //
+
+  for (i = k, j = Context->Writer.EditScriptIndex; (i < Total) && (j >= 0); i = t) {
+    for (t = i + 1; (t < Total) && (Path[t] == Path[i]); t++) { }
+    j = EmitEditScript(&Context->Writer, Path[i], t - i);
+  }
+
+  FreeWorkspace(Context, Workspace);
+  return j;
+}
@@ -0,0 +1,132 @@
+/*
+
+  Shared helpers for the compiled tests in this directory.  Each test is one source file
+  built into its own executable, which prints every check that fails and exits nonzero if
+  any did.  Inputs come from a fixed seed so a failure always reproduces.
+
+ */
+
+#ifndef _DIFFTEST_
+#define _DIFFTEST_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../diflib.h"
+
+static int TestFailures;
+static unsigned long long TestSeed = 0x9e3779b97f4a7c15ULL;
+
+#define Check(Condition) \
+  do { if (!(Condition)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #Condition); TestFailures++; } } while (0)
+
+static unsigned int TestRandom(void)
+{
+  TestSeed ^= TestSeed << 13;
+  TestSeed ^= TestSeed >> 7;
+  TestSeed ^= TestSeed << 17;
+  return (unsigned int)(TestSeed >> 16);
+}
+
+//
+//  Fill a string with random bytes drawn from the first Alphabet letters, or from all 256
+//  byte values when Alphabet is zero
+//
+
+static void TestFill(char *String, int Length, int Alphabet)
+{
+  int i;
+
+  for (i = 0; i < Length; i++) {
+    String[i] = (char)((Alphabet == 0) ? TestRandom() : 'a' + TestRandom() % Alphabet);
+  }
+}
+
+//
+//  Build a new string from an old one with about Edits scattered one byte changes, inserts,
+//  and deletes, and return its length.  NewString needs room for OldLength + Edits bytes.
+//
+
+static int TestMutate(char *OldString, int OldLength, char *NewString, int Edits, int Alphabet)
+{
+  int i, NewLength = 0;
+
+  for (i = 0; i < OldLength; i++) {
+    if ((OldLength > 0) && ((int)(TestRandom() % OldLength) < Edits)) {
+      switch (TestRandom() % 3) {
+      case 0: continue;
+      case 1: NewString[NewLength++] = (char)((Alphabet == 0) ? TestRandom() : 'a' + TestRandom() % Alphabet); break;
+      default: NewString[NewLength++] = (char)((Alphabet == 0) ? TestRandom() : 'A' + TestRandom() % Alphabet); continue;
+      }
+    }
+    NewString[NewLength++] = OldString[i];
+  }
+  return NewLength;
+}
+
+//
+//  Check that an edit script turns the old string into exactly the new string, and return
+//  the number of bytes it deletes and inserts, counting a replace as both
+//
+
+static int TestApply(char *OldString, int OldLength, char *Script, int ScriptLength, char *NewString, int NewLength)
+{
+  EDIT_SCRIPT_CURSOR Cursor;
+  EDIT_OP Op;
+  char *Literal, *Result;
+  int Length, Cost = 0;
+
+  Check(ScriptLength >= 0);
+  if (ScriptLength < 0) { return -1; }
+
+  Length = QueryEditScriptLengths(Script, ScriptLength, OldLength, NULL);
+  Check(Length == NewLength);
+  if ((Length != NewLength) || ((Result = (char *)malloc((size_t)NewLength + 1)) == NULL)) { return -1; }
+  Check(ApplyEditScript(OldString, OldLength, Script, ScriptLength, Result, NewLength) == NewLength);
+  Check(memcmp(Result, NewString, (size_t)NewLength) == 0);
+  free(Result);
+
+  InitializeEditScriptCursor(&Cursor, Script, ScriptLength, OldLength);
+  while ((Length = NextEditScriptOp(&Cursor, &Op, &Literal)) > 0) {
+    if (Op.Opcode != KeepOpcode) { Cost += Op.Length; }
+    if (Op.Opcode == ReplaceOpcode) { Cost += Op.Length; }
+  }
+  Check(Length == 0);
+  return Cost;
+}
+
+//
+//  The fewest bytes any edit script can delete and insert, from the usual dynamic program
+//
+
+static int TestDistance(char *OldString, int OldLength, char *NewString, int NewLength)
+{
+  int *Row = (int *)malloc(sizeof(int) * ((size_t)NewLength + 1));
+  int i, j, Diagonal, Saved;
+
+  for (j = 0; j <= NewLength; j++) { Row[j] = j; }
+  for (i = 1; i <= OldLength; i++) {
+    Diagonal = Row[0];
+    Row[0] = i;
+    for (j = 1; j <= NewLength; j++) {
+      Saved = Row[j];
+      if (OldString[i-1] == NewString[j-1]) {
+	Row[j] = Diagonal;
+      } else {
+	Row[j] = ((Row[j] < Row[j-1]) ? Row[j] : Row[j-1]) + 1;
+      }
+      Diagonal = Saved;
+    }
+  }
+  i = Row[NewLength];
+  free(Row);
+  return i;
+}
+
+static int FinishTest(const char *Name)
+{
+  printf("%s: %s\n", Name, (TestFailures == 0) ? "passed" : "FAILED");
+  return (TestFailures == 0) ? 0 : 1;
+}
+
+#endif // _DIFFTEST_
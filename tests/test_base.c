@@ -0,0 +1,125 @@
+/*
+
+  Prepared bases: scripts from a base are valid for any new string, stay small when the new
+  string is mostly the old one with spans inserted, deleted, and changed, and do not depend
+  on which thread asks.
+
+ */
+
+#include <pthread.h>
+#include "difftest.h"
+
+#define OLD_LENGTH (40000)
+
+static char OldString[OLD_LENGTH], NewString[2 * OLD_LENGTH];
+static PPREPARED_BASE SharedBase;
+static int SharedNewLength;
+
+//
+//  Build a new string from the old one with about Spans spans of up to 200 bytes deleted or
+//  inserted, and Edits bytes changed, which is the kind of revision a base is meant for
+//
+
+int Revise(char *Old, int OldLength, char *New, int Spans, int Edits)
+{
+  int Length = 0, OldIndex = 0, Next, SpanLength, i;
+
+  while (OldIndex < OldLength) {
+    Next = OldIndex + 1 + TestRandom() % (2 * OldLength / (Spans + 1));
+    if (Next > OldLength) { Next = OldLength; }
+    memcpy(New + Length, Old + OldIndex, (size_t)(Next - OldIndex));
+    Length += Next - OldIndex;
+    SpanLength = 1 + TestRandom() % 200;
+    if ((TestRandom() & 1) || (Length - Next + SpanLength > OldLength / 2)) {
+      OldIndex = Next + SpanLength;
+    } else {
+      TestFill(New + Length, SpanLength, 0);
+      Length += SpanLength;
+      OldIndex = Next;
+    }
+  }
+  for (i = 0; i < Edits; i++) { New[TestRandom() % Length] ^= 0x20; }
+  return Length;
+}
+
+void *DiffSharedBase(void *Argument)
+{
+  char *Script = malloc((size_t)MaxEditScriptLength(OLD_LENGTH, SharedNewLength));
+  int i, Length;
+
+  (void)Argument;
+  for (i = 0; i < 10; i++) {
+    Length = ComputeEditScriptFromBase(SharedBase, NewString, SharedNewLength, Script,
+				       MaxEditScriptLength(OLD_LENGTH, SharedNewLength), NULL);
+    TestApply(OldString, OLD_LENGTH, Script, Length, NewString, SharedNewLength);
+  }
+  free(Script);
+  return NULL;
+}
+
+int main(void)
+{
+  static char Script[3 * OLD_LENGTH];
+  int BlockLengths[3] = { 0, 8, 100 };
+  PPREPARED_BASE Base;
+  DIFF_OPTIONS Options;
+  pthread_t Threads[4];
+  int NewLength, Length, Round, b, i;
+
+  TestFill(OldString, OLD_LENGTH, 0);
+
+  for (b = 0; b < 3; b++) {
+    Check(CreatePreparedBase(OldString, OLD_LENGTH, BlockLengths[b], &Base) == 0);
+
+    for (Round = 0; Round < 10; Round++) {
+
+      //
+      //  A light revision comes out far shorter than the new string
+      //
+
+      NewLength = Revise(OldString, OLD_LENGTH, NewString, 2 + Round, Round * 5);
+      Length = ComputeEditScriptFromBase(Base, NewString, NewLength, Script, sizeof(Script), NULL);
+      TestApply(OldString, OLD_LENGTH, Script, Length, NewString, NewLength);
+      Check(Length < NewLength / 10);
+
+      //
+      //  Unrelated bytes and a budget that forces partitions in the gaps are still valid
+      //
+
+      NewLength = TestMutate(OldString, OLD_LENGTH, NewString, 2000, 0);
+      TestFill(NewString + NewLength / 2, 500, 0);
+      memset(&Options, 0, sizeof(Options));
+      Options.MemoryBudget = 4096;
+      Length = ComputeEditScriptFromBase(Base, NewString, NewLength, Script, sizeof(Script), &Options);
+      TestApply(OldString, OLD_LENGTH, Script, Length, NewString, NewLength);
+    }
+
+    Length = ComputeEditScriptFromBase(Base, NewString, 0, Script, sizeof(Script), NULL);
+    TestApply(OldString, OLD_LENGTH, Script, Length, NewString, 0);
+    NewLength = Revise(OldString, OLD_LENGTH, NewString, 1, 1);
+    Check(ComputeEditScriptFromBase(Base, NewString, NewLength, Script, 2, NULL) == -1);
+    DestroyPreparedBase(Base);
+  }
+
+  //
+  //  An old string shorter than a block has nothing to index but still works
+  //
+
+  Check(CreatePreparedBase(OldString, 5, 0, &Base) == 0);
+  NewLength = TestMutate(OldString, 5, NewString, 3, 0);
+  Length = ComputeEditScriptFromBase(Base, NewString, NewLength, Script, sizeof(Script), NULL);
+  TestApply(OldString, 5, Script, Length, NewString, NewLength);
+  DestroyPreparedBase(Base);
+
+  //
+  //  Several threads on one base
+  //
+
+  Check(CreatePreparedBase(OldString, OLD_LENGTH, 0, &SharedBase) == 0);
+  SharedNewLength = Revise(OldString, OLD_LENGTH, NewString, 8, 40);
+  for (i = 0; i < 4; i++) { pthread_create(&Threads[i], NULL, DiffSharedBase, NULL); }
+  for (i = 0; i < 4; i++) { pthread_join(Threads[i], NULL); }
+  DestroyPreparedBase(SharedBase);
+
+  return FinishTest("base");
+}
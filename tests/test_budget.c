@@ -0,0 +1,64 @@
+/*
+
+  Memory budgets: the exact engine when it fits, the linear engine when only it fits, and
+  partitions when neither does.  The first two must stay minimal, the partitions need only
+  be valid, and a caller's workspace must do as well as our own.
+
+ */
+
+#include "difftest.h"
+
+int main(void)
+{
+  static char OldString[1200], NewString[1600], Script[8192];
+  DIFF_OPTIONS Options;
+  size_t Budgets[3] = { 0, 64 * 1024, 512 };
+  int OldLength, NewLength, Distance, Length, Cost;
+  int Round, b;
+
+  for (Round = 0; Round < 60; Round++) {
+    OldLength = 1 + TestRandom() % 1200;
+    TestFill(OldString, OldLength, 4);
+    NewLength = TestMutate(OldString, OldLength, NewString, 1 + TestRandom() % 300, 4);
+    Distance = TestDistance(OldString, OldLength, NewString, NewLength);
+
+    for (b = 0; b < 3; b++) {
+      memset(&Options, 0, sizeof(Options));
+      Options.MemoryBudget = Budgets[b];
+      Length = ComputeEditScriptEx(OldString, OldLength, NewString, NewLength, Script, sizeof(Script), &Options);
+      Cost = TestApply(OldString, OldLength, Script, Length, NewString, NewLength);
+      if (b < 2) {
+	Check(Cost == Distance);
+      } else {
+	Check(Cost >= Distance);
+      }
+    }
+
+    //
+    //  A workspace of the size we ask for must be enough, and give the same script
+    //
+
+    memset(&Options, 0, sizeof(Options));
+    Options.MemoryBudget = Budgets[Round % 3];
+    Options.WorkspaceLength = QueryWorkspaceSize(OldLength, NewLength, &Options);
+    Options.Workspace = malloc(Options.WorkspaceLength);
+    Length = ComputeEditScriptEx(OldString, OldLength, NewString, NewLength, Script, sizeof(Script), &Options);
+    Cost = TestApply(OldString, OldLength, Script, Length, NewString, NewLength);
+    if (Options.MemoryBudget != 512) { Check(Cost == Distance); }
+    free(Options.Workspace);
+  }
+
+  //
+  //  A script buffer that is too short fails with -1 under every engine
+  //
+
+  TestFill(OldString, 1000, 0);
+  TestFill(NewString, 1000, 0);
+  for (b = 0; b < 3; b++) {
+    memset(&Options, 0, sizeof(Options));
+    Options.MemoryBudget = Budgets[b];
+    Check(ComputeEditScriptEx(OldString, 1000, NewString, 1000, Script, 100, &Options) == -1);
+  }
+
+  return FinishTest("budget");
+}
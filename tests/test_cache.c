@@ -0,0 +1,149 @@
+/*
+
+  Base caches: a repeated OldString hits, the result matches diffing against a base of our
+  own, the least recently used bases are evicted to stay within the budget, and many threads
+  can share one cache.
+
+ */
+
+#include <pthread.h>
+#include "difftest.h"
+
+#define OLD_LENGTH (20000)
+#define NEW_LENGTH (OLD_LENGTH + 200)
+
+static char OldStrings[3][OLD_LENGTH], NewStrings[3][NEW_LENGTH];
+static int NewLengths[3];
+static PBASE_CACHE SharedCache;
+
+//
+//  Diff one of the pairs through a cache, copying the OldString first so that only its
+//  contents can match, and check the result
+//
+
+int DiffThroughCache(PBASE_CACHE Cache, int Which, char *Script, int ScriptLength)
+{
+  char *Copy = malloc(OLD_LENGTH);
+  DIFF_OPTIONS Options;
+  int Length;
+
+  memcpy(Copy, OldStrings[Which], OLD_LENGTH);
+  memset(&Options, 0, sizeof(Options));
+  Options.BaseCache = Cache;
+  Length = ComputeEditScriptEx(Copy, OLD_LENGTH, NewStrings[Which], NewLengths[Which], Script, ScriptLength, &Options);
+  TestApply(OldStrings[Which], OLD_LENGTH, Script, Length, NewStrings[Which], NewLengths[Which]);
+  free(Copy);
+  return Length;
+}
+
+void *DiffSharedCache(void *Argument)
+{
+  char *Script = malloc(3 * NEW_LENGTH);
+  int i;
+
+  (void)Argument;
+  for (i = 0; i < 30; i++) { DiffThroughCache(SharedCache, i % 3, Script, 3 * NEW_LENGTH); }
+  free(Script);
+  return NULL;
+}
+
+int main(void)
+{
+  static char Script[3 * NEW_LENGTH], BaseScript[3 * NEW_LENGTH];
+  static EDIT_OP Ops[OLD_LENGTH + NEW_LENGTH];
+  unsigned long long Hits, Misses;
+  size_t Size, EntrySize;
+  PPREPARED_BASE Base;
+  PBASE_CACHE Cache;
+  DIFF_OPTIONS Options;
+  pthread_t Threads[4];
+  int Length, i;
+
+  for (i = 0; i < 3; i++) {
+    TestFill(OldStrings[i], OLD_LENGTH, 0);
+    NewLengths[i] = TestMutate(OldStrings[i], OLD_LENGTH, NewStrings[i], 100, 0);
+  }
+
+  //
+  //  A miss then a hit, both giving what a base of our own gives
+  //
+
+  Check(CreateBaseCache(1 << 20, 0, &Cache) == 0);
+  Check(CreatePreparedBase(OldStrings[0], OLD_LENGTH, 0, &Base) == 0);
+  Length = ComputeEditScriptFromBase(Base, NewStrings[0], NewLengths[0], BaseScript, sizeof(BaseScript), NULL);
+  DestroyPreparedBase(Base);
+
+  Check(DiffThroughCache(Cache, 0, Script, sizeof(Script)) == Length);
+  Check(memcmp(Script, BaseScript, (size_t)Length) == 0);
+  QueryBaseCacheStatistics(Cache, &Hits, &Misses, &EntrySize);
+  Check((Hits == 0) && (Misses == 1) && (EntrySize > OLD_LENGTH));
+
+  Check(DiffThroughCache(Cache, 0, Script, sizeof(Script)) == Length);
+  Check(memcmp(Script, BaseScript, (size_t)Length) == 0);
+  QueryBaseCacheStatistics(Cache, &Hits, &Misses, &Size);
+  Check((Hits == 1) && (Misses == 1) && (Size == EntrySize));
+
+  //
+  //  ComputeEditOps goes through the cache too
+  //
+
+  memset(&Options, 0, sizeof(Options));
+  Options.BaseCache = Cache;
+  Check(ComputeEditOps(OldStrings[0], OLD_LENGTH, NewStrings[0], NewLengths[0], Ops, OLD_LENGTH + NEW_LENGTH, &Options) > 0);
+  QueryBaseCacheStatistics(Cache, &Hits, &Misses, NULL);
+  Check((Hits == 2) && (Misses == 1));
+
+  //
+  //  OldStrings too short to be worth a base are not looked up at all
+  //
+
+  Length = ComputeEditScriptEx(OldStrings[1], BASE_CACHE_MIN_LENGTH - 1, NewStrings[1], 5000, Script, sizeof(Script), &Options);
+  TestApply(OldStrings[1], BASE_CACHE_MIN_LENGTH - 1, Script, Length, NewStrings[1], 5000);
+  QueryBaseCacheStatistics(Cache, &Hits, &Misses, &Size);
+  Check((Hits == 2) && (Misses == 1) && (Size == EntrySize));
+  DestroyBaseCache(Cache);
+
+  //
+  //  Room for two bases: the third evicts the least recently used one
+  //
+
+  Check(CreateBaseCache(2 * EntrySize + EntrySize / 2, 0, &Cache) == 0);
+  DiffThroughCache(Cache, 0, Script, sizeof(Script));
+  DiffThroughCache(Cache, 1, Script, sizeof(Script));
+  DiffThroughCache(Cache, 0, Script, sizeof(Script));
+  DiffThroughCache(Cache, 2, Script, sizeof(Script));   // evicts 1
+  QueryBaseCacheStatistics(Cache, &Hits, &Misses, &Size);
+  Check((Hits == 1) && (Misses == 3) && (Size == 2 * EntrySize));
+  DiffThroughCache(Cache, 0, Script, sizeof(Script));
+  DiffThroughCache(Cache, 2, Script, sizeof(Script));
+  QueryBaseCacheStatistics(Cache, &Hits, &Misses, NULL);
+  Check((Hits == 3) && (Misses == 3));
+  DiffThroughCache(Cache, 1, Script, sizeof(Script));
+  QueryBaseCacheStatistics(Cache, &Hits, &Misses, &Size);
+  Check((Hits == 3) && (Misses == 4) && (Size == 2 * EntrySize));
+  DestroyBaseCache(Cache);
+
+  //
+  //  A base larger than the budget is used for the call but never kept
+  //
+
+  Check(CreateBaseCache(EntrySize - 1, 0, &Cache) == 0);
+  DiffThroughCache(Cache, 0, Script, sizeof(Script));
+  DiffThroughCache(Cache, 0, Script, sizeof(Script));
+  QueryBaseCacheStatistics(Cache, &Hits, &Misses, &Size);
+  Check((Hits == 0) && (Misses == 2) && (Size == 0));
+  DestroyBaseCache(Cache);
+
+  //
+  //  Threads sharing a cache too small for all three OldStrings
+  //
+
+  Check(CreateBaseCache(2 * EntrySize, 0, &SharedCache) == 0);
+  for (i = 0; i < 4; i++) { pthread_create(&Threads[i], NULL, DiffSharedCache, NULL); }
+  for (i = 0; i < 4; i++) { pthread_join(Threads[i], NULL); }
+  QueryBaseCacheStatistics(SharedCache, &Hits, &Misses, &Size);
+  Check((Hits + Misses == 4 * 30) && (Size <= 2 * EntrySize));
+  DestroyBaseCache(SharedCache);
+
+  return FinishTest("cache");
+}
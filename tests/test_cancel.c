@@ -0,0 +1,79 @@
+/*
+
+  Cancellation and deadlines: a cancelled call returns -4 promptly under every engine, and
+  with DIFF_FLAG_APPROXIMATE_ON_CANCEL returns a valid script and sets IsApproximate.
+
+ */
+
+#include <time.h>
+#include "difftest.h"
+
+int CancelAfter(void *CancelContext)
+{
+  int *Polls = (int *)CancelContext;
+
+  return --*Polls < 0;
+}
+
+int main(void)
+{
+  static char OldString[4928], NewString[8754], Script[65536];
+  DIFF_OPTIONS Options;
+  size_t Budgets[3] = { 0, 256 * 1024, 4096 };
+  int Length, Polls, b;
+  clock_t Start;
+
+  TestFill(OldString, sizeof(OldString), 4);
+  TestFill(NewString, sizeof(NewString), 4);
+
+  //
+  //  A short deadline on a large pair must not wait for the workspace to be set up
+  //
+
+  memset(&Options, 0, sizeof(Options));
+  Options.TimeoutMilliseconds = 10;
+  Start = clock();
+  Length = ComputeEditScriptEx(OldString, sizeof(OldString), NewString, sizeof(NewString), Script, sizeof(Script), &Options);
+  Check(Length == -4);
+  Check((double)(clock() - Start) / CLOCKS_PER_SEC < 1.0);
+
+  for (b = 0; b < 3; b++) {
+
+    //
+    //  Cancelled on the first poll
+    //
+
+    memset(&Options, 0, sizeof(Options));
+    Options.MemoryBudget = Budgets[b];
+    Options.CancelRoutine = CancelAfter;
+    Options.CancelContext = &Polls;
+    Polls = 0;
+    Start = clock();
+    Length = ComputeEditScriptEx(OldString, sizeof(OldString), NewString, sizeof(NewString), Script, sizeof(Script), &Options);
+    Check(Length == -4);
+    Check((double)(clock() - Start) / CLOCKS_PER_SEC < 1.0);
+    Check(Options.IsApproximate == 0);
+
+    //
+    //  Cancelled part way, settling for an approximate script
+    //
+
+    Options.Flags = DIFF_FLAG_APPROXIMATE_ON_CANCEL;
+    Polls = 3;
+    Length = ComputeEditScriptEx(OldString, sizeof(OldString), NewString, sizeof(NewString), Script, sizeof(Script), &Options);
+    TestApply(OldString, sizeof(OldString), Script, Length, NewString, sizeof(NewString));
+    Check(Options.IsApproximate == 1);
+
+    //
+    //  And a call that is never cancelled is exact
+    //
+
+    Polls = 1 << 30;
+    Options.IsApproximate = 0;
+    Length = ComputeEditScriptEx(OldString, 600, NewString, 700, Script, sizeof(Script), &Options);
+    TestApply(OldString, 600, Script, Length, NewString, 700);
+    Check(Options.IsApproximate == 0);
+  }
+
+  return FinishTest("cancel");
+}
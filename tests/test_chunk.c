@@ -0,0 +1,149 @@
+/*
+
+  Content defined chunks: chunk lengths stay within their bounds, an insertion only moves
+  the boundaries near it, and the chunked diff finds content that moved so that its script
+  is a small part of the new string.
+
+ */
+
+#include "difftest.h"
+
+#define STRING_LENGTH (1 << 20)
+#define BLOCK_LENGTH (100000)
+#define MAX_CHUNKS (STRING_LENGTH / 16 + 2)
+
+int CancelNow(void *CancelContext)
+{
+  (void)CancelContext;
+  return 1;
+}
+
+//
+//  Check the chunk ends of a string against the length bounds
+//
+
+void CheckChunkEnds(int *Ends, int Count, int StringLength, int AverageLength)
+{
+  int Length, i;
+
+  Check((Count > 0) && (Ends[Count - 1] == StringLength));
+  for (i = 0; i < Count; i++) {
+    Length = Ends[i] - ((i > 0) ? Ends[i - 1] : 0);
+    Check(Length <= 8 * AverageLength);
+    if (i < Count - 1) { Check(Length >= AverageLength / 4); }
+  }
+}
+
+//
+//  Copy a string with Length bytes at From taken out and put back in before To
+//
+
+void MoveBlock(char *String, int StringLength, int From, int Length, int To, char *Moved)
+{
+  memcpy(Moved, String, (size_t)From);
+  memcpy(Moved + From, String + From + Length, (size_t)(To - From - Length));
+  memcpy(Moved + To - Length, String + From, (size_t)Length);
+  memcpy(Moved + To, String + To, (size_t)(StringLength - To));
+}
+
+int main(void)
+{
+  static char OldString[STRING_LENGTH], NewString[STRING_LENGTH + 4096];
+  static char Script[3 * (STRING_LENGTH + 4096)];
+  static int OldEnds[MAX_CHUNKS], NewEnds[MAX_CHUNKS];
+  int Averages[3] = { 64, 1000, CDC_DEFAULT_AVERAGE_LENGTH };
+  DIFF_OPTIONS Options;
+  int Average, OldCount, NewCount, NewLength, Length, Resync, Middle, a, i, j;
+
+  TestFill(OldString, STRING_LENGTH, 0);
+
+  for (a = 0; a < 3; a++) {
+    Average = Averages[a];
+    OldCount = ComputeContentChunks(OldString, STRING_LENGTH, Average, OldEnds, MAX_CHUNKS);
+    CheckChunkEnds(OldEnds, OldCount, STRING_LENGTH, Average);
+    Check(ComputeContentChunks(OldString, STRING_LENGTH, Average, NULL, 0) == OldCount);
+    Check(ComputeContentChunks(OldString, STRING_LENGTH, Average, OldEnds, OldCount - 1) == -1);
+
+    //
+    //  Insert 100 bytes in the middle: the ends before it stay put, and the ends after it
+    //  fall back into step within a few chunks, moved by exactly 100, and stay that way
+    //
+
+    Middle = STRING_LENGTH / 2;
+    memcpy(NewString, OldString, (size_t)Middle);
+    TestFill(NewString + Middle, 100, 0);
+    memcpy(NewString + Middle + 100, OldString + Middle, (size_t)(STRING_LENGTH - Middle));
+    NewCount = ComputeContentChunks(NewString, STRING_LENGTH + 100, Average, NewEnds, MAX_CHUNKS);
+    CheckChunkEnds(NewEnds, NewCount, STRING_LENGTH + 100, Average);
+
+    for (i = 0; (i < OldCount) && (OldEnds[i] < Middle); i++) { Check(NewEnds[i] == OldEnds[i]); }
+    for (Resync = -1, j = i; i < OldCount; i++) {
+      while ((j < NewCount) && (NewEnds[j] < OldEnds[i] + 100)) { j++; }
+      if ((j < NewCount) && (NewEnds[j] == OldEnds[i] + 100)) {
+	if (Resync < 0) { Resync = OldEnds[i]; }
+      } else {
+	Check(Resync < 0);
+      }
+    }
+    Check((Resync >= 0) && (Resync - Middle <= 32 * Average));
+  }
+  Check(ComputeContentChunks(OldString, 100, 63, NULL, 0) == -3);
+  Check(ComputeContentChunks(OldString, 0, 0, NULL, 0) == 0);
+
+  //
+  //  Move a block far along and change a few bytes after it.  Everything between the block's
+  //  old and new places shifts, so matching has to find the chunks at their new offsets, and
+  //  the script should carry little more than the moved block itself.  The changes are kept
+  //  clear of the move, a changed chunk next to it would leave a gap of a whole block against
+  //  one chunk, which the engines diff in time quadratic in the block.
+  //
+
+  MoveBlock(OldString, STRING_LENGTH, BLOCK_LENGTH, BLOCK_LENGTH, 6 * BLOCK_LENGTH, NewString);
+  for (i = 0; i < 20; i++) { NewString[7 * BLOCK_LENGTH + TestRandom() % (STRING_LENGTH - 7 * BLOCK_LENGTH)] ^= 1; }
+  NewLength = STRING_LENGTH;
+
+  memset(&Options, 0, sizeof(Options));
+  Options.Flags = DIFF_FLAG_CONTENT_CHUNKS;
+  Length = ComputeEditScriptEx(OldString, STRING_LENGTH, NewString, NewLength, Script, sizeof(Script), &Options);
+  TestApply(OldString, STRING_LENGTH, Script, Length, NewString, NewLength);
+  Check(Length < BLOCK_LENGTH + BLOCK_LENGTH / 4);
+
+  //
+  //  Scattered inserts and deletes before and after a move, with substitutions
+  //
+
+  MoveBlock(OldString, STRING_LENGTH, 4 * BLOCK_LENGTH, BLOCK_LENGTH / 2, 8 * BLOCK_LENGTH, Script);
+  NewLength = TestMutate(Script, 3 * BLOCK_LENGTH, NewString, 20, 0);
+  memcpy(NewString + NewLength, Script + 3 * BLOCK_LENGTH, 6 * BLOCK_LENGTH);
+  NewLength += 6 * BLOCK_LENGTH;
+  NewLength += TestMutate(Script + 9 * BLOCK_LENGTH, STRING_LENGTH - 9 * BLOCK_LENGTH, NewString + NewLength, 20, 0);
+  Options.Flags = DIFF_FLAG_CONTENT_CHUNKS | DIFF_FLAG_SUBSTITUTIONS;
+  Length = ComputeEditScriptEx(OldString, STRING_LENGTH, NewString, NewLength, Script, sizeof(Script), &Options);
+  TestApply(OldString, STRING_LENGTH, Script, Length, NewString, NewLength);
+  Check(Length < BLOCK_LENGTH);
+
+  //
+  //  Inputs shorter than a chunk
+  //
+
+  Options.Flags = DIFF_FLAG_CONTENT_CHUNKS;
+  NewLength = TestMutate(OldString, 300, NewString, 20, 0);
+  Length = ComputeEditScriptEx(OldString, 300, NewString, NewLength, Script, sizeof(Script), &Options);
+  TestApply(OldString, 300, Script, Length, NewString, NewLength);
+
+  //
+  //  A cancelled call settling for an approximate script.  Cancels are only polled while a
+  //  gap is diffed, so the new string needs a large one.
+  //
+
+  memcpy(NewString, OldString, STRING_LENGTH);
+  TestFill(NewString + 3 * BLOCK_LENGTH, BLOCK_LENGTH, 0);
+  NewLength = STRING_LENGTH;
+  Options.Flags = DIFF_FLAG_CONTENT_CHUNKS | DIFF_FLAG_APPROXIMATE_ON_CANCEL;
+  Options.CancelRoutine = CancelNow;
+  Length = ComputeEditScriptEx(OldString, STRING_LENGTH, NewString, NewLength, Script, sizeof(Script), &Options);
+  TestApply(OldString, STRING_LENGTH, Script, Length, NewString, NewLength);
+  Check(Options.IsApproximate == 1);
+
+  return FinishTest("chunk");
+}
@@ -0,0 +1,371 @@
+/*
+
+  The C++ interface in diflib.hpp: compute and apply round trips through owning edit
+  scripts allocated from a memory resource, with the thread local workspace, and errors
+  surfacing as diflib::error.  Then the differ template over other element types,
+  comparators, and index types, and the lazy edit_op range over an encoded script.
+
+ */
+
+#include <atomic>
+#include <cctype>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../diflib.hpp"
+#include "difftest.h"
+
+//
+//  A resource that counts what is outstanding, so leaks and double frees show up
+//
+
+class counting_resource : public std::pmr::memory_resource {
+public:
+  std::size_t outstanding = 0, allocations = 0;
+
+private:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override
+  {
+    outstanding += bytes;
+    allocations++;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+  {
+    outstanding -= bytes;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+};
+
+std::string RandomString(std::size_t Length, int Alphabet)
+{
+  std::string String(Length, '\0');
+
+  TestFill(&String[0], int(Length), Alphabet);
+  return String;
+}
+
+std::string MutatedString(std::string &Old, int Edits, int Alphabet)
+{
+  std::string New(Old.size() + std::size_t(Edits) + 1, '\0');
+
+  New.resize(std::size_t(TestMutate(&Old[0], int(Old.size()), &New[0], Edits, Alphabet)));
+  return New;
+}
+
+void TestComputeAndApply()
+{
+  counting_resource Resource;
+
+  for (int Round = 0; Round < 50; Round++) {
+    std::string Old = RandomString(1 + TestRandom() % 2000, 4);
+    std::string New = MutatedString(Old, 1 + TestRandom() % 100, 4);
+    {
+      diflib::edit_script Script = diflib::compute(Old, New, nullptr, &Resource);
+      Check(Script.resource() == &Resource);
+      Check(std::string_view(diflib::apply(Old, Script, &Resource)) == New);
+
+      //
+      //  Moving hands the bytes over without copying them
+      //
+
+      const char *Data = Script.data();
+      diflib::edit_script Moved(std::move(Script));
+      Check(Moved.data() == Data);
+      Check(Script.data() == nullptr && Script.empty());
+      Script = std::move(Moved);
+      Check(Script.data() == Data);
+
+      std::string Buffer(New.size(), '\0');
+      Check(diflib::apply(Old, Script.view(), &Buffer[0], Buffer.size()) == New.size());
+      Check(Buffer == New);
+    }
+    Check(Resource.outstanding == 0);
+  }
+
+  //
+  //  The thread local workspace must not be shared between threads
+  //
+
+  std::string Old = RandomString(3000, 4);
+  std::string New = MutatedString(Old, 200, 4);
+  std::atomic<int> Wrong(0);
+  std::thread Threads[4];
+  for (auto &Thread : Threads) {
+    Thread = std::thread([&] {
+      for (int i = 0; i < 20; i++) {
+	if (std::string_view(diflib::apply(Old, diflib::compute(Old, New))) != New) { Wrong++; }
+      }
+    });
+  }
+  for (auto &Thread : Threads) { Thread.join(); }
+  Check(Wrong == 0);
+
+  //
+  //  Errors carry the C return code
+  //
+
+  int Code = 0;
+  try {
+    diflib::apply("ab", std::string_view("\x82", 1));
+  } catch (const diflib::error &Error) {
+    Code = Error.code();
+  }
+  Check(Code == -3);
+
+  DIFF_OPTIONS Options{};
+  Options.CancelRoutine = [](void *) { return 1; };
+  Code = 0;
+  try {
+    diflib::compute(RandomString(5000, 4), RandomString(5000, 4), &Options);
+  } catch (const diflib::error &Error) {
+    Code = Error.code();
+  }
+  Check(Code == -4);
+
+  //
+  //  The ops cover both strings
+  //
+
+  std::size_t OldCovered = 0, NewCovered = 0;
+  for (const EDIT_OP &Op : diflib::compute_ops(Old, New)) {
+    if (Op.Opcode != InsertOpcode) { OldCovered += std::size_t(Op.Length); }
+    if (Op.Opcode != DeleteOpcode) { NewCovered += std::size_t(Op.Length); }
+  }
+  Check(OldCovered == Old.size() && NewCovered == New.size());
+}
+
+//
+//  Run a differ and check that what it reports walks both inputs in order, that every keep
+//  is a run the comparator calls equal, and return the number of inserts and deletes, or
+//  -1 if it gave up
+//
+
+template <class T, class Equal, class Index>
+int RunDiffer(diflib::differ<T, Equal, Index> &Differ, const std::vector<T> &Old, const std::vector<T> &New,
+	      Equal Compare, std::size_t MaxDistance = std::size_t(-1))
+{
+  std::size_t OldOffset = 0, NewOffset = 0;
+  int Cost = 0, Calls = 0;
+  bool Found;
+
+  Found = Differ(Old.data(), Old.size(), New.data(), New.size(),
+		 [&](diflib::op_code Op, std::size_t OpOld, std::size_t OpNew, std::size_t Length) {
+		   Calls++;
+		   Check((OpOld == OldOffset) && (OpNew == NewOffset) && (Length > 0));
+		   switch (Op) {
+		   case diflib::keep:
+		     for (std::size_t i = 0; i < Length; i++) { Check(Compare(Old[OldOffset + i], New[NewOffset + i])); }
+		     OldOffset += Length;
+		     NewOffset += Length;
+		     break;
+		   case diflib::erase: OldOffset += Length; Cost += int(Length); break;
+		   case diflib::insert: NewOffset += Length; Cost += int(Length); break;
+		   default: Check(!"differ reported a replace");
+		   }
+		 },
+		 MaxDistance);
+  if (!Found) {
+    Check(Calls == 0);
+    return -1;
+  }
+  Check((OldOffset == Old.size()) && (NewOffset == New.size()));
+  return Cost;
+}
+
+//
+//  The indel distance of two element vectors under a comparator, like TestDistance
+//
+
+template <class T, class Equal>
+int VectorDistance(const std::vector<T> &Old, const std::vector<T> &New, Equal Compare)
+{
+  std::vector<int> Row(New.size() + 1);
+
+  for (std::size_t j = 0; j <= New.size(); j++) { Row[j] = int(j); }
+  for (std::size_t i = 1; i <= Old.size(); i++) {
+    int Diagonal = Row[0];
+    Row[0] = int(i);
+    for (std::size_t j = 1; j <= New.size(); j++) {
+      int Saved = Row[j];
+      Row[j] = Compare(Old[i-1], New[j-1]) ? Diagonal : std::min(Row[j], Row[j-1]) + 1;
+      Diagonal = Saved;
+    }
+  }
+  return Row[New.size()];
+}
+
+struct SameLetter {
+  bool operator()(char a, char b) const { return std::tolower((unsigned char)a) == std::tolower((unsigned char)b); }
+};
+
+void TestDiffer()
+{
+  diflib::differ<int> IntDiffer;
+  diflib::differ<char, SameLetter, std::uint16_t> LetterDiffer;
+  diflib::differ<std::uint8_t, std::equal_to<std::uint8_t>, std::uint16_t> ByteDiffer;
+
+  for (int Round = 0; Round < 40; Round++) {
+
+    //
+    //  Ints, reusing one differ so its workspace carries over between calls
+    //
+
+    std::vector<int> OldInts(TestRandom() % 400), NewInts;
+    for (int &Value : OldInts) { Value = int(TestRandom() % 6) - 3; }
+    for (int Value : OldInts) {
+      switch (TestRandom() % 10) {
+      case 0: break;
+      case 1: NewInts.push_back(int(TestRandom() % 1000)); NewInts.push_back(Value); break;
+      case 2: NewInts.push_back(int(TestRandom() % 1000)); break;
+      default: NewInts.push_back(Value);
+      }
+    }
+    std::equal_to<int> IntEqual;
+    int Distance = VectorDistance(OldInts, NewInts, IntEqual);
+    Check(RunDiffer(IntDiffer, OldInts, NewInts, IntEqual) == Distance);
+
+    //
+    //  A bound below the distance gives up, a bound at it does not
+    //
+
+    if (Distance > 0) {
+      Check(RunDiffer(IntDiffer, OldInts, NewInts, IntEqual, std::size_t(Distance - 1)) == -1);
+    }
+    Check(RunDiffer(IntDiffer, OldInts, NewInts, IntEqual, std::size_t(Distance)) == Distance);
+
+    //
+    //  Letters under a case blind comparator, where changing case is not an edit
+    //
+
+    std::vector<char> OldLetters(TestRandom() % 300), NewLetters;
+    for (char &Letter : OldLetters) { Letter = char('a' + TestRandom() % 4); }
+    for (char Letter : OldLetters) {
+      switch (TestRandom() % 8) {
+      case 0: break;
+      case 1: NewLetters.push_back(char('a' + TestRandom() % 6)); break;
+      default: NewLetters.push_back((TestRandom() & 1) ? char(std::toupper(Letter)) : Letter);
+      }
+    }
+    SameLetter Letters;
+    Check(RunDiffer(LetterDiffer, OldLetters, NewLetters, Letters) == VectorDistance(OldLetters, NewLetters, Letters));
+
+    //
+    //  Bytes with a 16 bit index, long enough for the block compare in the snake
+    //
+
+    std::string OldString = RandomString(TestRandom() % 3000, 2);
+    std::string NewString = MutatedString(OldString, 1 + TestRandom() % 30, 2);
+    std::vector<std::uint8_t> OldBytes(OldString.begin(), OldString.end()), NewBytes(NewString.begin(), NewString.end());
+    Check(RunDiffer(ByteDiffer, OldBytes, NewBytes, std::equal_to<std::uint8_t>()) ==
+	  TestDistance(&OldString[0], int(OldString.size()), &NewString[0], int(NewString.size())));
+  }
+
+  //
+  //  Inputs too long for the index type are refused rather than wrapped
+  //
+
+  std::vector<std::uint8_t> Long(70000);
+  bool Threw = false;
+  try {
+    RunDiffer(ByteDiffer, Long, Long, std::equal_to<std::uint8_t>());
+  } catch (const std::length_error &) {
+    Threw = true;
+  }
+  Check(Threw);
+
+  //
+  //  diff picks the index type itself, so the same input works there
+  //
+
+  std::size_t Kept = 0;
+  Check(diflib::diff(Long.data(), Long.size(), Long.data(), Long.size(),
+		     [&](diflib::op_code Op, std::size_t, std::size_t, std::size_t Length) {
+		       Check(Op == diflib::keep);
+		       Kept += Length;
+		     }));
+  Check(Kept == Long.size());
+}
+
+void TestEditOpRange()
+{
+  for (int Round = 0; Round < 30; Round++) {
+    std::string Old = RandomString(1 + TestRandom() % 2000, 4);
+    std::string New = MutatedString(Old, 1 + TestRandom() % 100, 4);
+    diflib::edit_script Script = diflib::compute(Old, New);
+
+    //
+    //  Rebuilding the new string from the ops, with the trailing keep included
+    //
+
+    std::string Rebuilt;
+    std::size_t OldOffset = 0;
+    for (const diflib::edit_op &Op : diflib::ops(Script, int(Old.size()))) {
+      Check(Op.old_offset == OldOffset && Op.new_offset == Rebuilt.size());
+      Check((Op.literal != nullptr) == ((Op.op == diflib::insert) || (Op.op == diflib::replace)));
+      if (Op.op == diflib::keep) {
+	Rebuilt.append(Old, Op.old_offset, Op.length);
+      } else if (Op.literal != nullptr) {
+	Rebuilt.append(Op.literal, Op.length);
+      }
+      if (Op.op != diflib::insert) { OldOffset += Op.length; }
+    }
+    Check(Rebuilt == New);
+    Check(OldOffset == Old.size());
+
+    //
+    //  Without the old length the trailing keep is left out
+    //
+
+    std::size_t Last = 0;
+    for (const diflib::edit_op &Op : diflib::ops(Script.view())) {
+      Last = (Op.op == diflib::insert) ? Op.old_offset : Op.old_offset + Op.length;
+    }
+    Check(Last <= Old.size());
+  }
+
+  //
+  //  The range decodes on demand, so a loop that stops before a corrupt entry never sees
+  //  it, and one that reaches it throws -3
+  //
+
+  std::string_view Corrupt("\xc0\x82", 2);
+  int Seen = 0;
+  for (const diflib::edit_op &Op : diflib::ops(Corrupt, 2)) {
+    Check(Op.op == diflib::keep && Op.length == 1);
+    Seen++;
+    break;
+  }
+  Check(Seen == 1);
+
+  int Code = 0;
+  try {
+    for (const diflib::edit_op &Op : diflib::ops(Corrupt, 2)) { (void)Op; }
+  } catch (const diflib::error &Error) {
+    Code = Error.code();
+  }
+  Check(Code == -3);
+
+  //
+  //  An empty script is an empty range, or one keep of the whole old string
+  //
+
+  Check(diflib::ops(std::string_view()).begin() == diflib::ops(std::string_view()).end());
+  Seen = 0;
+  for (const diflib::edit_op &Op : diflib::ops(std::string_view(), 5)) {
+    Check(Op.op == diflib::keep && Op.old_offset == 0 && Op.length == 5);
+    Seen++;
+  }
+  Check(Seen == 1);
+}
+
+int main()
+{
+  TestComputeAndApply();
+  TestDiffer();
+  TestEditOpRange();
+  return FinishTest("cpp");
+}
@@ -0,0 +1,93 @@
+/*
+
+  Edit distances: ComputeEditDistance must agree with the dynamic program, a MaxDistance
+  must cap it at MaxDistance+1, and the matrices, serial and parallel, must hold the same
+  distances at EDIT_DISTANCE_INDEX.
+
+ */
+
+#include "difftest.h"
+
+#define STRING_COUNT (75)
+#define PAIR_COUNT (STRING_COUNT * (STRING_COUNT - 1) / 2)
+
+int main(void)
+{
+  static char OldString[1500], NewString[1800], Pool[STRING_COUNT][400];
+  static int Reference[PAIR_COUNT], Serial[PAIR_COUNT], Parallel[PAIR_COUNT];
+  char *Strings[STRING_COUNT];
+  int Lengths[STRING_COUNT];
+  int OldLength, NewLength, Distance, Max;
+  int Round, i, j;
+
+  for (Round = 0; Round < 100; Round++) {
+    OldLength = TestRandom() % 1200;
+    TestFill(OldString, OldLength, (Round % 2) ? 4 : 0);
+    if (Round % 5 == 0) {
+      NewLength = TestRandom() % 1200;
+      TestFill(NewString, NewLength, (Round % 2) ? 4 : 0);
+    } else {
+      NewLength = TestMutate(OldString, OldLength, NewString, TestRandom() % 300, (Round % 2) ? 4 : 0);
+    }
+    Distance = TestDistance(OldString, OldLength, NewString, NewLength);
+    Check(ComputeEditDistance(OldString, OldLength, NewString, NewLength, -1) == Distance);
+
+    //
+    //  A limit at, just under, and well under the distance
+    //
+
+    Check(ComputeEditDistance(OldString, OldLength, NewString, NewLength, Distance) == Distance);
+    if (Distance > 0) {
+      Check(ComputeEditDistance(OldString, OldLength, NewString, NewLength, Distance - 1) == Distance);
+      Max = TestRandom() % Distance;
+      Check(ComputeEditDistance(OldString, OldLength, NewString, NewLength, Max) == Max + 1);
+    }
+  }
+
+  Check(ComputeEditDistance("", 0, "", 0, -1) == 0);
+  Check(ComputeEditDistance("abc", 3, "", 0, -1) == 3);
+  Check(ComputeEditDistance("", 0, "abc", 3, 1) == 2);
+
+  //
+  //  A set of strings in families, spanning more than one tile of the matrix
+  //
+
+  for (i = 0; i < STRING_COUNT; i++) {
+    Strings[i] = Pool[i];
+    if (i % 5 == 0) {
+      Lengths[i] = TestRandom() % 300;
+      TestFill(Pool[i], Lengths[i], 4);
+    } else {
+      Lengths[i] = TestMutate(Pool[i - 1], Lengths[i - 1], Pool[i], 1 + TestRandom() % 20, 4);
+    }
+  }
+  for (i = 0; i < STRING_COUNT; i++) {
+    for (j = i + 1; j < STRING_COUNT; j++) {
+      Reference[EDIT_DISTANCE_INDEX(STRING_COUNT, i, j)] = TestDistance(Strings[i], Lengths[i], Strings[j], Lengths[j]);
+    }
+  }
+
+  for (Max = -1; Max < 200; Max += 100) {
+    Check(ComputeEditDistanceMatrix(Strings, Lengths, STRING_COUNT, Max, Serial) == 0);
+    Check(ComputeEditDistanceMatrixParallel(Strings, Lengths, STRING_COUNT, Max, Parallel, 4) == 0);
+    Check(memcmp(Serial, Parallel, sizeof(Serial)) == 0);
+    for (i = 0; i < STRING_COUNT; i++) {
+      for (j = i + 1; j < STRING_COUNT; j++) {
+	Distance = Reference[EDIT_DISTANCE_INDEX(STRING_COUNT, i, j)];
+	if ((Max >= 0) && (Distance > Max)) { Distance = Max + 1; }
+	Check(Serial[EDIT_DISTANCE_INDEX(STRING_COUNT, i, j)] == Distance);
+      }
+    }
+  }
+
+  //
+  //  Too few strings to pair up, and a negative length
+  //
+
+  Check(ComputeEditDistanceMatrix(Strings, Lengths, 1, -1, Serial) == 0);
+  Check(ComputeEditDistanceMatrix(Strings, Lengths, -1, -1, Serial) == -3);
+  Lengths[3] = -1;
+  Check(ComputeEditDistanceMatrixParallel(Strings, Lengths, STRING_COUNT, -1, Parallel, 0) == -3);
+
+  return FinishTest("distance");
+}
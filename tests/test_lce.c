@@ -0,0 +1,93 @@
+/*
+
+  The LCE engine: inputs whose shared runs are far longer than the byte by byte snakes, so
+  every snake goes through the suffix array, and budgets too small for the search rows, so
+  the linear engine runs on the forward and reverse indexes.  Both must stay minimal.
+
+ */
+
+#include "difftest.h"
+
+//
+//  Repeat a short random period, so the same long runs line up on many diagonals and the
+//  suffix sort has to recurse
+//
+
+void TestPeriodic(char *String, int Length, int Period, int Alphabet)
+{
+  int i;
+
+  TestFill(String, Period, Alphabet);
+  for (i = Period; i < Length; i++) { String[i] = String[i - Period]; }
+}
+
+int main(void)
+{
+  static char OldString[3000], NewString[3600], Script[32768];
+  DIFF_OPTIONS Options;
+  int OldLength, NewLength, Distance, Length, Cost, Alphabet;
+  int Round;
+
+  for (Round = 0; Round < 80; Round++) {
+
+    //
+    //  A few edits spread over a long string leave shared runs of hundreds of bytes
+    //
+
+    OldLength = 1000 + TestRandom() % 2000;
+    Alphabet = (Round % 4 == 0) ? 0 : 2 + Round % 3;
+    if (Round % 3 == 0) {
+      TestPeriodic(OldString, OldLength, 1 + TestRandom() % 40, Alphabet);
+    } else {
+      TestFill(OldString, OldLength, Alphabet);
+    }
+    NewLength = TestMutate(OldString, OldLength, NewString, 1 + TestRandom() % 40, Alphabet);
+    Distance = TestDistance(OldString, OldLength, NewString, NewLength);
+
+    memset(&Options, 0, sizeof(Options));
+    Options.Flags = DIFF_FLAG_LCE;
+    Length = ComputeEditScriptEx(OldString, OldLength, NewString, NewLength, Script, sizeof(Script), &Options);
+    Cost = TestApply(OldString, OldLength, Script, Length, NewString, NewLength);
+    Check(Cost == Distance);
+
+    Options.Flags = DIFF_FLAG_LCE | DIFF_FLAG_SUBSTITUTIONS;
+    Length = ComputeEditScriptEx(OldString, OldLength, NewString, NewLength, Script, sizeof(Script), &Options);
+    TestApply(OldString, OldLength, Script, Length, NewString, NewLength);
+  }
+
+  //
+  //  Many edits on a small alphabet under a budget that holds the indexes but not the
+  //  (D+1)^2 rows, so the linear engine runs with both indexes
+  //
+
+  for (Round = 0; Round < 40; Round++) {
+    OldLength = 1000 + TestRandom() % 1500;
+    Alphabet = 2 + Round % 3;
+    TestFill(OldString, OldLength, Alphabet);
+    NewLength = TestMutate(OldString, OldLength, NewString, 200 + TestRandom() % 600, Alphabet);
+    Distance = TestDistance(OldString, OldLength, NewString, NewLength);
+
+    memset(&Options, 0, sizeof(Options));
+    Options.Flags = DIFF_FLAG_LCE;
+    Options.MemoryBudget = 400000;
+    Length = ComputeEditScriptEx(OldString, OldLength, NewString, NewLength, Script, sizeof(Script), &Options);
+    Cost = TestApply(OldString, OldLength, Script, Length, NewString, NewLength);
+    Check(Cost == Distance);
+  }
+
+  //
+  //  Strings that share everything, or nothing at all
+  //
+
+  memset(&Options, 0, sizeof(Options));
+  Options.Flags = DIFF_FLAG_LCE;
+  TestPeriodic(OldString, 3000, 7, 3);
+  Check(ComputeEditScriptEx(OldString, 3000, OldString, 3000, Script, sizeof(Script), &Options) == 0);
+  Length = ComputeEditScriptEx(OldString, 3000, OldString + 7, 2993, Script, sizeof(Script), &Options);
+  Check(TestApply(OldString, 3000, Script, Length, OldString + 7, 2993) == 7);
+  memset(NewString, 'z', 500);
+  Length = ComputeEditScriptEx(OldString, 500, NewString, 500, Script, sizeof(Script), &Options);
+  Check(TestApply(OldString, 500, Script, Length, NewString, 500) == 1000);
+
+  return FinishTest("lce");
+}
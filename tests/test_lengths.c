@@ -0,0 +1,76 @@
+/*
+
+  QueryEditScriptLengths: the length it returns is exactly what ApplyEditScript needs and
+  produces, with or without the old string's length, and a script cut short anywhere or
+  too long for its old string is reported as corrupt.
+
+ */
+
+#include "difftest.h"
+
+int main(void)
+{
+  static char OldString[2000], NewString[2400], Script[8000];
+  DIFF_OPTIONS Options;
+  char *Copy, *Result;
+  int OldLength, NewLength, ScriptLength, Consumed, Length, Round, i;
+
+  for (Round = 0; Round < 100; Round++) {
+    OldLength = TestRandom() % 2000;
+    TestFill(OldString, OldLength, 4);
+    NewLength = TestMutate(OldString, OldLength, NewString, 1 + TestRandom() % 400, 4);
+    memset(&Options, 0, sizeof(Options));
+    Options.Flags = (Round & 1) ? DIFF_FLAG_SUBSTITUTIONS : 0;
+    ScriptLength = ComputeEditScriptEx(OldString, OldLength, NewString, NewLength, Script, sizeof(Script), &Options);
+    Check(ScriptLength >= 0);
+
+    //
+    //  With the old length the trailing keep is counted, without it it is not
+    //
+
+    Consumed = -1;
+    Check(QueryEditScriptLengths(Script, ScriptLength, OldLength, &Consumed) == NewLength);
+    Check((Consumed >= 0) && (Consumed <= OldLength));
+    Check(QueryEditScriptLengths(Script, ScriptLength, -1, NULL) == NewLength - (OldLength - Consumed));
+    if (Consumed > 0) { Check(QueryEditScriptLengths(Script, ScriptLength, Consumed - 1, NULL) == -3); }
+
+    //
+    //  The length is exactly enough, one byte less is not, in a buffer of just that size
+    //
+
+    Result = malloc((size_t)NewLength + 1);
+    Check(ApplyEditScript(OldString, OldLength, Script, ScriptLength, Result, NewLength) == NewLength);
+    Check(memcmp(Result, NewString, (size_t)NewLength) == 0);
+    if (NewLength > 0) { Check(ApplyEditScript(OldString, OldLength, Script, ScriptLength, Result, NewLength - 1) == -1); }
+    free(Result);
+
+    //
+    //  Every prefix of the script either ends between entries or is corrupt, and the walk
+    //  never reads past it
+    //
+
+    for (i = 0; i < ScriptLength; i++) {
+      Copy = malloc((size_t)i + 1);
+      memcpy(Copy, Script, (size_t)i);
+      Length = QueryEditScriptLengths(Copy, i, OldLength, NULL);
+      Check((Length >= 0) || (Length == -3));
+      free(Copy);
+    }
+  }
+
+  //
+  //  By hand: an empty script keeps everything, a keep past the end does not fit, and an
+  //  insert whose bytes are cut short is corrupt
+  //
+
+  Check(QueryEditScriptLengths("", 0, 7, &Consumed) == 7);
+  Check(Consumed == 0);
+  Check(QueryEditScriptLengths("\xc2", 1, 3, &Consumed) == 3);
+  Check(Consumed == 3);
+  Check(QueryEditScriptLengths("\xc2", 1, 2, NULL) == -3);
+  Check(QueryEditScriptLengths("\x42" "ab", 3, 0, NULL) == -3);
+  Check(QueryEditScriptLengths("\x42" "abc" "\x81", 5, 4, &Consumed) == 5);
+  Check(Consumed == 2);
+
+  return FinishTest("lengths");
+}
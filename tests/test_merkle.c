@@ -0,0 +1,135 @@
+/*
+
+  Merkle trees: the script only edits leaves whose hashes differ, is the same whether the
+  trees are built by us, by the caller, or rebuilt from saved leaf hashes, and trees that do
+  not fit their strings are refused.
+
+ */
+
+#include "difftest.h"
+
+#define STRING_LENGTH (300000)
+
+//
+//  Check that every edit falls in a leaf that changed.  An insert sits between two bytes, so
+//  either of their leaves will do.
+//
+
+int LeafChanged(char *Changed, int LeafCount, int LeafLength, int Offset)
+{
+  return (Offset < 0) || (Offset / LeafLength >= LeafCount) || Changed[Offset / LeafLength];
+}
+
+void CheckEditsInChangedLeaves(char *Script, int ScriptLength, int OldLength, char *Changed, int LeafCount, int LeafLength)
+{
+  EDIT_SCRIPT_CURSOR Cursor;
+  EDIT_OP Op;
+  char *Literal;
+  int Offset;
+
+  InitializeEditScriptCursor(&Cursor, Script, ScriptLength, OldLength);
+  while (NextEditScriptOp(&Cursor, &Op, &Literal) > 0) {
+    if (Op.Opcode == InsertOpcode) {
+      Check(LeafChanged(Changed, LeafCount, LeafLength, Op.OldOffset) ||
+	    ((Op.OldOffset > 0) && LeafChanged(Changed, LeafCount, LeafLength, Op.OldOffset - 1)));
+    } else if (Op.Opcode != KeepOpcode) {
+      for (Offset = Op.OldOffset; Offset < Op.OldOffset + Op.Length; Offset++) {
+	Check(LeafChanged(Changed, LeafCount, LeafLength, Offset));
+      }
+    }
+  }
+}
+
+int main(void)
+{
+  static char OldString[STRING_LENGTH], NewString[STRING_LENGTH + 5000];
+  static char Script[3 * STRING_LENGTH], Other[3 * STRING_LENGTH];
+  static unsigned long long Hashes[STRING_LENGTH / 4];
+  static char Changed[STRING_LENGTH / 4];
+  int LeafLengths[3] = { 0, 512, 1000 };
+  PMERKLE_TREE OldTree, NewTree, Rebuilt;
+  int LeafLength, LeafCount, NewLength, Length, OtherLength, Cost, Flipped, Offset;
+  int Round, l, i;
+
+  TestFill(OldString, STRING_LENGTH, 0);
+
+  for (l = 0; l < 3; l++) {
+    LeafLength = (LeafLengths[l] == 0) ? 4096 : LeafLengths[l];
+    LeafCount = (STRING_LENGTH + LeafLength - 1) / LeafLength;
+    Check(CreateMerkleTree(OldString, STRING_LENGTH, LeafLengths[l], &OldTree) == 0);
+
+    for (Round = 0; Round < 5; Round++) {
+
+      //
+      //  Scattered changes in place, and sometimes a longer or shorter new string
+      //
+
+      memcpy(NewString, OldString, STRING_LENGTH);
+      memset(Changed, 0, sizeof(Changed));
+      Flipped = 0;
+      for (i = 0; i < 1 + 10 * Round; i++) {
+	Offset = TestRandom() % STRING_LENGTH;
+	if (NewString[Offset] == OldString[Offset]) { Flipped++; }
+	NewString[Offset] = (char)(OldString[Offset] ^ 0x11);
+	Changed[Offset / LeafLength] = 1;
+      }
+      NewLength = STRING_LENGTH;
+      if (Round >= 3) {
+	NewLength += (Round == 3) ? -3000 : 3000;
+	TestFill(NewString + STRING_LENGTH, NewLength - STRING_LENGTH, 0);
+	for (i = NewLength / LeafLength; i < LeafCount; i++) { Changed[i] = 1; }
+      }
+
+      Check(CreateMerkleTree(NewString, NewLength, LeafLengths[l], &NewTree) == 0);
+      Length = ComputeMerkleEditScript(OldString, STRING_LENGTH, OldTree, NewString, NewLength, NewTree, Script, sizeof(Script), NULL);
+      Cost = TestApply(OldString, STRING_LENGTH, Script, Length, NewString, NewLength);
+      if (NewLength == STRING_LENGTH) { Check(Cost <= 2 * Flipped); }
+      CheckEditsInChangedLeaves(Script, Length, STRING_LENGTH, Changed, LeafCount, LeafLength);
+
+      //
+      //  Building the new tree ourselves gives the same script
+      //
+
+      OtherLength = ComputeMerkleEditScript(OldString, STRING_LENGTH, OldTree, NewString, NewLength, NULL, Other, sizeof(Other), NULL);
+      Check((OtherLength == Length) && (memcmp(Other, Script, (size_t)Length) == 0));
+
+      //
+      //  So does a tree rebuilt from the saved leaf hashes
+      //
+
+      Check(QueryMerkleLeafHashes(NewTree, Hashes, (NewLength + LeafLength - 1) / LeafLength - 1) == -1);
+      Check(QueryMerkleLeafHashes(NewTree, Hashes, sizeof(Hashes) / sizeof(Hashes[0])) >= 0);
+      Check(CreateMerkleTreeFromLeafHashes(Hashes, NewLength, LeafLengths[l], &Rebuilt) == 0);
+      OtherLength = ComputeMerkleEditScript(OldString, STRING_LENGTH, OldTree, NewString, NewLength, Rebuilt, Other, sizeof(Other), NULL);
+      Check((OtherLength == Length) && (memcmp(Other, Script, (size_t)Length) == 0));
+      DestroyMerkleTree(Rebuilt);
+      DestroyMerkleTree(NewTree);
+    }
+
+    //
+    //  Hashes are trusted, so the old tree standing in for the new one keeps everything
+    //
+
+    Check(ComputeMerkleEditScript(OldString, STRING_LENGTH, OldTree, NewString, STRING_LENGTH, OldTree, Script, sizeof(Script), NULL) == 0);
+
+    //
+    //  A tree for another length, or with another leaf length, is refused
+    //
+
+    Check(ComputeMerkleEditScript(OldString, STRING_LENGTH - 1, OldTree, NewString, STRING_LENGTH, NULL, Script, sizeof(Script), NULL) == -3);
+    Check(CreateMerkleTree(NewString, STRING_LENGTH, LeafLength * 2, &NewTree) == 0);
+    Check(ComputeMerkleEditScript(OldString, STRING_LENGTH, OldTree, NewString, STRING_LENGTH, NewTree, Script, sizeof(Script), NULL) == -3);
+    DestroyMerkleTree(NewTree);
+    DestroyMerkleTree(OldTree);
+  }
+
+  //
+  //  An insertion near the front shifts every leaf after it, which is still a valid script
+  //
+
+  NewLength = TestMutate(OldString, 20000, NewString, 3, 0);
+  Length = ComputeMerkleEditScript(OldString, 20000, NULL, NewString, NewLength, NULL, Script, sizeof(Script), NULL);
+  TestApply(OldString, 20000, Script, Length, NewString, NewLength);
+
+  return FinishTest("merkle");
+}
@@ -0,0 +1,94 @@
+/*
+
+  ComputeEditOps: the records are maximal runs that cover both strings in order, keeps only
+  span equal bytes, and the alignment is as short as the one behind the edit script.
+
+ */
+
+#include "difftest.h"
+
+//
+//  Check the records against the strings and return the bytes they delete and insert
+//
+
+int CheckOps(PEDIT_OP Ops, int Count, char *OldString, int OldLength, char *NewString, int NewLength)
+{
+  int OldOffset = 0, NewOffset = 0, Cost = 0, i;
+
+  Check(Count >= 0);
+  for (i = 0; i < Count; i++) {
+    Check((Ops[i].OldOffset == OldOffset) && (Ops[i].NewOffset == NewOffset) && (Ops[i].Length > 0));
+    if (i > 0) { Check(Ops[i].Opcode != Ops[i-1].Opcode); }
+    switch (Ops[i].Opcode) {
+    case KeepOpcode:
+      Check(memcmp(OldString + OldOffset, NewString + NewOffset, (size_t)Ops[i].Length) == 0);
+      OldOffset += Ops[i].Length;
+      NewOffset += Ops[i].Length;
+      break;
+    case DeleteOpcode:
+      OldOffset += Ops[i].Length;
+      Cost += Ops[i].Length;
+      break;
+    case InsertOpcode:
+      NewOffset += Ops[i].Length;
+      Cost += Ops[i].Length;
+      break;
+    default:
+      Check(!"unexpected opcode");
+    }
+  }
+  Check((OldOffset == OldLength) && (NewOffset == NewLength));
+  return Cost;
+}
+
+int main(void)
+{
+  static char OldString[1500], NewString[1900];
+  static EDIT_OP Ops[3400];
+  DIFF_OPTIONS Options;
+  int OldLength, NewLength, Distance, Count, Cost;
+  int Round;
+
+  for (Round = 0; Round < 60; Round++) {
+    OldLength = TestRandom() % 1500;
+    TestFill(OldString, OldLength, 4);
+    NewLength = TestMutate(OldString, OldLength, NewString, 1 + TestRandom() % 400, 4);
+    Distance = TestDistance(OldString, OldLength, NewString, NewLength);
+
+    Count = ComputeEditOps(OldString, OldLength, NewString, NewLength, Ops, OldLength + NewLength, NULL);
+    Check(CheckOps(Ops, Count, OldString, OldLength, NewString, NewLength) == Distance);
+
+    //
+    //  Under a budget that forces partitions the records must still be consistent
+    //
+
+    memset(&Options, 0, sizeof(Options));
+    Options.MemoryBudget = 512;
+    Count = ComputeEditOps(OldString, OldLength, NewString, NewLength, Ops, OldLength + NewLength, &Options);
+    Cost = CheckOps(Ops, Count, OldString, OldLength, NewString, NewLength);
+    Check(Cost >= Distance);
+  }
+
+  //
+  //  Identical strings are one keep, and disjoint ones a delete and an insert
+  //
+
+  TestFill(OldString, 100, 0);
+  Check(ComputeEditOps(OldString, 100, OldString, 100, Ops, 200, NULL) == 1);
+  Check((Ops[0].Opcode == KeepOpcode) && (Ops[0].Length == 100));
+
+  memset(OldString, 'a', 10);
+  memset(NewString, 'b', 20);
+  Check(ComputeEditOps(OldString, 10, NewString, 20, Ops, 30, NULL) == 2);
+  Check(CheckOps(Ops, 2, OldString, 10, NewString, 20) == 30);
+
+  Check(ComputeEditOps(OldString, 0, NewString, 0, Ops, 0, NULL) == 0);
+
+  //
+  //  Too few records fails with -1
+  //
+
+  Check(ComputeEditOps(OldString, 10, NewString, 20, Ops, 1, NULL) == -1);
+
+  return FinishTest("ops");
+}
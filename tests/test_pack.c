@@ -0,0 +1,123 @@
+/*
+
+  Pack files: every script comes back byte for byte under its id, the last one added under
+  an id wins, absent ids are not found with or without the bloom filter, and files that are
+  not packs are refused.
+
+ */
+
+#include <unistd.h>
+#include "difftest.h"
+
+#define SCRIPT_COUNT (3000)
+
+static char OldStrings[SCRIPT_COUNT][64], NewStrings[SCRIPT_COUNT][80];
+static char Scripts[SCRIPT_COUNT][256];
+static int NewLengths[SCRIPT_COUNT], ScriptLengths[SCRIPT_COUNT];
+static unsigned long long Ids[SCRIPT_COUNT];
+
+//
+//  Write the scripts to a pack, the first Duplicates of them a second time under their
+//  ids with the script of the next one
+//
+
+void WritePack(const char *Path, unsigned int Flags, int Duplicates)
+{
+  PPACK_WRITER Writer;
+  int i;
+
+  Check(CreatePackWriter(Path, Flags, &Writer) == 0);
+  for (i = 0; i < SCRIPT_COUNT; i++) { Check(AppendPackScript(Writer, Ids[i], Scripts[i], ScriptLengths[i]) == 0); }
+  for (i = 0; i < Duplicates; i++) { Check(AppendPackScript(Writer, Ids[i], Scripts[i + 1], ScriptLengths[i + 1]) == 0); }
+  Check(FinishPackWriter(Writer) == 0);
+}
+
+int main(void)
+{
+  char Path[] = "/tmp/diflib_test_packXXXXXX";
+  char Result[80], *Script;
+  unsigned int Flags[2] = { 0, PACK_FLAG_BLOOM_FILTER };
+  PPACK_WRITER Writer;
+  PPACK Pack;
+  FILE *File;
+  int Length, Found, f, i, j, Fd;
+
+  if ((Fd = mkstemp(Path)) < 0) {
+    printf("pack: cannot create a temporary file\n");
+    return 1;
+  }
+  close(Fd);
+
+  for (i = 0; i < SCRIPT_COUNT; i++) {
+    TestFill(OldStrings[i], 64, 4);
+    NewLengths[i] = TestMutate(OldStrings[i], 64, NewStrings[i], TestRandom() % 16, 4);
+    ScriptLengths[i] = ComputeEditScript(OldStrings[i], 64, NewStrings[i], NewLengths[i], Scripts[i], 256);
+    Ids[i] = (i % 3 == 0) ? (unsigned long long)i : ((unsigned long long)TestRandom() << 32) | TestRandom();
+  }
+
+  for (f = 0; f < 2; f++) {
+    WritePack(Path, Flags[f], 10);
+    Check(OpenPack(Path, &Pack) == 0);
+
+    //
+    //  Each script comes back and applies straight from the mapping
+    //
+
+    for (i = 0; i < SCRIPT_COUNT; i++) {
+      j = (i < 10) ? i + 1 : i;
+      Check(LookupPackScript(Pack, Ids[i], &Script, &Length) == 1);
+      Check((Length == ScriptLengths[j]) && (memcmp(Script, Scripts[j], (size_t)Length) == 0));
+      if (j == i) {
+	Check(ApplyEditScript(OldStrings[i], 64, Script, Length, Result, NewLengths[i]) == NewLengths[i]);
+	Check(memcmp(Result, NewStrings[i], (size_t)NewLengths[i]) == 0);
+      }
+    }
+
+    //
+    //  Ids that were never added are not found
+    //
+
+    for (i = 0, Found = 0; i < 10000; i++) {
+      Found += LookupPackScript(Pack, (3ULL * SCRIPT_COUNT) + 3 * (unsigned long long)i + 1, &Script, &Length);
+    }
+    Check(Found == 0);
+    ClosePack(Pack);
+  }
+
+  //
+  //  An empty pack, and an empty script
+  //
+
+  Check(CreatePackWriter(Path, PACK_FLAG_BLOOM_FILTER, &Writer) == 0);
+  Check(FinishPackWriter(Writer) == 0);
+  Check(OpenPack(Path, &Pack) == 0);
+  Check(LookupPackScript(Pack, 0, &Script, &Length) == 0);
+  ClosePack(Pack);
+
+  Check(CreatePackWriter(Path, 0, &Writer) == 0);
+  Check(AppendPackScript(Writer, 42, Scripts[0], 0) == 0);
+  Check(AppendPackScript(Writer, 43, Scripts[0], -1) == -3);
+  Check(FinishPackWriter(Writer) == 0);
+  Check(OpenPack(Path, &Pack) == 0);
+  Check((LookupPackScript(Pack, 42, &Script, &Length) == 1) && (Length == 0));
+  ClosePack(Pack);
+
+  //
+  //  A pack cut short, a file that is not a pack, and no file at all
+  //
+
+  WritePack(Path, 0, 0);
+  Check(truncate(Path, 1000) == 0);
+  Check(OpenPack(Path, &Pack) == -3);
+
+  File = fopen(Path, "wb");
+  for (i = 0; i < 100; i++) { fputs("not a pack ", File); }
+  fclose(File);
+  Check(OpenPack(Path, &Pack) == -3);
+
+  unlink(Path);
+  Check(OpenPack(Path, &Pack) == -5);
+  Check(CreatePackWriter("/nonexistent/directory/pack", 0, &Writer) == -5);
+
+  return FinishTest("pack");
+}
@@ -0,0 +1,101 @@
+/*
+
+  Edit plans: a plan applies exactly like its edit script, to the old string it was made
+  from and to any other old string of a length it fits, serially or in parallel.
+
+ */
+
+#include "difftest.h"
+
+#define TARGET_COUNT (12)
+
+int main(void)
+{
+  static char OldString[3000], Variant[3100], NewString[3500], Script[12000];
+  static char Expected[TARGET_COUNT][3600], Results[TARGET_COUNT][3600];
+  EDIT_PLAN_TARGET Targets[TARGET_COUNT];
+  int Threads[3] = { 0, 1, 3 };
+  PEDIT_PLAN Plan;
+  int OldLength, NewLength, VariantLength, ScriptLength, Length, Round, i, t;
+
+  for (Round = 0; Round < 40; Round++) {
+    OldLength = TestRandom() % 3000;
+    TestFill(OldString, OldLength, 4);
+    NewLength = TestMutate(OldString, OldLength, NewString, 1 + TestRandom() % 400, 4);
+    ScriptLength = ComputeEditScript(OldString, OldLength, NewString, NewLength, Script, sizeof(Script));
+    Check(ScriptLength >= 0);
+    Check(CreateEditPlan(Script, ScriptLength, &Plan) == 0);
+
+    //
+    //  On its own old string
+    //
+
+    Check(QueryEditPlanLength(Plan, OldLength) == NewLength);
+    memset(Results[0], 0, sizeof(Results[0]));
+    Check(ApplyEditPlan(Plan, OldString, OldLength, Results[0], NewLength) == NewLength);
+    Check(memcmp(Results[0], NewString, (size_t)NewLength) == 0);
+    if (NewLength > 0) { Check(ApplyEditPlan(Plan, OldString, OldLength, Results[0], NewLength - 1) == -1); }
+
+    //
+    //  On variants with different kept bytes and a longer tail, against the script
+    //
+
+    for (i = 0; i < TARGET_COUNT; i++) {
+      VariantLength = OldLength + TestRandom() % 100;
+      memcpy(Variant, OldString, (size_t)OldLength);
+      TestFill(Variant + OldLength, VariantLength - OldLength, 4);
+      if (OldLength > 0) { Variant[TestRandom() % OldLength] ^= 1; }
+
+      Length = QueryEditScriptLengths(Script, ScriptLength, VariantLength, NULL);
+      Check(QueryEditPlanLength(Plan, VariantLength) == Length);
+      Check(ApplyEditScript(Variant, VariantLength, Script, ScriptLength, Expected[i], Length) == Length);
+      Check(ApplyEditPlan(Plan, Variant, VariantLength, Results[i], Length) == Length);
+      Check(memcmp(Results[i], Expected[i], (size_t)Length) == 0);
+    }
+
+    //
+    //  An old string shorter than the plan covers does not fit it
+    //
+
+    if (ScriptLength > 0) {
+      for (i = 0; (i < OldLength) && (QueryEditScriptLengths(Script, ScriptLength, i, NULL) < 0); i++) { }
+      if (i > 0) {
+	Check(QueryEditPlanLength(Plan, i - 1) == -3);
+	Check(ApplyEditPlan(Plan, OldString, i - 1, Results[0], sizeof(Results[0])) == -3);
+      }
+    }
+
+    //
+    //  In parallel, with some targets too small or too short, each result as ApplyEditPlan's
+    //
+
+    for (t = 0; t < 3; t++) {
+      for (i = 0; i < TARGET_COUNT; i++) {
+	Targets[i].OldString = OldString;
+	Targets[i].OldStringLength = OldLength;
+	Targets[i].NewString = Results[i];
+	Targets[i].NewStringLength = ((i % 5 == 4) && (NewLength > 0)) ? NewLength - 1 : NewLength;
+	Targets[i].Result = 12345;
+	memset(Results[i], 0, (size_t)NewLength);
+      }
+      Check(ApplyEditPlanParallel(Plan, Targets, TARGET_COUNT, Threads[t]) == ((NewLength > 0) ? -1 : 0));
+      for (i = 0; i < TARGET_COUNT; i++) {
+	if (Targets[i].NewStringLength < NewLength) {
+	  Check(Targets[i].Result == -1);
+	} else {
+	  Check(Targets[i].Result == NewLength);
+	  Check(memcmp(Results[i], NewString, (size_t)NewLength) == 0);
+	}
+      }
+    }
+    DestroyEditPlan(Plan);
+  }
+
+  //
+  //  A script whose literal is cut short makes no plan
+  //
+
+  Check(CreateEditPlan("\x45" "ab", 3, &Plan) == -3);
+
+  return FinishTest("plan");
+}
@@ -0,0 +1,91 @@
+/*
+
+  Segment lists: diffing strings cut into random segments, empty ones included, must give
+  the same script as diffing the joined strings, and a malformed list is -3.
+
+ */
+
+#include "difftest.h"
+
+//
+//  Cut a string into at most Count segments at random points, some of them empty, and
+//  return how many there are
+//
+
+int TestCut(char *String, int Length, PDIFF_SEGMENT Segments, int Count)
+{
+  int i, Offset = 0, Piece;
+
+  for (i = 0; i < Count - 1; i++) {
+    Piece = (TestRandom() % 4 == 0) ? 0 : TestRandom() % (Length - Offset + 1);
+    Segments[i].Data = &String[Offset];
+    Segments[i].Length = Piece;
+    Offset += Piece;
+  }
+  Segments[i].Data = &String[Offset];
+  Segments[i].Length = Length - Offset;
+  return Count;
+}
+
+int main(void)
+{
+  static char OldString[2000], NewString[2600], Script[16384], Joined[16384];
+  DIFF_SEGMENT OldSegments[12], NewSegments[12];
+  DIFF_OPTIONS Options;
+  int OldLength, NewLength, OldCount, NewCount, Length, JoinedLength;
+  int Round;
+
+  for (Round = 0; Round < 200; Round++) {
+    OldLength = TestRandom() % 2000;
+    TestFill(OldString, OldLength, (Round % 3) ? 4 : 0);
+    NewLength = TestMutate(OldString, OldLength, NewString, TestRandom() % 300, (Round % 3) ? 4 : 0);
+    OldCount = TestCut(OldString, OldLength, OldSegments, 1 + TestRandom() % 12);
+    NewCount = TestCut(NewString, NewLength, NewSegments, 1 + TestRandom() % 12);
+
+    memset(&Options, 0, sizeof(Options));
+    Options.MemoryBudget = (Round % 4 == 0) ? 64 * 1024 : 0;
+    JoinedLength = ComputeEditScriptEx(OldString, OldLength, NewString, NewLength, Joined, sizeof(Joined), &Options);
+    Length = ComputeEditScriptSegments(OldSegments, OldCount, NewSegments, NewCount, Script, sizeof(Script), &Options);
+    Check(Length == JoinedLength);
+    Check((Length < 0) || (memcmp(Script, Joined, Length) == 0));
+    TestApply(OldString, OldLength, Script, Length, NewString, NewLength);
+  }
+
+  //
+  //  Edits right at segment boundaries, where the prefix and suffix scans change segments
+  //
+
+  memcpy(OldString, "abcdefgh", 8);
+  memcpy(NewString, "abcXdefgh", 9);
+  OldSegments[0].Data = OldString;      OldSegments[0].Length = 3;
+  OldSegments[1].Data = &OldString[3];  OldSegments[1].Length = 0;
+  OldSegments[2].Data = &OldString[3];  OldSegments[2].Length = 5;
+  NewSegments[0].Data = NewString;      NewSegments[0].Length = 4;
+  NewSegments[1].Data = &NewString[4];  NewSegments[1].Length = 5;
+  Length = ComputeEditScriptSegments(OldSegments, 3, NewSegments, 2, Script, sizeof(Script), NULL);
+  TestApply(OldString, 8, Script, Length, NewString, 9);
+  Check((Length == 3) && (memcmp(Script, "\xc2\x40X", 3) == 0));
+
+  //
+  //  Nothing at all, and the same string cut two different ways
+  //
+
+  Check(ComputeEditScriptSegments(NULL, 0, NULL, 0, Script, sizeof(Script), NULL) == 0);
+  NewSegments[0].Data = OldString;      NewSegments[0].Length = 6;
+  NewSegments[1].Data = &OldString[6];  NewSegments[1].Length = 2;
+  Check(ComputeEditScriptSegments(OldSegments, 3, NewSegments, 2, Script, sizeof(Script), NULL) == 0);
+
+  //
+  //  Malformed lists
+  //
+
+  Check(ComputeEditScriptSegments(OldSegments, -1, NewSegments, 2, Script, sizeof(Script), NULL) == -3);
+  Check(ComputeEditScriptSegments(NULL, 2, NewSegments, 2, Script, sizeof(Script), NULL) == -3);
+  OldSegments[1].Length = -1;
+  Check(ComputeEditScriptSegments(OldSegments, 3, NewSegments, 2, Script, sizeof(Script), NULL) == -3);
+  OldSegments[1].Data = NULL;
+  OldSegments[1].Length = 1;
+  Check(ComputeEditScriptSegments(OldSegments, 3, NewSegments, 2, Script, sizeof(Script), NULL) == -3);
+
+  return FinishTest("segment");
+}
@@ -0,0 +1,169 @@
+/*
+
+  Signatures: a delta computed from the signature alone rebuilds the new string from the
+  old one, finds blocks wherever they moved to, and is refused against any other old string.
+  The parallel variants give the same signature, and deltas that differ at most around the
+  region boundaries.
+
+ */
+
+#include "difftest.h"
+
+#define OLD_LENGTH (200000)
+#define NEW_LENGTH (OLD_LENGTH + 20000)
+
+static char OldString[OLD_LENGTH], NewString[NEW_LENGTH], Result[NEW_LENGTH];
+static char Signature[OLD_LENGTH], Delta[2 * NEW_LENGTH];
+static char ParallelSignature[OLD_LENGTH], ParallelDelta[2 * NEW_LENGTH];
+
+//
+//  Build a new string out of pieces of the old one in any order, with some bytes changed
+//
+
+int Shuffle(char *Old, int OldLength, char *New, int Edits)
+{
+  int Length = 0, Start, PieceLength, i;
+
+  while (Length < OldLength) {
+    PieceLength = 1000 + TestRandom() % 20000;
+    if (PieceLength > OldLength - Length) { PieceLength = OldLength - Length; }
+    Start = TestRandom() % (OldLength - PieceLength + 1);
+    memcpy(New + Length, Old + Start, (size_t)PieceLength);
+    Length += PieceLength;
+  }
+  for (i = 0; i < Edits; i++) { New[TestRandom() % Length] ^= 0x40; }
+  return Length;
+}
+
+//
+//  Compute a signature and a delta and check that the delta rebuilds the new string
+//
+
+int CheckDelta(char *Old, int OldLength, int BlockLength, char *New, int NewLength)
+{
+  int SignatureLength, DeltaLength;
+
+  SignatureLength = ComputeSignature(Old, OldLength, BlockLength, Signature, sizeof(Signature));
+  Check((SignatureLength > 0) && (SignatureLength <= MaxSignatureLength(OldLength, BlockLength)));
+  DeltaLength = ComputeSignatureDelta(Signature, SignatureLength, New, NewLength, Delta, sizeof(Delta), NULL);
+  Check((DeltaLength > 0) && (DeltaLength <= MaxSignatureDeltaLength(NewLength)));
+  if (DeltaLength < 0) { return DeltaLength; }
+
+  Check(ApplySignatureDelta(Old, OldLength, Delta, DeltaLength, NULL, 0) == NewLength);
+  memset(Result, 0, sizeof(Result));
+  Check(ApplySignatureDelta(Old, OldLength, Delta, DeltaLength, Result, NewLength) == NewLength);
+  Check(memcmp(Result, New, (size_t)NewLength) == 0);
+  return DeltaLength;
+}
+
+void TestParallel(void)
+{
+  int ThreadCounts[4] = { 0, 1, 2, 5 };
+  int BlockLengths[2] = { SIGNATURE_MIN_BLOCK_LENGTH, 0 };
+  int BlockLength, NewLength, SignatureLength, DeltaLength, Length, b, t;
+
+  NewLength = Shuffle(OldString, OLD_LENGTH, NewString, 10);
+
+  for (b = 0; b < 2; b++) {
+    BlockLength = (BlockLengths[b] == 0) ? SIGNATURE_DEFAULT_BLOCK_LENGTH : BlockLengths[b];
+    SignatureLength = ComputeSignature(OldString, OLD_LENGTH, BlockLengths[b], Signature, sizeof(Signature));
+    DeltaLength = ComputeSignatureDelta(Signature, SignatureLength, NewString, NewLength, Delta, sizeof(Delta), NULL);
+
+    for (t = 0; t < 4; t++) {
+      Length = ComputeSignatureParallel(OldString, OLD_LENGTH, BlockLengths[b], ParallelSignature, sizeof(ParallelSignature), ThreadCounts[t]);
+      Check((Length == SignatureLength) && (memcmp(ParallelSignature, Signature, (size_t)Length) == 0));
+
+      //
+      //  One thread scans one region, exactly as the serial routine does.  More threads cut
+      //  the new string into four regions each, and a block straddling a cut goes as literals.
+      //
+
+      Length = ComputeSignatureDeltaParallel(Signature, SignatureLength, NewString, NewLength, ParallelDelta, sizeof(ParallelDelta), NULL, ThreadCounts[t]);
+      if (ThreadCounts[t] == 1) {
+	Check((Length == DeltaLength) && (memcmp(ParallelDelta, Delta, (size_t)Length) == 0));
+      } else if (ThreadCounts[t] > 1) {
+	Check(Length <= DeltaLength + 4 * ThreadCounts[t] * (BlockLength + 16));
+      }
+      memset(Result, 0, sizeof(Result));
+      Check(ApplySignatureDelta(OldString, OLD_LENGTH, ParallelDelta, Length, Result, NewLength) == NewLength);
+      Check(memcmp(Result, NewString, (size_t)NewLength) == 0);
+    }
+  }
+
+  //
+  //  Strings too small to split still work with many threads
+  //
+
+  SignatureLength = ComputeSignatureParallel(OldString, 100, 0, Signature, sizeof(Signature), 8);
+  Length = ComputeSignatureDeltaParallel(Signature, SignatureLength, OldString, 100, Delta, sizeof(Delta), NULL, 8);
+  Check(ApplySignatureDelta(OldString, 100, Delta, Length, Result, 100) == 100);
+  Check(memcmp(Result, OldString, 100) == 0);
+}
+
+int main(void)
+{
+  int BlockLengths[3] = { SIGNATURE_MIN_BLOCK_LENGTH, 700, 0 };
+  int BlockLength, NewLength, DeltaLength, SignatureLength, Round, b;
+
+  TestFill(OldString, OLD_LENGTH, 0);
+
+  for (b = 0; b < 3; b++) {
+    BlockLength = (BlockLengths[b] == 0) ? SIGNATURE_DEFAULT_BLOCK_LENGTH : BlockLengths[b];
+
+    for (Round = 0; Round < 4; Round++) {
+
+      //
+      //  Shuffled pieces with a few changes cost a few blocks of literals per piece and change
+      //
+
+      NewLength = Shuffle(OldString, OLD_LENGTH, NewString, Round * 5);
+      DeltaLength = CheckDelta(OldString, OLD_LENGTH, BlockLengths[b], NewString, NewLength);
+      Check(DeltaLength < 100 + 40 * (2 * BlockLength) + Round * 5 * (2 * BlockLength));
+
+      //
+      //  Scattered inserts and deletes, and an old string that is not a whole number of blocks
+      //
+
+      NewLength = TestMutate(OldString, OLD_LENGTH - 17, NewString, 20, 0);
+      CheckDelta(OldString, OLD_LENGTH - 17, BlockLengths[b], NewString, NewLength);
+    }
+
+    //
+    //  Unrelated bytes go across as literals, and an empty new string is just a header
+    //
+
+    TestFill(NewString, 5000, 0);
+    Check(CheckDelta(OldString, OLD_LENGTH, BlockLengths[b], NewString, 5000) > 5000);
+    CheckDelta(OldString, OLD_LENGTH, BlockLengths[b], NewString, 0);
+    CheckDelta(OldString, 0, BlockLengths[b], NewString, 5000);
+  }
+
+  //
+  //  A delta only fits the old string it was made for
+  //
+
+  NewLength = TestMutate(OldString, OLD_LENGTH, NewString, 5, 0);
+  DeltaLength = CheckDelta(OldString, OLD_LENGTH, 0, NewString, NewLength);
+  Check(ApplySignatureDelta(OldString, OLD_LENGTH, Delta, DeltaLength, Result, NewLength - 1) == -1);
+  Check(ApplySignatureDelta(OldString, OLD_LENGTH - 1, Delta, DeltaLength, Result, NewLength) == -3);
+  OldString[OLD_LENGTH / 2] ^= 1;
+  Check(ApplySignatureDelta(OldString, OLD_LENGTH, Delta, DeltaLength, Result, NewLength) == -3);
+  OldString[OLD_LENGTH / 2] ^= 1;
+  Check(ApplySignatureDelta(OldString, OLD_LENGTH, Delta, DeltaLength - 1, Result, NewLength) == -3);
+  Delta[0] ^= 1;
+  Check(ApplySignatureDelta(OldString, OLD_LENGTH, Delta, DeltaLength, Result, NewLength) == -3);
+
+  //
+  //  Bad block lengths, short buffers, and signatures that are not signatures
+  //
+
+  Check(ComputeSignature(OldString, OLD_LENGTH, SIGNATURE_MIN_BLOCK_LENGTH - 1, Signature, sizeof(Signature)) == -3);
+  SignatureLength = ComputeSignature(OldString, OLD_LENGTH, 0, Signature, sizeof(Signature));
+  Check(ComputeSignature(OldString, OLD_LENGTH, 0, Signature, SignatureLength - 1) == -1);
+  Check(ComputeSignatureDelta(Signature, SignatureLength, NewString, NewLength, Delta, 10, NULL) == -1);
+  Signature[0] ^= 1;
+  Check(ComputeSignatureDelta(Signature, SignatureLength, NewString, NewLength, Delta, sizeof(Delta), NULL) == -3);
+
+  TestParallel();
+  return FinishTest("signature");
+}
@@ -0,0 +1,105 @@
+/*
+
+  Sketches: a string fed in pieces must sketch the same as all at once, near duplicates must
+  agree on most bins and unrelated strings on almost none, and a sketch index must return a
+  string's near duplicates without the unrelated ones.
+
+ */
+
+#include "difftest.h"
+
+#define FAMILY_COUNT (40)
+#define FAMILY_SIZE (5)
+#define STRING_COUNT (FAMILY_COUNT * FAMILY_SIZE)
+
+int main(void)
+{
+  static char Pool[STRING_COUNT][2100];
+  static SKETCH Sketches[STRING_COUNT];
+  unsigned long long Ids[STRING_COUNT];
+  PSKETCH_INDEX Index;
+  SKETCH Sketch;
+  int Lengths[STRING_COUNT];
+  int Count, Offset, Piece, Found, Stray;
+  int i, j;
+
+  for (i = 0; i < STRING_COUNT; i++) {
+    if (i % FAMILY_SIZE == 0) {
+      Lengths[i] = 1000 + TestRandom() % 1000;
+      TestFill(Pool[i], Lengths[i], 0);
+    } else {
+      Lengths[i] = TestMutate(Pool[i - i % FAMILY_SIZE], Lengths[i - i % FAMILY_SIZE], Pool[i], 1 + TestRandom() % 8, 0);
+    }
+    ComputeSketch(Pool[i], Lengths[i], &Sketches[i]);
+
+    //
+    //  The same string in random pieces, some of them empty
+    //
+
+    InitializeSketch(&Sketch);
+    for (Offset = 0; Offset < Lengths[i]; Offset += Piece) {
+      Piece = TestRandom() % 40;
+      if (Piece > Lengths[i] - Offset) { Piece = Lengths[i] - Offset; }
+      UpdateSketch(&Sketch, &Pool[i][Offset], Piece);
+    }
+    FinishSketch(&Sketch);
+    Check(memcmp(Sketch.Minima, Sketches[i].Minima, sizeof(Sketch.Minima)) == 0);
+    Check(CompareSketches(&Sketch, &Sketches[i]) == SKETCH_SIZE);
+  }
+
+  //
+  //  Near duplicates agree on most bins, strangers on hardly any
+  //
+
+  for (i = 0; i < STRING_COUNT; i += FAMILY_SIZE) {
+    for (j = 1; j < FAMILY_SIZE; j++) {
+      Check(CompareSketches(&Sketches[i], &Sketches[i + j]) > SKETCH_SIZE / 2);
+    }
+    Check(CompareSketches(&Sketches[i], &Sketches[(i + FAMILY_SIZE) % STRING_COUNT]) < SKETCH_SIZE / 16);
+  }
+
+  //
+  //  An index finds each string's family and nothing else, best first, and nothing can share
+  //  more bands with a string than the string itself does
+  //
+
+  Check(CreateSketchIndex(SKETCH_DEFAULT_BAND_COUNT, &Index) == 0);
+  for (i = 0; i < STRING_COUNT; i++) {
+    Check(InsertSketch(Index, 1000 + i, &Sketches[i]) == 0);
+  }
+
+  Stray = 0;
+  for (i = 0; i < STRING_COUNT; i++) {
+    Count = QuerySketchCandidates(Index, &Sketches[i], Ids, STRING_COUNT);
+    Check((Count >= 1) && (Count <= STRING_COUNT));
+    if (Count < 1) { continue; }
+    Check(CompareSketches(&Sketches[Ids[0] - 1000], &Sketches[i]) == SKETCH_SIZE);
+    Found = 0;
+    for (j = 0; j < Count; j++) {
+      if ((Ids[j] - 1000) / FAMILY_SIZE == (unsigned long long)(i / FAMILY_SIZE)) { Found++; } else { Stray++; }
+    }
+    Check(Found == FAMILY_SIZE);
+  }
+  Check(Stray == 0);
+
+  //
+  //  A short Ids array still reports every candidate
+  //
+
+  Check(QuerySketchCandidates(Index, &Sketches[0], Ids, 1) == FAMILY_SIZE);
+  Check(CompareSketches(&Sketches[Ids[0] - 1000], &Sketches[0]) == SKETCH_SIZE);
+  DestroySketchIndex(Index);
+
+  //
+  //  Band counts must be powers of two up to SKETCH_SIZE
+  //
+
+  Check(CreateSketchIndex(3, &Index) == -3);
+  Check(CreateSketchIndex(-1, &Index) == -3);
+  Check(CreateSketchIndex(2 * SKETCH_SIZE, &Index) == -3);
+  Check(CreateSketchIndex(0, &Index) == 0);
+  Check(QuerySketchCandidates(Index, &Sketches[0], Ids, STRING_COUNT) == 0);
+  DestroySketchIndex(Index);
+
+  return FinishTest("sketch");
+}
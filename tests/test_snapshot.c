@@ -0,0 +1,121 @@
+/*
+
+  Snapshot mode: over many pages, clean pages are kept in place, a dirty page costs only
+  the bytes that changed in it, and snapshots of different lengths or a cancelled call
+  still give a valid script.
+
+ */
+
+#include "difftest.h"
+
+#define PAGES (64)
+#define SNAPSHOT_LENGTH (PAGES * SNAPSHOT_PAGE_SIZE)
+
+int CancelNow(void *CancelContext)
+{
+  (void)CancelContext;
+  return 1;
+}
+
+//
+//  Check that every edit falls on a dirty page, pages past the end counting as dirty.  An
+//  insert sits between two bytes, so either of their pages will do.
+//
+
+int PageDirty(char *Dirty, int Offset)
+{
+  return (Offset < 0) || (Offset / SNAPSHOT_PAGE_SIZE >= PAGES) || Dirty[Offset / SNAPSHOT_PAGE_SIZE];
+}
+
+void CheckCleanPagesKept(char *Script, int ScriptLength, int OldLength, char *Dirty)
+{
+  EDIT_SCRIPT_CURSOR Cursor;
+  EDIT_OP Op;
+  char *Literal;
+  int Offset;
+
+  InitializeEditScriptCursor(&Cursor, Script, ScriptLength, OldLength);
+  while (NextEditScriptOp(&Cursor, &Op, &Literal) > 0) {
+    if (Op.Opcode == InsertOpcode) {
+      Check(PageDirty(Dirty, Op.OldOffset) || ((Op.OldOffset > 0) && PageDirty(Dirty, Op.OldOffset - 1)));
+    } else if (Op.Opcode != KeepOpcode) {
+      for (Offset = Op.OldOffset; Offset < Op.OldOffset + Op.Length; Offset++) { Check(PageDirty(Dirty, Offset)); }
+    }
+  }
+}
+
+int main(void)
+{
+  static char OldString[SNAPSHOT_LENGTH + 8192], NewString[SNAPSHOT_LENGTH + 8192];
+  static char Script[3 * (SNAPSHOT_LENGTH + 8192)];
+  char Dirty[PAGES];
+  DIFF_OPTIONS Options;
+  int Flags[2] = { DIFF_FLAG_SNAPSHOT, DIFF_FLAG_SNAPSHOT | DIFF_FLAG_SUBSTITUTIONS };
+  int NewLength, Length, Cost, Changed, Page, Offset, Round, f, i;
+
+  TestFill(OldString, sizeof(OldString), 0);
+
+  for (Round = 0; Round < 10; Round++) {
+    for (f = 0; f < 2; f++) {
+
+      //
+      //  A few scattered bytes change on a few pages
+      //
+
+      memcpy(NewString, OldString, SNAPSHOT_LENGTH);
+      memset(Dirty, 0, sizeof(Dirty));
+      Changed = 0;
+      for (i = 0; i < 1 + Round; i++) {
+	Page = TestRandom() % PAGES;
+	Offset = Page * SNAPSHOT_PAGE_SIZE + (int)(TestRandom() % SNAPSHOT_PAGE_SIZE);
+	if (NewString[Offset] == OldString[Offset]) { Changed++; }
+	NewString[Offset] = (char)(OldString[Offset] ^ 0x5a);
+	Dirty[Page] = 1;
+      }
+
+      memset(&Options, 0, sizeof(Options));
+      Options.Flags = Flags[f];
+      Length = ComputeEditScriptEx(OldString, SNAPSHOT_LENGTH, NewString, SNAPSHOT_LENGTH, Script, sizeof(Script), &Options);
+      Cost = TestApply(OldString, SNAPSHOT_LENGTH, Script, Length, NewString, SNAPSHOT_LENGTH);
+      Check(Cost <= 2 * Changed);
+      CheckCleanPagesKept(Script, Length, SNAPSHOT_LENGTH, Dirty);
+
+      //
+      //  One page rewritten end to end, and the new snapshot longer or shorter by a bit
+      //
+
+      Page = TestRandom() % PAGES;
+      TestFill(NewString + Page * SNAPSHOT_PAGE_SIZE, SNAPSHOT_PAGE_SIZE, 0);
+      Dirty[Page] = 1;
+      NewLength = SNAPSHOT_LENGTH - 5000 + (int)(TestRandom() % 10000);
+      if (NewLength > SNAPSHOT_LENGTH) { TestFill(NewString + SNAPSHOT_LENGTH, NewLength - SNAPSHOT_LENGTH, 0); }
+      Length = ComputeEditScriptEx(OldString, SNAPSHOT_LENGTH, NewString, NewLength, Script, sizeof(Script), &Options);
+      TestApply(OldString, SNAPSHOT_LENGTH, Script, Length, NewString, NewLength);
+      for (i = NewLength / SNAPSHOT_PAGE_SIZE; i < PAGES; i++) { Dirty[i] = 1; }
+      CheckCleanPagesKept(Script, Length, SNAPSHOT_LENGTH, Dirty);
+
+      //
+      //  Cancelled before the first page, approximately
+      //
+
+      Options.Flags |= DIFF_FLAG_APPROXIMATE_ON_CANCEL;
+      Options.CancelRoutine = CancelNow;
+      Length = ComputeEditScriptEx(OldString, SNAPSHOT_LENGTH, NewString, NewLength, Script, sizeof(Script), &Options);
+      TestApply(OldString, SNAPSHOT_LENGTH, Script, Length, NewString, NewLength);
+      Check(Options.IsApproximate == 1);
+    }
+  }
+
+  //
+  //  Identical snapshots need no script at all, and ones shorter than a page still work
+  //
+
+  memset(&Options, 0, sizeof(Options));
+  Options.Flags = DIFF_FLAG_SNAPSHOT;
+  Check(ComputeEditScriptEx(OldString, SNAPSHOT_LENGTH, OldString, SNAPSHOT_LENGTH, Script, sizeof(Script), &Options) == 0);
+  NewLength = TestMutate(OldString, 1000, NewString, 50, 0);
+  Length = ComputeEditScriptEx(OldString, 1000, NewString, NewLength, Script, sizeof(Script), &Options);
+  TestApply(OldString, 1000, Script, Length, NewString, NewLength);
+
+  return FinishTest("snapshot");
+}
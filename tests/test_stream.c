@@ -0,0 +1,139 @@
+/*
+
+  Apply streams: reading the new string in small pieces, or pushing it to a sink that now and
+  then takes nothing, must give exactly what ApplyEditScript gives, and a corrupt script must
+  fail with -3 after whatever came before it.
+
+ */
+
+#include "difftest.h"
+
+typedef struct _TEST_SINK_ {
+  char *Buffer;
+  int Length;
+  int Calls;
+  int Limit;
+} TEST_SINK, *PTEST_SINK;
+
+//
+//  Take up to Limit bytes at a time, and nothing on every third call
+//
+
+int TestSink(void *SinkContext, char *Data, int Length)
+{
+  PTEST_SINK Sink = (PTEST_SINK)SinkContext;
+
+  if ((++Sink->Calls % 3) == 0) { return 0; }
+  if (Length > Sink->Limit) { Length = Sink->Limit; }
+  memcpy(&Sink->Buffer[Sink->Length], Data, Length);
+  Sink->Length += Length;
+  return Length;
+}
+
+int OverSink(void *SinkContext, char *Data, int Length)
+{
+  return Length + 1;
+}
+
+int FailSink(void *SinkContext, char *Data, int Length)
+{
+  return -9;
+}
+
+int main(void)
+{
+  static char OldString[3000], NewString[4000], Script[16384], Result[4000];
+  APPLY_STREAM Stream;
+  TEST_SINK Sink;
+  int OldLength, NewLength, ScriptLength, Length, Done, Piece, Blocked;
+  int Round;
+
+  for (Round = 0; Round < 100; Round++) {
+    OldLength = TestRandom() % 3000;
+    TestFill(OldString, OldLength, (Round % 2) ? 4 : 0);
+    NewLength = TestMutate(OldString, OldLength, NewString, 1 + TestRandom() % 500, (Round % 2) ? 4 : 0);
+    ScriptLength = ComputeEditScript(OldString, OldLength, NewString, NewLength, Script, sizeof(Script));
+    Check(ScriptLength >= 0);
+
+    //
+    //  Read in pieces no bigger than a small ring buffer's free span
+    //
+
+    InitializeApplyStream(&Stream, OldString, OldLength, Script, ScriptLength);
+    Done = 0;
+    for (;;) {
+      Piece = 1 + TestRandom() % 64;
+      if (Piece > (int)sizeof(Result) - Done) { Piece = sizeof(Result) - Done; }
+      if ((Length = ReadApplyStream(&Stream, &Result[Done], Piece)) <= 0) { break; }
+      Check((Length == Piece) || (Done + Length == NewLength));
+      Done += Length;
+    }
+    Check(Length == 0);
+    Check(Done == NewLength);
+    Check(memcmp(Result, NewString, NewLength) == 0);
+    Check(ReadApplyStream(&Stream, Result, sizeof(Result)) == 0);
+
+    //
+    //  Push to a sink that blocks now and then, resuming each time
+    //
+
+    memset(&Sink, 0, sizeof(Sink));
+    Sink.Buffer = Result;
+    Sink.Limit = 1 + TestRandom() % 100;
+    InitializeApplyStream(&Stream, OldString, OldLength, Script, ScriptLength);
+    Blocked = 0;
+    while ((Length = WriteApplyStream(&Stream, TestSink, &Sink)) == -6) { Blocked++; }
+    Check(Length == NewLength);
+    Check(Sink.Length == NewLength);
+    Check(memcmp(Result, NewString, NewLength) == 0);
+    Check((NewLength == 0) || (Blocked > 0));
+
+    //
+    //  And the two mixed on one stream
+    //
+
+    memset(&Sink, 0, sizeof(Sink));
+    Sink.Buffer = Result;
+    Sink.Limit = 7;
+    InitializeApplyStream(&Stream, OldString, OldLength, Script, ScriptLength);
+    Sink.Length = ReadApplyStream(&Stream, Result, NewLength / 2);
+    Check(Sink.Length == NewLength / 2);
+    while ((Length = WriteApplyStream(&Stream, TestSink, &Sink)) == -6) {}
+    Check(Length == NewLength);
+    Check(memcmp(Result, NewString, NewLength) == 0);
+  }
+
+  //
+  //  A script that runs past the old string gives what came first and then -3, for good
+  //
+
+  memcpy(OldString, "abcd", 4);
+  InitializeApplyStream(&Stream, OldString, 4, "\x42xyz\xc2\x81", 6);
+  Length = ReadApplyStream(&Stream, Result, sizeof(Result));
+  Check(Length == 6);
+  Check(memcmp(Result, "xyzabc", 6) == 0);
+  Check(ReadApplyStream(&Stream, Result, sizeof(Result)) == -3);
+  Check(ReadApplyStream(&Stream, Result, sizeof(Result)) == -3);
+
+  memset(&Sink, 0, sizeof(Sink));
+  Sink.Buffer = Result;
+  Sink.Limit = 100;
+  InitializeApplyStream(&Stream, OldString, 4, "\x42xyz\xc2\x81", 6);
+  while ((Length = WriteApplyStream(&Stream, TestSink, &Sink)) == -6) {}
+  Check(Length == -3);
+  Check(Sink.Length == 6);
+
+  //
+  //  A literal cut short is corrupt, and so is a sink that claims too much, while a sink's
+  //  own error comes back as it is
+  //
+
+  InitializeApplyStream(&Stream, OldString, 4, "\x45xy", 3);
+  Check(ReadApplyStream(&Stream, Result, sizeof(Result)) == -3);
+  InitializeApplyStream(&Stream, OldString, 4, "\x42xyz", 4);
+  Check(WriteApplyStream(&Stream, OverSink, NULL) == -3);
+  InitializeApplyStream(&Stream, OldString, 4, "\x42xyz", 4);
+  Check(WriteApplyStream(&Stream, FailSink, NULL) == -9);
+
+  return FinishTest("stream");
+}
@@ -0,0 +1,193 @@
+/*
+
+  Version caches: every version comes back as it was, a rebuild stops at the nearest cached
+  ancestor, the budget is kept, failures are not cached, and concurrent readers of a version
+  share one rebuild.
+
+ */
+
+#include <pthread.h>
+#include "difftest.h"
+
+#define VERSION_COUNT (200)
+#define BASE_LENGTH (5000)
+#define MAX_LENGTH (BASE_LENGTH + 4 * VERSION_COUNT)
+
+static char Texts[VERSION_COUNT][MAX_LENGTH];
+static char Scripts[VERSION_COUNT][3 * MAX_LENGTH];
+static int TextLengths[VERSION_COUNT], ScriptLengths[VERSION_COUNT];
+static unsigned long long Parents[VERSION_COUNT];
+static pthread_mutex_t FetchLock = PTHREAD_MUTEX_INITIALIZER;
+static int Fetches;
+static PVERSION_CACHE SharedCache;
+
+//
+//  Version 0 is the base and every other version an edit script against an earlier one.
+//  Versions from VERSION_COUNT on exercise the failures: 1000 fails to fetch, 1001 and 1002
+//  are each other's parents, and 1003's script is cut short.
+//
+
+int FetchVersion(void *FetchContext, unsigned long long Version, PVERSION_RECORD Record)
+{
+  (void)FetchContext;
+  pthread_mutex_lock(&FetchLock);
+  Fetches++;
+  pthread_mutex_unlock(&FetchLock);
+
+  if (Version == 0) {
+    Record->IsBase = 1;
+    Record->Data = Texts[0];
+    Record->DataLength = TextLengths[0];
+  } else if (Version < VERSION_COUNT) {
+    Record->Parent = Parents[Version];
+    Record->Data = Scripts[Version];
+    Record->DataLength = ScriptLengths[Version];
+  } else if ((Version == 1001) || (Version == 1002)) {
+    Record->Parent = (Version == 1001) ? 1002 : 1001;
+    Record->Data = Scripts[1];
+    Record->DataLength = ScriptLengths[1];
+  } else if (Version == 1003) {
+    Record->Parent = 0;
+    Record->Data = "\x45";
+    Record->DataLength = 1;
+  } else {
+    return -7;
+  }
+  return 0;
+}
+
+//
+//  Acquire a version, check it, and release it, returning how many records it fetched
+//
+
+int CheckVersion(PVERSION_CACHE Cache, unsigned long long Version)
+{
+  PVERSION_HANDLE Handle;
+  char *Data;
+  int Length, Before;
+
+  pthread_mutex_lock(&FetchLock);
+  Before = Fetches;
+  pthread_mutex_unlock(&FetchLock);
+
+  Check(AcquireVersion(Cache, Version, &Handle, &Data, &Length) == 0);
+  Check((Length == TextLengths[Version]) && (memcmp(Data, Texts[Version], (size_t)Length) == 0));
+  ReleaseVersion(Cache, Handle);
+
+  pthread_mutex_lock(&FetchLock);
+  Before = Fetches - Before;
+  pthread_mutex_unlock(&FetchLock);
+  return Before;
+}
+
+int ChainLength(unsigned long long Version)
+{
+  int Length = 1;
+
+  for (; Version != 0; Version = Parents[Version]) { Length++; }
+  return Length;
+}
+
+//
+//  TestRandom is not thread safe, so each reader steps through the versions on its own
+//
+
+void *ReadSharedCache(void *Argument)
+{
+  unsigned int Version = (unsigned int)(size_t)Argument;
+  int i;
+
+  for (i = 0; i < 200; i++) {
+    Version = (Version * 37 + 11) % VERSION_COUNT;
+    CheckVersion(SharedCache, Version);
+  }
+  return NULL;
+}
+
+int main(void)
+{
+  unsigned long long Hits, Misses;
+  PVERSION_HANDLE Handle;
+  PVERSION_CACHE Cache;
+  pthread_t Threads[8];
+  size_t Size, Budget;
+  char *Data;
+  int Length, v, i;
+
+  //
+  //  Mostly a straight line of versions, with every tenth branching off an earlier one
+  //
+
+  TextLengths[0] = BASE_LENGTH;
+  TestFill(Texts[0], BASE_LENGTH, 4);
+  for (v = 1; v < VERSION_COUNT; v++) {
+    Parents[v] = (v % 10 == 0) ? TestRandom() % v : (unsigned long long)v - 1;
+    TextLengths[v] = TestMutate(Texts[Parents[v]], TextLengths[Parents[v]], Texts[v], 3, 4);
+    ScriptLengths[v] = ComputeEditScript(Texts[Parents[v]], TextLengths[Parents[v]], Texts[v], TextLengths[v], Scripts[v], 3 * MAX_LENGTH);
+  }
+
+  //
+  //  A cold rebuild fetches the whole chain, a second read fetches nothing, and a child of
+  //  a cached version fetches only its own script
+  //
+
+  Check(CreateVersionCache(64 << 20, FetchVersion, NULL, &Cache) == 0);
+  Check(CheckVersion(Cache, 48) == ChainLength(48));
+  Check(CheckVersion(Cache, 48) == 0);
+  Check(CheckVersion(Cache, 49) == 1);
+  QueryVersionCacheStatistics(Cache, &Hits, &Misses, &Size);
+  Check((Hits == 1) && (Misses == 2) && (Size > 2 * BASE_LENGTH));
+
+  //
+  //  A handle keeps its data valid while other versions come and go
+  //
+
+  Check(AcquireVersion(Cache, 49, &Handle, &Data, &Length) == 0);
+  for (v = 0; v < VERSION_COUNT; v++) { CheckVersion(Cache, (unsigned long long)v); }
+  Check((Length == TextLengths[49]) && (memcmp(Data, Texts[49], (size_t)Length) == 0));
+  ReleaseVersion(Cache, Handle);
+
+  //
+  //  Failures come back to the caller and are tried again next time
+  //
+
+  Check(AcquireVersion(Cache, 1000, &Handle, &Data, &Length) == -7);
+  Check(AcquireVersion(Cache, 1000, &Handle, &Data, &Length) == -7);
+  Check(AcquireVersion(Cache, 1001, &Handle, &Data, &Length) == -3);
+  Check(AcquireVersion(Cache, 1003, &Handle, &Data, &Length) == -3);
+  QueryVersionCacheStatistics(Cache, &Hits, &Misses, NULL);
+  Check(Misses == 2 + VERSION_COUNT - 2 + 4);
+  DestroyVersionCache(Cache);
+
+  //
+  //  A budget of a few versions is never exceeded, and a version larger than the budget is
+  //  still returned
+  //
+
+  Budget = 4 * (size_t)MAX_LENGTH + 1024;
+  Check(CreateVersionCache(Budget, FetchVersion, NULL, &Cache) == 0);
+  for (i = 0; i < 300; i++) {
+    CheckVersion(Cache, TestRandom() % VERSION_COUNT);
+    QueryVersionCacheStatistics(Cache, NULL, NULL, &Size);
+    Check(Size <= Budget);
+  }
+  DestroyVersionCache(Cache);
+
+  Check(CreateVersionCache(100, FetchVersion, NULL, &Cache) == 0);
+  Check(CheckVersion(Cache, 20) == ChainLength(20));
+  Check(CheckVersion(Cache, 20) == ChainLength(20));
+  DestroyVersionCache(Cache);
+
+  //
+  //  Readers on several threads, with room for everything, rebuild each version only once
+  //
+
+  Check(CreateVersionCache(64 << 20, FetchVersion, NULL, &SharedCache) == 0);
+  for (i = 0; i < 8; i++) { pthread_create(&Threads[i], NULL, ReadSharedCache, (void *)(size_t)i); }
+  for (i = 0; i < 8; i++) { pthread_join(Threads[i], NULL); }
+  QueryVersionCacheStatistics(SharedCache, &Hits, &Misses, NULL);
+  Check((Hits + Misses == 8 * 200) && (Misses <= VERSION_COUNT));
+  DestroyVersionCache(SharedCache);
+
+  return FinishTest("version");
+}
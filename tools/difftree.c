@@ -0,0 +1,320 @@
+/*
+
+  difftree compares two directory trees and writes a tree archive (see treearchive.h) that
+  patchtree can use to turn the old tree into the new one.
+
+    difftree [-j threads] [-m budget-megabytes] [-t timeout-milliseconds] OLD_DIR NEW_DIR ARCHIVE
+
+  Files are matched by path first.  A new file with no old file at the same path is matched
+  by content hash, which catches renames and copies.  Files matched either way are compared
+  byte by byte before they are stored as copies.  Every changed pair is diffed with
+  ComputeEditScriptEx on a pool of threads, each call limited to the memory budget and
+  optionally to a timeout after which it settles for an approximate script.  A file whose
+  edit script would not be smaller than the file itself is stored whole.
+
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../diflib.h"
+#include "../diflib_internal.h"
+#include "treearchive.h"
+
+typedef struct _DIFF_TREE_ {
+  const char *OldRoot, *NewRoot;
+  PTREE_FILE OldFiles; int OldCount;
+  PTREE_FILE NewFiles; int NewCount;
+  int *OldByHash;                  // indices of OldFiles sorted by size and hash
+  PTREE_ENTRY Entries;             // one per new file, in the same order
+  DIFF_OPTIONS Options;            // copied for each diff
+  FILE *Archive;
+  unsigned long long ArchiveOffset;
+  pthread_mutex_t Lock;            // protects the archive and Failed
+  int Failed;
+} DIFF_TREE, *PDIFF_TREE;
+
+void ReportTreeFailure(PDIFF_TREE Tree, const char *Message, const char *Path)
+{
+  pthread_mutex_lock(&Tree->Lock);
+  fprintf(stderr, "difftree: %s %s\n", Message, Path);
+  Tree->Failed = 1;
+  pthread_mutex_unlock(&Tree->Lock);
+}
+
+//
+//  Hashing runs over the old files and then the new files as one parallel loop
+//
+
+void HashTreeFile(void *Context, int ThreadIndex, int TaskIndex)
+{
+  PDIFF_TREE Tree = (PDIFF_TREE)Context;
+  PTREE_FILE File;
+  const char *Root;
+  char *Path, *Data;
+  unsigned long long Length;
+
+  (void)ThreadIndex;
+  if (TaskIndex < Tree->OldCount) {
+    File = &Tree->OldFiles[TaskIndex];
+    Root = Tree->OldRoot;
+  } else {
+    File = &Tree->NewFiles[TaskIndex - Tree->OldCount];
+    Root = Tree->NewRoot;
+  }
+
+  if (((Path = JoinPath(Root, File->Path)) == NULL) || (ReadWholeFile(Path, &Data, &Length) != 0)) {
+    ReportTreeFailure(Tree, "cannot read", File->Path);
+    free(Path);
+    return;
+  }
+  File->Size = Length;
+  File->Hash = DiffHash64(Data, (size_t)Length, 0);
+  free(Data);
+  free(Path);
+}
+
+PDIFF_TREE SortTree; // qsort has no context parameter
+
+int CompareOldByHash(const void *a, const void *b)
+{
+  PTREE_FILE x = &SortTree->OldFiles[*(const int *)a];
+  PTREE_FILE y = &SortTree->OldFiles[*(const int *)b];
+
+  if (x->Size != y->Size) { return (x->Size < y->Size) ? -1 : 1; }
+  if (x->Hash != y->Hash) { return (x->Hash < y->Hash) ? -1 : 1; }
+  return 0;
+}
+
+//
+//  Find an old file with the same size and hash as the given new file, or return -1
+//
+
+int FindOldByHash(PDIFF_TREE Tree, PTREE_FILE File)
+{
+  int Low = 0, High = Tree->OldCount - 1, Middle;
+  PTREE_FILE Old;
+
+  while (Low <= High) {
+    Middle = Low + (High - Low) / 2;
+    Old = &Tree->OldFiles[Tree->OldByHash[Middle]];
+    if ((Old->Size == File->Size) && (Old->Hash == File->Hash)) { return Tree->OldByHash[Middle]; }
+    if ((Old->Size < File->Size) || ((Old->Size == File->Size) && (Old->Hash < File->Hash))) {
+      Low = Middle + 1;
+    } else {
+      High = Middle - 1;
+    }
+  }
+  return -1;
+}
+
+int FindOldByPath(PDIFF_TREE Tree, const char *Path)
+{
+  int Low = 0, High = Tree->OldCount - 1, Middle, Order;
+
+  while (Low <= High) {
+    Middle = Low + (High - Low) / 2;
+    if ((Order = strcmp(Tree->OldFiles[Middle].Path, Path)) == 0) { return Middle; }
+    if (Order < 0) { Low = Middle + 1; } else { High = Middle - 1; }
+  }
+  return -1;
+}
+
+//
+//  Append a blob to the archive and record where it went
+//
+
+int AppendTreeBlob(PDIFF_TREE Tree, PTREE_ENTRY Entry, const char *Data, unsigned long long Length)
+{
+  int Result = 0;
+
+  pthread_mutex_lock(&Tree->Lock);
+  Entry->BlobOffset = Tree->ArchiveOffset;
+  Entry->BlobLength = Length;
+  if ((Length > 0) && (fwrite(Data, 1, (size_t)Length, Tree->Archive) != (size_t)Length)) {
+    Result = -1;
+  }
+  Tree->ArchiveOffset += Length;
+  pthread_mutex_unlock(&Tree->Lock);
+  return Result;
+}
+
+void DiffTreeEntry(void *Context, int ThreadIndex, int TaskIndex)
+/*++
+
+  Description:
+
+    This routine produces the archive blob for one new file.  COPY entries need none, PATCH
+    entries get an edit script against the old file, and ADD entries (including patches
+    that did not pay off) get the whole new file.  A COPY was only matched on size and hash,
+    so the two files are compared first, and if they differ after all it becomes a PATCH
+    when the old file has the same path and an ADD otherwise.
+
+--*/
+{
+  PDIFF_TREE Tree = (PDIFF_TREE)Context;
+  PTREE_ENTRY Entry = &Tree->Entries[TaskIndex];
+  DIFF_OPTIONS Options = Tree->Options;
+  char *OldPath = NULL, *NewPath = NULL;
+  char *OldData = NULL, *NewData = NULL, *Script = NULL;
+  unsigned long long OldLength, NewLength;
+  int ScriptLength = -1;
+
+  (void)ThreadIndex;
+
+  if (((NewPath = JoinPath(Tree->NewRoot, Entry->Path)) == NULL) || (ReadWholeFile(NewPath, &NewData, &NewLength) != 0)) {
+    ReportTreeFailure(Tree, "cannot read", Entry->Path);
+    goto Done;
+  }
+
+  if (Entry->Kind == TREE_ENTRY_COPY) {
+    if (((OldPath = JoinPath(Tree->OldRoot, Entry->SourcePath)) == NULL) || (ReadWholeFile(OldPath, &OldData, &OldLength) != 0)) {
+      ReportTreeFailure(Tree, "cannot read", Entry->SourcePath);
+      goto Done;
+    }
+    if ((OldLength == NewLength) && (memcmp(OldData, NewData, (size_t)NewLength) == 0)) { goto Done; }
+    Entry->Kind = (strcmp(Entry->Path, Entry->SourcePath) == 0) ? TREE_ENTRY_PATCH : TREE_ENTRY_ADD;
+  }
+
+  //
+  //  Edit scripts are limited to int lengths, anything close to that is simply stored whole
+  //
+
+  if ((Entry->Kind == TREE_ENTRY_PATCH) && (NewLength < 0x7fffffff / 3)) {
+    if ((OldData == NULL) &&
+	(((OldPath = JoinPath(Tree->OldRoot, Entry->SourcePath)) == NULL) || (ReadWholeFile(OldPath, &OldData, &OldLength) != 0))) {
+      ReportTreeFailure(Tree, "cannot read", Entry->SourcePath);
+      goto Done;
+    }
+    if ((OldLength < 0x7fffffff / 3) &&
+	((Script = malloc((size_t)MaxEditScriptLength((int)OldLength, (int)NewLength) + 1)) != NULL)) {
+      ScriptLength = ComputeEditScriptEx(OldData, (int)OldLength, NewData, (int)NewLength,
+					 Script, MaxEditScriptLength((int)OldLength, (int)NewLength), &Options);
+    }
+  }
+
+  if ((ScriptLength >= 0) && ((unsigned long long)ScriptLength < NewLength)) {
+    if (AppendTreeBlob(Tree, Entry, Script, (unsigned long long)ScriptLength) != 0) { ReportTreeFailure(Tree, "cannot write blob for", Entry->Path); }
+  } else {
+    Entry->Kind = TREE_ENTRY_ADD;
+    free(Entry->SourcePath);
+    Entry->SourcePath = NULL;
+    if (AppendTreeBlob(Tree, Entry, NewData, NewLength) != 0) { ReportTreeFailure(Tree, "cannot write blob for", Entry->Path); }
+  }
+
+ Done:
+  free(Script);
+  free(OldData);
+  free(NewData);
+  free(OldPath);
+  free(NewPath);
+}
+
+int main(int argc, char *argv[])
+{
+  DIFF_TREE Tree;
+  int ThreadCount = 0;
+  int Counts[4] = { 0, 0, 0, 0 };
+  const char *ArchivePath;
+  int Old, i;
+
+  memset(&Tree, 0, sizeof(Tree));
+  Tree.Options.MemoryBudget = (size_t)64 << 20;
+
+  for (i = 1; (i + 1 < argc) && (argv[i][0] == '-'); i += 2) {
+    if (strcmp(argv[i], "-j") == 0) {
+      ThreadCount = atoi(argv[i+1]);
+    } else if (strcmp(argv[i], "-m") == 0) {
+      Tree.Options.MemoryBudget = (size_t)atol(argv[i+1]) << 20;
+    } else if (strcmp(argv[i], "-t") == 0) {
+      Tree.Options.TimeoutMilliseconds = (unsigned int)atol(argv[i+1]);
+      Tree.Options.Flags |= DIFF_FLAG_APPROXIMATE_ON_CANCEL;
+    } else {
+      break;
+    }
+  }
+  if (argc - i != 3) {
+    fprintf(stderr, "usage: difftree [-j threads] [-m budget-megabytes] [-t timeout-milliseconds] OLD_DIR NEW_DIR ARCHIVE\n");
+    return 2;
+  }
+  Tree.OldRoot = argv[i];
+  Tree.NewRoot = argv[i+1];
+  ArchivePath = argv[i+2];
+
+  if ((ListTreeFiles(Tree.OldRoot, &Tree.OldFiles, &Tree.OldCount) != 0) ||
+      (ListTreeFiles(Tree.NewRoot, &Tree.NewFiles, &Tree.NewCount) != 0)) {
+    return 1;
+  }
+  pthread_mutex_init(&Tree.Lock, NULL);
+
+  //
+  //  Hash every file, then index the old files by size and hash for the rename lookups
+  //
+
+  DiffParallelFor(ThreadCount, Tree.OldCount + Tree.NewCount, HashTreeFile, &Tree);
+  if (Tree.Failed) { return 1; }
+
+  if (((Tree.OldByHash = malloc(sizeof(int) * ((size_t)Tree.OldCount + 1))) == NULL) ||
+      ((Tree.Entries = calloc((size_t)Tree.NewCount + 1, sizeof(TREE_ENTRY))) == NULL)) {
+    fprintf(stderr, "difftree: out of memory\n");
+    return 1;
+  }
+  for (i = 0; i < Tree.OldCount; i++) { Tree.OldByHash[i] = i; }
+  SortTree = &Tree;
+  qsort(Tree.OldByHash, Tree.OldCount, sizeof(int), CompareOldByHash);
+
+  //
+  //  Decide what each new file is: unchanged or renamed (COPY), changed (PATCH), or new (ADD)
+  //
+
+  for (i = 0; i < Tree.NewCount; i++) {
+    PTREE_FILE File = &Tree.NewFiles[i];
+    PTREE_ENTRY Entry = &Tree.Entries[i];
+
+    Entry->Path = File->Path;
+    Entry->Mode = File->Mode;
+    Entry->NewLength = File->Size;
+    Entry->NewHash = File->Hash;
+
+    Old = FindOldByPath(&Tree, File->Path);
+    if ((Old >= 0) && (Tree.OldFiles[Old].Size == File->Size) && (Tree.OldFiles[Old].Hash == File->Hash)) {
+      Entry->Kind = TREE_ENTRY_COPY;
+    } else if ((Old < 0) && ((Old = FindOldByHash(&Tree, File)) >= 0)) {
+      Entry->Kind = TREE_ENTRY_COPY;
+    } else if (Old >= 0) {
+      Entry->Kind = TREE_ENTRY_PATCH;
+    } else {
+      Entry->Kind = TREE_ENTRY_ADD;
+    }
+    Entry->SourcePath = (Old >= 0) ? strdup(Tree.OldFiles[Old].Path) : NULL;
+  }
+
+  //
+  //  Leave room for the header, write the blobs in parallel, then the index and the header
+  //
+
+  if ((Tree.Archive = fopen(ArchivePath, "wb")) == NULL) {
+    fprintf(stderr, "difftree: cannot create %s\n", ArchivePath);
+    return 1;
+  }
+  Tree.ArchiveOffset = TREE_ARCHIVE_HEADER_SIZE;
+  fseeko(Tree.Archive, TREE_ARCHIVE_HEADER_SIZE, SEEK_SET);
+
+  DiffParallelFor(ThreadCount, Tree.NewCount, DiffTreeEntry, &Tree);
+
+  if (Tree.Failed ||
+      (fseeko(Tree.Archive, (off_t)Tree.ArchiveOffset, SEEK_SET) != 0) ||
+      (WriteTreeArchiveIndex(Tree.Archive, Tree.Entries, Tree.NewCount) != 0) ||
+      (WriteTreeArchiveHeader(Tree.Archive, Tree.NewCount, Tree.ArchiveOffset) != 0) ||
+      (fclose(Tree.Archive) != 0)) {
+    fprintf(stderr, "difftree: failed to write %s\n", ArchivePath);
+    return 1;
+  }
+
+  for (i = 0; i < Tree.NewCount; i++) { Counts[Tree.Entries[i].Kind]++; }
+  printf("%d old files, %d new files: %d added, %d copied, %d patched, %llu bytes of blobs\n",
+	 Tree.OldCount, Tree.NewCount, Counts[TREE_ENTRY_ADD], Counts[TREE_ENTRY_COPY], Counts[TREE_ENTRY_PATCH],
+	 Tree.ArchiveOffset - TREE_ARCHIVE_HEADER_SIZE);
+  return 0;
+}
@@ -0,0 +1,170 @@
+/*
+
+  patchtree rebuilds a new directory tree from an old tree and a tree archive written by
+  difftree.
+
+    patchtree [-j threads] OLD_DIR ARCHIVE OUT_DIR
+
+  Every entry in the archive is one file of the new tree, and they are independent of each
+  other, so they are rebuilt in parallel.  The old tree is only read, and every rebuilt file
+  is checked against the hash recorded in the archive.
+
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../diflib.h"
+#include "../diflib_internal.h"
+#include "treearchive.h"
+
+typedef struct _PATCH_TREE_ {
+  const char *OldRoot, *OutRoot;
+  int ArchiveFd;
+  PTREE_ENTRY Entries;
+  int EntryCount;
+  pthread_mutex_t Lock;            // protects Failures
+  int Failures;
+} PATCH_TREE, *PPATCH_TREE;
+
+void PatchTreeEntry(void *Context, int ThreadIndex, int TaskIndex)
+{
+  PPATCH_TREE Tree = (PPATCH_TREE)Context;
+  PTREE_ENTRY Entry = &Tree->Entries[TaskIndex];
+  char *OldPath = NULL, *OutPath = NULL;
+  char *OldData = NULL, *Blob = NULL, *NewData = NULL;
+  unsigned long long OldLength = 0;
+  const char *Problem = NULL;
+  int Length;
+
+  (void)ThreadIndex;
+
+  if ((OutPath = JoinPath(Tree->OutRoot, Entry->Path)) == NULL) {
+    Problem = "out of memory for";
+    goto Done;
+  }
+
+  //
+  //  Get the old file for COPY and PATCH entries, and the blob for ADD and PATCH entries
+  //
+
+  if (Entry->Kind != TREE_ENTRY_ADD) {
+    if (((OldPath = JoinPath(Tree->OldRoot, Entry->SourcePath)) == NULL) || (ReadWholeFile(OldPath, &OldData, &OldLength) != 0)) {
+      Problem = "cannot read the old file for";
+      goto Done;
+    }
+  }
+  if (Entry->Kind != TREE_ENTRY_COPY) {
+    if (Entry->BlobLength >= INT_MAX) {
+      Problem = "corrupt archive for";
+      goto Done;
+    }
+    if (((Blob = malloc((size_t)Entry->BlobLength + 1)) == NULL) ||
+	(ReadAt(Tree->ArchiveFd, Blob, Entry->BlobLength, Entry->BlobOffset) != 0)) {
+      Problem = "cannot read the archive blob for";
+      goto Done;
+    }
+  }
+
+  //
+  //  The new file is as long as the old file for a COPY and as the blob for an ADD, and if
+  //  not the old tree has drifted or the archive is damaged
+  //
+
+  if (Entry->Kind == TREE_ENTRY_COPY) {
+    if (OldLength != Entry->NewLength) {
+      Problem = "old file differs for";
+      goto Done;
+    }
+    NewData = OldData;
+    OldData = NULL;
+  } else if (Entry->Kind == TREE_ENTRY_ADD) {
+    if (Entry->BlobLength != Entry->NewLength) {
+      Problem = "corrupt archive for";
+      goto Done;
+    }
+    NewData = Blob;
+    Blob = NULL;
+  } else if (Entry->Kind == TREE_ENTRY_PATCH) {
+    if ((Entry->NewLength >= 0x7fffffff) || (OldLength >= 0x7fffffff) ||
+	(QueryEditScriptLengths(Blob, (int)Entry->BlobLength, (int)OldLength, NULL) != (int)Entry->NewLength)) {
+      Problem = "cannot apply the edit script for";
+      goto Done;
+    }
+    if ((NewData = malloc((size_t)Entry->NewLength + 1)) == NULL) {
+      Problem = "out of memory for";
+      goto Done;
+    }
+    Length = ApplyEditScript(OldData, (int)OldLength, Blob, (int)Entry->BlobLength, NewData, (int)Entry->NewLength);
+    if ((Length < 0) || ((unsigned long long)Length != Entry->NewLength)) {
+      Problem = "cannot apply the edit script for";
+      goto Done;
+    }
+  } else {
+    Problem = "unknown entry kind for";
+    goto Done;
+  }
+
+  if (DiffHash64(NewData, (size_t)Entry->NewLength, 0) != Entry->NewHash) {
+    Problem = "hash mismatch for";
+  } else if (WriteWholeFile(OutPath, NewData, Entry->NewLength, Entry->Mode) != 0) {
+    Problem = "cannot write";
+  }
+
+ Done:
+  if (Problem != NULL) {
+    pthread_mutex_lock(&Tree->Lock);
+    fprintf(stderr, "patchtree: %s %s\n", Problem, Entry->Path);
+    Tree->Failures++;
+    pthread_mutex_unlock(&Tree->Lock);
+  }
+  free(NewData);
+  free(Blob);
+  free(OldData);
+  free(OldPath);
+  free(OutPath);
+}
+
+int main(int argc, char *argv[])
+{
+  PATCH_TREE Tree;
+  int ThreadCount = 0;
+  int i;
+
+  memset(&Tree, 0, sizeof(Tree));
+
+  for (i = 1; (i + 1 < argc) && (argv[i][0] == '-'); i += 2) {
+    if (strcmp(argv[i], "-j") == 0) {
+      ThreadCount = atoi(argv[i+1]);
+    } else {
+      break;
+    }
+  }
+  if (argc - i != 3) {
+    fprintf(stderr, "usage: patchtree [-j threads] OLD_DIR ARCHIVE OUT_DIR\n");
+    return 2;
+  }
+  Tree.OldRoot = argv[i];
+  Tree.OutRoot = argv[i+2];
+
+  if (((Tree.ArchiveFd = open(argv[i+1], O_RDONLY)) < 0) ||
+      (ReadTreeArchiveIndex(Tree.ArchiveFd, &Tree.Entries, &Tree.EntryCount) != 0)) {
+    fprintf(stderr, "patchtree: cannot read archive %s\n", argv[i+1]);
+    return 1;
+  }
+  pthread_mutex_init(&Tree.Lock, NULL);
+
+  DiffParallelFor(ThreadCount, Tree.EntryCount, PatchTreeEntry, &Tree);
+
+  close(Tree.ArchiveFd);
+  FreeTreeEntries(Tree.Entries, Tree.EntryCount);
+  if (Tree.Failures > 0) {
+    fprintf(stderr, "patchtree: %d files failed\n", Tree.Failures);
+    return 1;
+  }
+  return 0;
+}
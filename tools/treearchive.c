@@ -0,0 +1,379 @@
+/*
+
+  Routines shared by difftree and patchtree for walking directory trees, reading and writing
+  whole files, and reading and writing the tree archive format described in treearchive.h.
+
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "treearchive.h"
+
+char *JoinPath(const char *Root, const char *Path)
+{
+  size_t RootLength = strlen(Root), PathLength = strlen(Path);
+  char *Result;
+
+  if ((Result = malloc(RootLength + PathLength + 2)) == NULL) { return NULL; }
+  memcpy(Result, Root, RootLength);
+  Result[RootLength] = '/';
+  memcpy(Result + RootLength + 1, Path, PathLength + 1);
+  return Result;
+}
+
+//
+//  Walking a tree collects the regular files below Root into a growing array.  Symbolic
+//  links and special files are skipped.
+//
+
+typedef struct _TREE_LIST_ {
+  PTREE_FILE Files;
+  int FileCount, FileCapacity;
+} TREE_LIST, *PTREE_LIST;
+
+int WalkTree(const char *Root, const char *Relative, PTREE_LIST List)
+{
+  DIR *Directory;
+  struct dirent *Entry;
+  struct stat Status;
+  char *Full, *Child;
+  PTREE_FILE Grown;
+  int Result = 0;
+
+  Full = (Relative[0] == 0) ? strdup(Root) : JoinPath(Root, Relative);
+  if ((Full == NULL) || ((Directory = opendir(Full)) == NULL)) {
+    fprintf(stderr, "cannot open directory %s: %s\n", Full ? Full : Root, strerror(errno));
+    free(Full);
+    return -1;
+  }
+
+  while ((Result == 0) && ((Entry = readdir(Directory)) != NULL)) {
+    if ((strcmp(Entry->d_name, ".") == 0) || (strcmp(Entry->d_name, "..") == 0)) { continue; }
+
+    Child = (Relative[0] == 0) ? strdup(Entry->d_name) : JoinPath(Relative, Entry->d_name);
+    free(Full);
+    Full = (Child == NULL) ? NULL : JoinPath(Root, Child);
+    if ((Child == NULL) || (Full == NULL) || (lstat(Full, &Status) != 0)) {
+      free(Child);
+      Result = -1;
+      break;
+    }
+
+    if (S_ISDIR(Status.st_mode)) {
+      Result = WalkTree(Root, Child, List);
+      free(Child);
+    } else if (S_ISREG(Status.st_mode)) {
+      if (List->FileCount == List->FileCapacity) {
+	List->FileCapacity = (List->FileCapacity == 0) ? 256 : 2 * List->FileCapacity;
+	if ((Grown = realloc(List->Files, sizeof(TREE_FILE) * List->FileCapacity)) == NULL) {
+	  free(Child);
+	  Result = -1;
+	  break;
+	}
+	List->Files = Grown;
+      }
+      List->Files[List->FileCount].Path = Child;
+      List->Files[List->FileCount].Size = (unsigned long long)Status.st_size;
+      List->Files[List->FileCount].Mode = (unsigned int)(Status.st_mode & 07777);
+      List->Files[List->FileCount].Hash = 0;
+      List->FileCount++;
+    } else {
+      free(Child);
+    }
+  }
+
+  free(Full);
+  closedir(Directory);
+  return Result;
+}
+
+int CompareTreeFiles(const void *a, const void *b)
+{
+  return strcmp(((PTREE_FILE)a)->Path, ((PTREE_FILE)b)->Path);
+}
+
+int ListTreeFiles(const char *Root, PTREE_FILE *Files, int *FileCount)
+/*++
+
+  Description:
+
+    This routine lists the regular files below Root, sorted by their relative path.
+
+  Output:
+
+    We return 0 on success and -1 on failure, in which case nothing needs to be freed.
+
+--*/
+{
+  TREE_LIST List;
+
+  memset(&List, 0, sizeof(List));
+  if (WalkTree(Root, "", &List) != 0) {
+    FreeTreeFiles(List.Files, List.FileCount);
+    return -1;
+  }
+  qsort(List.Files, List.FileCount, sizeof(TREE_FILE), CompareTreeFiles);
+  *Files = List.Files;
+  *FileCount = List.FileCount;
+  return 0;
+}
+
+void FreeTreeFiles(PTREE_FILE Files, int FileCount)
+{
+  int i;
+
+  for (i = 0; i < FileCount; i++) { free(Files[i].Path); }
+  free(Files);
+}
+
+int ReadAt(int Fd, char *Buffer, unsigned long long Length, unsigned long long Offset)
+{
+  ssize_t Done;
+
+  while (Length > 0) {
+    if ((Done = pread(Fd, Buffer, Length, (off_t)Offset)) <= 0) {
+      if ((Done < 0) && (errno == EINTR)) { continue; }
+      return -1;
+    }
+    Buffer += Done;
+    Length -= Done;
+    Offset += Done;
+  }
+  return 0;
+}
+
+int ReadWholeFile(const char *Path, char **Data, unsigned long long *Length)
+/*++
+
+  Description:
+
+    This routine reads the whole file into a malloc'ed buffer.  The buffer always has room
+    for one extra byte past the end of the file.
+
+--*/
+{
+  struct stat Status;
+  int Fd;
+
+  if ((Fd = open(Path, O_RDONLY)) < 0) { return -1; }
+  if ((fstat(Fd, &Status) != 0) || ((*Data = malloc((size_t)Status.st_size + 1)) == NULL)) {
+    close(Fd);
+    return -1;
+  }
+  if (ReadAt(Fd, *Data, (unsigned long long)Status.st_size, 0) != 0) {
+    free(*Data);
+    close(Fd);
+    return -1;
+  }
+  *Length = (unsigned long long)Status.st_size;
+  close(Fd);
+  return 0;
+}
+
+//
+//  Create every missing directory leading up to Path.  Another thread may be creating the
+//  same directories at the same time, so EEXIST is fine.
+//
+
+int MakeParentDirectories(const char *Path)
+{
+  char *Copy, *Slash;
+  int Result = 0;
+
+  if ((Copy = strdup(Path)) == NULL) { return -1; }
+  for (Slash = strchr(Copy + 1, '/'); (Slash != NULL) && (Result == 0); Slash = strchr(Slash + 1, '/')) {
+    *Slash = 0;
+    if ((mkdir(Copy, 0777) != 0) && (errno != EEXIST)) { Result = -1; }
+    *Slash = '/';
+  }
+  free(Copy);
+  return Result;
+}
+
+int WriteWholeFile(const char *Path, const char *Data, unsigned long long Length, unsigned int Mode)
+{
+  ssize_t Done;
+  int Fd;
+
+  if (MakeParentDirectories(Path) != 0) { return -1; }
+  if ((Fd = open(Path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) { return -1; }
+  while (Length > 0) {
+    if ((Done = write(Fd, Data, Length)) <= 0) {
+      if ((Done < 0) && (errno == EINTR)) { continue; }
+      close(Fd);
+      return -1;
+    }
+    Data += Done;
+    Length -= Done;
+  }
+  if ((fchmod(Fd, (mode_t)Mode) != 0) || (close(Fd) != 0)) { return -1; }
+  return 0;
+}
+
+//
+//  Little endian encoding of the archive's integers
+//
+
+void PutInteger(unsigned char *Buffer, unsigned long long Value, int Size)
+{
+  int i;
+
+  for (i = 0; i < Size; i++, Value >>= 8) { Buffer[i] = (unsigned char)Value; }
+}
+
+unsigned long long GetInteger(const unsigned char *Buffer, int Size)
+{
+  unsigned long long Value = 0;
+  int i;
+
+  for (i = Size - 1; i >= 0; i--) { Value = (Value << 8) | Buffer[i]; }
+  return Value;
+}
+
+int WriteTreeArchiveHeader(FILE *Archive, int EntryCount, unsigned long long IndexOffset)
+{
+  unsigned char Header[TREE_ARCHIVE_HEADER_SIZE];
+
+  memcpy(Header, TREE_ARCHIVE_MAGIC, 8);
+  PutInteger(Header + 8, (unsigned long long)EntryCount, 4);
+  PutInteger(Header + 12, 0, 4);
+  PutInteger(Header + 16, IndexOffset, 8);
+  if ((fseeko(Archive, 0, SEEK_SET) != 0) || (fwrite(Header, sizeof(Header), 1, Archive) != 1)) { return -1; }
+  return 0;
+}
+
+int WriteTreeArchiveIndex(FILE *Archive, PTREE_ENTRY Entries, int EntryCount)
+{
+  unsigned char Fixed[TREE_ENTRY_FIXED_SIZE];
+  size_t PathLength, SourcePathLength;
+  int i;
+
+  for (i = 0; i < EntryCount; i++) {
+    PathLength = strlen(Entries[i].Path);
+    SourcePathLength = (Entries[i].SourcePath != NULL) ? strlen(Entries[i].SourcePath) : 0;
+    if ((PathLength > 0xffff) || (SourcePathLength > 0xffff)) { return -1; }
+
+    memset(Fixed, 0, sizeof(Fixed));
+    Fixed[0] = (unsigned char)Entries[i].Kind;
+    PutInteger(Fixed + 2, PathLength, 2);
+    PutInteger(Fixed + 4, SourcePathLength, 2);
+    PutInteger(Fixed + 8, Entries[i].Mode, 4);
+    PutInteger(Fixed + 12, Entries[i].BlobOffset, 8);
+    PutInteger(Fixed + 20, Entries[i].BlobLength, 8);
+    PutInteger(Fixed + 28, Entries[i].NewLength, 8);
+    PutInteger(Fixed + 36, Entries[i].NewHash, 8);
+
+    if ((fwrite(Fixed, TREE_ENTRY_FIXED_SIZE, 1, Archive) != 1) ||
+	(fwrite(Entries[i].Path, 1, PathLength, Archive) != PathLength) ||
+	((SourcePathLength > 0) && (fwrite(Entries[i].SourcePath, 1, SourcePathLength, Archive) != SourcePathLength))) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+//
+//  A safe path is relative, not empty, and has no empty, "." or ".." components
+//
+
+int IsSafeRelativePath(const char *Path)
+{
+  const char *Component, *End;
+  size_t Length;
+
+  if ((Path[0] == 0) || (Path[0] == '/')) { return 0; }
+  for (Component = Path; ; Component = End + 1) {
+    End = strchr(Component, '/');
+    Length = (End == NULL) ? strlen(Component) : (size_t)(End - Component);
+    if ((Length == 0) || ((Length == 1) && (Component[0] == '.')) ||
+	((Length == 2) && (Component[0] == '.') && (Component[1] == '.'))) {
+      return 0;
+    }
+    if (End == NULL) { return 1; }
+  }
+}
+
+int ReadTreeArchiveIndex(int ArchiveFd, PTREE_ENTRY *Entries, int *EntryCount)
+/*++
+
+  Description:
+
+    This routine checks the archive header and reads the whole index into memory.
+
+  Output:
+
+    We return 0 on success and -1 if the archive cannot be read or is not a tree archive.
+
+--*/
+{
+  unsigned char Header[TREE_ARCHIVE_HEADER_SIZE];
+  unsigned char Fixed[TREE_ENTRY_FIXED_SIZE];
+  unsigned long long Offset;
+  size_t PathLength, SourcePathLength;
+  PTREE_ENTRY Result;
+  int Count, i;
+
+  if ((ReadAt(ArchiveFd, (char *)Header, sizeof(Header), 0) != 0) || (memcmp(Header, TREE_ARCHIVE_MAGIC, 8) != 0)) { return -1; }
+  Count = (int)GetInteger(Header + 8, 4);
+  Offset = GetInteger(Header + 16, 8);
+  if ((Count < 0) || ((Result = calloc((size_t)Count + 1, sizeof(TREE_ENTRY))) == NULL)) { return -1; }
+
+  for (i = 0; i < Count; i++) {
+    if (ReadAt(ArchiveFd, (char *)Fixed, TREE_ENTRY_FIXED_SIZE, Offset) != 0) { break; }
+    Offset += TREE_ENTRY_FIXED_SIZE;
+
+    PathLength = (size_t)GetInteger(Fixed + 2, 2);
+    SourcePathLength = (size_t)GetInteger(Fixed + 4, 2);
+    Result[i].Kind = Fixed[0];
+    Result[i].Mode = (unsigned int)GetInteger(Fixed + 8, 4);
+    Result[i].BlobOffset = GetInteger(Fixed + 12, 8);
+    Result[i].BlobLength = GetInteger(Fixed + 20, 8);
+    Result[i].NewLength = GetInteger(Fixed + 28, 8);
+    Result[i].NewHash = GetInteger(Fixed + 36, 8);
+
+    if (((Result[i].Path = malloc(PathLength + 1)) == NULL) ||
+	((Result[i].SourcePath = malloc(SourcePathLength + 1)) == NULL) ||
+	(ReadAt(ArchiveFd, Result[i].Path, PathLength, Offset) != 0) ||
+	(ReadAt(ArchiveFd, Result[i].SourcePath, SourcePathLength, Offset + PathLength) != 0)) {
+      break;
+    }
+    Result[i].Path[PathLength] = 0;
+    Result[i].SourcePath[SourcePathLength] = 0;
+    Offset += PathLength + SourcePathLength;
+
+    //
+    //  Paths come from the archive, refuse any that would escape the trees
+    //
+
+    if (!IsSafeRelativePath(Result[i].Path) ||
+	((SourcePathLength > 0) && !IsSafeRelativePath(Result[i].SourcePath))) {
+      break;
+    }
+  }
+
+  if (i < Count) {
+    FreeTreeEntries(Result, Count);
+    return -1;
+  }
+  *Entries = Result;
+  *EntryCount = Count;
+  return 0;
+}
+
+void FreeTreeEntries(PTREE_ENTRY Entries, int EntryCount)
+{
+  int i;
+
+  for (i = 0; i < EntryCount; i++) {
+    free(Entries[i].Path);
+    free(Entries[i].SourcePath);
+  }
+  free(Entries);
+}
@@ -0,0 +1,68 @@
+#ifndef _TREEARCHIVE_
+#define _TREEARCHIVE_
+
+//
+//  A tree archive holds everything needed to turn one directory tree into another.  It is
+//  laid out as a fixed header, then the blobs (edit scripts and whole files), then an index
+//  with one entry per file of the new tree, sorted by path.  All integers are little endian.
+//
+//    Header   "DIFTREE1"  u32 EntryCount  u32 Reserved  u64 IndexOffset
+//    Entry    u8 Kind  u8 Reserved  u16 PathLength  u16 SourcePathLength  u16 Reserved
+//             u32 Mode  u64 BlobOffset  u64 BlobLength  u64 NewLength  u64 NewHash
+//             Path  SourcePath
+//
+//  An ADD entry's blob is the whole file.  A COPY entry has no blob, the file is SourcePath
+//  in the old tree unchanged (SourcePath differs from Path for a rename).  A PATCH entry's
+//  blob is the edit script to apply to SourcePath in the old tree.  NewHash is DiffHash64
+//  of the resulting file so the apply side can check its work.
+//
+
+#define TREE_ARCHIVE_MAGIC       "DIFTREE1"
+#define TREE_ARCHIVE_HEADER_SIZE (24)
+#define TREE_ENTRY_FIXED_SIZE    (44)
+
+#define TREE_ENTRY_ADD   (1)
+#define TREE_ENTRY_COPY  (2)
+#define TREE_ENTRY_PATCH (3)
+
+typedef struct _TREE_ENTRY_ {
+  int Kind;
+  char *Path;               // relative to the root of the new tree
+  char *SourcePath;         // relative to the root of the old tree, for COPY and PATCH
+  unsigned int Mode;        // permission bits of the new file
+  unsigned long long BlobOffset, BlobLength;
+  unsigned long long NewLength, NewHash;
+} TREE_ENTRY, *PTREE_ENTRY;
+
+//
+//  A file found while walking a tree
+//
+
+typedef struct _TREE_FILE_ {
+  char *Path;               // relative to the root of the tree
+  unsigned long long Size;
+  unsigned int Mode;
+  unsigned long long Hash;  // filled in by the caller once the file has been read
+} TREE_FILE, *PTREE_FILE;
+
+int ListTreeFiles(const char *Root, PTREE_FILE *Files, int *FileCount);
+
+void FreeTreeFiles(PTREE_FILE Files, int FileCount);
+
+char *JoinPath(const char *Root, const char *Path);
+
+int ReadWholeFile(const char *Path, char **Data, unsigned long long *Length);
+
+int WriteWholeFile(const char *Path, const char *Data, unsigned long long Length, unsigned int Mode);
+
+int WriteTreeArchiveHeader(FILE *Archive, int EntryCount, unsigned long long IndexOffset);
+
+int WriteTreeArchiveIndex(FILE *Archive, PTREE_ENTRY Entries, int EntryCount);
+
+int ReadTreeArchiveIndex(int ArchiveFd, PTREE_ENTRY *Entries, int *EntryCount);
+
+void FreeTreeEntries(PTREE_ENTRY Entries, int EntryCount);
+
+int ReadAt(int Fd, char *Buffer, unsigned long long Length, unsigned long long Offset);
+
+#endif // _TREEARCHIVE_